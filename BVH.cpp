@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QVarLengthArray>
+#include "BVH.h"
+
+#define BIN_COUNT           12
+#define LEAF_SIZE           2
+#define MAX_LEAF_SIZE       8
+
+///////////////////////////////////////////////////////////////////////////////
+BVH::BVH( void )
+{
+    m_buildTime = 0;
+    m_refitTime = 0;
+}
+
+void BVH::clear( void )
+{
+    m_nodes.clear( );
+    m_items.clear( );
+    m_leafOf.clear( );
+    m_itemBounds.clear( );
+}
+
+void BVH::build( const QVector<AABB>& bounds )
+{
+    QElapsedTimer timer;
+    timer.start( );
+
+    clear( );
+    m_itemBounds = bounds;
+    m_leafOf.resize( bounds.size( ) );
+    m_items.resize( bounds.size( ) );
+    m_centers.resize( bounds.size( ) );
+    for ( int i = 0; i < bounds.size( ); ++i )
+    {
+        m_items[i] = i;
+        m_centers[i] = bounds[i].center( );
+    }
+
+    // 二叉树的结点数不超过2n - 1
+    m_nodes.reserve( qMax( 1, 2 * bounds.size( ) - 1 ) );
+    if ( !bounds.isEmpty( ) ) buildRange( 0, bounds.size( ), -1 );
+    m_centers.clear( );
+
+    m_buildTime = timer.nsecsElapsed( );
+}
+
+int BVH::buildRange( int first, int count, int parent )
+{
+    int index = m_nodes.size( );
+    Node node;
+    node.parent = parent;
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+
+    AABB centerBounds;
+    for ( int i = first; i < first + count; ++i )
+    {
+        node.bounds.unite( m_itemBounds[m_items[i]] );
+        centerBounds.unite( m_centers[m_items[i]] );
+    }
+    m_nodes.append( node );
+
+    if ( count <= LEAF_SIZE )
+    {
+        updateLeaf( index );
+        return index;
+    }
+
+    // 选择质心分布最广的轴
+    QVector3D extent = centerBounds.maximum - centerBounds.minimum;
+    int axis = 0;
+    if ( extent.y( ) > extent[axis] ) axis = 1;
+    if ( extent.z( ) > extent[axis] ) axis = 2;
+
+    int middle = first + count / 2;
+    int* items = m_items.data( );
+    if ( extent[axis] > 1e-6f )
+    {
+        // 分箱计算SAH代价
+        AABB binBounds[BIN_COUNT];
+        int binCount[BIN_COUNT] = { 0 };
+        float scale = BIN_COUNT / extent[axis];
+        float origin = centerBounds.minimum[axis];
+        for ( int i = first; i < first + count; ++i )
+        {
+            int bin = qMin( BIN_COUNT - 1,
+                            int( ( m_centers[items[i]][axis] - origin ) * scale ) );
+            ++binCount[bin];
+            binBounds[bin].unite( m_itemBounds[items[i]] );
+        }
+
+        float rightArea[BIN_COUNT];
+        int rightCount[BIN_COUNT];
+        AABB accumulated;
+        int accumulatedCount = 0;
+        for ( int i = BIN_COUNT - 1; i > 0; --i )
+        {
+            accumulated.unite( binBounds[i] );
+            accumulatedCount += binCount[i];
+            rightArea[i] = accumulated.surfaceArea( );
+            rightCount[i] = accumulatedCount;
+        }
+
+        int bestSplit = -1;
+        float bestCost = node.bounds.surfaceArea( ) * count;
+        accumulated = AABB( );
+        accumulatedCount = 0;
+        for ( int i = 0; i < BIN_COUNT - 1; ++i )
+        {
+            accumulated.unite( binBounds[i] );
+            accumulatedCount += binCount[i];
+            if ( accumulatedCount == 0 || rightCount[i + 1] == 0 ) continue;
+            float cost = accumulated.surfaceArea( ) * accumulatedCount +
+                    rightArea[i + 1] * rightCount[i + 1];
+            if ( cost < bestCost )
+            {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        // 划分不划算并且图元不多时直接作为叶子
+        if ( bestSplit < 0 && count <= MAX_LEAF_SIZE )
+        {
+            updateLeaf( index );
+            return index;
+        }
+
+        if ( bestSplit >= 0 )
+        {
+            const QVector3D* centers = m_centers.constData( );
+            int* split = std::partition( items + first, items + first + count,
+                                         [=]( int item )
+            {
+                int bin = qMin( BIN_COUNT - 1,
+                                int( ( centers[item][axis] - origin ) * scale ) );
+                return bin <= bestSplit;
+            } );
+            middle = int( split - items );
+        }
+        else
+        {
+            const QVector3D* centers = m_centers.constData( );
+            std::nth_element( items + first, items + middle, items + first + count,
+                              [=]( int a, int b )
+            {
+                return centers[a][axis] < centers[b][axis];
+            } );
+        }
+    }
+
+    int left = buildRange( first, middle - first, index );
+    int right = buildRange( middle, first + count - middle, index );
+    m_nodes[index].left = left;
+    m_nodes[index].right = right;
+    m_nodes[index].count = 0;
+    return index;
+}
+
+void BVH::updateLeaf( int node )
+{
+    const Node& leaf = m_nodes[node];
+    for ( int i = leaf.first; i < leaf.first + leaf.count; ++i )
+        m_leafOf[m_items[i]] = node;
+}
+
+void BVH::refit( const QVector<int>& changed, const QVector<AABB>& bounds )
+{
+    QElapsedTimer timer;
+    timer.start( );
+
+    foreach ( int item, changed )
+    {
+        m_itemBounds[item] = bounds[item];
+
+        // 重新计算叶子的包围盒
+        int index = m_leafOf[item];
+        Node& leaf = m_nodes[index];
+        AABB leafBounds;
+        for ( int i = leaf.first; i < leaf.first + leaf.count; ++i )
+            leafBounds.unite( m_itemBounds[m_items[i]] );
+        if ( leafBounds == leaf.bounds ) continue;
+        leaf.bounds = leafBounds;
+
+        // 向上传播，包围盒不变时提前结束
+        index = leaf.parent;
+        while ( index >= 0 )
+        {
+            Node& node = m_nodes[index];
+            AABB nodeBounds = m_nodes[node.left].bounds;
+            nodeBounds.unite( m_nodes[node.right].bounds );
+            if ( nodeBounds == node.bounds ) break;
+            node.bounds = nodeBounds;
+            index = node.parent;
+        }
+    }
+
+    m_refitTime = timer.nsecsElapsed( );
+}
+
+void BVH::extractPlanes( const QMatrix4x4& viewProjection,
+                         QVector4D planes[6] )
+{
+    QVector4D row0 = viewProjection.row( 0 );
+    QVector4D row1 = viewProjection.row( 1 );
+    QVector4D row2 = viewProjection.row( 2 );
+    QVector4D row3 = viewProjection.row( 3 );
+    planes[0] = row3 + row0;        // 左
+    planes[1] = row3 - row0;        // 右
+    planes[2] = row3 + row1;        // 下
+    planes[3] = row3 - row1;        // 上
+    planes[4] = row3 + row2;        // 近
+    planes[5] = row3 - row2;        // 远
+}
+
+bool BVH::outsideFrustum( const AABB& box, const QVector4D planes[6] )
+{
+    for ( int i = 0; i < 6; ++i )
+    {
+        const QVector4D& p = planes[i];
+        float positive = p.w( ) +
+                p.x( ) * ( p.x( ) >= 0.0f ? box.maximum.x( ) : box.minimum.x( ) ) +
+                p.y( ) * ( p.y( ) >= 0.0f ? box.maximum.y( ) : box.minimum.y( ) ) +
+                p.z( ) * ( p.z( ) >= 0.0f ? box.maximum.z( ) : box.minimum.z( ) );
+        if ( positive < 0.0f ) return true;
+    }
+    return false;
+}
+
+void BVH::queryFrustum( const QMatrix4x4& viewProjection,
+                        QVector<int>& result ) const
+{
+    result.clear( );
+    if ( m_nodes.isEmpty( ) ) return;
+
+    QVector4D planes[6];
+    extractPlanes( viewProjection, planes );
+
+    QVarLengthArray<int, 64> stack;
+    stack.append( 0 );
+    while ( !stack.isEmpty( ) )
+    {
+        const Node& node = m_nodes[stack.last( )];
+        stack.removeLast( );
+
+        // 完全在视锥体内的子树不必再测试
+        bool contained = true;
+        {
+            const AABB& box = node.bounds;
+            bool outside = false;
+            for ( int i = 0; i < 6 && !outside; ++i )
+            {
+                const QVector4D& p = planes[i];
+                // 正顶点在平面外则整个盒子在外
+                float positive = p.w( ) +
+                        p.x( ) * ( p.x( ) >= 0.0f ? box.maximum.x( ) : box.minimum.x( ) ) +
+                        p.y( ) * ( p.y( ) >= 0.0f ? box.maximum.y( ) : box.minimum.y( ) ) +
+                        p.z( ) * ( p.z( ) >= 0.0f ? box.maximum.z( ) : box.minimum.z( ) );
+                if ( positive < 0.0f ) outside = true;
+                float negative = p.w( ) +
+                        p.x( ) * ( p.x( ) >= 0.0f ? box.minimum.x( ) : box.maximum.x( ) ) +
+                        p.y( ) * ( p.y( ) >= 0.0f ? box.minimum.y( ) : box.maximum.y( ) ) +
+                        p.z( ) * ( p.z( ) >= 0.0f ? box.minimum.z( ) : box.maximum.z( ) );
+                if ( negative < 0.0f ) contained = false;
+            }
+            if ( outside ) continue;
+        }
+
+        if ( node.count > 0 || contained )
+        {
+            if ( node.count > 0 )
+            {
+                for ( int i = node.first; i < node.first + node.count; ++i )
+                    result.append( m_items[i] );
+            }
+            else
+            {
+                // 整个子树都可见，叶子的图元在m_items里是连续的
+                const Node* leftmost = &node;
+                while ( leftmost->count == 0 ) leftmost = &m_nodes[leftmost->left];
+                const Node* rightmost = &node;
+                while ( rightmost->count == 0 ) rightmost = &m_nodes[rightmost->right];
+                for ( int i = leftmost->first;
+                      i < rightmost->first + rightmost->count; ++i )
+                    result.append( m_items[i] );
+            }
+            continue;
+        }
+
+        stack.append( node.right );
+        stack.append( node.left );
+    }
+
+    std::sort( result.begin( ), result.end( ) );
+}
+
+bool BVH::intersectBox( const AABB& box,
+                        const QVector3D& origin,
+                        const QVector3D& inverseDirection,
+                        float maxDistance,
+                        float* entry )
+{
+    float t0 = 0.0f, t1 = maxDistance;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        float tNear = ( box.minimum[axis] - origin[axis] ) * inverseDirection[axis];
+        float tFar = ( box.maximum[axis] - origin[axis] ) * inverseDirection[axis];
+        if ( tNear > tFar ) qSwap( tNear, tFar );
+        t0 = qMax( t0, tNear );
+        t1 = qMin( t1, tFar );
+        if ( t0 > t1 ) return false;
+    }
+    if ( entry != Q_NULLPTR ) *entry = t0;
+    return true;
+}
+
+int BVH::intersectRay( const QVector3D& origin,
+                       const QVector3D& direction,
+                       float* distance ) const
+{
+    if ( m_nodes.isEmpty( ) ) return -1;
+
+    QVector3D inverseDirection(
+                qFuzzyIsNull( direction.x( ) ) ? 1e30f : 1.0f / direction.x( ),
+                qFuzzyIsNull( direction.y( ) ) ? 1e30f : 1.0f / direction.y( ),
+                qFuzzyIsNull( direction.z( ) ) ? 1e30f : 1.0f / direction.z( ) );
+
+    int nearest = -1;
+    float nearestDistance = 1e30f;
+    float entry;
+    if ( !intersectBox( m_nodes[0].bounds, origin, inverseDirection,
+                        nearestDistance, &entry ) ) return -1;
+
+    QVarLengthArray<int, 64> stack;
+    stack.append( 0 );
+    while ( !stack.isEmpty( ) )
+    {
+        const Node& node = m_nodes[stack.last( )];
+        stack.removeLast( );
+        if ( node.count > 0 )
+        {
+            for ( int i = node.first; i < node.first + node.count; ++i )
+            {
+                if ( intersectBox( m_itemBounds[m_items[i]], origin,
+                                   inverseDirection, nearestDistance, &entry ) &&
+                     entry < nearestDistance )
+                {
+                    nearestDistance = entry;
+                    nearest = m_items[i];
+                }
+            }
+            continue;
+        }
+
+        // 先访问近的孩子，远的孩子可能被提前剔除
+        float leftEntry, rightEntry;
+        bool hitLeft = intersectBox( m_nodes[node.left].bounds, origin,
+                                     inverseDirection, nearestDistance, &leftEntry );
+        bool hitRight = intersectBox( m_nodes[node.right].bounds, origin,
+                                      inverseDirection, nearestDistance, &rightEntry );
+        if ( hitLeft && hitRight )
+        {
+            if ( leftEntry < rightEntry )
+            {
+                stack.append( node.right );
+                stack.append( node.left );
+            }
+            else
+            {
+                stack.append( node.left );
+                stack.append( node.right );
+            }
+        }
+        else if ( hitLeft ) stack.append( node.left );
+        else if ( hitRight ) stack.append( node.right );
+    }
+
+    if ( nearest >= 0 && distance != Q_NULLPTR ) *distance = nearestDistance;
+    return nearest;
+}
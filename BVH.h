@@ -0,0 +1,114 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QVector4D>
+#include <QMatrix4x4>
+
+// 轴对齐包围盒
+struct AABB
+{
+    AABB( void ): minimum( 1e30f, 1e30f, 1e30f ),
+        maximum( -1e30f, -1e30f, -1e30f ) { }
+    AABB( const QVector3D& _minimum, const QVector3D& _maximum ):
+        minimum( _minimum ), maximum( _maximum ) { }
+
+    bool isValid( void ) const
+    {
+        return minimum.x( ) <= maximum.x( ) &&
+                minimum.y( ) <= maximum.y( ) &&
+                minimum.z( ) <= maximum.z( );
+    }
+    void unite( const AABB& other )
+    {
+        minimum = QVector3D( qMin( minimum.x( ), other.minimum.x( ) ),
+                             qMin( minimum.y( ), other.minimum.y( ) ),
+                             qMin( minimum.z( ), other.minimum.z( ) ) );
+        maximum = QVector3D( qMax( maximum.x( ), other.maximum.x( ) ),
+                             qMax( maximum.y( ), other.maximum.y( ) ),
+                             qMax( maximum.z( ), other.maximum.z( ) ) );
+    }
+    void unite( const QVector3D& point )
+    {
+        unite( AABB( point, point ) );
+    }
+    QVector3D center( void ) const { return ( minimum + maximum ) * 0.5f; }
+    float surfaceArea( void ) const
+    {
+        if ( !isValid( ) ) return 0.0f;
+        QVector3D d = maximum - minimum;
+        return 2.0f * ( d.x( ) * d.y( ) + d.y( ) * d.z( ) + d.z( ) * d.x( ) );
+    }
+    bool operator==( const AABB& other ) const
+    {
+        return minimum == other.minimum && maximum == other.maximum;
+    }
+    bool operator!=( const AABB& other ) const { return !( *this == other ); }
+
+    QVector3D           minimum, maximum;
+};
+
+// 场景实体的层次包围体（SAH分箱构建，支持增量refit）
+class BVH
+{
+public:
+    struct Node
+    {
+        AABB            bounds;
+        int             parent;
+        int             left, right;    // 内部结点的孩子
+        int             first, count;   // 叶子结点的图元范围，count > 0表示叶子
+    };
+
+    BVH( void );
+
+    // 全量构建，bounds的下标即为图元编号
+    void build( const QVector<AABB>& bounds );
+
+    // 只更新发生变化的图元，并沿父结点向上修正包围盒
+    void refit( const QVector<int>& changed, const QVector<AABB>& bounds );
+    void clear( void );
+
+    int itemCount( void ) const { return m_leafOf.size( ); }
+    int nodeCount( void ) const { return m_nodes.size( ); }
+    const AABB& itemBounds( int item ) const { return m_itemBounds[item]; }
+
+    // 视锥体裁剪，结果按图元编号升序排列
+    void queryFrustum( const QMatrix4x4& viewProjection,
+                       QVector<int>& result ) const;
+
+    // 射线查询，返回最近相交的图元编号，未命中返回-1
+    int intersectRay( const QVector3D& origin,
+                      const QVector3D& direction,
+                      float* distance = Q_NULLPTR ) const;
+
+    // 由观察投影矩阵提取六个裁剪平面
+    static void extractPlanes( const QMatrix4x4& viewProjection,
+                               QVector4D planes[6] );
+    // 盒子是否完全在某个裁剪平面之外
+    static bool outsideFrustum( const AABB& box, const QVector4D planes[6] );
+    static bool intersectBox( const AABB& box,
+                              const QVector3D& origin,
+                              const QVector3D& inverseDirection,
+                              float maxDistance,
+                              float* entry );
+
+    // 统计（纳秒）
+    qint64 buildTime( void ) const { return m_buildTime; }
+    qint64 refitTime( void ) const { return m_refitTime; }
+protected:
+    int buildRange( int first, int count, int parent );
+    void updateLeaf( int node );
+
+    QVector<Node>       m_nodes;
+    QVector<int>        m_items;        // 叶子里的图元编号
+    QVector<int>        m_leafOf;       // 图元所在的叶子结点
+    QVector<AABB>       m_itemBounds;
+    QVector<QVector3D>  m_centers;      // 构建时使用
+
+    qint64              m_buildTime;
+    qint64              m_refitTime;
+};
+
+#endif // BVH_H
@@ -0,0 +1,46 @@
+// Blur.frag
+// 方差阴影图的可分离高斯模糊。两个矩各自打包在两个通道中，
+// 需要先解包再加权，最后重新打包
+#ifdef GL_ES
+precision highp float;
+#endif
+
+#define MAX_BLUR_RADIUS 8
+
+uniform sampler2D texture;
+uniform vec2 direction;                     // 一个纹素的步长
+uniform vec4 tileBounds;                    // 采样范围，防止读到相邻的图块
+uniform int radius;
+uniform float weights[MAX_BLUR_RADIUS + 1];
+
+varying vec2 v_texCoord;
+
+vec2 unpackMoments( vec4 colour )
+{
+    return vec2( colour.x + colour.y / 255.0, colour.z + colour.w / 255.0 );
+}
+
+vec4 packMoments( vec2 moments )
+{
+    moments = clamp( moments, 0.0, 1.0 );
+    vec2 high = floor( moments * 255.0 ) / 255.0;
+    vec2 low = ( moments - high ) * 255.0;
+    return vec4( high.x, low.x, high.y, low.y );
+}
+
+vec2 fetch( vec2 texCoord )
+{
+    return unpackMoments( texture2D( texture, clamp( texCoord, tileBounds.xy, tileBounds.zw ) ) );
+}
+
+void main( void )
+{
+    vec2 moments = fetch( v_texCoord ) * weights[0];
+    for ( int i = 1; i <= MAX_BLUR_RADIUS; ++i )
+    {
+        if ( i > radius ) break;
+        vec2 offset = direction * float( i );
+        moments += ( fetch( v_texCoord + offset ) + fetch( v_texCoord - offset ) ) * weights[i];
+    }
+    gl_FragColor = packMoments( moments );
+}
@@ -0,0 +1,17 @@
+// Blur.vert
+#ifdef GL_ES
+precision highp float;
+#endif
+
+attribute vec2 position;
+
+// 图块在纹理中的偏移以及缩放，视口与图块一致
+uniform vec4 tile;
+
+varying vec2 v_texCoord;
+
+void main( void )
+{
+    v_texCoord = tile.xy + ( position * 0.5 + 0.5 ) * tile.zw;
+    gl_Position = vec4( position, 0.0, 1.0 );
+}
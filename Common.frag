@@ -3,16 +3,34 @@
 // 可能原因：多纹理失败，也就是说shadowTexture失效
 // 或者是v_shadowCoord传入错误的数值（经过测试，v_shadowColor没有错误）
 
-uniform sampler2D texture;
-uniform sampler2D shadowTexture;
+#define MAX_LIGHTS 8
 
-uniform vec3 lightPosition;
+uniform sampler2D texture;
 uniform mat4 viewMatrix;
 
+// 光源数组，只有前lightCount个有效
+uniform int lightCount;
+uniform vec3 lightPositions[MAX_LIGHTS];
+uniform vec3 lightColors[MAX_LIGHTS];
+
 varying vec3 viewSpacePosition;
 varying vec2 v_texCoord;
 varying vec3 v_normal;
-varying vec4 v_shadowCoord;
+varying vec3 worldPosition;
+
+// NO_SHADOW由View定义，不接收阴影的实体使用，以下阴影相关的部分都不编译
+#ifndef NO_SHADOW
+uniform sampler2D shadowTexture;
+uniform samplerCube shadowCubeTexture;
+uniform int shadowType;
+
+// shadowTiles为各个光源在阴影图集中的偏移以及缩放（纹理坐标），缩放为0表示不投射阴影
+uniform mat4 lightViewProjectionMatrices[MAX_LIGHTS];
+uniform vec4 shadowTiles[MAX_LIGHTS];
+uniform float lightRanges[MAX_LIGHTS];    // 方差阴影用来归一化到光源的距离
+
+// 点光源阴影（shadowType为2）只用于第一个光源，大于0时有效
+uniform float pointShadowRange;
 
 float unpack (vec4 colour)
 {
@@ -23,13 +41,17 @@ float unpack (vec4 colour)
     return dot(colour , bitShifts);
 }
 
-float shadowSimple( )
+float shadowSimple( vec4 shadowCoord, vec4 tile )
 {
-    vec4 shadowMapPosition = v_shadowCoord / v_shadowCoord.w;
+    vec4 shadowMapPosition = shadowCoord / shadowCoord.w;
 
     shadowMapPosition = (shadowMapPosition + 1.0) /2.0;
 
-    vec4 packedZValue = texture2D(shadowTexture, shadowMapPosition.st);
+    // 图块以外的部分不在这个光源的阴影中，也不能采样到相邻的图块
+    if ( any( lessThan( shadowMapPosition.st, vec2( 0.0 ) ) ) ||
+         any( greaterThan( shadowMapPosition.st, vec2( 1.0 ) ) ) ) return 1.0;
+
+    vec4 packedZValue = texture2D(shadowTexture, tile.xy + shadowMapPosition.st * tile.zw);
 
     float distanceFromLight = unpack(packedZValue);
 
@@ -41,23 +63,76 @@ float shadowSimple( )
     return float(distanceFromLight > shadowMapPosition.z - bias);
 }
 
-void main( )
+float shadowVariance( vec4 shadowCoord, vec4 tile, float distance )
 {
-    vec3 viewSpaceLightPosition = vec3( viewMatrix * vec4( lightPosition, 1.0 ) );
-    vec3 lightVector = viewSpaceLightPosition - viewSpacePosition;
-    lightVector = normalize( lightVector );
-    float NdotL = dot( v_normal, lightVector );
+    vec2 shadowMapPosition = ( shadowCoord.st / shadowCoord.w + 1.0 ) / 2.0;
+    if ( any( lessThan( shadowMapPosition, vec2( 0.0 ) ) ) ||
+         any( greaterThan( shadowMapPosition, vec2( 1.0 ) ) ) ) return 1.0;
 
-    float diffuse = max( 0.0, NdotL );
-    float ambient = 0.3;
+    // 模糊以后的两个矩，一次双线性采样，与半影的宽度无关
+    vec4 packedMoments = texture2D( shadowTexture, tile.xy + shadowMapPosition * tile.zw );
+    float mean = packedMoments.x + packedMoments.y / 255.0;
+    float meanSquare = packedMoments.z + packedMoments.w / 255.0;
+    if ( distance <= mean ) return 1.0;
 
-    float shadow = 1.0;
-    if ( v_shadowCoord.w > 0.0 )
+    // Chebyshev不等式给出的上界，去掉下面一段以减轻漏光
+    float variance = max( meanSquare - mean * mean, 0.00002 );
+    float d = distance - mean;
+    float pMax = variance / ( variance + d * d );
+    return clamp( ( pMax - 0.2 ) / 0.8, 0.0, 1.0 );
+}
+
+float shadowPoint( vec3 lightToFragment )
+{
+    // 立方体贴图中保存的是到光源的距离除以范围
+    float distanceFromLight = unpack( textureCube( shadowCubeTexture, lightToFragment ) );
+    float bias = 0.001;
+    return float( distanceFromLight > length( lightToFragment ) / pointShadowRange - bias );
+}
+#endif
+
+void main( )
+{
+    // 环境光平均分给各个光源，只有一个白色光源时与原来的结果相同
+    float ambient = 0.3 / float( lightCount );
+    vec3 lighting = vec3( 0.0 );
+    for ( int i = 0; i < MAX_LIGHTS; ++i )
     {
-        shadow = shadowSimple( );
-        shadow = shadow * 0.8 + 0.2;
+        if ( i >= lightCount ) break;
+
+        vec3 viewSpaceLightPosition = vec3( viewMatrix * vec4( lightPositions[i], 1.0 ) );
+        vec3 lightVector = viewSpaceLightPosition - viewSpacePosition;
+        lightVector = normalize( lightVector );
+        float NdotL = dot( v_normal, lightVector );
+
+        float diffuse = max( 0.0, NdotL );
+
+        float shadow = 1.0;
+#ifndef NO_SHADOW
+        if ( shadowType == 2 && i == 0 && pointShadowRange > 0.0 )
+        {
+            shadow = shadowPoint( worldPosition - lightPositions[0] );
+            shadow = shadow * 0.8 + 0.2;
+        }
+        else if ( shadowType != 0 && shadowTiles[i].z > 0.0 )
+        {
+            vec4 shadowCoord = lightViewProjectionMatrices[i] * vec4( worldPosition, 1.0 );
+            if ( shadowCoord.w > 0.0 )
+            {
+                if ( shadowType == 3 )
+                {
+                    float distance = length( worldPosition - lightPositions[i] ) / lightRanges[i];
+                    shadow = shadowVariance( shadowCoord, shadowTiles[i], distance );
+                }
+                else shadow = shadowSimple( shadowCoord, shadowTiles[i] );
+                shadow = shadow * 0.8 + 0.2;
+            }
+        }
+#endif
+
+        lighting += lightColors[i] * ( diffuse + ambient ) * shadow;
     }
 
     vec4 textureColor = texture2D( texture, v_texCoord );
-    gl_FragColor = textureColor * ( diffuse + ambient ) * shadow;
+    gl_FragColor = textureColor * vec4( lighting, 1.0 );
 }
@@ -5,30 +5,44 @@ attribute vec3 position;
 attribute vec3 normal;
 attribute vec2 texCoord;
 
-uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
+// 纹理坐标是归一化的短整型，xy是偏移，zw是缩放，由MeshBuffer::bind设置
+uniform vec4 texCoordTransform;
+
+// 每个物体不同的矩阵。OBJECT_BLOCK由View::addCommonVertexShader定义，
+// 这时它们来自StreamBuffer中的一段，每个物体只需要绑定一次
+#ifdef OBJECT_BLOCK
+layout( std140 ) uniform ObjectBlock
+{
+    mat4 modelMatrix;
+    mat3 modelViewNormalMatrix;
+};
+#else
+uniform mat4 modelMatrix;
 uniform mat3 modelViewNormalMatrix;
-uniform mat4 lightViewProjectionMatrix;
+#endif
+
+// 深度预渲染与主渲染是不同的程序，GL_EQUAL要求两边的深度完全相同。
+// 桌面上由View::addCommonVertexShader声明为GLSL 1.20
+invariant gl_Position;
 
 // 转换到varying中的
 varying vec3 viewSpacePosition;
 varying vec2 v_texCoord;
 varying vec3 v_normal;
-varying vec4 v_shadowCoord;
+varying vec3 worldPosition;
 
 void main( void )
 {
-    viewSpacePosition = vec3( viewMatrix * modelMatrix * vec4( position, 1.0 ) );
+    // 各个光源的阴影坐标在片段着色器中计算，避免占用过多的varying
+    worldPosition = vec3( modelMatrix * vec4( position, 1.0 ) );
+    viewSpacePosition = vec3( viewMatrix * vec4( worldPosition, 1.0 ) );
 
-    v_texCoord = texCoord;
+    v_texCoord = texCoordTransform.xy + texCoord * texCoordTransform.zw;
 
     v_normal = modelViewNormalMatrix * normal;
 
-    v_shadowCoord = lightViewProjectionMatrix *
-            modelMatrix *
-            vec4( position, 1.0 );
-
     gl_Position = projectionMatrix *
             viewMatrix *
             modelMatrix *
@@ -1,55 +1,43 @@
-#include <math.h>
+#include <string.h>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLFunctions>
-#include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QQmlFile>
 #include "View.h"
+#include "Light.h"
+#include "MeshBuffer.h"
+#include "StreamBuffer.h"
 #include "Cube.h"
 
-#define VERTEX_COUNT   36
 #define CUBE_LENGTH    25.0
 #define TEXTURE_UNIT    GL_TEXTURE0
 #define SHADOW_TEXTURE_UNIT GL_TEXTURE1
+#define SHADOW_CUBE_TEXTURE_UNIT GL_TEXTURE2
+#define OBJECT_BLOCK_BINDING    0
 
-static void canonicalPosition( QVector3D& position )
+// Common.vert中ObjectBlock的std140布局，mat3的每一列补齐到vec4
+struct ObjectBlock
 {
-    if ( !qFuzzyIsNull( position.x( ) ) )
-        position.setX( position.x( ) / fabsf( position.x( ) ) );
-    if ( !qFuzzyIsNull( position.y( ) ) )
-        position.setY( position.y( ) / fabsf( position.y( ) ) );
-    if ( !qFuzzyIsNull( position.z( ) ) )
-        position.setZ( position.z( ) / fabsf( position.z( ) ) );
-}
+    float                   modelMatrix[16];
+    float                   modelViewNormalMatrix[12];
+};
 
 class CubeRenderer: protected QOpenGLFunctions
 {
-    struct Vertex
-    {
-        void set( const QVector3D& _position, const QVector3D& _normal,
-                  const QVector2D& _texCoord )
-        {
-            position = _position;
-            normal = _normal;
-            texCoord = _texCoord;
-        }
-
-        QVector3D               position;
-        QVector3D               normal;
-        QVector2D               texCoord;
-    };
 public:
     enum ShadowType
     {
         NoShadow = 0,// 以后依次递增
         SimpleShadow,
-        PCFShadow
+        PointShadow,
+        VarianceShadow
     };
 
     explicit CubeRenderer( Cube* plane, ShadowType shadowType ):
         m_cube( plane ),
         m_shadowType( shadowType ),
-        m_vertexBuffer( QOpenGLBuffer::VertexBuffer ),
         m_texture( QOpenGLTexture::Target2D )
     {
         initializeOpenGLFunctions( );
@@ -57,21 +45,31 @@ public:
         // 根据创建的次数来创建着色器
         if ( s_count++ == 0 )
         {
+            // 立方体的数量可能很多，有uniform块时每个立方体的矩阵通过StreamBuffer上传
+            s_objectBlock = plane->m_view->streamBuffer( )->hasUniformBlocks( );
             s_program = new QOpenGLShaderProgram;
-            s_program->addShaderFromSourceFile( QOpenGLShader::Vertex,
-                                                ":/Common.vert" );
+            View::addCommonVertexShader( s_program, s_objectBlock );
             s_program->addShaderFromSourceFile( QOpenGLShader::Fragment,
                                                 ":/Common.frag" );
             s_program->link( );
+            if ( s_objectBlock )
+            {
+                QOpenGLExtraFunctions* functions =
+                        QOpenGLContext::currentContext( )->extraFunctions( );
+                GLuint blockIndex = functions->glGetUniformBlockIndex(
+                            s_program->programId( ), "ObjectBlock" );
+                functions->glUniformBlockBinding( s_program->programId( ),
+                                                  blockIndex, OBJECT_BLOCK_BINDING );
+            }
             s_program->bind( );
             s_positionLoc = s_program->attributeLocation( "position" );
             s_normalLoc = s_program->attributeLocation( "normal" );
             s_texCoordLoc = s_program->attributeLocation( "texCoord" );
+            s_texCoordTransformLoc = s_program->uniformLocation( "texCoordTransform" );
             s_modelMatrixLoc = s_program->uniformLocation( "modelMatrix" );
             s_viewMatrixLoc = s_program->uniformLocation( "viewMatrix" );
             s_projectionMatrixLoc = s_program->uniformLocation( "projectionMatrix" );
-            s_lightPositionLoc = s_program->uniformLocation( "lightPosition" );
-            s_lightViewProjectionMatrixLoc = s_program->uniformLocation( "lightViewProjectionMatrix" );
+            s_lightUniforms.resolve( s_program );
             s_modelViewNormalMatrixLoc =
                     s_program->uniformLocation( "modelViewNormalMatrix" );
             s_shadowTypeLoc = s_program->uniformLocation( "shadowType" );
@@ -81,98 +79,18 @@ public:
                                         TEXTURE_UNIT - GL_TEXTURE0 );
             s_program->setUniformValue( shadowLoc,
                                         SHADOW_TEXTURE_UNIT - GL_TEXTURE0 );
+            s_program->setUniformValue( s_program->uniformLocation( "shadowCubeTexture" ),
+                                        SHADOW_CUBE_TEXTURE_UNIT - GL_TEXTURE0 );
 
             s_program->release( );
         }
 
-        // 设置顶点坐标
-        qreal semi = CUBE_LENGTH / 2.0;
-        const QVector3D basicVertices[] =
-        {
-            QVector3D( semi, -semi, semi ),
-            QVector3D( semi, -semi, -semi ),
-            QVector3D( -semi, -semi, -semi ),
-            QVector3D( -semi, -semi, semi ),
-            QVector3D( semi, semi, semi ),
-            QVector3D( semi, semi, -semi ),
-            QVector3D( -semi, semi, -semi ),
-            QVector3D( -semi, semi, semi )
-        };
-
-        const QVector3D normals[] =
-        {
-            QVector3D( 1.0, 0.0, 0.0 ),
-            QVector3D( 0.0, 1.0, 0.0 ),
-            QVector3D( 0.0, 0.0, 1.0 ),
-            QVector3D( -1.0, 0.0, 0.0 ),
-            QVector3D( 0.0, -1.0, 0.0 ),
-            QVector3D( 0.0, 0.0, -1.0 )
-        };
-
-        const QVector2D texCoords[] =
-        {
-            QVector2D( 0.0, 0.0 ),
-            QVector2D( 0.0, 1.0 ),
-            QVector2D( 1.0, 0.0 ),
-            QVector2D( 1.0, 1.0 )
-        };
-
-        m_vertices = new Vertex[VERTEX_COUNT];
-        Vertex* v = m_vertices;
-
-        // 前面
-        v[0].set( basicVertices[7], normals[2], texCoords[2] );
-        v[1].set( basicVertices[3], normals[2], texCoords[0] );
-        v[2].set( basicVertices[0], normals[2], texCoords[1] );
-        v[3].set( basicVertices[4], normals[2], texCoords[3] );
-        v[4].set( basicVertices[7], normals[2], texCoords[2] );
-        v[5].set( basicVertices[0], normals[2], texCoords[1] );
-
-        // 后面
-        v[6].set( basicVertices[5], normals[5], texCoords[2] );
-        v[7].set( basicVertices[2], normals[5], texCoords[1] );
-        v[8].set( basicVertices[6], normals[5], texCoords[3] );
-        v[9].set( basicVertices[5], normals[5], texCoords[2] );
-        v[10].set( basicVertices[1], normals[5], texCoords[0] );
-        v[11].set( basicVertices[2], normals[5], texCoords[1] );
-
-        // 上面
-        v[12].set( basicVertices[4], normals[1], texCoords[2] );
-        v[13].set( basicVertices[5], normals[1], texCoords[3] );
-        v[14].set( basicVertices[6], normals[1], texCoords[1] );
-        v[15].set( basicVertices[4], normals[1], texCoords[2] );
-        v[16].set( basicVertices[6], normals[1], texCoords[1] );
-        v[17].set( basicVertices[7], normals[1], texCoords[0] );
-
-        // 下面
-        v[18].set( basicVertices[0], normals[4], texCoords[3] );
-        v[19].set( basicVertices[2], normals[4], texCoords[0] );
-        v[20].set( basicVertices[1], normals[4], texCoords[1] );
-        v[21].set( basicVertices[0], normals[4], texCoords[3] );
-        v[22].set( basicVertices[3], normals[4], texCoords[2] );
-        v[23].set( basicVertices[2], normals[4], texCoords[0] );
-
-        // 左面
-        v[24].set( basicVertices[2], normals[3], texCoords[0] );
-        v[25].set( basicVertices[3], normals[3], texCoords[1] );
-        v[26].set( basicVertices[7], normals[3], texCoords[3] );
-        v[27].set( basicVertices[2], normals[3], texCoords[0] );
-        v[28].set( basicVertices[7], normals[3], texCoords[3] );
-        v[29].set( basicVertices[6], normals[3], texCoords[2] );
-
-        // 右面
-        v[30].set( basicVertices[4], normals[0], texCoords[2] );
-        v[31].set( basicVertices[1], normals[0], texCoords[1] );
-        v[32].set( basicVertices[5], normals[0], texCoords[3] );
-        v[33].set( basicVertices[1], normals[0], texCoords[1] );
-        v[34].set( basicVertices[4], normals[0], texCoords[2] );
-        v[35].set( basicVertices[0], normals[0], texCoords[0] );
-
-        m_vertexBuffer.setUsagePattern( QOpenGLBuffer::DynamicDraw );
-        m_vertexBuffer.create( );
-        m_vertexBuffer.bind( );
-        m_vertexBuffer.allocate( v, VERTEX_COUNT * sizeof( Vertex ) );
-        m_vertexBuffer.release( );
+        // 设置顶点坐标，保留单位边长的位置用于resize
+        Geometry::MeshData data;
+        Geometry::cube( 1.0f, data );
+        m_unitPositions = data.positions;
+        Geometry::cube( CUBE_LENGTH, data );
+        m_mesh.create( data, QOpenGLBuffer::DynamicDraw );
 
         // 设置纹理滤波
         m_texture.setMinificationFilter( QOpenGLTexture::LinearMipMapLinear );
@@ -180,9 +98,8 @@ public:
     }
     ~CubeRenderer( void )
     {
-        m_vertexBuffer.destroy( );
+        m_mesh.destroy( );
         m_texture.destroy( );
-        delete []m_vertices;
         if ( --s_count == 0 )
         {
             delete s_program;
@@ -190,89 +107,114 @@ public:
     }
     void render( void )
     {
+        // 是否启用实时阴影，由View的shadowMode决定
+        ShadowType shadowType = m_shadowType == NoShadow ?
+                    NoShadow : ShadowType( m_cube->m_view->renderShadowMode( ) );
+        if ( shadowType == NoShadow )
+        {
+            renderUnshadowed( );
+            return;
+        }
+
         s_program->bind( );
-        m_vertexBuffer.bind( );
+        int changes = 1;
 
         // 绘制box
-        int offset = 0;
-        setVertexAttribute( s_positionLoc, GL_FLOAT, 3, offset );
-        offset += 3 * sizeof( GLfloat );
-        setVertexAttribute( s_normalLoc, GL_FLOAT, 3, offset );
-        offset += 3 * sizeof( GLfloat );
-        setVertexAttribute( s_texCoordLoc, GL_FLOAT, 2, offset );
+        changes += m_mesh.bind( s_program, s_positionLoc, s_normalLoc, s_texCoordLoc,
+                                s_texCoordTransformLoc );
 
         // 摄像机的MVP矩阵
         QMatrix4x4& viewMatrix = m_cube->m_view->viewMatrix( );
-        s_program->setUniformValue( s_modelMatrixLoc, m_modelMatrix );
         s_program->setUniformValue( s_viewMatrixLoc, viewMatrix );
         s_program->setUniformValue( s_projectionMatrixLoc, m_cube->m_view->projectionMatrix( ) );
-        s_program->setUniformValue( s_modelViewNormalMatrixLoc,
-                                    ( viewMatrix * m_modelMatrix ).normalMatrix( ) );
-
-        // 是否启用实时阴影
-        //s_program->setUniformValue( s_shadowTypeLoc, m_shadowType );
-
-        m_texture.bind( );
-        if ( m_shadowType != NoShadow )
+        if ( s_objectBlock )
         {
-            s_program->setUniformValue( s_lightPositionLoc, m_cube->m_view->lightPosition( ) );
-            s_program->setUniformValue( s_lightViewProjectionMatrixLoc,
-                                        m_cube->m_view->lightViewProjectionMatrix( ) );
-
-            glActiveTexture( SHADOW_TEXTURE_UNIT );
-            glBindTexture( GL_TEXTURE_2D, m_cube->m_view->shadowTexture( ) );
-            glDrawArrays( GL_TRIANGLES, 0, VERTEX_COUNT );
-            glActiveTexture( TEXTURE_UNIT );
+            ObjectBlock block;
+            memcpy( block.modelMatrix, m_modelMatrix.constData( ), sizeof( block.modelMatrix ) );
+            const float* normalMatrix = m_modelViewNormalMatrix.constData( );
+            for ( int column = 0; column < 3; ++column )
+            {
+                for ( int row = 0; row < 3; ++row )
+                    block.modelViewNormalMatrix[column * 4 + row] = normalMatrix[column * 3 + row];
+                block.modelViewNormalMatrix[column * 4 + 3] = 0.0f;
+            }
+            m_cube->m_view->streamBuffer( )->bindUniformBlock(
+                        OBJECT_BLOCK_BINDING, &block, sizeof( block ) );
+            // 两次uniform上传换成一次缓存绑定
+            --changes;
         }
         else
         {
-            glDrawArrays( GL_TRIANGLES, 0, VERTEX_COUNT );
+            s_program->setUniformValue( s_modelMatrixLoc, m_modelMatrix );
+            s_program->setUniformValue( s_modelViewNormalMatrixLoc,
+                                        m_modelViewNormalMatrix );
         }
+
+        s_program->setUniformValue( s_shadowTypeLoc, int( shadowType ) );
+        // 上面的四个矩阵和阴影类型，再加上光源数组
+        changes += 5 + s_lightUniforms.apply( s_program, m_cube->m_view );
+
+        m_texture.bind( );
+        glActiveTexture( SHADOW_TEXTURE_UNIT );
+        glBindTexture( GL_TEXTURE_2D, m_cube->m_view->shadowTexture( ) );
+        if ( shadowType == PointShadow )
+        {
+            glActiveTexture( SHADOW_CUBE_TEXTURE_UNIT );
+            glBindTexture( GL_TEXTURE_CUBE_MAP, m_cube->m_view->shadowCubeTexture( ) );
+        }
+        m_mesh.draw( );
+        glActiveTexture( TEXTURE_UNIT );
+        changes += shadowType == PointShadow ? 3 : 2;
+        m_cube->m_view->countStateChanges( changes );
+        m_cube->m_view->countDrawCall( m_mesh.triangleCount( ) );
         m_texture.release( );
-        m_vertexBuffer.release( );
+        m_mesh.release( );
 
         s_program->release( );
     }
+    void renderUnshadowed( void )
+    {
+        // View中没有阴影计算的程序，不上传阴影的uniform，也不绑定阴影图
+        View* view = m_cube->m_view;
+        const View::UnshadowedProgram& unshadowed = view->unshadowedProgram( );
+        int changes = view->bindUnshadowedProgram( m_modelMatrix, m_modelViewNormalMatrix );
+        changes += m_mesh.bind( unshadowed.program, unshadowed.positionLoc,
+                                unshadowed.normalLoc, unshadowed.texCoordLoc,
+                                unshadowed.texCoordTransformLoc );
+        m_texture.bind( );
+        m_mesh.draw( );
+        view->countStateChanges( changes + 1 );
+        view->countDrawCall( m_mesh.triangleCount( ) );
+        m_texture.release( );
+        m_mesh.release( );
+
+        unshadowed.program->release( );
+    }
+    void prepare( void )
+    {
+        // 可以在工作线程中执行，不涉及OpenGL调用
+        m_modelViewNormalMatrix =
+                ( m_cube->m_view->viewMatrix( ) * m_modelMatrix ).normalMatrix( );
+    }
     void renderShadow( void )
     {
-        m_vertexBuffer.bind( );
+        // 阴影只需要位置
         QOpenGLShaderProgram* depthProgram = m_cube->m_view->depthProgram( );
-        depthProgram->enableAttributeArray( "position" );
-        depthProgram->setAttributeBuffer(
-                    "position",             // 位置
-                    GL_FLOAT,               // 类型
-                    0,                      // 偏移
-                    3,                      // 元大小
-                    sizeof( Vertex ) );     // 迈
+        int changes = m_mesh.bindPositions( depthProgram,
+                                            depthProgram->attributeLocation( "position" ) );
 
         depthProgram->setUniformValue( "modelMatrix", m_modelMatrix );
-        glDrawArrays( GL_TRIANGLES, 0, VERTEX_COUNT );
-        m_vertexBuffer.release( );
+        m_mesh.draw( );
+        m_cube->m_view->countStateChanges( changes + 1 );
+        m_cube->m_view->countDrawCall( m_mesh.triangleCount( ) );
+        m_mesh.release( );
     }
     void resize( qreal length )
     {
-        qreal semi = length / 2.0;
-        m_vertexBuffer.bind( );
-        Vertex* v = (Vertex*)m_vertexBuffer.map( QOpenGLBuffer::WriteOnly );
-        for ( int i = 0; i < VERTEX_COUNT; ++i )
-        {
-            canonicalPosition( v[i].position );
-            v[i].position *= semi;
-        }
-        m_vertexBuffer.unmap( );
-        m_vertexBuffer.release( );
-    }
-    void setVertexAttribute( int attributeLocation,
-                             GLenum elementType,
-                             quint32 elementSize,
-                             quint32 offset )
-    {
-        s_program->enableAttributeArray( attributeLocation );
-        s_program->setAttributeBuffer( attributeLocation,      // 位置
-                                       elementType,            // 类型
-                                       offset,                 // 偏移
-                                       elementSize,            // 元大小
-                                       sizeof( Vertex ) );     // 迈
+        QVector<QVector3D> positions( m_unitPositions.size( ) );
+        for ( int i = 0; i < positions.size( ); ++i )
+            positions[i] = m_unitPositions[i] * length;
+        m_mesh.writePositions( positions, m_cube->m_view->streamBuffer( ) );
     }
     void loadTextureFromSource( const QUrl& source )
     {
@@ -288,21 +230,24 @@ public:
         m_modelMatrix.setToIdentity( );
         m_modelMatrix.translate( translate );
     }
+    void setShadowType( ShadowType shadowType ) { m_shadowType = shadowType; }
 protected:
     Cube*                   m_cube;
 
     QMatrix4x4              m_modelMatrix;
+    QMatrix3x3              m_modelViewNormalMatrix;
     ShadowType              m_shadowType;
-    QOpenGLBuffer           m_vertexBuffer;
+    MeshBuffer              m_mesh;
+    QVector<QVector3D>      m_unitPositions;
     QOpenGLTexture          m_texture;
-    Vertex*                 m_vertices;
 
     static QOpenGLShaderProgram* s_program;
     static int s_positionLoc, s_normalLoc,
-    s_texCoordLoc, s_modelMatrixLoc,
+    s_texCoordLoc, s_texCoordTransformLoc, s_modelMatrixLoc,
     s_viewMatrixLoc, s_projectionMatrixLoc,
-    s_lightViewProjectionMatrixLoc,
-    s_lightPositionLoc, s_modelViewNormalMatrixLoc, s_shadowTypeLoc;
+    s_modelViewNormalMatrixLoc, s_shadowTypeLoc;
+    static LightUniforms    s_lightUniforms;
+    static bool             s_objectBlock;  // 物体矩阵在uniform块中
     static int              s_count;        // 计数
 };
 
@@ -310,14 +255,15 @@ QOpenGLShaderProgram* CubeRenderer::s_program = Q_NULLPTR;
 int CubeRenderer::s_positionLoc,
 CubeRenderer::s_normalLoc,
 CubeRenderer::s_texCoordLoc,
+CubeRenderer::s_texCoordTransformLoc,
 CubeRenderer::s_modelMatrixLoc,
 CubeRenderer::s_viewMatrixLoc,
 CubeRenderer::s_projectionMatrixLoc,
-CubeRenderer::s_lightViewProjectionMatrixLoc,
-CubeRenderer::s_lightPositionLoc,
 CubeRenderer::s_modelViewNormalMatrixLoc,
 CubeRenderer::s_shadowTypeLoc,
 CubeRenderer::s_count = 0;
+LightUniforms CubeRenderer::s_lightUniforms;
+bool CubeRenderer::s_objectBlock = false;
 
 Cube::Cube( QObject* parent ): QObject( parent )
 {
@@ -325,6 +271,11 @@ Cube::Cube( QObject* parent ): QObject( parent )
     m_lengthIsDirty = false;
     m_sourceIsDirty = false;
     m_translateIsDirty = false;
+    m_staticGeometry = false;
+    m_castShadows = true;
+    m_receiveShadows = true;
+    m_view = Q_NULLPTR;
+    m_renderer = Q_NULLPTR;
 }
 
 void Cube::initialize( void )
@@ -337,6 +288,11 @@ void Cube::render( void )
     m_renderer->render( );
 }
 
+void Cube::prepare( void )
+{
+    m_renderer->prepare( );
+}
+
 void Cube::renderShadow( void )
 {
     m_renderer->renderShadow( );
@@ -344,6 +300,8 @@ void Cube::renderShadow( void )
 
 void Cube::sync( void )
 {
+    TRACE_SCOPE( "Cube::sync" );
+
     if ( m_lengthIsDirty )
     {
         m_renderer->resize( m_length );
@@ -351,6 +309,7 @@ void Cube::sync( void )
     }
     if ( m_sourceIsDirty )
     {
+        TRACE_SCOPE( "Cube::loadTexture" );
         m_renderer->loadTextureFromSource( m_source );
         m_sourceIsDirty = false;
     }
@@ -359,6 +318,8 @@ void Cube::sync( void )
         m_renderer->translate( m_translate );
         m_translateIsDirty = false;
     }
+    m_renderer->setShadowType( m_receiveShadows ?
+                                   CubeRenderer::SimpleShadow : CubeRenderer::NoShadow );
 }
 
 void Cube::release( void )
@@ -366,12 +327,20 @@ void Cube::release( void )
     delete m_renderer;
 }
 
+AABB Cube::boundingBox( void )
+{
+    float semi = m_length / 2.0;
+    QVector3D extent( semi, semi, semi );
+    return AABB( m_translate - extent, m_translate + extent );
+}
+
 void Cube::setLength( qreal length )
 {
     if ( m_length == length ) return;
     m_length = length;
     emit lengthChanged( );
     m_lengthIsDirty = true;
+    updateWindow( );
 }
 
 void Cube::setSource( const QUrl& source )
@@ -380,6 +349,7 @@ void Cube::setSource( const QUrl& source )
     m_source = source;
     emit sourceChanged( );
     m_sourceIsDirty = true;
+    updateWindow( );
 }
 
 void Cube::setTranslate( const QVector3D& translate )
@@ -388,4 +358,37 @@ void Cube::setTranslate( const QVector3D& translate )
     m_translate = translate;
     emit translateChanged( );
     m_translateIsDirty = true;
+    updateWindow( );
+}
+
+void Cube::setStaticGeometry( bool staticGeometry )
+{
+    if ( m_staticGeometry == staticGeometry ) return;
+    m_staticGeometry = staticGeometry;
+    emit staticGeometryChanged( );
+    updateWindow( );
+}
+
+void Cube::setCastShadows( bool castShadows )
+{
+    if ( m_castShadows == castShadows ) return;
+    m_castShadows = castShadows;
+    emit castShadowsChanged( );
+    updateWindow( );
+}
+
+void Cube::setReceiveShadows( bool receiveShadows )
+{
+    if ( m_receiveShadows == receiveShadows ) return;
+    m_receiveShadows = receiveShadows;
+    emit receiveShadowsChanged( );
+    updateWindow( );
+}
+
+void Cube::updateWindow( void )
+{
+    // 所有属性的修改都经过这里，View据此只更新变化了的GPU实例
+    if ( m_view == Q_NULLPTR ) return;
+    m_view->cubeChanged( this );
+    m_view->updateWindow( );
 }
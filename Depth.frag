@@ -6,7 +6,23 @@
 precision highp float;
 #endif
 
+// xyz为光源位置，w为范围。w大于0时保存到光源的距离除以范围（点光源以及方差阴影），
+// 为0时保存投影以后的深度
+uniform vec4 pointLight;
+// 方差阴影：保存距离以及距离的平方两个矩，各自打包成16位
+uniform int moments;
+
+// DEPTH_LAYERED由View定义，这时是GLSL 1.50，输入来自DepthLayered.geom
+#ifdef DEPTH_LAYERED
+in vec4 projectedPosition;
+in vec3 worldPosition;
+out vec4 fragColor;
+#define FRAG_COLOR fragColor
+#else
 varying vec4 projectedPosition;
+varying vec3 worldPosition;
+#define FRAG_COLOR gl_FragColor
+#endif
 
 vec4 pack( float depth )
 {
@@ -23,9 +39,31 @@ vec4 pack( float depth )
     return comp;
 }
 
+vec4 packMoments( vec2 moments )
+{
+    moments = clamp( moments, 0.0, 1.0 );
+    vec2 high = floor( moments * 255.0 ) / 255.0;
+    vec2 low = ( moments - high ) * 255.0;
+    return vec4( high.x, low.x, high.y, low.y );
+}
+
 void main( void )
 {
+    if ( pointLight.w > 0.0 )
+    {
+        float distance = length( worldPosition - pointLight.xyz ) / pointLight.w;
+        if ( moments != 0 )
+        {
+            FRAG_COLOR = packMoments( vec2( distance, distance * distance ) );
+            return;
+        }
+
+        // 1.0打包以后变成0，所以限制在1以内
+        FRAG_COLOR = pack( min( distance, 0.9999 ) );
+        return;
+    }
+
     float normalizedZ = projectedPosition.z / projectedPosition.w;
     normalizedZ = ( normalizedZ + 1.0 ) / 2.0;
-    gl_FragColor = pack( normalizedZ );
+    FRAG_COLOR = pack( normalizedZ );
 }
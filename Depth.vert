@@ -9,14 +9,15 @@ uniform mat4 modelMatrix;
 uniform mat4 viewProjectionMatrix;
 
 varying vec4 projectedPosition;
+varying vec3 worldPosition;
 
 void main( void )
 {
     vec3 finalPosition = position;
 
+    worldPosition = vec3( modelMatrix * vec4( finalPosition, 1.0 ) );
     projectedPosition =
             viewProjectionMatrix *
-            modelMatrix *
-            vec4( finalPosition, 1.0 );
+            vec4( worldPosition, 1.0 );
     gl_Position = projectedPosition;
 }
@@ -0,0 +1,15 @@
+// DepthLayered.vert
+// 点光源阴影的单遍渲染，投影在DepthLayered.geom中对六个面分别进行
+#version 150
+
+in vec3 position;
+
+uniform mat4 modelMatrix;
+
+out vec3 v_worldPosition;
+
+void main( void )
+{
+    v_worldPosition = vec3( modelMatrix * vec4( position, 1.0 ) );
+    gl_Position = vec4( v_worldPosition, 1.0 );
+}
@@ -0,0 +1,223 @@
+#include "Cube.h"
+#include "Plane.h"
+#include "TexturedCube.h"
+#include "Mesh.h"
+#include "View.h"
+#include "FrameRecorder.h"
+
+#define FRAME_TAG       'F'
+
+using namespace FrameLog;
+
+///////////////////////////////////////////////////////////////////////////////
+static bool entityType( QObject* object, quint8& type )
+{
+    if ( qobject_cast<Cube*>( object ) != Q_NULLPTR ) type = CubeEntity;
+    else if ( qobject_cast<Plane*>( object ) != Q_NULLPTR ) type = PlaneEntity;
+    else if ( qobject_cast<TexturedCube*>( object ) != Q_NULLPTR ) type = TexturedCubeEntity;
+    else if ( qobject_cast<Mesh*>( object ) != Q_NULLPTR ) type = MeshEntity;
+    else return false;
+    return true;
+}
+
+static QObject* createEntity( quint8 type )
+{
+    switch ( type )
+    {
+    case CubeEntity: return new Cube;
+    case PlaneEntity: return new Plane;
+    case TexturedCubeEntity: return new TexturedCube;
+    case MeshEntity: return new Mesh;
+    default: return Q_NULLPTR;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameRecorder::FrameRecorder( void )
+{
+    m_changeCount = 0;
+}
+
+FrameRecorder::~FrameRecorder( void )
+{
+    close( );
+}
+
+bool FrameRecorder::open( const QString& fileName )
+{
+    close( );
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::WriteOnly ) )
+    {
+        qWarning( "FrameRecorder: cannot write %s.", qPrintable( fileName ) );
+        return false;
+    }
+    m_stream.setDevice( &m_file );
+    m_stream.setVersion( QDataStream::Qt_5_4 );
+    m_stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+    m_stream << quint32( Magic ) << quint16( Version );
+    m_entities.clear( );
+    m_changes.clear( );
+    m_changeCount = 0;
+    return true;
+}
+
+void FrameRecorder::close( void )
+{
+    if ( !m_file.isOpen( ) ) return;
+    m_stream.setDevice( Q_NULLPTR );
+    m_file.close( );
+}
+
+void FrameRecorder::recordEntities( const QObjectList& data )
+{
+    if ( !m_file.isOpen( ) ) return;
+
+    QDataStream stream( &m_changes, QIODevice::WriteOnly | QIODevice::Append );
+    stream.setVersion( m_stream.version( ) );
+    stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+
+    // 只记录发生变化的字段，实体的序号按照在data中出现的顺序
+    int index = 0;
+    foreach ( QObject* object, data )
+    {
+        EntityState state;
+        if ( !entityType( object, state.type ) ) continue;
+        state.length = object->property( "length" ).toReal( );
+        state.source = object->property( "source" ).toUrl( );
+        state.translate = object->property( "translate" ).value<QVector3D>( );
+
+        quint8 fields = AllFields;
+        if ( index < m_entities.size( ) )
+        {
+            const EntityState& last = m_entities[index];
+            fields = 0;
+            if ( last.length != state.length ) fields |= LengthField;
+            if ( last.source != state.source ) fields |= SourceField;
+            if ( last.translate != state.translate ) fields |= TranslateField;
+            m_entities[index] = state;
+        }
+        else m_entities.append( state );
+
+        if ( fields != 0 )
+        {
+            stream << quint32( index ) << state.type << fields;
+            if ( fields & LengthField ) stream << state.length;
+            if ( fields & SourceField ) stream << state.source;
+            if ( fields & TranslateField ) stream << state.translate;
+            ++m_changeCount;
+        }
+        ++index;
+    }
+}
+
+void FrameRecorder::recordFrame( const QMatrix4x4& viewMatrix,
+                                 const QMatrix4x4& projectionMatrix,
+                                 const QVector3D& lightPosition,
+                                 int shadowMode )
+{
+    if ( !m_file.isOpen( ) ) return;
+
+    m_stream << quint8( FRAME_TAG )
+             << viewMatrix << projectionMatrix
+             << lightPosition << quint8( shadowMode )
+             << m_changeCount;
+    m_stream.writeRawData( m_changes.constData( ), m_changes.size( ) );
+    m_changes.clear( );
+    m_changeCount = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameReplayer::FrameReplayer( void )
+{
+    m_dataOffset = 0;
+    m_frameCount = 0;
+}
+
+bool FrameReplayer::open( const QString& fileName )
+{
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::ReadOnly ) )
+    {
+        qWarning( "FrameReplayer: cannot read %s.", qPrintable( fileName ) );
+        return false;
+    }
+    m_stream.setDevice( &m_file );
+    m_stream.setVersion( QDataStream::Qt_5_4 );
+    m_stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+
+    quint32 magic;
+    quint16 version;
+    m_stream >> magic >> version;
+    if ( magic != quint32( Magic ) || version != Version )
+    {
+        qWarning( "FrameReplayer: %s is not a frame log.", qPrintable( fileName ) );
+        return false;
+    }
+    m_dataOffset = m_file.pos( );
+
+    // 先扫描一遍得到帧数，顺便检查日志是否完整
+    m_frameCount = 0;
+    while ( next( Q_NULLPTR ) ) ++m_frameCount;
+    rewind( );
+    return m_frameCount > 0;
+}
+
+void FrameReplayer::rewind( void )
+{
+    m_file.seek( m_dataOffset );
+    m_stream.resetStatus( );
+}
+
+bool FrameReplayer::next( View* view )
+{
+    if ( m_stream.atEnd( ) ) return false;
+
+    quint8 tag, shadowMode;
+    QMatrix4x4 viewMatrix, projectionMatrix;
+    QVector3D lightPosition;
+    quint32 changeCount;
+    m_stream >> tag;
+    if ( tag != FRAME_TAG ) return false;
+    m_stream >> viewMatrix >> projectionMatrix
+             >> lightPosition >> shadowMode >> changeCount;
+
+    for ( quint32 i = 0; i < changeCount; ++i )
+    {
+        quint32 index;
+        quint8 type, fields;
+        qreal length = 0.0;
+        QUrl source;
+        QVector3D translate;
+        m_stream >> index >> type >> fields;
+        if ( fields & LengthField ) m_stream >> length;
+        if ( fields & SourceField ) m_stream >> source;
+        if ( fields & TranslateField ) m_stream >> translate;
+        if ( view == Q_NULLPTR ) continue;
+
+        // 实体只会追加，所以序号等于已有的数量时创建新的实体
+        if ( int( index ) == m_entities.size( ) )
+        {
+            QObject* entity = createEntity( type );
+            if ( entity == Q_NULLPTR ) return false;
+            QQmlListProperty<QObject> data = view->data( );
+            data.append( &data, entity );
+            m_entities.append( entity );
+        }
+        if ( int( index ) >= m_entities.size( ) ) return false;
+
+        QObject* entity = m_entities[index];
+        if ( fields & LengthField ) entity->setProperty( "length", length );
+        if ( fields & SourceField ) entity->setProperty( "source", source );
+        if ( fields & TranslateField ) entity->setProperty( "translate", translate );
+    }
+    if ( m_stream.status( ) != QDataStream::Ok ) return false;
+
+    if ( view != Q_NULLPTR )
+    {
+        view->setShadowMode( View::ShadowMode( shadowMode ) );
+        view->setLightPosition( lightPosition );
+        view->setMatrices( viewMatrix, projectionMatrix );
+    }
+    return true;
+}
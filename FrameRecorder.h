@@ -0,0 +1,95 @@
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QDataStream>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector>
+#include <QUrl>
+
+class View;
+
+// 日志格式：文件头以后是连续的帧记录，每一帧包含渲染实际使用的相机矩阵、
+// 光源位置和阴影模式，以及自上一帧以来发生变化的实体
+namespace FrameLog
+{
+    enum
+    {
+        Magic = 0x534D524C,         // "SMRL"
+        Version = 1
+    };
+
+    enum EntityType
+    {
+        CubeEntity = 0,
+        PlaneEntity,
+        TexturedCubeEntity,
+        MeshEntity                  // 只记录网格文件和位置，不包括纹理和缩放
+    };
+
+    enum EntityField
+    {
+        LengthField = 0x1,
+        SourceField = 0x2,
+        TranslateField = 0x4,
+        AllFields = LengthField | SourceField | TranslateField
+    };
+
+    struct EntityState
+    {
+        quint8          type;
+        qreal           length;
+        QUrl            source;
+        QVector3D       translate;
+    };
+}
+
+// 在渲染线程记录View::sync以及render消费的状态
+class FrameRecorder
+{
+public:
+    FrameRecorder( void );
+    ~FrameRecorder( void );
+
+    bool open( const QString& fileName );
+    void close( void );
+
+    // sync中调用，此时GUI线程被阻塞，可以读取实体的属性
+    void recordEntities( const QObjectList& data );
+    // render中调用，记录动画以后的矩阵
+    void recordFrame( const QMatrix4x4& viewMatrix,
+                      const QMatrix4x4& projectionMatrix,
+                      const QVector3D& lightPosition,
+                      int shadowMode );
+protected:
+    QFile                           m_file;
+    QDataStream                     m_stream;
+    QVector<FrameLog::EntityState>  m_entities;
+    QByteArray                      m_changes;
+    quint32                         m_changeCount;
+};
+
+// 在GUI线程读取日志，逐帧地驱动View
+class FrameReplayer
+{
+public:
+    FrameReplayer( void );
+
+    bool open( const QString& fileName );
+    int frameCount( void ) { return m_frameCount; }
+
+    // 把下一帧应用到view上，第一次遇到的实体会被创建并添加到view中。
+    // 到达结尾时返回false，rewind以后可以重新播放
+    bool next( View* view );
+    void rewind( void );
+protected:
+    QFile                           m_file;
+    QDataStream                     m_stream;
+    qint64                          m_dataOffset;
+    int                             m_frameCount;
+    QObjectList                     m_entities;
+};
+
+#endif // FRAMERECORDER_H
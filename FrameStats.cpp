@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <QOpenGLContext>
+#ifndef QT_OPENGL_ES_2
+#include <QOpenGLTimerQuery>
+#endif
+#include "FrameStats.h"
+
+#define DEFAULT_WINDOW      120
+
+///////////////////////////////////////////////////////////////////////////////
+GpuTimer::GpuTimer( void )
+{
+    m_available = false;
+    m_frame = 0;
+    for ( int i = 0; i < Latency; ++i )
+    {
+        for ( int j = 0; j < PassCount; ++j )
+        {
+            m_queries[i][j] = Q_NULLPTR;
+            m_pending[i][j] = false;
+        }
+        m_frameIndices[i] = -1;
+    }
+    for ( int j = 0; j < PassCount; ++j ) m_results[j] = -1;
+    m_resultFrame = -1;
+}
+
+GpuTimer::~GpuTimer( void )
+{
+    release( );
+}
+
+bool GpuTimer::initialize( QOpenGLContext* context )
+{
+    release( );
+#ifndef QT_OPENGL_ES_2
+    // GL_TIME_ELAPSED需要OpenGL 3.3或者GL_ARB_timer_query
+    if ( context->isOpenGLES( ) ) return false;
+    QPair<int, int> version = context->format( ).version( );
+    if ( version < qMakePair( 3, 3 ) &&
+         !context->hasExtension( "GL_ARB_timer_query" ) ) return false;
+
+    for ( int i = 0; i < Latency; ++i )
+    {
+        for ( int j = 0; j < PassCount; ++j )
+        {
+            m_queries[i][j] = new QOpenGLTimerQuery;
+            if ( !m_queries[i][j]->create( ) )
+            {
+                release( );
+                return false;
+            }
+        }
+    }
+    m_available = true;
+#else
+    Q_UNUSED( context );
+#endif
+    return m_available;
+}
+
+void GpuTimer::release( void )
+{
+#ifndef QT_OPENGL_ES_2
+    for ( int i = 0; i < Latency; ++i )
+    {
+        for ( int j = 0; j < PassCount; ++j )
+        {
+            delete m_queries[i][j];
+            m_queries[i][j] = Q_NULLPTR;
+            m_pending[i][j] = false;
+        }
+        m_frameIndices[i] = -1;
+    }
+#endif
+    for ( int j = 0; j < PassCount; ++j ) m_results[j] = -1;
+    m_resultFrame = -1;
+    m_available = false;
+}
+
+void GpuTimer::beginFrame( int frameIndex )
+{
+    if ( !m_available ) return;
+#ifndef QT_OPENGL_ES_2
+    // 读取Latency帧以前的结果，这时候通常已经完成了。
+    // 那一帧没有执行的阶段为-1，不沿用更早的结果
+    m_frame = ( m_frame + 1 ) % Latency;
+    m_resultFrame = -1;
+    for ( int j = 0; j < PassCount; ++j )
+    {
+        m_results[j] = -1;
+        if ( !m_pending[m_frame][j] ) continue;
+        m_results[j] = m_queries[m_frame][j]->waitForResult( );
+        m_pending[m_frame][j] = false;
+        m_resultFrame = m_frameIndices[m_frame];
+    }
+    m_frameIndices[m_frame] = frameIndex;
+#else
+    Q_UNUSED( frameIndex );
+#endif
+}
+
+void GpuTimer::begin( Pass pass )
+{
+    if ( !m_available ) return;
+#ifndef QT_OPENGL_ES_2
+    m_queries[m_frame][pass]->begin( );
+#endif
+}
+
+void GpuTimer::end( Pass pass )
+{
+    if ( !m_available ) return;
+#ifndef QT_OPENGL_ES_2
+    m_queries[m_frame][pass]->end( );
+    m_pending[m_frame][pass] = true;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+FrameStats::FrameStats( QObject* parent ): QObject( parent )
+{
+    m_recording = false;
+    m_window = DEFAULT_WINDOW;
+    m_frameTime = 0.0;
+    m_frameTimeP50 = m_frameTimeP95 = m_frameTimeP99 = 0.0;
+    m_syncTime = m_shadowTime = m_mainTime = 0.0;
+    m_gpuShadowTime = m_gpuMainTime = -1.0;
+    m_gpuTimingAvailable = false;
+    m_frameIndex = 0;
+    m_gpuFrameIndex = -1;
+    m_drawCalls = m_triangles = m_stateChanges = 0;
+    m_uploadBytes = 0;
+}
+
+void FrameStats::submit( const FrameSample& sample )
+{
+    m_ring.push( sample );
+
+    // 只投递一次collect，GUI线程会一次取出所有的样本
+    if ( m_collectPending.testAndSetOrdered( 0, 1 ) )
+        QMetaObject::invokeMethod( this, "collect", Qt::QueuedConnection );
+}
+
+void FrameStats::collect( void )
+{
+    m_collectPending.store( 0 );
+
+    FrameSample sample;
+    bool received = false;
+    while ( m_ring.pop( sample ) )
+    {
+        m_history.append( sample );
+        if ( m_recording ) m_recorded.append( sample );
+        received = true;
+    }
+    if ( !received ) return;
+
+    if ( m_history.size( ) > m_window )
+        m_history.remove( 0, m_history.size( ) - m_window );
+
+    qint64 frame = 0, sync = 0, shadow = 0, main = 0;
+    qint64 gpuShadow = 0, gpuMain = 0;
+    int gpuSamples = 0;
+    QVector<qint64> frameTimes;
+    frameTimes.reserve( m_history.size( ) );
+    foreach ( const FrameSample& s, m_history )
+    {
+        frame += s.frame;
+        sync += s.sync;
+        shadow += s.shadow;
+        main += s.main;
+        frameTimes.append( s.frame );
+        if ( s.gpuMain >= 0 )
+        {
+            gpuShadow += qMax( s.gpuShadow, qint64( 0 ) );
+            gpuMain += s.gpuMain;
+            ++gpuSamples;
+        }
+    }
+
+    int count = m_history.size( );
+    m_frameTime = frame / 1000000.0 / count;
+    m_syncTime = sync / 1000000.0 / count;
+    m_shadowTime = shadow / 1000000.0 / count;
+    m_mainTime = main / 1000000.0 / count;
+    m_gpuTimingAvailable = gpuSamples > 0;
+    m_gpuShadowTime = gpuSamples > 0 ? gpuShadow / 1000000.0 / gpuSamples : -1.0;
+    m_gpuMainTime = gpuSamples > 0 ? gpuMain / 1000000.0 / gpuSamples : -1.0;
+
+    std::sort( frameTimes.begin( ), frameTimes.end( ) );
+    int last = count - 1;
+    m_frameTimeP50 = frameTimes[last * 50 / 100] / 1000000.0;
+    m_frameTimeP95 = frameTimes[last * 95 / 100] / 1000000.0;
+    m_frameTimeP99 = frameTimes[last * 99 / 100] / 1000000.0;
+
+    // GPU时间标记为它们自己所属的帧，通常比最近一帧早GpuTimer::Latency帧
+    m_frameIndex = m_history.last( ).index;
+    for ( int i = m_history.size( ) - 1; i >= 0; --i )
+    {
+        if ( m_history[i].gpuIndex < 0 ) continue;
+        m_gpuFrameIndex = m_history[i].gpuIndex;
+        break;
+    }
+
+    // 绘制相关的计数取最近一帧的
+    m_drawCalls = m_history.last( ).drawCalls;
+    m_triangles = m_history.last( ).triangles;
+    m_stateChanges = m_history.last( ).stateChanges;
+    m_uploadBytes = m_history.last( ).uploadBytes;
+
+    emit updated( );
+}
+
+void FrameStats::setWindow( int window )
+{
+    window = qMax( 1, window );
+    if ( m_window == window ) return;
+    m_window = window;
+    emit windowChanged( );
+}
@@ -0,0 +1,200 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QVector>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QObject>
+
+QT_BEGIN_NAMESPACE
+class QOpenGLContext;
+class QOpenGLTimerQuery;
+QT_END_NAMESPACE
+
+// 一帧的统计数据，时间单位为纳秒，GPU时间不可用时为-1。
+// GPU时间延迟几帧才能读到，属于编号为gpuIndex的帧，而不是这一帧
+struct FrameSample
+{
+    FrameSample( void ):
+        index( 0 ), gpuIndex( -1 ),
+        frame( 0 ), sync( 0 ), shadow( 0 ), main( 0 ), depthPrepass( 0 ),
+        gpuShadow( -1 ), gpuMain( -1 ),
+        drawCalls( 0 ), triangles( 0 ), stateChanges( 0 ), occluded( 0 ),
+        uploadBytes( 0 ) { }
+
+    int                 index;              // 渲染线程的帧编号
+    int                 gpuIndex;           // gpuShadow以及gpuMain所属的帧
+    qint64              frame;
+    qint64              sync;
+    qint64              shadow;
+    qint64              main;
+    qint64              depthPrepass;       // 包含在main中
+    qint64              gpuShadow;
+    qint64              gpuMain;
+    int                 drawCalls;
+    int                 triangles;
+    int                 stateChanges;
+    int                 occluded;           // 被遮挡剔除的实体数
+    int                 uploadBytes;        // 经过StreamBuffer上传的动态数据
+};
+
+// 单生产者单消费者的无锁环形缓冲：渲染线程写入，GUI线程读出
+class FrameSampleRing
+{
+public:
+    enum { Capacity = 256 };
+
+    FrameSampleRing( void ): m_head( 0 ), m_tail( 0 ) { }
+
+    // 满了的时候丢弃新的样本
+    bool push( const FrameSample& sample )
+    {
+        int head = m_head.loadAcquire( );
+        if ( head - m_tail.loadAcquire( ) >= Capacity ) return false;
+        m_samples[head % Capacity] = sample;
+        m_head.storeRelease( head + 1 );
+        return true;
+    }
+    bool pop( FrameSample& sample )
+    {
+        int tail = m_tail.loadAcquire( );
+        if ( tail == m_head.loadAcquire( ) ) return false;
+        sample = m_samples[tail % Capacity];
+        m_tail.storeRelease( tail + 1 );
+        return true;
+    }
+protected:
+    FrameSample         m_samples[Capacity];
+    QAtomicInt          m_head, m_tail;
+};
+
+// 作用域计时，析构时把耗时累加到target上
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer( qint64& target ): m_target( target )
+    {
+        m_timer.start( );
+    }
+    ~ScopedTimer( void )
+    {
+        m_target += m_timer.nsecsElapsed( );
+    }
+protected:
+    qint64&             m_target;
+    QElapsedTimer       m_timer;
+};
+
+// 用GL_TIME_ELAPSED查询各个阶段的GPU耗时，结果延迟几帧读取以免等待
+class GpuTimer
+{
+public:
+    enum Pass
+    {
+        ShadowPass = 0,
+        MainPass,
+        PassCount
+    };
+    enum { Latency = 3 };
+
+    GpuTimer( void );
+    ~GpuTimer( void );
+
+    bool initialize( QOpenGLContext* context );
+    void release( void );
+    bool isAvailable( void ) { return m_available; }
+
+    // frameIndex是这一帧的编号，读到的结果属于resultFrame
+    void beginFrame( int frameIndex );
+    void begin( Pass pass );
+    void end( Pass pass );
+    qint64 result( Pass pass ) { return m_results[pass]; }
+    int resultFrame( void ) { return m_resultFrame; }
+protected:
+    bool                m_available;
+    int                 m_frame;
+    QOpenGLTimerQuery*  m_queries[Latency][PassCount];
+    bool                m_pending[Latency][PassCount];
+    int                 m_frameIndices[Latency];
+    qint64              m_results[PassCount];
+    int                 m_resultFrame;          // 没有结果时为-1
+};
+
+// 对QML公开滚动平均值以及百分位数
+class FrameStats: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY( int window READ window WRITE setWindow NOTIFY windowChanged )
+    Q_PROPERTY( qreal frameTime READ frameTime NOTIFY updated )
+    Q_PROPERTY( qreal frameTimeP50 READ frameTimeP50 NOTIFY updated )
+    Q_PROPERTY( qreal frameTimeP95 READ frameTimeP95 NOTIFY updated )
+    Q_PROPERTY( qreal frameTimeP99 READ frameTimeP99 NOTIFY updated )
+    Q_PROPERTY( qreal syncTime READ syncTime NOTIFY updated )
+    Q_PROPERTY( qreal shadowTime READ shadowTime NOTIFY updated )
+    Q_PROPERTY( qreal mainTime READ mainTime NOTIFY updated )
+    Q_PROPERTY( qreal gpuShadowTime READ gpuShadowTime NOTIFY updated )
+    Q_PROPERTY( qreal gpuMainTime READ gpuMainTime NOTIFY updated )
+    Q_PROPERTY( bool gpuTimingAvailable READ gpuTimingAvailable NOTIFY updated )
+    Q_PROPERTY( int frameIndex READ frameIndex NOTIFY updated )
+    Q_PROPERTY( int gpuFrameIndex READ gpuFrameIndex NOTIFY updated )
+    Q_PROPERTY( int drawCalls READ drawCalls NOTIFY updated )
+    Q_PROPERTY( int triangles READ triangles NOTIFY updated )
+    Q_PROPERTY( int stateChanges READ stateChanges NOTIFY updated )
+    Q_PROPERTY( int uploadBytes READ uploadBytes NOTIFY updated )
+public:
+    explicit FrameStats( QObject* parent = Q_NULLPTR );
+
+    // 渲染线程调用
+    void submit( const FrameSample& sample );
+
+    // 保留所有样本，供benchmark使用
+    void setRecording( bool recording ) { m_recording = recording; }
+    const QVector<FrameSample>& recorded( void ) { return m_recorded; }
+
+    int window( void ) { return m_window; }
+    void setWindow( int window );
+
+    // 毫秒
+    qreal frameTime( void ) { return m_frameTime; }
+    qreal frameTimeP50( void ) { return m_frameTimeP50; }
+    qreal frameTimeP95( void ) { return m_frameTimeP95; }
+    qreal frameTimeP99( void ) { return m_frameTimeP99; }
+    qreal syncTime( void ) { return m_syncTime; }
+    qreal shadowTime( void ) { return m_shadowTime; }
+    qreal mainTime( void ) { return m_mainTime; }
+    qreal gpuShadowTime( void ) { return m_gpuShadowTime; }
+    qreal gpuMainTime( void ) { return m_gpuMainTime; }
+    bool gpuTimingAvailable( void ) { return m_gpuTimingAvailable; }
+    // 最近一帧的编号，以及最近读到的GPU时间所属的帧
+    int frameIndex( void ) { return m_frameIndex; }
+    int gpuFrameIndex( void ) { return m_gpuFrameIndex; }
+    int drawCalls( void ) { return m_drawCalls; }
+    int triangles( void ) { return m_triangles; }
+    int stateChanges( void ) { return m_stateChanges; }
+    int uploadBytes( void ) { return m_uploadBytes; }
+signals:
+    void windowChanged( void );
+    void updated( void );
+public slots:
+    // GUI线程：取出缓冲中的样本并重新计算
+    void collect( void );
+protected:
+    FrameSampleRing         m_ring;
+    QAtomicInt              m_collectPending;
+
+    QVector<FrameSample>    m_history;
+    QVector<FrameSample>    m_recorded;
+    bool                    m_recording;
+    int                     m_window;
+
+    qreal                   m_frameTime;
+    qreal                   m_frameTimeP50, m_frameTimeP95, m_frameTimeP99;
+    qreal                   m_syncTime, m_shadowTime, m_mainTime;
+    qreal                   m_gpuShadowTime, m_gpuMainTime;
+    bool                    m_gpuTimingAvailable;
+    int                     m_frameIndex, m_gpuFrameIndex;
+    int                     m_drawCalls, m_triangles, m_stateChanges;
+    int                     m_uploadBytes;
+};
+
+#endif // FRAMESTATS_H
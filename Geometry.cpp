@@ -0,0 +1,238 @@
+#include "Geometry.h"
+
+///////////////////////////////////////////////////////////////////////////////
+void Geometry::index( const QVector<Vertex>& triangles, MeshData& mesh )
+{
+    // 合并完全相同的顶点，立方体的36个顶点变成24个。
+    // 顶点数很少，直接线性查找
+    mesh.positions.clear( );
+    mesh.normals.clear( );
+    mesh.texCoords.clear( );
+    mesh.indices.clear( );
+    mesh.indices.reserve( triangles.size( ) );
+
+    foreach ( const Vertex& vertex, triangles )
+    {
+        int i = 0;
+        for ( ; i < mesh.positions.size( ); ++i )
+        {
+            if ( mesh.positions[i] == vertex.position &&
+                 mesh.normals[i] == vertex.normal &&
+                 mesh.texCoords[i] == vertex.texCoord ) break;
+        }
+        if ( i == mesh.positions.size( ) )
+        {
+            mesh.positions.append( vertex.position );
+            mesh.normals.append( vertex.normal );
+            mesh.texCoords.append( vertex.texCoord );
+        }
+        mesh.indices.append( quint16( i ) );
+    }
+}
+
+void Geometry::cube( float length, MeshData& mesh )
+{
+    float semi = length / 2.0f;
+    const QVector3D basicVertices[] =
+    {
+        QVector3D( semi, -semi, semi ),
+        QVector3D( semi, -semi, -semi ),
+        QVector3D( -semi, -semi, -semi ),
+        QVector3D( -semi, -semi, semi ),
+        QVector3D( semi, semi, semi ),
+        QVector3D( semi, semi, -semi ),
+        QVector3D( -semi, semi, -semi ),
+        QVector3D( -semi, semi, semi )
+    };
+
+    const QVector3D normals[] =
+    {
+        QVector3D( 1.0, 0.0, 0.0 ),
+        QVector3D( 0.0, 1.0, 0.0 ),
+        QVector3D( 0.0, 0.0, 1.0 ),
+        QVector3D( -1.0, 0.0, 0.0 ),
+        QVector3D( 0.0, -1.0, 0.0 ),
+        QVector3D( 0.0, 0.0, -1.0 )
+    };
+
+    const QVector2D texCoords[] =
+    {
+        QVector2D( 0.0, 0.0 ),
+        QVector2D( 0.0, 1.0 ),
+        QVector2D( 1.0, 0.0 ),
+        QVector2D( 1.0, 1.0 )
+    };
+
+    QVector<Vertex> triangles( 36 );
+    Vertex* v = triangles.data( );
+
+    // 前面
+    v[0].set( basicVertices[7], normals[2], texCoords[2] );
+    v[1].set( basicVertices[3], normals[2], texCoords[0] );
+    v[2].set( basicVertices[0], normals[2], texCoords[1] );
+    v[3].set( basicVertices[4], normals[2], texCoords[3] );
+    v[4].set( basicVertices[7], normals[2], texCoords[2] );
+    v[5].set( basicVertices[0], normals[2], texCoords[1] );
+
+    // 后面
+    v[6].set( basicVertices[5], normals[5], texCoords[2] );
+    v[7].set( basicVertices[2], normals[5], texCoords[1] );
+    v[8].set( basicVertices[6], normals[5], texCoords[3] );
+    v[9].set( basicVertices[5], normals[5], texCoords[2] );
+    v[10].set( basicVertices[1], normals[5], texCoords[0] );
+    v[11].set( basicVertices[2], normals[5], texCoords[1] );
+
+    // 上面
+    v[12].set( basicVertices[4], normals[1], texCoords[2] );
+    v[13].set( basicVertices[5], normals[1], texCoords[3] );
+    v[14].set( basicVertices[6], normals[1], texCoords[1] );
+    v[15].set( basicVertices[4], normals[1], texCoords[2] );
+    v[16].set( basicVertices[6], normals[1], texCoords[1] );
+    v[17].set( basicVertices[7], normals[1], texCoords[0] );
+
+    // 下面
+    v[18].set( basicVertices[0], normals[4], texCoords[3] );
+    v[19].set( basicVertices[2], normals[4], texCoords[0] );
+    v[20].set( basicVertices[1], normals[4], texCoords[1] );
+    v[21].set( basicVertices[0], normals[4], texCoords[3] );
+    v[22].set( basicVertices[3], normals[4], texCoords[2] );
+    v[23].set( basicVertices[2], normals[4], texCoords[0] );
+
+    // 左面
+    v[24].set( basicVertices[2], normals[3], texCoords[0] );
+    v[25].set( basicVertices[3], normals[3], texCoords[1] );
+    v[26].set( basicVertices[7], normals[3], texCoords[3] );
+    v[27].set( basicVertices[2], normals[3], texCoords[0] );
+    v[28].set( basicVertices[7], normals[3], texCoords[3] );
+    v[29].set( basicVertices[6], normals[3], texCoords[2] );
+
+    // 右面
+    v[30].set( basicVertices[4], normals[0], texCoords[2] );
+    v[31].set( basicVertices[1], normals[0], texCoords[1] );
+    v[32].set( basicVertices[5], normals[0], texCoords[3] );
+    v[33].set( basicVertices[1], normals[0], texCoords[1] );
+    v[34].set( basicVertices[4], normals[0], texCoords[2] );
+    v[35].set( basicVertices[0], normals[0], texCoords[0] );
+
+    index( triangles, mesh );
+}
+
+void Geometry::plane( float length, MeshData& mesh )
+{
+    float semi = length / 2.0f;
+    const QVector3D corners[] =
+    {
+        QVector3D( semi, 0.0f, -semi ),
+        QVector3D( semi, 0.0f, semi ),
+        QVector3D( -semi, 0.0f, -semi ),
+        QVector3D( -semi, 0.0f, semi )
+    };
+
+    const QVector2D texCoords[] =
+    {
+        QVector2D( 0.0, 0.0 ),
+        QVector2D( 0.0, 1.0 ),
+        QVector2D( 1.0, 0.0 ),
+        QVector2D( 1.0, 1.0 )
+    };
+
+    QVector<Vertex> triangles( 6 );
+    Vertex* v = triangles.data( );
+
+    v[0].set( corners[2], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[1] );
+    v[1].set( corners[1], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[2] );
+    v[2].set( corners[0], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[0] );
+    v[3].set( corners[2], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[1] );
+    v[4].set( corners[3], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[3] );
+    v[5].set( corners[1], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[2] );
+
+    index( triangles, mesh );
+}
+
+void Geometry::texturedCube( float length, MeshData& mesh )
+{
+    // 与cube的面的顺序以及纹理坐标不同
+    float semi = length / 2.0f;
+    const QVector3D basicVertices[] =
+    {
+        QVector3D( semi, -semi, semi ),
+        QVector3D( semi, -semi, -semi ),
+        QVector3D( -semi, -semi, -semi ),
+        QVector3D( -semi, -semi, semi ),
+        QVector3D( semi, semi, semi ),
+        QVector3D( semi, semi, -semi ),
+        QVector3D( -semi, semi, -semi ),
+        QVector3D( -semi, semi, semi )
+    };
+
+    const QVector3D normals[] =
+    {
+        QVector3D( 1.0, 0.0, 0.0 ),
+        QVector3D( 0.0, 1.0, 0.0 ),
+        QVector3D( 0.0, 0.0, 1.0 ),
+        QVector3D( -1.0, 0.0, 0.0 ),
+        QVector3D( 0.0, -1.0, 0.0 ),
+        QVector3D( 0.0, 0.0, -1.0 )
+    };
+
+    const QVector2D texCoords[] =
+    {
+        QVector2D( 0.0, 0.0 ),
+        QVector2D( 0.0, 1.0 ),
+        QVector2D( 1.0, 0.0 ),
+        QVector2D( 1.0, 1.0 )
+    };
+
+    QVector<Vertex> triangles( 36 );
+    Vertex* v = triangles.data( );
+
+    // 前面
+    v[0].set( basicVertices[6], normals[2], texCoords[0] );
+    v[1].set( basicVertices[2], normals[2], texCoords[1] );
+    v[2].set( basicVertices[5], normals[2], texCoords[2] );
+    v[3].set( basicVertices[2], normals[2], texCoords[1] );
+    v[4].set( basicVertices[1], normals[2], texCoords[3] );
+    v[5].set( basicVertices[5], normals[2], texCoords[2] );
+
+    // 后面
+    v[6].set( basicVertices[4], normals[4], texCoords[0] );
+    v[7].set( basicVertices[0], normals[4], texCoords[1] );
+    v[8].set( basicVertices[7], normals[4], texCoords[2] );
+    v[9].set( basicVertices[0], normals[4], texCoords[1] );
+    v[10].set( basicVertices[3], normals[4], texCoords[3] );
+    v[11].set( basicVertices[7], normals[4], texCoords[2] );
+
+    // 上面
+    v[12].set( basicVertices[2], normals[1], texCoords[0] );
+    v[13].set( basicVertices[3], normals[1], texCoords[1] );
+    v[14].set( basicVertices[1], normals[1], texCoords[2] );
+    v[15].set( basicVertices[3], normals[1], texCoords[1] );
+    v[16].set( basicVertices[0], normals[1], texCoords[3] );
+    v[17].set( basicVertices[1], normals[1], texCoords[2] );
+
+    // 下面
+    v[18].set( basicVertices[7], normals[5], texCoords[0] );
+    v[19].set( basicVertices[6], normals[5], texCoords[1] );
+    v[20].set( basicVertices[4], normals[5], texCoords[2] );
+    v[21].set( basicVertices[6], normals[5], texCoords[1] );
+    v[22].set( basicVertices[5], normals[5], texCoords[3] );
+    v[23].set( basicVertices[4], normals[5], texCoords[2] );
+
+    // 左面
+    v[24].set( basicVertices[7], normals[3], texCoords[0] );
+    v[25].set( basicVertices[3], normals[3], texCoords[1] );
+    v[26].set( basicVertices[6], normals[3], texCoords[2] );
+    v[27].set( basicVertices[3], normals[3], texCoords[1] );
+    v[28].set( basicVertices[2], normals[3], texCoords[3] );
+    v[29].set( basicVertices[6], normals[3], texCoords[2] );
+
+    // 右面
+    v[30].set( basicVertices[5], normals[2], texCoords[0] );
+    v[31].set( basicVertices[1], normals[2], texCoords[1] );
+    v[32].set( basicVertices[4], normals[2], texCoords[2] );
+    v[33].set( basicVertices[1], normals[2], texCoords[1] );
+    v[34].set( basicVertices[0], normals[2], texCoords[3] );
+    v[35].set( basicVertices[4], normals[2], texCoords[2] );
+
+    index( triangles, mesh );
+}
@@ -0,0 +1,48 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+
+// 立方体和平面的网格数据，各个渲染器以及静态合批共用
+namespace Geometry
+{
+    struct Vertex
+    {
+        void set( const QVector3D& _position, const QVector3D& _normal,
+                  const QVector2D& _texCoord )
+        {
+            position = _position;
+            normal = _normal;
+            texCoord = _texCoord;
+        }
+
+        QVector3D               position;
+        QVector3D               normal;
+        QVector2D               texCoord;
+    };
+
+    // 带索引的网格，各个属性分开存放
+    struct MeshData
+    {
+        QVector<QVector3D>      positions;
+        QVector<QVector3D>      normals;
+        QVector<QVector2D>      texCoords;
+        QVector<quint16>        indices;
+    };
+
+    // 把三角形列表中重复的顶点合并，生成索引
+    void index( const QVector<Vertex>& triangles, MeshData& mesh );
+
+    // 以原点为中心、边长为length的立方体，24个顶点
+    void cube( float length, MeshData& mesh );
+
+    // 位于XZ平面、法线朝上的正方形，4个顶点
+    void plane( float length, MeshData& mesh );
+
+    // TexturedCube使用的立方体，面的纹理坐标与cube不同
+    void texturedCube( float length, MeshData& mesh );
+}
+
+#endif // GEOMETRY_H
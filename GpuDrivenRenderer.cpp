@@ -0,0 +1,517 @@
+#include <QMap>
+#include <QFile>
+#include <QImage>
+#include <QQmlFile>
+#include <QOpenGLContext>
+#include <QOpenGLTexture>
+#include <QOpenGLShaderProgram>
+#include "BVH.h"
+#include "Cube.h"
+#include "Geometry.h"
+#include "MeshBuffer.h"
+#include "ShadowCubeMap.h"
+#include "StreamBuffer.h"
+#include "View.h"
+#include "GpuDrivenRenderer.h"
+
+// ES上没有计算着色器以及间接绘制，只编译回退的路径
+#ifndef QT_OPENGL_ES_2
+#include <QOpenGLFunctions_4_3_Core>
+#define GPU_DRIVEN
+#endif
+
+#define TEXTURE_UNIT        GL_TEXTURE0
+#define SHADOW_TEXTURE_UNIT GL_TEXTURE1
+#define SHADOW_CUBE_TEXTURE_UNIT GL_TEXTURE2
+#define CULL_GROUP_SIZE     64          // 与Cull.comp中的local_size_x一致
+
+// 一帧中最多的pass数：主渲染、每个光源的阴影以及点光源阴影的六个面
+#define MAX_PASSES          ( 1 + MAX_LIGHTS + ShadowCubeMap::FaceCount )
+
+// glMultiDrawElementsIndirect的命令格式，与Cull.comp中的DrawCommand一致
+struct DrawCommand
+{
+    GLuint          count;
+    GLuint          instanceCount;
+    GLuint          firstIndex;
+    GLint           baseVertex;
+    GLuint          baseInstance;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+GpuDrivenRenderer::GpuDrivenRenderer( void )
+{
+    m_functions = Q_NULLPTR;
+    m_instanceBuffer = m_commandBuffer = 0;
+    m_capacity = 0;
+    m_pass = 0;
+    m_warned = false;
+    m_enabled = false;
+    m_generation = 0;
+    m_cube = Q_NULLPTR;
+    m_cullProgram = m_program = m_depthProgram = Q_NULLPTR;
+    m_layeredDepthProgram = Q_NULLPTR;
+}
+
+GpuDrivenRenderer::~GpuDrivenRenderer( void )
+{
+    release( );
+}
+
+void GpuDrivenRenderer::initialize( QOpenGLContext* context )
+{
+#ifdef GPU_DRIVEN
+    if ( context->isOpenGLES( ) ||
+         context->format( ).version( ) < qMakePair( 4, 3 ) ) return;
+    QOpenGLFunctions_4_3_Core* functions =
+            context->versionFunctions<QOpenGLFunctions_4_3_Core>( );
+    if ( functions == Q_NULLPTR || !functions->initializeOpenGLFunctions( ) ) return;
+
+    m_cullProgram = new QOpenGLShaderProgram;
+    m_cullProgram->addShaderFromSourceFile( QOpenGLShader::Compute, ":/Cull.comp" );
+    m_program = new QOpenGLShaderProgram;
+    m_program->addShaderFromSourceFile( QOpenGLShader::Vertex, ":/Indirect.vert" );
+    m_program->addShaderFromSourceFile( QOpenGLShader::Fragment, ":/Common.frag" );
+    m_depthProgram = new QOpenGLShaderProgram;
+    m_depthProgram->addShaderFromSourceFile( QOpenGLShader::Vertex, ":/IndirectDepth.vert" );
+    m_depthProgram->addShaderFromSourceFile( QOpenGLShader::Fragment, ":/Depth.frag" );
+    bool linked = m_cullProgram->link( );
+    linked = m_program->link( ) && linked;
+    linked = m_depthProgram->link( ) && linked;
+    if ( !linked )
+    {
+        qWarning( "GpuDrivenRenderer: failed to link the shaders, "
+                  "falling back to per-entity rendering" );
+        delete m_cullProgram;
+        delete m_program;
+        delete m_depthProgram;
+        m_cullProgram = m_program = m_depthProgram = Q_NULLPTR;
+        return;
+    }
+
+    m_program->bind( );
+    m_positionLoc = m_program->attributeLocation( "position" );
+    m_normalLoc = m_program->attributeLocation( "normal" );
+    m_texCoordLoc = m_program->attributeLocation( "texCoord" );
+    m_instanceLoc = m_program->attributeLocation( "instance" );
+    m_viewMatrixLoc = m_program->uniformLocation( "viewMatrix" );
+    m_projectionMatrixLoc = m_program->uniformLocation( "projectionMatrix" );
+    m_shadowTypeLoc = m_program->uniformLocation( "shadowType" );
+    m_lightUniforms.resolve( m_program );
+    m_program->setUniformValue( m_program->uniformLocation( "texture" ),
+                                TEXTURE_UNIT - GL_TEXTURE0 );
+    m_program->setUniformValue( m_program->uniformLocation( "shadowTexture" ),
+                                SHADOW_TEXTURE_UNIT - GL_TEXTURE0 );
+    m_program->setUniformValue( m_program->uniformLocation( "shadowCubeTexture" ),
+                                SHADOW_CUBE_TEXTURE_UNIT - GL_TEXTURE0 );
+    m_program->release( );
+    m_depthPositionLoc = m_depthProgram->attributeLocation( "position" );
+    m_depthInstanceLoc = m_depthProgram->attributeLocation( "instance" );
+
+    // 点光源阴影的单遍渲染，几何着色器以及片段着色器与View的分层程序相同。
+    // 链接失败时View逐面调用renderShadow
+    QFile file( ":/Depth.frag" );
+    file.open( QIODevice::ReadOnly );
+    QByteArray fragment = file.readAll( );
+    fragment.prepend( "#version 150\n#define DEPTH_LAYERED\n" );
+    m_layeredDepthProgram = new QOpenGLShaderProgram;
+    bool layered = m_layeredDepthProgram->addShaderFromSourceFile(
+                QOpenGLShader::Vertex, ":/IndirectDepthLayered.vert" ) &&
+            m_layeredDepthProgram->addShaderFromSourceFile(
+                QOpenGLShader::Geometry, ":/DepthLayered.geom" ) &&
+            m_layeredDepthProgram->addShaderFromSourceCode(
+                QOpenGLShader::Fragment, fragment ) &&
+            m_layeredDepthProgram->link( );
+    if ( layered )
+    {
+        m_layeredPositionLoc = m_layeredDepthProgram->attributeLocation( "position" );
+        m_layeredInstanceLoc = m_layeredDepthProgram->attributeLocation( "instance" );
+    }
+    else
+    {
+        delete m_layeredDepthProgram;
+        m_layeredDepthProgram = Q_NULLPTR;
+    }
+
+    // 实例的边长放在属性中，单位立方体的顶点乘以边长就是Cube的几何体
+    Geometry::MeshData data;
+    Geometry::cube( 1.0f, data );
+    m_cube = new MeshBuffer;
+    m_cube->create( data, QOpenGLBuffer::StaticDraw );
+
+    functions->glGenBuffers( 1, &m_instanceBuffer );
+    functions->glGenBuffers( 1, &m_commandBuffer );
+    m_functions = functions;
+#else
+    Q_UNUSED( context );
+#endif
+}
+
+void GpuDrivenRenderer::release( void )
+{
+    if ( !isSupported( ) ) return;
+    qDeleteAll( m_textures );
+    m_textures.clear( );
+    m_slots.clear( );
+    m_instances.clear( );
+    m_instanceObjects.clear( );
+    m_instanceGroups.clear( );
+    m_groups.clear( );
+    m_enabled = false;
+    delete m_cube;
+    delete m_cullProgram;
+    delete m_program;
+    delete m_depthProgram;
+    delete m_layeredDepthProgram;
+    m_cube = Q_NULLPTR;
+    m_cullProgram = m_program = m_depthProgram = Q_NULLPTR;
+    m_layeredDepthProgram = Q_NULLPTR;
+#ifdef GPU_DRIVEN
+    m_functions->glDeleteBuffers( 1, &m_instanceBuffer );
+    m_functions->glDeleteBuffers( 1, &m_commandBuffer );
+#endif
+    m_instanceBuffer = m_commandBuffer = 0;
+    m_capacity = 0;
+    m_functions = Q_NULLPTR;
+}
+
+void GpuDrivenRenderer::update( const QObjectList& data, const QSet<Cube*>& changed,
+                                bool enabled, StreamBuffer* stream )
+{
+    if ( !isSupported( ) )
+    {
+        if ( enabled && !m_warned )
+        {
+            qWarning( "GpuDrivenRenderer: gpuCulling requires desktop OpenGL 4.3, "
+                      "falling back to per-entity rendering" );
+            m_warned = true;
+        }
+        return;
+    }
+
+    // 移动或者缩放只改写自己的实例；加入、退出接管或者换纹理需要重新分组，这些很少发生
+    bool relayout = enabled != m_enabled;
+    int first = m_instances.size( ), last = -1;
+    if ( enabled && !relayout )
+    {
+        foreach ( Cube* cube, changed )
+        {
+            int slot = m_slots.value( cube, -1 );
+            if ( slot < 0 )
+            {
+                relayout = isEligible( cube );
+                if ( relayout ) break;
+                continue;
+            }
+            if ( !isEligible( cube ) ||
+                 m_groups[m_instanceGroups[slot]].source != cube->source( ) )
+            {
+                relayout = true;
+                break;
+            }
+            QVector4D instance( cube->translate( ), float( cube->length( ) ) );
+            if ( m_instances[slot] == instance ) continue;
+            m_instances[slot] = instance;
+            first = qMin( first, slot );
+            last = qMax( last, slot );
+        }
+    }
+
+    if ( relayout )
+    {
+        m_enabled = enabled;
+        rebuild( enabled ? data : QObjectList( ) );
+        first = 0;
+        last = m_instances.size( ) - 1;
+        ++m_generation;
+    }
+    else if ( last >= first ) ++m_generation;
+    if ( last < first ) return;
+
+    // 变化的实例之间的部分一起上传，通常远小于整个缓存
+    stream->upload( m_instanceBuffer, int( first * sizeof( QVector4D ) ),
+                    m_instances.constData( ) + first,
+                    int( ( last - first + 1 ) * sizeof( QVector4D ) ) );
+}
+
+bool GpuDrivenRenderer::isEligible( Cube* cube )
+{
+    // 只接管动态的立方体，阴影标志与默认不同的仍由CubeRenderer绘制
+    return !cube->staticGeometry( ) && cube->castShadows( ) && cube->receiveShadows( );
+}
+
+void GpuDrivenRenderer::rebuild( const QObjectList& data )
+{
+    // 按纹理分组，QMap保证每次的顺序相同
+    QMap<QUrl, QVector<Cube*> > sources;
+    foreach ( QObject* object, data )
+    {
+        Cube* cube = qobject_cast<Cube*>( object );
+        if ( cube != Q_NULLPTR && isEligible( cube ) ) sources[cube->source( )].append( cube );
+    }
+
+    m_slots.clear( );
+    m_instances.clear( );
+    m_instanceObjects.clear( );
+    m_instanceGroups.clear( );
+    m_groups.clear( );
+    for ( QMap<QUrl, QVector<Cube*> >::const_iterator it = sources.constBegin( );
+          it != sources.constEnd( ); ++it )
+    {
+        Group group;
+        group.source = it.key( );
+        group.first = m_instances.size( );
+        group.count = it.value( ).size( );
+        foreach ( Cube* cube, it.value( ) )
+        {
+            m_slots.insert( cube, m_instances.size( ) );
+            m_instances.append( QVector4D( cube->translate( ), float( cube->length( ) ) ) );
+            m_instanceObjects.append( cube );
+            m_instanceGroups.append( m_groups.size( ) );
+        }
+        m_groups.append( group );
+        texture( group.source );
+    }
+
+    // 不再使用的纹理
+    for ( QHash<QUrl, QOpenGLTexture*>::iterator it = m_textures.begin( );
+          it != m_textures.end( ); )
+    {
+        if ( sources.contains( it.key( ) ) )
+        {
+            ++it;
+            continue;
+        }
+        delete it.value( );
+        it = m_textures.erase( it );
+    }
+    reserve( m_instances.size( ) );
+}
+
+QObject* GpuDrivenRenderer::intersectRay( const QVector3D& origin,
+                                          const QVector3D& direction, float* distance )
+{
+    // 只在点击时调用，逐个测试实例
+    QVector3D inverseDirection(
+                qFuzzyIsNull( direction.x( ) ) ? 1e30f : 1.0f / direction.x( ),
+                qFuzzyIsNull( direction.y( ) ) ? 1e30f : 1.0f / direction.y( ),
+                qFuzzyIsNull( direction.z( ) ) ? 1e30f : 1.0f / direction.z( ) );
+    QObject* nearest = Q_NULLPTR;
+    float nearestDistance = *distance;
+    for ( int i = 0; i < m_instances.size( ); ++i )
+    {
+        const QVector4D& instance = m_instances[i];
+        QVector3D extent( instance.w( ), instance.w( ), instance.w( ) );
+        AABB box( instance.toVector3D( ) - extent * 0.5f,
+                  instance.toVector3D( ) + extent * 0.5f );
+        float entry;
+        if ( BVH::intersectBox( box, origin, inverseDirection, nearestDistance, &entry ) &&
+             entry < nearestDistance )
+        {
+            nearestDistance = entry;
+            nearest = m_instanceObjects[i];
+        }
+    }
+    *distance = nearestDistance;
+    return nearest;
+}
+
+void GpuDrivenRenderer::reserve( int count )
+{
+    if ( count <= m_capacity ) return;
+    m_capacity = qMax( count, m_capacity * 2 );
+#ifdef GPU_DRIVEN
+    // 命令缓存为每个pass保留一段，由计算着色器写入
+    m_functions->glBindBuffer( GL_ARRAY_BUFFER, m_instanceBuffer );
+    m_functions->glBufferData( GL_ARRAY_BUFFER, m_capacity * sizeof( QVector4D ),
+                               Q_NULLPTR, GL_DYNAMIC_DRAW );
+    m_functions->glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    m_functions->glBindBuffer( GL_DRAW_INDIRECT_BUFFER, m_commandBuffer );
+    m_functions->glBufferData( GL_DRAW_INDIRECT_BUFFER,
+                               m_capacity * MAX_PASSES * sizeof( DrawCommand ),
+                               Q_NULLPTR, GL_DYNAMIC_COPY );
+    m_functions->glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+#endif
+}
+
+QOpenGLTexture* GpuDrivenRenderer::texture( const QUrl& source )
+{
+    QOpenGLTexture*& texture = m_textures[source];
+    if ( texture == Q_NULLPTR )
+    {
+        QString imagePath = QQmlFile::urlToLocalFileOrQrc( source );
+        texture = new QOpenGLTexture( QImage( imagePath ).mirrored( ) );
+        texture->setMinificationFilter( QOpenGLTexture::LinearMipMapLinear );
+        texture->setMagnificationFilter( QOpenGLTexture::Linear );
+    }
+    return texture;
+}
+
+int GpuDrivenRenderer::cull( View* view, const QMatrix4x4& viewProjectionMatrix )
+{
+    if ( m_pass >= MAX_PASSES ) return -1;
+
+    QVector4D planes[6];
+    BVH::extractPlanes( viewProjectionMatrix, planes );
+    m_cullProgram->bind( );
+    m_cullProgram->setUniformValueArray( "planes", planes, 6 );
+    m_cullProgram->setUniformValue( "instanceCount", m_instances.size( ) );
+    m_cullProgram->setUniformValue( "commandOffset", m_pass * m_capacity );
+    m_cullProgram->setUniformValue( "indexCount", m_cube->indexCount( ) );
+#ifdef GPU_DRIVEN
+    m_functions->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer );
+    m_functions->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, m_commandBuffer );
+    m_functions->glDispatchCompute( GLuint( ( m_instances.size( ) + CULL_GROUP_SIZE - 1 ) /
+                                            CULL_GROUP_SIZE ), 1, 1 );
+
+    // 间接绘制读取命令之前计算着色器必须写完
+    m_functions->glMemoryBarrier( GL_COMMAND_BARRIER_BIT );
+    m_functions->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, 0 );
+    m_functions->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, 0 );
+#endif
+    m_cullProgram->release( );
+    // 着色器、四个uniform以及两个SSBO
+    view->countStateChanges( 7 );
+    return m_pass++;
+}
+
+int GpuDrivenRenderer::bindInstances( QOpenGLShaderProgram* program, int instanceLoc )
+{
+#ifdef GPU_DRIVEN
+    // 除数为1，每个实例取一个属性，间接命令的baseInstance就是实例的下标
+    m_functions->glBindBuffer( GL_ARRAY_BUFFER, m_instanceBuffer );
+    program->enableAttributeArray( instanceLoc );
+    program->setAttributeBuffer( instanceLoc, GL_FLOAT, 0, 4 );
+    m_functions->glVertexAttribDivisor( GLuint( instanceLoc ), 1 );
+    m_functions->glBindBuffer( GL_DRAW_INDIRECT_BUFFER, m_commandBuffer );
+    return 2;
+#else
+    Q_UNUSED( program );
+    Q_UNUSED( instanceLoc );
+    return 0;
+#endif
+}
+
+void GpuDrivenRenderer::releaseInstances( QOpenGLShaderProgram* program, int instanceLoc )
+{
+#ifdef GPU_DRIVEN
+    // 其它渲染器不使用实例属性，恢复默认的除数
+    m_functions->glVertexAttribDivisor( GLuint( instanceLoc ), 0 );
+    program->disableAttributeArray( instanceLoc );
+    m_functions->glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+#else
+    Q_UNUSED( program );
+    Q_UNUSED( instanceLoc );
+#endif
+}
+
+void GpuDrivenRenderer::drawIndirect( int pass, int first, int count )
+{
+#ifdef GPU_DRIVEN
+    quintptr offset = quintptr( pass * m_capacity + first ) * sizeof( DrawCommand );
+    m_functions->glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_SHORT,
+                                              reinterpret_cast<const void*>( offset ),
+                                              count, 0 );
+#else
+    Q_UNUSED( pass );
+    Q_UNUSED( first );
+    Q_UNUSED( count );
+#endif
+}
+
+void GpuDrivenRenderer::render( View* view )
+{
+    if ( m_instances.isEmpty( ) ) return;
+    int pass = cull( view, view->projectionMatrix( ) * view->viewMatrix( ) );
+    if ( pass < 0 ) return;
+
+    View::ShadowMode shadowMode = View::ShadowMode( view->renderShadowMode( ) );
+    m_program->bind( );
+    m_program->setUniformValue( m_viewMatrixLoc, view->viewMatrix( ) );
+    m_program->setUniformValue( m_projectionMatrixLoc, view->projectionMatrix( ) );
+    m_program->setUniformValue( m_shadowTypeLoc, int( shadowMode ) );
+    // 着色器、三个uniform以及光源数组
+    int changes = 4 + m_lightUniforms.apply( m_program, view );
+    if ( shadowMode != View::NoShadow )
+    {
+        QOpenGLFunctions* f = QOpenGLContext::currentContext( )->functions( );
+        f->glActiveTexture( SHADOW_TEXTURE_UNIT );
+        f->glBindTexture( GL_TEXTURE_2D, view->shadowTexture( ) );
+        if ( shadowMode == View::PointShadow )
+        {
+            f->glActiveTexture( SHADOW_CUBE_TEXTURE_UNIT );
+            f->glBindTexture( GL_TEXTURE_CUBE_MAP, view->shadowCubeTexture( ) );
+        }
+        f->glActiveTexture( TEXTURE_UNIT );
+        changes += shadowMode == View::PointShadow ? 2 : 1;
+    }
+
+    // 没有纹理数组，每种纹理一次间接绘制。剔除的结果留在GPU上，不统计三角形数
+    changes += m_cube->bind( m_program, m_positionLoc, m_normalLoc, m_texCoordLoc );
+    changes += bindInstances( m_program, m_instanceLoc );
+    view->countStateChanges( changes );
+    foreach ( const Group& group, m_groups )
+    {
+        QOpenGLTexture* groupTexture = m_textures.value( group.source );
+        groupTexture->bind( );
+        drawIndirect( pass, group.first, group.count );
+        groupTexture->release( );
+        view->countStateChanges( 1 );
+        view->countDrawCall( 0 );
+    }
+    releaseInstances( m_program, m_instanceLoc );
+    MeshBuffer::release( );
+    m_program->release( );
+}
+
+void GpuDrivenRenderer::renderShadow( View* view, const QMatrix4x4& lightViewProjectionMatrix,
+                                      const QVector4D& pointLight )
+{
+    if ( m_instances.isEmpty( ) ) return;
+    int pass = cull( view, lightViewProjectionMatrix );
+    if ( pass < 0 ) return;
+
+    // 阴影不需要纹理，所有实例一次绘制
+    bool variance = view->renderShadowMode( ) == View::VarianceShadow;
+    m_depthProgram->bind( );
+    m_depthProgram->setUniformValue( "viewProjectionMatrix", lightViewProjectionMatrix );
+    m_depthProgram->setUniformValue( "pointLight", pointLight );
+    m_depthProgram->setUniformValue( "moments", int( variance ) );
+    int changes = m_cube->bindPositions( m_depthProgram, m_depthPositionLoc );
+    changes += bindInstances( m_depthProgram, m_depthInstanceLoc );
+    drawIndirect( pass, 0, m_instances.size( ) );
+    releaseInstances( m_depthProgram, m_depthInstanceLoc );
+    MeshBuffer::release( );
+    view->countDrawCall( 0 );
+
+    // 着色器以及三个uniform，再加上重新绑定View的深度着色器
+    view->depthProgram( )->bind( );
+    view->countStateChanges( changes + 5 );
+}
+
+bool GpuDrivenRenderer::renderLayeredShadow( View* view, const QMatrix4x4& rangeMatrix,
+                                             const QMatrix4x4* faceMatrices,
+                                             const QVector4D& pointLight )
+{
+    if ( m_layeredDepthProgram == Q_NULLPTR ) return false;
+    if ( m_instances.isEmpty( ) ) return true;
+    // 与View的分层渲染一样，用包住光源范围的盒子裁剪一次
+    int pass = cull( view, rangeMatrix );
+    if ( pass < 0 ) return true;
+
+    m_layeredDepthProgram->bind( );
+    m_layeredDepthProgram->setUniformValueArray( "faceMatrices", faceMatrices,
+                                                 ShadowCubeMap::FaceCount );
+    m_layeredDepthProgram->setUniformValue( "pointLight", pointLight );
+    m_layeredDepthProgram->setUniformValue( "moments", 0 );
+    int changes = m_cube->bindPositions( m_layeredDepthProgram, m_layeredPositionLoc );
+    changes += bindInstances( m_layeredDepthProgram, m_layeredInstanceLoc );
+    drawIndirect( pass, 0, m_instances.size( ) );
+    releaseInstances( m_layeredDepthProgram, m_layeredInstanceLoc );
+    MeshBuffer::release( );
+    view->countDrawCall( 0 );
+
+    view->depthProgram( )->bind( );
+    view->countStateChanges( changes + 5 );
+    return true;
+}
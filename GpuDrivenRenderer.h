@@ -0,0 +1,115 @@
+#ifndef GPUDRIVENRENDERER_H
+#define GPUDRIVENRENDERER_H
+
+#include <QHash>
+#include <QSet>
+#include <QVector3D>
+#include <QUrl>
+#include <QVector>
+#include <QVector4D>
+#include <QMatrix4x4>
+#include <QOpenGLFunctions>
+#include "Light.h"
+
+QT_BEGIN_NAMESPACE
+class QOpenGLContext;
+class QOpenGLTexture;
+class QOpenGLShaderProgram;
+class QOpenGLFunctions_4_3_Core;
+QT_END_NAMESPACE
+
+class View;
+class Cube;
+class MeshBuffer;
+class StreamBuffer;
+
+// GPU驱动的渲染（需要桌面OpenGL 4.3）：动态立方体的中心和边长放在同一个缓存中，
+// 它既是计算着色器的SSBO，也是实例属性。每个pass先由计算着色器对所有实例做视锥体裁剪，
+// 写出DrawElementsIndirectCommand，再用glMultiDrawElementsIndirect提交，
+// CPU上的开销与实例数无关。接管的立方体不进入View的层次包围体，
+// sync中只处理属性变化了的立方体。上下文不满足要求时isSupported为false，实体仍由各自的渲染器绘制
+class GpuDrivenRenderer
+{
+public:
+    GpuDrivenRenderer( void );
+    ~GpuDrivenRenderer( void );
+
+    // 渲染线程，需要当前的OpenGL上下文
+    void initialize( QOpenGLContext* context );
+    void release( void );
+    bool isSupported( void ) { return m_functions != Q_NULLPTR; }
+
+    // sync中调用，此时GUI线程被阻塞。changed是上次sync以后属性变化或者新追加的立方体，
+    // 只有它们的实例被更新；接管的集合或者纹理变化时才遍历data重新排列。
+    // enabled为false时放弃所有的实例
+    void update( const QObjectList& data, const QSet<Cube*>& changed,
+                 bool enabled, StreamBuffer* stream );
+    bool isManaged( QObject* object ) { return m_slots.contains( object ); }
+    int instanceCount( void ) { return m_instances.size( ); }
+    // 实例变化时加一，View据此判断阴影图块是否过期
+    int generation( void ) { return m_generation; }
+
+    // 拾取，返回最近相交的立方体，未命中返回Q_NULLPTR
+    QObject* intersectRay( const QVector3D& origin, const QVector3D& direction,
+                           float* distance );
+
+    // 每帧开始时调用，每个pass使用命令缓存中单独的一段，不需要等待上一个pass的绘制完成
+    void beginFrame( void ) { m_pass = 0; }
+    void render( View* view );
+    // 每个阴影视锥体调用一次，绘制以后重新绑定View的深度着色器
+    void renderShadow( View* view, const QMatrix4x4& lightViewProjectionMatrix,
+                       const QVector4D& pointLight );
+    // 点光源阴影的单遍渲染，立方体贴图的分层帧缓存已经绑定。rangeMatrix用于裁剪，
+    // faceMatrices是六个面的投影。没有分层的程序时返回false，View逐面调用renderShadow
+    bool renderLayeredShadow( View* view, const QMatrix4x4& rangeMatrix,
+                              const QMatrix4x4* faceMatrices, const QVector4D& pointLight );
+protected:
+    // 同一纹理的实例在实例缓存中连续存放，主渲染每种纹理一次间接绘制
+    struct Group
+    {
+        QUrl                source;
+        int                 first;
+        int                 count;
+    };
+
+    static bool isEligible( Cube* cube );
+    void rebuild( const QObjectList& data );
+
+    // 返回这个pass在命令缓存中的编号，pass用完时返回-1
+    int cull( View* view, const QMatrix4x4& viewProjectionMatrix );
+    // 返回绑定的缓存数
+    int bindInstances( QOpenGLShaderProgram* program, int instanceLoc );
+    void releaseInstances( QOpenGLShaderProgram* program, int instanceLoc );
+    void drawIndirect( int pass, int first, int count );
+    void reserve( int count );
+    QOpenGLTexture* texture( const QUrl& source );
+
+    QOpenGLFunctions_4_3_Core*      m_functions;
+    QHash<QObject*, int>            m_slots;            // 立方体在实例缓存中的下标
+    QVector<QVector4D>              m_instances;        // xyz为中心，w为边长
+    QVector<QObject*>               m_instanceObjects;
+    QVector<int>                    m_instanceGroups;   // 实例所在的Group
+    QList<Group>                    m_groups;
+    bool                            m_enabled;
+    int                             m_generation;
+    QHash<QUrl, QOpenGLTexture*>    m_textures;
+
+    GLuint                          m_instanceBuffer;
+    GLuint                          m_commandBuffer;
+    int                             m_capacity;         // 两个缓存能容纳的实例数
+    int                             m_pass;
+    bool                            m_warned;
+    MeshBuffer*                     m_cube;             // 所有实例共用的单位立方体
+
+    QOpenGLShaderProgram*           m_cullProgram;
+    QOpenGLShaderProgram*           m_program;
+    int                             m_positionLoc, m_normalLoc, m_texCoordLoc, m_instanceLoc;
+    int                             m_viewMatrixLoc, m_projectionMatrixLoc, m_shadowTypeLoc;
+    LightUniforms                   m_lightUniforms;
+    QOpenGLShaderProgram*           m_depthProgram;
+    int                             m_depthPositionLoc, m_depthInstanceLoc;
+    QOpenGLShaderProgram*           m_layeredDepthProgram;  // 不支持时为空
+    int                             m_layeredPositionLoc, m_layeredInstanceLoc;
+};
+
+#endif // GPUDRIVENRENDERER_H
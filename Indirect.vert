@@ -0,0 +1,30 @@
+// Indirect.vert
+// GPU剔除路径的立方体：所有实例共用一个单位立方体，
+// 实例属性的除数为1，由间接绘制命令的baseInstance选择
+
+attribute vec3 position;
+attribute vec3 normal;
+attribute vec2 texCoord;
+attribute vec4 instance;        // xyz为中心，w为边长
+
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+
+// 与Common.vert相同，片段着色器直接使用Common.frag
+varying vec3 viewSpacePosition;
+varying vec2 v_texCoord;
+varying vec3 v_normal;
+varying vec3 worldPosition;
+
+void main( void )
+{
+    worldPosition = instance.xyz + position * instance.w;
+    viewSpacePosition = vec3( viewMatrix * vec4( worldPosition, 1.0 ) );
+
+    v_texCoord = texCoord;
+
+    // 只有平移和统一缩放，法线只需要相机的旋转
+    v_normal = vec3( viewMatrix * vec4( normal, 0.0 ) );
+
+    gl_Position = projectionMatrix * vec4( viewSpacePosition, 1.0 );
+}
@@ -0,0 +1,17 @@
+// IndirectDepth.vert
+// GPU剔除路径的阴影，片段着色器使用Depth.frag
+
+attribute vec3 position;
+attribute vec4 instance;        // xyz为中心，w为边长
+
+uniform mat4 viewProjectionMatrix;
+
+varying vec4 projectedPosition;
+varying vec3 worldPosition;
+
+void main( void )
+{
+    worldPosition = instance.xyz + position * instance.w;
+    projectedPosition = viewProjectionMatrix * vec4( worldPosition, 1.0 );
+    gl_Position = projectedPosition;
+}
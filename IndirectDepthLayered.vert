@@ -0,0 +1,14 @@
+// IndirectDepthLayered.vert
+// GPU剔除路径的点光源阴影单遍渲染，与DepthLayered.vert相同，只是位置来自实例
+#version 150
+
+in vec3 position;
+in vec4 instance;       // xyz为中心，w为边长
+
+out vec3 v_worldPosition;
+
+void main( void )
+{
+    v_worldPosition = instance.xyz + position * instance.w;
+    gl_Position = vec4( v_worldPosition, 1.0 );
+}
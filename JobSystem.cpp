@@ -0,0 +1,182 @@
+#include <QThread>
+#include "JobSystem.h"
+
+///////////////////////////////////////////////////////////////////////////////
+class JobWorker: public QThread
+{
+public:
+    JobWorker( JobSystem* system, int index, quint64 generation ):
+        m_system( system ),
+        m_index( index ),
+        m_generation( generation )
+    {
+    }
+protected:
+    void run( void ) Q_DECL_OVERRIDE
+    {
+        quint64 generation = m_generation;
+        forever
+        {
+            {
+                QMutexLocker locker( &m_system->m_mutex );
+                while ( !m_system->m_quit &&
+                        m_system->m_generation == generation )
+                    m_system->m_wake.wait( &m_system->m_mutex );
+                if ( m_system->m_quit ) return;
+                generation = m_system->m_generation;
+            }
+            m_system->runTasks( m_index );
+        }
+    }
+
+    JobSystem*              m_system;
+    int                     m_index;
+    quint64                 m_generation;           // 创建时的代数，只等待之后的任务
+};
+
+///////////////////////////////////////////////////////////////////////////////
+JobSystem::JobSystem( int workerCount )
+{
+    m_function = Q_NULLPTR;
+    m_generation = 0;
+    m_quit = false;
+    m_queues.append( new Queue );
+    m_queues.first( )->head = 0;
+    setWorkerCount( workerCount );
+}
+
+JobSystem::~JobSystem( void )
+{
+    stopWorkers( );
+    qDeleteAll( m_queues );
+}
+
+void JobSystem::stopWorkers( void )
+{
+    {
+        QMutexLocker locker( &m_mutex );
+        m_quit = true;
+        m_wake.wakeAll( );
+    }
+    foreach ( JobWorker* worker, m_workers )
+    {
+        worker->wait( );
+        delete worker;
+    }
+    m_workers.clear( );
+    m_quit = false;
+}
+
+void JobSystem::setWorkerCount( int workerCount )
+{
+    workerCount = qMax( 0, workerCount );
+    if ( workerCount == m_workers.size( ) ) return;
+
+    stopWorkers( );
+    while ( m_queues.size( ) > 1 ) delete m_queues.takeLast( );
+    for ( int i = 1; i <= workerCount; ++i )
+    {
+        Queue* queue = new Queue;
+        queue->head = 0;
+        m_queues.append( queue );
+
+        JobWorker* worker = new JobWorker( this, i, m_generation );
+        m_workers.append( worker );
+    }
+
+    // 新的线程从当前的代数开始等待，不会把已经完成的任务当成新任务
+    foreach ( JobWorker* worker, m_workers ) worker->start( );
+}
+
+void JobSystem::parallelFor( int count, int chunkSize,
+                             const RangeFunction& function )
+{
+    if ( count <= 0 ) return;
+    chunkSize = qMax( 1, chunkSize );
+
+    // 没有工作线程或者只有一块时直接在调用线程上执行
+    if ( m_workers.isEmpty( ) || count <= chunkSize )
+    {
+        for ( int begin = 0; begin < count; begin += chunkSize )
+            function( begin, qMin( begin + chunkSize, count ) );
+        return;
+    }
+
+    // 轮流分发到各个队列，先设置函数再放入任务
+    m_function = &function;
+    int taskCount = ( count + chunkSize - 1 ) / chunkSize;
+    m_remaining.store( taskCount );
+    for ( int i = 0; i < taskCount; ++i )
+    {
+        Queue* queue = m_queues[i % m_queues.size( )];
+        QMutexLocker locker( &queue->mutex );
+        Task task;
+        task.begin = i * chunkSize;
+        task.end = qMin( task.begin + chunkSize, count );
+        queue->tasks.append( task );
+    }
+
+    {
+        QMutexLocker locker( &m_mutex );
+        ++m_generation;
+        m_wake.wakeAll( );
+    }
+
+    runTasks( 0 );
+
+    QMutexLocker locker( &m_mutex );
+    while ( m_remaining.load( ) > 0 ) m_done.wait( &m_mutex );
+}
+
+void JobSystem::runTasks( int self )
+{
+    Task task;
+    forever
+    {
+        if ( !popTask( self, task ) )
+        {
+            // 自己的队列空了就从其他队列窃取
+            bool stolen = false;
+            for ( int i = 1; i < m_queues.size( ) && !stolen; ++i )
+                stolen = stealTask( ( self + i ) % m_queues.size( ), task );
+            if ( !stolen ) return;
+        }
+
+        ( *m_function )( task.begin, task.end );
+
+        if ( !m_remaining.deref( ) )
+        {
+            QMutexLocker locker( &m_mutex );
+            m_done.wakeAll( );
+        }
+    }
+}
+
+bool JobSystem::popTask( int queue, Task& task )
+{
+    Queue* q = m_queues[queue];
+    QMutexLocker locker( &q->mutex );
+    if ( q->head >= q->tasks.size( ) ) return false;
+    task = q->tasks.last( );
+    q->tasks.removeLast( );
+    if ( q->head >= q->tasks.size( ) )
+    {
+        q->tasks.clear( );
+        q->head = 0;
+    }
+    return true;
+}
+
+bool JobSystem::stealTask( int queue, Task& task )
+{
+    Queue* q = m_queues[queue];
+    QMutexLocker locker( &q->mutex );
+    if ( q->head >= q->tasks.size( ) ) return false;
+    task = q->tasks[q->head++];
+    if ( q->head >= q->tasks.size( ) )
+    {
+        q->tasks.clear( );
+        q->head = 0;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <functional>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+// 简单的工作窃取任务系统，把循环分块后分发到各个工作线程
+// 分块只取决于元素个数和块大小，与线程数无关，所以结果是确定的
+class JobWorker;
+class JobSystem
+{
+public:
+    typedef std::function<void( int begin, int end )> RangeFunction;
+
+    explicit JobSystem( int workerCount = 0 );
+    ~JobSystem( void );
+
+    int workerCount( void ) const { return m_workers.size( ); }
+    void setWorkerCount( int workerCount );
+
+    // 并行执行function，调用线程也参与执行，返回时所有的块都已完成
+    // 不可重入，只能由同一个线程调用
+    void parallelFor( int count, int chunkSize, const RangeFunction& function );
+
+    friend class JobWorker;
+protected:
+    struct Task
+    {
+        int begin, end;
+    };
+    struct Queue
+    {
+        QMutex          mutex;
+        QVector<Task>   tasks;
+        int             head;       // 窃取者从头部取
+    };
+
+    void runTasks( int self );
+    bool popTask( int queue, Task& task );
+    bool stealTask( int queue, Task& task );
+    void stopWorkers( void );
+
+    // 0号队列属于调用线程，其余的属于各个工作线程
+    QVector<Queue*>         m_queues;
+    QList<JobWorker*>       m_workers;
+    const RangeFunction*    m_function;
+    QAtomicInt              m_remaining;
+
+    QMutex                  m_mutex;
+    QWaitCondition          m_wake;
+    QWaitCondition          m_done;
+    quint64                 m_generation;
+    bool                    m_quit;
+};
+
+#endif // JOBSYSTEM_H
@@ -0,0 +1,107 @@
+#include <QOpenGLShaderProgram>
+#include "View.h"
+#include "Light.h"
+
+///////////////////////////////////////////////////////////////////////////////
+Light::Light( QObject* parent ): QObject( parent )
+{
+    m_position = QVector3D( 0.0f, 50.0f, 0.0f );
+    m_lookAt = QVector3D( 0.0f, 0.0f, 0.0f );
+    m_color = Qt::white;
+    m_fieldOfView = 90.0;
+    m_range = 500.0;
+    m_importance = 1.0;
+    m_castShadows = true;
+    m_view = Q_NULLPTR;
+}
+
+void Light::setPosition( const QVector3D& position )
+{
+    if ( m_position == position ) return;
+    m_position = position;
+    emit positionChanged( );
+    updateWindow( );
+}
+
+void Light::setLookAt( const QVector3D& lookAt )
+{
+    if ( m_lookAt == lookAt ) return;
+    m_lookAt = lookAt;
+    emit lookAtChanged( );
+    updateWindow( );
+}
+
+void Light::setColor( const QColor& color )
+{
+    if ( m_color == color ) return;
+    m_color = color;
+    emit colorChanged( );
+    updateWindow( );
+}
+
+void Light::setFieldOfView( qreal fieldOfView )
+{
+    fieldOfView = qBound( qreal( 1.0 ), fieldOfView, qreal( 179.0 ) );
+    if ( m_fieldOfView == fieldOfView ) return;
+    m_fieldOfView = fieldOfView;
+    emit fieldOfViewChanged( );
+    updateWindow( );
+}
+
+void Light::setRange( qreal range )
+{
+    if ( m_range == range ) return;
+    m_range = range;
+    emit rangeChanged( );
+    updateWindow( );
+}
+
+void Light::setImportance( qreal importance )
+{
+    importance = qMax( qreal( 0.0 ), importance );
+    if ( m_importance == importance ) return;
+    m_importance = importance;
+    emit importanceChanged( );
+    updateWindow( );
+}
+
+void Light::setCastShadows( bool castShadows )
+{
+    if ( m_castShadows == castShadows ) return;
+    m_castShadows = castShadows;
+    emit castShadowsChanged( );
+    updateWindow( );
+}
+
+void Light::updateWindow( void )
+{
+    if ( m_view != Q_NULLPTR ) m_view->updateWindow( );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void LightUniforms::resolve( QOpenGLShaderProgram* program )
+{
+    lightCountLoc = program->uniformLocation( "lightCount" );
+    lightPositionsLoc = program->uniformLocation( "lightPositions" );
+    lightColorsLoc = program->uniformLocation( "lightColors" );
+    lightMatricesLoc = program->uniformLocation( "lightViewProjectionMatrices" );
+    shadowTilesLoc = program->uniformLocation( "shadowTiles" );
+    lightRangesLoc = program->uniformLocation( "lightRanges" );
+    pointShadowRangeLoc = program->uniformLocation( "pointShadowRange" );
+}
+
+int LightUniforms::apply( QOpenGLShaderProgram* program, View* view )
+{
+    // 只上传实际使用的部分，单个光源时与原来的两个uniform开销相当
+    int count = view->lightCount( );
+    program->setUniformValue( lightCountLoc, count );
+    program->setUniformValueArray( lightPositionsLoc, view->lightPositions( ), count );
+    program->setUniformValueArray( lightColorsLoc, view->lightColors( ), count );
+    // NO_SHADOW的程序没有后面这些uniform
+    if ( lightMatricesLoc < 0 ) return 3;
+    program->setUniformValueArray( lightMatricesLoc, view->lightMatrices( ), count );
+    program->setUniformValueArray( shadowTilesLoc, view->shadowTiles( ), count );
+    program->setUniformValueArray( lightRangesLoc, view->lightRanges( ), count, 1 );
+    program->setUniformValue( pointShadowRangeLoc, view->pointShadowRange( ) );
+    return 7;
+}
@@ -0,0 +1,96 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <QColor>
+#include <QVector3D>
+#include <QObject>
+
+#define MAX_LIGHTS      8       // 与Common.frag中的MAX_LIGHTS一致
+
+QT_BEGIN_NAMESPACE
+class QOpenGLShaderProgram;
+QT_END_NAMESPACE
+
+// 聚光灯式的光源，View中可以放置多个。投射阴影的光源在同一张阴影图集中
+// 各占一块，图块大小由importance决定。没有任何Light时，View的lightPosition
+// 作为唯一的光源
+class View;
+class Light: public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY( QVector3D position READ position WRITE setPosition NOTIFY positionChanged )
+    Q_PROPERTY( QVector3D lookAt READ lookAt WRITE setLookAt NOTIFY lookAtChanged )
+    Q_PROPERTY( QColor color READ color WRITE setColor NOTIFY colorChanged )
+
+    // 阴影视锥体的张角（度）以及远平面
+    Q_PROPERTY( qreal fieldOfView READ fieldOfView WRITE setFieldOfView NOTIFY fieldOfViewChanged )
+    Q_PROPERTY( qreal range READ range WRITE setRange NOTIFY rangeChanged )
+
+    // 阴影图块的相对大小：最重要的光源使用最大的图块，重要程度每减半边长也减半
+    Q_PROPERTY( qreal importance READ importance WRITE setImportance NOTIFY importanceChanged )
+    Q_PROPERTY( bool castShadows READ castShadows WRITE setCastShadows NOTIFY castShadowsChanged )
+public:
+    explicit Light( QObject* parent = Q_NULLPTR );
+
+    void setView( View* view ) { m_view = view; }
+
+    QVector3D position( void ) { return m_position; }
+    void setPosition( const QVector3D& position );
+
+    QVector3D lookAt( void ) { return m_lookAt; }
+    void setLookAt( const QVector3D& lookAt );
+
+    QColor color( void ) { return m_color; }
+    void setColor( const QColor& color );
+
+    qreal fieldOfView( void ) { return m_fieldOfView; }
+    void setFieldOfView( qreal fieldOfView );
+
+    qreal range( void ) { return m_range; }
+    void setRange( qreal range );
+
+    qreal importance( void ) { return m_importance; }
+    void setImportance( qreal importance );
+
+    bool castShadows( void ) { return m_castShadows; }
+    void setCastShadows( bool castShadows );
+signals:
+    void positionChanged( void );
+    void lookAtChanged( void );
+    void colorChanged( void );
+    void fieldOfViewChanged( void );
+    void rangeChanged( void );
+    void importanceChanged( void );
+    void castShadowsChanged( void );
+protected:
+    void updateWindow( void );
+
+    QVector3D           m_position;
+    QVector3D           m_lookAt;
+    QColor              m_color;
+    qreal               m_fieldOfView;
+    qreal               m_range;
+    qreal               m_importance;
+    bool                m_castShadows;
+
+    View*               m_view;
+};
+
+// 着色器中光源数组的位置，各个渲染器链接着色器以后解析一次，
+// 绘制时从View取出渲染线程的光源数组上传
+struct LightUniforms
+{
+    void resolve( QOpenGLShaderProgram* program );
+    // 返回上传的uniform数
+    int apply( QOpenGLShaderProgram* program, View* view );
+
+    int                 lightCountLoc;
+    int                 lightPositionsLoc;
+    int                 lightColorsLoc;
+    int                 lightMatricesLoc;
+    int                 shadowTilesLoc;
+    int                 lightRangesLoc;
+    int                 pointShadowRangeLoc;
+};
+
+#endif // LIGHT_H
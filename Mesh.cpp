@@ -0,0 +1,491 @@
+#include <QFile>
+#include <QImage>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QQmlFile>
+#include "View.h"
+#include "Light.h"
+#include "MeshBuffer.h"
+#include "Mesh.h"
+
+#define TEXTURE_UNIT    GL_TEXTURE0
+#define SHADOW_TEXTURE_UNIT GL_TEXTURE1
+#define SHADOW_CUBE_TEXTURE_UNIT GL_TEXTURE2
+
+class MeshRenderer: protected QOpenGLFunctions
+{
+public:
+    explicit MeshRenderer( Mesh* mesh ):
+        m_mesh( mesh ),
+        m_level( 0 ),
+        m_texture( QOpenGLTexture::Target2D ),
+        m_radius( 0.0f ),
+        m_scale( 1.0f ),
+        m_receiveShadows( true )
+    {
+        initializeOpenGLFunctions( );
+
+        // 根据创建的次数来创建着色器
+        if ( s_count++ == 0 )
+        {
+            s_program = new QOpenGLShaderProgram;
+            View::addCommonVertexShader( s_program );
+            s_program->addShaderFromSourceFile( QOpenGLShader::Fragment,
+                                                ":/Common.frag" );
+            s_program->link( );
+            s_program->bind( );
+            s_positionLoc = s_program->attributeLocation( "position" );
+            s_normalLoc = s_program->attributeLocation( "normal" );
+            s_texCoordLoc = s_program->attributeLocation( "texCoord" );
+            s_texCoordTransformLoc = s_program->uniformLocation( "texCoordTransform" );
+            s_modelMatrixLoc = s_program->uniformLocation( "modelMatrix" );
+            s_viewMatrixLoc = s_program->uniformLocation( "viewMatrix" );
+            s_projectionMatrixLoc = s_program->uniformLocation( "projectionMatrix" );
+            s_lightUniforms.resolve( s_program );
+            s_modelViewNormalMatrixLoc =
+                    s_program->uniformLocation( "modelViewNormalMatrix" );
+            s_shadowTypeLoc = s_program->uniformLocation( "shadowType" );
+            int textureLoc = s_program->uniformLocation( "texture" );
+            int shadowLoc = s_program->uniformLocation( "shadowTexture" );
+            s_program->setUniformValue( textureLoc,
+                                        TEXTURE_UNIT - GL_TEXTURE0 );
+            s_program->setUniformValue( shadowLoc,
+                                        SHADOW_TEXTURE_UNIT - GL_TEXTURE0 );
+            s_program->setUniformValue( s_program->uniformLocation( "shadowCubeTexture" ),
+                                        SHADOW_CUBE_TEXTURE_UNIT - GL_TEXTURE0 );
+
+            s_program->release( );
+        }
+
+        loadTextureFromSource( QUrl( ) );
+    }
+    ~MeshRenderer( void )
+    {
+        unload( );
+        m_texture.destroy( );
+        if ( --s_count == 0 )
+        {
+            delete s_program;
+        }
+    }
+    bool loadFromSource( const QUrl& source, AABB& bounds )
+    {
+        unload( );
+        bounds = AABB( );
+        if ( source.isEmpty( ) ) return true;
+
+        QFile file( QQmlFile::urlToLocalFileOrQrc( source ) );
+        if ( !file.open( QIODevice::ReadOnly ) )
+        {
+            qWarning( "Mesh: cannot open %s.", qPrintable( file.fileName( ) ) );
+            return false;
+        }
+
+        // 映射整个文件，各个块直接从映射的内存上传到顶点缓存，
+        // qrc中的资源没有对应的文件，map直接返回资源数据的指针
+        qint64 size = file.size( );
+        const uchar* data = file.map( 0, size );
+        QByteArray contents;
+        if ( data == Q_NULLPTR )
+        {
+            contents = file.readAll( );
+            data = reinterpret_cast<const uchar*>( contents.constData( ) );
+        }
+
+        bool valid = upload( data, size, bounds );
+        if ( !valid )
+        {
+            qWarning( "Mesh: %s is not a valid mesh file.",
+                      qPrintable( file.fileName( ) ) );
+            unload( );
+            bounds = AABB( );
+        }
+        file.close( );
+        return valid;
+    }
+    void unload( void )
+    {
+        qDeleteAll( m_chunks );
+        m_chunks.clear( );
+        m_lods.clear( );
+        m_level = 0;
+    }
+    void render( void )
+    {
+        if ( m_chunks.isEmpty( ) ) return;
+        View* view = m_mesh->m_view;
+        int shadowType = m_receiveShadows ? view->renderShadowMode( ) : View::NoShadow;
+        if ( shadowType == View::NoShadow )
+        {
+            // View中没有阴影计算的程序，不上传阴影的uniform，也不绑定阴影图
+            const View::UnshadowedProgram& unshadowed = view->unshadowedProgram( );
+            int changes = view->bindUnshadowedProgram( m_modelMatrix, m_modelViewNormalMatrix );
+            m_texture.bind( );
+            view->countStateChanges( changes + 1 );
+            drawLod( m_level, unshadowed.program, unshadowed.positionLoc, unshadowed.normalLoc,
+                     unshadowed.texCoordLoc, unshadowed.texCoordTransformLoc );
+            m_texture.release( );
+            unshadowed.program->release( );
+            return;
+        }
+
+        s_program->bind( );
+        int changes = 1;
+
+        // 摄像机的MVP矩阵
+        s_program->setUniformValue( s_modelMatrixLoc, m_modelMatrix );
+        s_program->setUniformValue( s_viewMatrixLoc, view->viewMatrix( ) );
+        s_program->setUniformValue( s_projectionMatrixLoc, view->projectionMatrix( ) );
+        s_program->setUniformValue( s_modelViewNormalMatrixLoc,
+                                    m_modelViewNormalMatrix );
+
+        s_program->setUniformValue( s_shadowTypeLoc, shadowType );
+        // 上面的四个矩阵和阴影类型，再加上光源数组
+        changes += 5 + s_lightUniforms.apply( s_program, view );
+
+        m_texture.bind( );
+        glActiveTexture( SHADOW_TEXTURE_UNIT );
+        glBindTexture( GL_TEXTURE_2D, view->shadowTexture( ) );
+        if ( shadowType == View::PointShadow )
+        {
+            glActiveTexture( SHADOW_CUBE_TEXTURE_UNIT );
+            glBindTexture( GL_TEXTURE_CUBE_MAP, view->shadowCubeTexture( ) );
+        }
+        glActiveTexture( TEXTURE_UNIT );
+        changes += shadowType == View::PointShadow ? 3 : 2;
+
+        drawLod( m_level, s_program, s_positionLoc, s_normalLoc,
+                 s_texCoordLoc, s_texCoordTransformLoc );
+        view->countStateChanges( changes );
+        m_texture.release( );
+
+        s_program->release( );
+    }
+    void prepare( void )
+    {
+        // 可以在工作线程中执行，不涉及OpenGL调用
+        m_modelViewNormalMatrix =
+                ( m_mesh->m_view->viewMatrix( ) * m_modelMatrix ).normalMatrix( );
+        m_level = selectLod( m_mesh->m_view->lodParameters( false ) );
+    }
+    void renderShadow( void )
+    {
+        if ( m_chunks.isEmpty( ) ) return;
+
+        // 阴影只需要位置，细节层次单独选择，通常比主渲染更粗糙
+        View* view = m_mesh->m_view;
+        QOpenGLShaderProgram* depthProgram = view->depthProgram( );
+        depthProgram->setUniformValue( "modelMatrix", m_modelMatrix );
+        view->countStateChanges( 1 );
+        drawLod( selectLod( view->lodParameters( true ) ), depthProgram,
+                 depthProgram->attributeLocation( "position" ) );
+    }
+    void loadTextureFromSource( const QUrl& source )
+    {
+        QImage image;
+        if ( !source.isEmpty( ) )
+            image = QImage( QQmlFile::urlToLocalFileOrQrc( source ) ).mirrored( );
+        if ( image.isNull( ) )
+        {
+            image = QImage( 1, 1, QImage::Format_RGB32 );
+            image.fill( Qt::white );
+        }
+        m_texture.destroy( );
+        m_texture.setData( image );
+
+        // 设置纹理滤波
+        m_texture.setMinificationFilter( QOpenGLTexture::LinearMipMapLinear );
+        m_texture.setMagnificationFilter( QOpenGLTexture::Linear );
+    }
+    void transform( const QVector3D& translate, qreal scale )
+    {
+        m_modelMatrix.setToIdentity( );
+        m_modelMatrix.translate( translate );
+        m_modelMatrix.scale( scale );
+        m_scale = scale;
+    }
+    void setBounds( const AABB& bounds )
+    {
+        m_center = ( bounds.minimum + bounds.maximum ) * 0.5f;
+        m_radius = ( bounds.maximum - bounds.minimum ).length( ) * 0.5f;
+    }
+    void setReceiveShadows( bool receiveShadows ) { m_receiveShadows = receiveShadows; }
+protected:
+    static bool inside( quint64 offset, quint64 length, qint64 size )
+    {
+        return offset + length <= quint64( size );
+    }
+    bool upload( const uchar* data, qint64 size, AABB& bounds )
+    {
+        using namespace MeshFormat;
+
+        if ( size < qint64( sizeof( FileHeader ) ) ) return false;
+        const FileHeader* header = reinterpret_cast<const FileHeader*>( data );
+        if ( header->magic != quint32( Magic ) ||
+             header->version < 1 || header->version > quint32( Version ) ) return false;
+
+        // 版本1的文件只有一层，版本3以前的块头没有纹理坐标变换
+        quint32 lodCount = header->version >= 2 ? header->lodCount : 0;
+        quint64 chunkHeaderSize = header->version >= 3 ?
+                    sizeof( ChunkHeader ) : sizeof( ChunkHeaderV2 );
+        quint64 headersSize = sizeof( FileHeader ) + quint64( lodCount ) * sizeof( LodHeader ) +
+                quint64( header->chunkCount ) * chunkHeaderSize;
+        if ( !inside( 0, headersSize, size ) ) return false;
+
+        const LodHeader* lods =
+                reinterpret_cast<const LodHeader*>( data + sizeof( FileHeader ) );
+        const uchar* chunks = data + sizeof( FileHeader ) + lodCount * sizeof( LodHeader );
+        for ( quint32 i = 0; i < header->chunkCount; ++i )
+        {
+            // ChunkHeader以ChunkHeaderV2的字段开头
+            const ChunkHeader& chunk =
+                    *reinterpret_cast<const ChunkHeader*>( chunks + i * chunkHeaderSize );
+            TexCoordTransform texCoordTransform = header->version >= 3 ?
+                        chunk.texCoordTransform : identityTexCoordTransform( );
+            quint64 vertexCount = chunk.vertexCount;
+            quint64 indexCount = chunk.indexCount;
+            if ( vertexCount > MaxChunkVertices || indexCount % 3 != 0 ||
+                 !inside( chunk.positionOffset, vertexCount * 3 * sizeof( float ), size ) ||
+                 !inside( chunk.attributeOffset, vertexCount * sizeof( PackedAttributes ), size ) ||
+                 !inside( chunk.indexOffset, indexCount * sizeof( quint16 ), size ) )
+                return false;
+
+            // 越界的索引会让GPU读到缓存以外的数据，拒绝整个文件
+            const quint16* indices = reinterpret_cast<const quint16*>( data + chunk.indexOffset );
+            for ( quint64 j = 0; j < indexCount; ++j )
+                if ( indices[j] >= vertexCount ) return false;
+
+            MeshBuffer* buffer = new MeshBuffer;
+            buffer->create( reinterpret_cast<const QVector3D*>( data + chunk.positionOffset ),
+                            reinterpret_cast<const PackedAttributes*>( data + chunk.attributeOffset ),
+                            indices, int( vertexCount ), int( indexCount ),
+                            texCoordTransform, QOpenGLBuffer::StaticDraw );
+            m_chunks.append( buffer );
+        }
+
+        if ( lodCount == 0 )
+        {
+            Lod lod = { 0, int( header->chunkCount ), 0.0f };
+            m_lods.append( lod );
+        }
+        for ( quint32 i = 0; i < lodCount; ++i )
+        {
+            if ( quint64( lods[i].firstChunk ) + lods[i].chunkCount > header->chunkCount )
+                return false;
+            Lod lod = { int( lods[i].firstChunk ), int( lods[i].chunkCount ), lods[i].error };
+            m_lods.append( lod );
+        }
+
+        bounds = AABB( QVector3D( header->minimum[0], header->minimum[1], header->minimum[2] ),
+                       QVector3D( header->maximum[0], header->maximum[1], header->maximum[2] ) );
+        return true;
+    }
+    int selectLod( const View::LodParameters& parameters )
+    {
+        // 包围球以外的距离，视点在包围球内时使用最细的一层。
+        // 各层的误差依次增大，选择投影以后仍然不超过阈值的最粗的一层
+        float distance = ( m_center - parameters.origin ).length( ) - m_radius;
+        if ( distance <= 0.0f ) return 0;
+        int level = 0;
+        for ( int i = 1; i < m_lods.size( ); ++i )
+        {
+            float pixels = m_lods[i].error * m_scale *
+                    parameters.pixelsPerUnit / distance;
+            if ( pixels > parameters.threshold ) break;
+            level = i;
+        }
+        return level;
+    }
+    // normalLoc小于0时只绑定位置，用于阴影以及深度预渲染
+    void drawLod( int level, QOpenGLShaderProgram* program, int positionLoc,
+                  int normalLoc = -1, int texCoordLoc = -1, int texCoordTransformLoc = -1 )
+    {
+        if ( level >= m_lods.size( ) ) return;
+        View* view = m_mesh->m_view;
+        const Lod& lod = m_lods[level];
+        for ( int i = lod.firstChunk; i < lod.firstChunk + lod.chunkCount; ++i )
+        {
+            MeshBuffer* chunk = m_chunks[i];
+            int changes = normalLoc < 0 ? chunk->bindPositions( program, positionLoc ) :
+                                          chunk->bind( program, positionLoc, normalLoc, texCoordLoc,
+                                                       texCoordTransformLoc );
+            chunk->draw( );
+            view->countStateChanges( changes );
+            view->countDrawCall( chunk->triangleCount( ) );
+        }
+        MeshBuffer::release( );
+    }
+
+    // 细节层次占用m_chunks中连续的一段
+    struct Lod
+    {
+        int                 firstChunk;
+        int                 chunkCount;
+        float               error;
+    };
+
+    Mesh*                   m_mesh;
+
+    QMatrix4x4              m_modelMatrix;
+    QMatrix3x3              m_modelViewNormalMatrix;
+    QList<MeshBuffer*>      m_chunks;
+    QVector<Lod>            m_lods;
+    int                     m_level;            // prepare中选择的主渲染层次
+    QOpenGLTexture          m_texture;
+
+    // 渲染线程的世界空间包围球以及缩放，sync中更新
+    QVector3D               m_center;
+    float                   m_radius;
+    float                   m_scale;
+    bool                    m_receiveShadows;
+
+    static QOpenGLShaderProgram* s_program;
+    static int s_positionLoc, s_normalLoc,
+    s_texCoordLoc, s_texCoordTransformLoc, s_modelMatrixLoc,
+    s_viewMatrixLoc, s_projectionMatrixLoc,
+    s_modelViewNormalMatrixLoc, s_shadowTypeLoc;
+    static LightUniforms    s_lightUniforms;
+    static int              s_count;        // 计数
+};
+
+QOpenGLShaderProgram* MeshRenderer::s_program = Q_NULLPTR;
+int MeshRenderer::s_positionLoc,
+MeshRenderer::s_normalLoc,
+MeshRenderer::s_texCoordLoc,
+MeshRenderer::s_texCoordTransformLoc,
+MeshRenderer::s_modelMatrixLoc,
+MeshRenderer::s_viewMatrixLoc,
+MeshRenderer::s_projectionMatrixLoc,
+MeshRenderer::s_modelViewNormalMatrixLoc,
+MeshRenderer::s_shadowTypeLoc,
+MeshRenderer::s_count = 0;
+LightUniforms MeshRenderer::s_lightUniforms;
+
+Mesh::Mesh( QObject* parent ): QObject( parent )
+{
+    m_scale = 1.0;
+    m_castShadows = true;
+    m_receiveShadows = true;
+    m_sourceIsDirty = false;
+    m_textureIsDirty = false;
+    m_transformIsDirty = true;
+    m_view = Q_NULLPTR;
+    m_renderer = Q_NULLPTR;
+}
+
+void Mesh::initialize( void )
+{
+    m_renderer = new MeshRenderer( this );
+}
+
+void Mesh::render( void )
+{
+    m_renderer->render( );
+}
+
+void Mesh::prepare( void )
+{
+    m_renderer->prepare( );
+}
+
+void Mesh::renderShadow( void )
+{
+    m_renderer->renderShadow( );
+}
+
+void Mesh::sync( void )
+{
+    TRACE_SCOPE( "Mesh::sync" );
+
+    if ( m_sourceIsDirty )
+    {
+        TRACE_SCOPE( "Mesh::load" );
+        m_renderer->loadFromSource( m_source, m_localBounds );
+        m_sourceIsDirty = false;
+    }
+    if ( m_textureIsDirty )
+    {
+        TRACE_SCOPE( "Mesh::loadTexture" );
+        m_renderer->loadTextureFromSource( m_texture );
+        m_textureIsDirty = false;
+    }
+    if ( m_transformIsDirty )
+    {
+        m_renderer->transform( m_translate, m_scale );
+        m_transformIsDirty = false;
+    }
+    m_renderer->setBounds( boundingBox( ) );
+    m_renderer->setReceiveShadows( m_receiveShadows );
+}
+
+void Mesh::release( void )
+{
+    delete m_renderer;
+}
+
+AABB Mesh::boundingBox( void )
+{
+    // 还没有加载时退化成一个点
+    if ( !m_localBounds.isValid( ) ) return AABB( m_translate, m_translate );
+    float scale = m_scale;
+    return AABB( m_translate + m_localBounds.minimum * scale,
+                 m_translate + m_localBounds.maximum * scale );
+}
+
+void Mesh::setSource( const QUrl& source )
+{
+    if ( m_source == source ) return;
+    m_source = source;
+    emit sourceChanged( );
+    m_sourceIsDirty = true;
+    updateWindow( );
+}
+
+void Mesh::setTexture( const QUrl& texture )
+{
+    if ( m_texture == texture ) return;
+    m_texture = texture;
+    emit textureChanged( );
+    m_textureIsDirty = true;
+    updateWindow( );
+}
+
+void Mesh::setTranslate( const QVector3D& translate )
+{
+    if ( m_translate == translate ) return;
+    m_translate = translate;
+    emit translateChanged( );
+    m_transformIsDirty = true;
+    updateWindow( );
+}
+
+void Mesh::setScale( qreal scale )
+{
+    if ( m_scale == scale ) return;
+    m_scale = scale;
+    emit scaleChanged( );
+    m_transformIsDirty = true;
+    updateWindow( );
+}
+
+void Mesh::setCastShadows( bool castShadows )
+{
+    if ( m_castShadows == castShadows ) return;
+    m_castShadows = castShadows;
+    emit castShadowsChanged( );
+    updateWindow( );
+}
+
+void Mesh::setReceiveShadows( bool receiveShadows )
+{
+    if ( m_receiveShadows == receiveShadows ) return;
+    m_receiveShadows = receiveShadows;
+    emit receiveShadowsChanged( );
+    updateWindow( );
+}
+
+void Mesh::updateWindow( void )
+{
+    if ( m_view != Q_NULLPTR ) m_view->updateWindow( );
+}
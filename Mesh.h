@@ -0,0 +1,82 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <QUrl>
+#include <QVector3D>
+#include <QObject>
+#include "BVH.h"
+
+class View;
+class MeshRenderer;
+class Mesh: public QObject
+{
+    Q_OBJECT
+    // 由tools/meshconv转换得到的网格文件
+    Q_PROPERTY( QUrl source READ source WRITE setSource NOTIFY sourceChanged )
+    // 纹理，为空时使用白色
+    Q_PROPERTY( QUrl texture READ texture WRITE setTexture NOTIFY textureChanged )
+    Q_PROPERTY( QVector3D translate READ translate WRITE setTranslate NOTIFY translateChanged )
+    Q_PROPERTY( qreal scale READ scale WRITE setScale NOTIFY scaleChanged )
+    // 是否绘制到阴影图中，以及是否采样阴影图
+    Q_PROPERTY( bool castShadows READ castShadows WRITE setCastShadows NOTIFY castShadowsChanged )
+    Q_PROPERTY( bool receiveShadows READ receiveShadows WRITE setReceiveShadows NOTIFY receiveShadowsChanged )
+public:
+    explicit Mesh( QObject* parent = Q_NULLPTR );
+
+    void initialize( void );
+    void render( void );
+    void prepare( void );
+    void renderShadow( void );
+    void sync( void );
+    void release( void );
+    void setView( View* view ) { m_view = view; }
+    AABB boundingBox( void );
+
+    QUrl source( void ) { return m_source; }
+    void setSource( const QUrl& source );
+
+    QUrl texture( void ) { return m_texture; }
+    void setTexture( const QUrl& texture );
+
+    QVector3D translate( void ) { return m_translate; }
+    void setTranslate( const QVector3D& translate );
+
+    qreal scale( void ) { return m_scale; }
+    void setScale( qreal scale );
+
+    bool castShadows( void ) { return m_castShadows; }
+    void setCastShadows( bool castShadows );
+
+    bool receiveShadows( void ) { return m_receiveShadows; }
+    void setReceiveShadows( bool receiveShadows );
+
+    friend class MeshRenderer;
+signals:
+    void sourceChanged( void );
+    void textureChanged( void );
+    void translateChanged( void );
+    void scaleChanged( void );
+    void castShadowsChanged( void );
+    void receiveShadowsChanged( void );
+protected:
+    void updateWindow( void );
+
+    QUrl            m_source;
+    QUrl            m_texture;
+    QVector3D       m_translate;
+    qreal           m_scale;
+    bool            m_castShadows;
+    bool            m_receiveShadows;
+
+    // 网格文件中记录的局部包围盒，加载以后才有效
+    AABB            m_localBounds;
+
+    bool            m_sourceIsDirty: 1;
+    bool            m_textureIsDirty: 1;
+    bool            m_transformIsDirty: 1;
+
+    View* m_view;
+    MeshRenderer*  m_renderer;
+};
+
+#endif // MESH_H
@@ -0,0 +1,146 @@
+#include <QOpenGLShaderProgram>
+#include "StreamBuffer.h"
+#include "MeshBuffer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+MeshBuffer::MeshBuffer( void ):
+    m_positionBuffer( QOpenGLBuffer::VertexBuffer ),
+    m_attributeBuffer( QOpenGLBuffer::VertexBuffer ),
+    m_indexBuffer( QOpenGLBuffer::IndexBuffer ),
+    m_texCoordTransform( 0.0f, 0.0f, 1.0f, 1.0f ),
+    m_vertexCount( 0 ),
+    m_indexCount( 0 )
+{
+}
+
+MeshBuffer::~MeshBuffer( void )
+{
+    destroy( );
+}
+
+void MeshBuffer::create( const Geometry::MeshData& data,
+                         QOpenGLBuffer::UsagePattern usage )
+{
+    float minimum[2] = { 0.0f, 0.0f }, maximum[2] = { 1.0f, 1.0f };
+    foreach ( const QVector2D& texCoord, data.texCoords )
+    {
+        minimum[0] = qMin( minimum[0], texCoord.x( ) );
+        minimum[1] = qMin( minimum[1], texCoord.y( ) );
+        maximum[0] = qMax( maximum[0], texCoord.x( ) );
+        maximum[1] = qMax( maximum[1], texCoord.y( ) );
+    }
+    MeshFormat::TexCoordTransform transform =
+            MeshFormat::texCoordTransform( minimum, maximum );
+
+    QVector<PackedAttributes> attributes( data.positions.size( ) );
+    for ( int i = 0; i < attributes.size( ); ++i )
+    {
+        const QVector3D& normal = data.normals[i];
+        const QVector2D& texCoord = data.texCoords[i];
+        attributes[i] = MeshFormat::packAttributes(
+                    normal.x( ), normal.y( ), normal.z( ),
+                    texCoord.x( ), texCoord.y( ), transform );
+    }
+
+    create( data.positions.constData( ), attributes.constData( ),
+            data.indices.constData( ), data.positions.size( ),
+            data.indices.size( ), transform, usage );
+}
+
+void MeshBuffer::create( const QVector3D* positions,
+                         const PackedAttributes* attributes,
+                         const quint16* indices,
+                         int vertexCount, int indexCount,
+                         const MeshFormat::TexCoordTransform& texCoordTransform,
+                         QOpenGLBuffer::UsagePattern usage )
+{
+    initializeOpenGLFunctions( );
+    destroy( );
+
+    m_vertexCount = vertexCount;
+    m_indexCount = indexCount;
+    m_texCoordTransform = QVector4D( texCoordTransform.offset[0], texCoordTransform.offset[1],
+                                     texCoordTransform.scale[0], texCoordTransform.scale[1] );
+
+    // 只有位置会被resize改写，另外两个缓存总是静态的
+    m_positionBuffer.setUsagePattern( usage );
+    m_positionBuffer.create( );
+    m_positionBuffer.bind( );
+    m_positionBuffer.allocate( positions, m_vertexCount * sizeof( QVector3D ) );
+    m_positionBuffer.release( );
+
+    m_attributeBuffer.setUsagePattern( QOpenGLBuffer::StaticDraw );
+    m_attributeBuffer.create( );
+    m_attributeBuffer.bind( );
+    m_attributeBuffer.allocate( attributes,
+                                m_vertexCount * sizeof( PackedAttributes ) );
+    m_attributeBuffer.release( );
+
+    m_indexBuffer.setUsagePattern( QOpenGLBuffer::StaticDraw );
+    m_indexBuffer.create( );
+    m_indexBuffer.bind( );
+    m_indexBuffer.allocate( indices, m_indexCount * sizeof( quint16 ) );
+    m_indexBuffer.release( );
+}
+
+void MeshBuffer::destroy( void )
+{
+    m_positionBuffer.destroy( );
+    m_attributeBuffer.destroy( );
+    m_indexBuffer.destroy( );
+    m_vertexCount = 0;
+    m_indexCount = 0;
+}
+
+void MeshBuffer::writePositions( const QVector<QVector3D>& positions, StreamBuffer* stream )
+{
+    Q_ASSERT( positions.size( ) == m_vertexCount );
+    stream->upload( m_positionBuffer.bufferId( ), 0, positions.constData( ),
+                    int( m_vertexCount * sizeof( QVector3D ) ) );
+}
+
+int MeshBuffer::bind( QOpenGLShaderProgram* program,
+                      int positionLoc, int normalLoc, int texCoordLoc,
+                      int texCoordTransformLoc )
+{
+    int changes = bindPositions( program, positionLoc );
+
+    // setAttributeBuffer总是归一化，字节法线会被映射到[-1, 1]，
+    // 短整型纹理坐标被映射到[0, 1]，再由着色器中的texCoordTransform还原
+    m_attributeBuffer.bind( );
+    program->enableAttributeArray( normalLoc );
+    program->setAttributeBuffer( normalLoc, GL_BYTE, 0, 3,
+                                 sizeof( PackedAttributes ) );
+    program->enableAttributeArray( texCoordLoc );
+    program->setAttributeBuffer( texCoordLoc, GL_UNSIGNED_SHORT,
+                                 4 * sizeof( qint8 ), 2,
+                                 sizeof( PackedAttributes ) );
+    if ( texCoordTransformLoc >= 0 )
+    {
+        program->setUniformValue( texCoordTransformLoc, m_texCoordTransform );
+        ++changes;
+    }
+    // 索引缓存已经在bindPositions中绑定，绑定顶点缓存不会改变它
+    return changes + 1;
+}
+
+int MeshBuffer::bindPositions( QOpenGLShaderProgram* program, int positionLoc )
+{
+    m_positionBuffer.bind( );
+    program->enableAttributeArray( positionLoc );
+    program->setAttributeBuffer( positionLoc, GL_FLOAT, 0, 3,
+                                 sizeof( QVector3D ) );
+    m_indexBuffer.bind( );
+    return 2;
+}
+
+void MeshBuffer::draw( void )
+{
+    glDrawElements( GL_TRIANGLES, m_indexCount, GL_UNSIGNED_SHORT, Q_NULLPTR );
+}
+
+void MeshBuffer::release( void )
+{
+    QOpenGLBuffer::release( QOpenGLBuffer::VertexBuffer );
+    QOpenGLBuffer::release( QOpenGLBuffer::IndexBuffer );
+}
@@ -0,0 +1,62 @@
+#ifndef MESHBUFFER_H
+#define MESHBUFFER_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QVector4D>
+#include "Geometry.h"
+#include "MeshFormat.h"
+
+QT_BEGIN_NAMESPACE
+class QOpenGLShaderProgram;
+QT_END_NAMESPACE
+
+class StreamBuffer;
+
+// 带索引的网格的顶点缓存。位置单独放在一个缓存中，阴影只需要绑定这一个；
+// 法线和纹理坐标压缩成8个字节放在另一个缓存中，纹理坐标的范围由每个缓存自己的变换还原
+class MeshBuffer: protected QOpenGLFunctions
+{
+public:
+    MeshBuffer( void );
+    ~MeshBuffer( void );
+
+    // 渲染线程，需要当前的OpenGL上下文
+    void create( const Geometry::MeshData& data,
+                 QOpenGLBuffer::UsagePattern usage );
+    // 数据已经是GPU的布局，例如映射到内存的网格文件，直接上传
+    void create( const QVector3D* positions,
+                 const MeshFormat::PackedAttributes* attributes,
+                 const quint16* indices,
+                 int vertexCount, int indexCount,
+                 const MeshFormat::TexCoordTransform& texCoordTransform,
+                 QOpenGLBuffer::UsagePattern usage );
+    void destroy( void );
+
+    // 只更新位置，顶点数不能改变。经过流式缓存在GPU上拷贝，不等待正在使用位置缓存的绘制
+    void writePositions( const QVector<QVector3D>& positions, StreamBuffer* stream );
+
+    // 返回绑定的缓存数，计入View的状态切换。texCoordTransformLoc是着色器中
+    // texCoordTransform的位置，小于0时不设置，纹理坐标只能在[0, 1]以内
+    int bind( QOpenGLShaderProgram* program,
+              int positionLoc, int normalLoc, int texCoordLoc,
+              int texCoordTransformLoc = -1 );
+    int bindPositions( QOpenGLShaderProgram* program, int positionLoc );
+    void draw( void );
+    static void release( void );
+
+    int vertexCount( void ) { return m_vertexCount; }
+    int indexCount( void ) { return m_indexCount; }
+    int triangleCount( void ) { return m_indexCount / 3; }
+protected:
+    typedef MeshFormat::PackedAttributes PackedAttributes;
+
+    QOpenGLBuffer           m_positionBuffer;
+    QOpenGLBuffer           m_attributeBuffer;
+    QOpenGLBuffer           m_indexBuffer;
+    QVector4D               m_texCoordTransform;    // xy是偏移，zw是缩放
+    int                     m_vertexCount;
+    int                     m_indexCount;
+};
+
+#endif // MESHBUFFER_H
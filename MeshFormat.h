@@ -0,0 +1,120 @@
+#ifndef MESHFORMAT_H
+#define MESHFORMAT_H
+
+#include <QtGlobal>
+
+// 网格文件的格式，由tools/meshconv生成。文件头以后是LodHeader数组以及ChunkHeader数组，
+// 每一块的数据与GPU上的布局完全相同，加载时映射文件后直接上传，不需要解析。
+// 每一块最多65536个顶点，可以使用16位索引。每个细节层次占用连续的若干块，
+// 第0层是原始网格，之后越来越粗糙
+namespace MeshFormat
+{
+    enum
+    {
+        Magic = 0x48534D53,         // "SMSH"
+        Version = 3,                // 版本1没有LodHeader，所有的块属于第0层；
+                                    // 版本1和2的ChunkHeader没有纹理坐标变换（ChunkHeaderV2）
+        MaxChunkVertices = 65536,
+        Alignment = 4               // 各个数据段的起始位置按4字节对齐
+    };
+
+    struct FileHeader
+    {
+        quint32         magic;
+        quint32         version;
+        quint32         chunkCount;
+        quint32         lodCount;
+        float           minimum[3];
+        float           maximum[3];
+    };
+
+    struct LodHeader
+    {
+        quint32         firstChunk;
+        quint32         chunkCount;
+        float           error;              // 与原始网格的最大偏差，模型空间的长度
+        quint32         reserved;
+    };
+
+    // 纹理坐标存成归一化的无符号短整型，乘以scale再加上offset得到原来的值。
+    // 在[0, 1]以内时是单位变换，超出时（平铺的纹理）映射块中纹理坐标的包围范围
+    struct TexCoordTransform
+    {
+        float           offset[2];
+        float           scale[2];
+    };
+
+    struct ChunkHeader
+    {
+        quint32         vertexCount;
+        quint32         indexCount;
+        quint32         positionOffset;     // float[3]
+        quint32         attributeOffset;    // PackedAttributes
+        quint32         indexOffset;        // quint16
+        quint32         reserved;
+        float           minimum[3];
+        float           maximum[3];
+        TexCoordTransform texCoordTransform;
+    };
+
+    // 版本1和2的块头，纹理坐标被限制在[0, 1]，相当于单位变换
+    struct ChunkHeaderV2
+    {
+        quint32         vertexCount;
+        quint32         indexCount;
+        quint32         positionOffset;
+        quint32         attributeOffset;
+        quint32         indexOffset;
+        quint32         reserved;
+        float           minimum[3];
+        float           maximum[3];
+    };
+
+    // 归一化的有符号字节法线（第四个分量补齐到4字节）以及归一化的无符号短整型纹理坐标，共8个字节
+    struct PackedAttributes
+    {
+        qint8           normal[4];
+        quint16         texCoord[2];
+    };
+
+    inline TexCoordTransform identityTexCoordTransform( void )
+    {
+        TexCoordTransform transform = { { 0.0f, 0.0f }, { 1.0f, 1.0f } };
+        return transform;
+    }
+
+    inline TexCoordTransform texCoordTransform( const float minimum[2], const float maximum[2] )
+    {
+        TexCoordTransform transform = identityTexCoordTransform( );
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( minimum[i] >= 0.0f && maximum[i] <= 1.0f ) continue;
+            transform.offset[i] = minimum[i];
+            transform.scale[i] = maximum[i] > minimum[i] ? maximum[i] - minimum[i] : 1.0f;
+        }
+        return transform;
+    }
+
+    inline PackedAttributes packAttributes( float nx, float ny, float nz,
+                                            float u, float v,
+                                            const TexCoordTransform& transform )
+    {
+        PackedAttributes packed;
+        packed.normal[0] = qint8( qRound( qBound( -1.0f, nx, 1.0f ) * 127.0f ) );
+        packed.normal[1] = qint8( qRound( qBound( -1.0f, ny, 1.0f ) * 127.0f ) );
+        packed.normal[2] = qint8( qRound( qBound( -1.0f, nz, 1.0f ) * 127.0f ) );
+        packed.normal[3] = 0;
+        float s = ( u - transform.offset[0] ) / transform.scale[0];
+        float t = ( v - transform.offset[1] ) / transform.scale[1];
+        packed.texCoord[0] = quint16( qRound( qBound( 0.0f, s, 1.0f ) * 65535.0f ) );
+        packed.texCoord[1] = quint16( qRound( qBound( 0.0f, t, 1.0f ) * 65535.0f ) );
+        return packed;
+    }
+
+    inline quint32 align( quint32 offset )
+    {
+        return ( offset + Alignment - 1 ) & ~quint32( Alignment - 1 );
+    }
+}
+
+#endif // MESHFORMAT_H
@@ -0,0 +1,240 @@
+#include <math.h>
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+#define MIN_OCCLUDER_AREA   64.0f       // 遮挡体在深度缓存中至少覆盖的像素数
+#define OCCLUSION_BIAS      0.0001f     // 避免浮点误差把实体自己挡住
+
+///////////////////////////////////////////////////////////////////////////////
+// 包围盒的角按(x, y, z)的位取最大或者最小值，六个面从外面看都是逆时针
+static const int s_boxTriangles[12][3] =
+{
+    { 0, 4, 6 }, { 0, 6, 2 },   // -X
+    { 1, 3, 7 }, { 1, 7, 5 },   // +X
+    { 0, 1, 5 }, { 0, 5, 4 },   // -Y
+    { 2, 6, 7 }, { 2, 7, 3 },   // +Y
+    { 0, 2, 3 }, { 0, 3, 1 },   // -Z
+    { 4, 5, 7 }, { 4, 7, 6 }    // +Z
+};
+
+OcclusionCuller::OcclusionCuller( void ):
+    m_depth( Width * Height, 1.0f ),
+    m_occluderCount( 0 )
+{
+}
+
+void OcclusionCuller::begin( const QMatrix4x4& viewProjection )
+{
+    m_viewProjection = viewProjection;
+    m_triangles.clear( );
+    m_occluderCount = 0;
+}
+
+bool OcclusionCuller::projectBox( const AABB& box, float x[8], float y[8], float z[8] ) const
+{
+    for ( int i = 0; i < 8; ++i )
+    {
+        QVector4D corner( i & 1 ? box.maximum.x( ) : box.minimum.x( ),
+                          i & 2 ? box.maximum.y( ) : box.minimum.y( ),
+                          i & 4 ? box.maximum.z( ) : box.minimum.z( ),
+                          1.0f );
+        QVector4D clip = m_viewProjection * corner;
+
+        // 在近平面之前的角投影以后没有意义
+        if ( clip.w( ) <= 0.0f || clip.z( ) < -clip.w( ) ) return false;
+        float inverseW = 1.0f / clip.w( );
+        x[i] = ( clip.x( ) * inverseW * 0.5f + 0.5f ) * Width;
+        y[i] = ( clip.y( ) * inverseW * 0.5f + 0.5f ) * Height;
+        z[i] = clip.z( ) * inverseW;
+    }
+    return true;
+}
+
+bool OcclusionCuller::addOccluder( const AABB& box, OccluderShape shape )
+{
+    float x[8], y[8], z[8];
+    if ( !projectBox( box, x, y, z ) ) return false;
+
+    float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+    for ( int i = 1; i < 8; ++i )
+    {
+        minX = qMin( minX, x[i] );
+        maxX = qMax( maxX, x[i] );
+        minY = qMin( minY, y[i] );
+        maxY = qMax( maxY, y[i] );
+    }
+    float width = qMin( maxX, float( Width ) ) - qMax( minX, 0.0f );
+    float height = qMin( maxY, float( Height ) ) - qMax( minY, 0.0f );
+    if ( width <= 0.0f || height <= 0.0f || width * height < MIN_OCCLUDER_AREA ) return false;
+
+    // +Y面是s_boxTriangles中的第6、7个三角形
+    int first = shape == TopFaceOccluder ? 6 : 0;
+    int last = shape == TopFaceOccluder ? 8 : 12;
+    for ( int i = first; i < last; ++i )
+    {
+        Triangle triangle;
+        for ( int j = 0; j < 3; ++j )
+        {
+            int corner = s_boxTriangles[i][j];
+            triangle.x[j] = x[corner];
+            triangle.y[j] = y[corner];
+            triangle.z[j] = z[corner];
+        }
+
+        // 背面以及退化的面（例如平面的侧面）面积不为正
+        float doubleArea = ( triangle.x[1] - triangle.x[0] ) * ( triangle.y[2] - triangle.y[0] ) -
+                ( triangle.x[2] - triangle.x[0] ) * ( triangle.y[1] - triangle.y[0] );
+        if ( doubleArea <= 0.0f ) continue;
+
+        triangle.minX = qMax( 0, int( floorf( qMin( triangle.x[0], qMin( triangle.x[1], triangle.x[2] ) ) ) ) );
+        triangle.maxX = qMin( Width - 1, int( ceilf( qMax( triangle.x[0], qMax( triangle.x[1], triangle.x[2] ) ) ) ) );
+        triangle.minY = qMax( 0, int( floorf( qMin( triangle.y[0], qMin( triangle.y[1], triangle.y[2] ) ) ) ) );
+        triangle.maxY = qMin( Height - 1, int( ceilf( qMax( triangle.y[0], qMax( triangle.y[1], triangle.y[2] ) ) ) ) );
+        if ( triangle.minX > triangle.maxX || triangle.minY > triangle.maxY ) continue;
+        m_triangles.append( triangle );
+    }
+    ++m_occluderCount;
+    return true;
+}
+
+void OcclusionCuller::rasterize( JobSystem& jobSystem )
+{
+    // 每个任务清空并绘制自己的几行，互不重叠，不需要同步
+    jobSystem.parallelFor( Height / BandHeight, 1, [this]( int begin, int end )
+    {
+        for ( int band = begin; band < end; ++band )
+            rasterizeBand( band * BandHeight, band * BandHeight + BandHeight - 1 );
+    } );
+}
+
+void OcclusionCuller::rasterizeBand( int firstRow, int lastRow )
+{
+    float* depth = m_depth.data( );
+    for ( int i = firstRow * Width; i < ( lastRow + 1 ) * Width; ++i ) depth[i] = 1.0f;
+
+    foreach ( const Triangle& triangle, m_triangles )
+    {
+        if ( triangle.maxY < firstRow || triangle.minY > lastRow ) continue;
+        rasterizeTriangle( triangle, firstRow, lastRow );
+    }
+}
+
+void OcclusionCuller::rasterizeTriangle( const Triangle& t, int firstRow, int lastRow )
+{
+    // 三条边的边函数E = A * x + B * y + C，在三角形内部都不小于0
+    float a[3], b[3], c[3];
+    for ( int i = 0; i < 3; ++i )
+    {
+        int j = ( i + 1 ) % 3;
+        a[i] = t.y[i] - t.y[j];
+        b[i] = t.x[j] - t.x[i];
+        c[i] = -( a[i] * t.x[i] + b[i] * t.y[i] );
+    }
+
+    // 深度是屏幕坐标的线性函数：z0 + (E20 * (z1 - z0) + E01 * (z2 - z0)) / 面积
+    float inverseArea = 1.0f / ( a[0] * t.x[2] + b[0] * t.y[2] + c[0] );
+    float dz1 = ( t.z[1] - t.z[0] ) * inverseArea;
+    float dz2 = ( t.z[2] - t.z[0] ) * inverseArea;
+    float za = a[2] * dz1 + a[0] * dz2;
+    float zb = b[2] * dz1 + b[0] * dz2;
+    float zc = t.z[0] + c[2] * dz1 + c[0] * dz2;
+
+    int startX = t.minX & ~3;
+    int minY = qMax( t.minY, firstRow ), maxY = qMin( t.maxY, lastRow );
+    float* depth = m_depth.data( );
+    for ( int y = minY; y <= maxY; ++y )
+    {
+        float py = y + 0.5f;
+        float* row = depth + y * Width;
+#ifdef OCCLUSION_SSE
+        // 一次处理一行中相邻的四个像素
+        __m128 e0Row = _mm_set1_ps( b[0] * py + c[0] );
+        __m128 e1Row = _mm_set1_ps( b[1] * py + c[1] );
+        __m128 e2Row = _mm_set1_ps( b[2] * py + c[2] );
+        __m128 zRow = _mm_set1_ps( zb * py + zc );
+        __m128 a0 = _mm_set1_ps( a[0] ), a1 = _mm_set1_ps( a[1] ), a2 = _mm_set1_ps( a[2] );
+        __m128 zA = _mm_set1_ps( za );
+        __m128 zero = _mm_setzero_ps( );
+        __m128 px = _mm_add_ps( _mm_set1_ps( startX + 0.5f ),
+                                _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f ) );
+        __m128 four = _mm_set1_ps( 4.0f );
+        for ( int x = startX; x <= t.maxX; x += 4 )
+        {
+            __m128 e0 = _mm_add_ps( _mm_mul_ps( a0, px ), e0Row );
+            __m128 e1 = _mm_add_ps( _mm_mul_ps( a1, px ), e1Row );
+            __m128 e2 = _mm_add_ps( _mm_mul_ps( a2, px ), e2Row );
+            __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( e0, zero ),
+                                                    _mm_cmpge_ps( e1, zero ) ),
+                                        _mm_cmpge_ps( e2, zero ) );
+            if ( _mm_movemask_ps( inside ) != 0 )
+            {
+                __m128 z = _mm_add_ps( _mm_mul_ps( zA, px ), zRow );
+                __m128 old = _mm_loadu_ps( row + x );
+                __m128 nearer = _mm_min_ps( old, z );
+                _mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( inside, nearer ),
+                                                   _mm_andnot_ps( inside, old ) ) );
+            }
+            px = _mm_add_ps( px, four );
+        }
+#else
+        for ( int x = startX; x <= t.maxX; ++x )
+        {
+            float px = x + 0.5f;
+            if ( a[0] * px + b[0] * py + c[0] < 0.0f ||
+                 a[1] * px + b[1] * py + c[1] < 0.0f ||
+                 a[2] * px + b[2] * py + c[2] < 0.0f ) continue;
+            row[x] = qMin( row[x], za * px + zb * py + zc );
+        }
+#endif
+    }
+}
+
+bool OcclusionCuller::isVisible( const AABB& box ) const
+{
+    float x[8], y[8], z[8];
+    if ( !projectBox( box, x, y, z ) ) return true;
+
+    float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0], minZ = z[0];
+    for ( int i = 1; i < 8; ++i )
+    {
+        minX = qMin( minX, x[i] );
+        maxX = qMax( maxX, x[i] );
+        minY = qMin( minY, y[i] );
+        maxY = qMax( maxY, y[i] );
+        minZ = qMin( minZ, z[i] );
+    }
+
+    // 覆盖包围盒投影的所有像素，x方向按4对齐以后更保守
+    int firstX = qMax( 0, int( floorf( minX ) ) ) & ~3;
+    int lastX = qMin( Width - 1, int( ceilf( maxX ) ) );
+    int firstY = qMax( 0, int( floorf( minY ) ) );
+    int lastY = qMin( Height - 1, int( ceilf( maxY ) ) );
+    if ( firstX > lastX || firstY > lastY ) return true;
+
+    // 只要有一个像素的遮挡体比包围盒最近的点还远，就可能看得见
+    float threshold = minZ - OCCLUSION_BIAS;
+    const float* depth = m_depth.constData( );
+    for ( int y = firstY; y <= lastY; ++y )
+    {
+        const float* row = depth + y * Width;
+#ifdef OCCLUSION_SSE
+        __m128 limit = _mm_set1_ps( threshold );
+        for ( int x = firstX; x <= lastX; x += 4 )
+        {
+            if ( _mm_movemask_ps( _mm_cmpge_ps( _mm_loadu_ps( row + x ), limit ) ) != 0 )
+                return true;
+        }
+#else
+        for ( int x = firstX; x <= lastX; ++x )
+        {
+            if ( row[x] >= threshold ) return true;
+        }
+#endif
+    }
+    return false;
+}
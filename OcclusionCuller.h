@@ -0,0 +1,68 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <QVector>
+#include <QMatrix4x4>
+#include "BVH.h"
+
+class JobSystem;
+
+// CPU上的遮挡剔除：把大的遮挡体（立方体、平面的包围盒）光栅化到低分辨率的
+// 深度缓存中，再用实体包围盒在屏幕上的矩形以及最近的深度测试是否完全被挡住。
+// 深度为NDC的z/w，按行分带在工作线程上并行光栅化，不需要GPU查询
+class OcclusionCuller
+{
+public:
+    enum
+    {
+        Width = 256,
+        Height = 128,
+        BandHeight = 16         // 每个任务负责的行数
+    };
+
+    // 遮挡体光栅化包围盒的哪些面。平面只绘制朝上的一面，
+    // 从下方看时平面被背面剔除，不能挡住后面的物体
+    enum OccluderShape
+    {
+        NoOccluder = 0,
+        BoxOccluder,
+        TopFaceOccluder
+    };
+
+    OcclusionCuller( void );
+
+    // 每帧开始时调用，清空上一帧的遮挡体
+    void begin( const QMatrix4x4& viewProjection );
+
+    // 投影以后面积太小或者穿过近平面的遮挡体被忽略，返回是否加入
+    bool addOccluder( const AABB& box, OccluderShape shape = BoxOccluder );
+
+    // 清空深度缓存并绘制所有的遮挡体
+    void rasterize( JobSystem& jobSystem );
+
+    // 可以在多个线程中同时调用。无法判断时（例如穿过近平面）返回true
+    bool isVisible( const AABB& box ) const;
+
+    int occluderCount( void ) const { return m_occluderCount; }
+    int triangleCount( void ) const { return m_triangles.size( ); }
+    const float* depthBuffer( void ) const { return m_depth.constData( ); }
+protected:
+    // 屏幕空间（像素）的三角形，已经去掉背面
+    struct Triangle
+    {
+        float           x[3], y[3], z[3];
+        int             minX, maxX, minY, maxY;
+    };
+
+    // 包围盒的八个角投影到屏幕，有角在近平面之后时返回false
+    bool projectBox( const AABB& box, float x[8], float y[8], float z[8] ) const;
+    void rasterizeBand( int firstRow, int lastRow );
+    void rasterizeTriangle( const Triangle& triangle, int firstRow, int lastRow );
+
+    QMatrix4x4          m_viewProjection;
+    QVector<Triangle>   m_triangles;
+    QVector<float>      m_depth;
+    int                 m_occluderCount;
+};
+
+#endif // OCCLUSIONCULLER_H
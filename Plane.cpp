@@ -1,55 +1,31 @@
-#include <math.h>
 #include <QOpenGLFunctions>
-#include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QQmlFile>
 #include "View.h"
+#include "Light.h"
+#include "MeshBuffer.h"
 #include "Plane.h"
 
-#define VERTEX_COUNT    6
 #define PLANE_LENGTH    25.0
 #define TEXTURE_UNIT    GL_TEXTURE0
 #define SHADOW_TEXTURE_UNIT GL_TEXTURE1
-
-static void canonicalPosition( QVector3D& position )
-{
-    if ( !qFuzzyIsNull( position.x( ) ) )
-        position.setX( position.x( ) / fabsf( position.x( ) ) );
-    if ( !qFuzzyIsNull( position.y( ) ) )
-        position.setY( position.y( ) / fabsf( position.y( ) ) );
-    if ( !qFuzzyIsNull( position.z( ) ) )
-        position.setZ( position.z( ) / fabsf( position.z( ) ) );
-}
+#define SHADOW_CUBE_TEXTURE_UNIT GL_TEXTURE2
 
 class PlaneRenderer: protected QOpenGLFunctions
 {
-    struct Vertex
-    {
-        void set( const QVector3D& _position, const QVector3D& _normal,
-                  const QVector2D& _texCoord )
-        {
-            position = _position;
-            normal = _normal;
-            texCoord = _texCoord;
-        }
-
-        QVector3D               position;
-        QVector3D               normal;
-        QVector2D               texCoord;
-    };
 public:
     enum ShadowType
     {
         NoShadow = 0,// 以后依次递增
         SimpleShadow,
-        PCFShadow
+        PointShadow,
+        VarianceShadow
     };
 
     explicit PlaneRenderer( Plane* plane, ShadowType shadowType ):
         m_plane( plane ),
         m_shadowType( shadowType ),
-        m_vertexBuffer( QOpenGLBuffer::VertexBuffer ),
         m_texture( QOpenGLTexture::Target2D )
     {
         initializeOpenGLFunctions( );
@@ -58,8 +34,7 @@ public:
         if ( s_count++ == 0 )
         {
             s_program = new QOpenGLShaderProgram;
-            s_program->addShaderFromSourceFile( QOpenGLShader::Vertex,
-                                                ":/Common.vert" );
+            View::addCommonVertexShader( s_program );
             s_program->addShaderFromSourceFile( QOpenGLShader::Fragment,
                                                 ":/Common.frag" );
             s_program->link( );
@@ -67,12 +42,11 @@ public:
             s_positionLoc = s_program->attributeLocation( "position" );
             s_normalLoc = s_program->attributeLocation( "normal" );
             s_texCoordLoc = s_program->attributeLocation( "texCoord" );
+            s_texCoordTransformLoc = s_program->uniformLocation( "texCoordTransform" );
             s_modelMatrixLoc = s_program->uniformLocation( "modelMatrix" );
             s_viewMatrixLoc = s_program->uniformLocation( "viewMatrix" );
             s_projectionMatrixLoc = s_program->uniformLocation( "projectionMatrix" );
-            s_lightPositionLoc = s_program->uniformLocation( "lightPosition" );
-            s_lightViewProjectionMatrixLoc =
-                    s_program->uniformLocation( "lightViewProjectionMatrix" );
+            s_lightUniforms.resolve( s_program );
             s_modelViewNormalMatrixLoc =
                     s_program->uniformLocation( "modelViewNormalMatrix" );
             s_shadowTypeLoc = s_program->uniformLocation( "shadowType" );
@@ -82,43 +56,18 @@ public:
                                         TEXTURE_UNIT - GL_TEXTURE0 );
             s_program->setUniformValue( shadowLoc,
                                         SHADOW_TEXTURE_UNIT - GL_TEXTURE0 );
+            s_program->setUniformValue( s_program->uniformLocation( "shadowCubeTexture" ),
+                                        SHADOW_CUBE_TEXTURE_UNIT - GL_TEXTURE0 );
 
             s_program->release( );
         }
 
-        // 设置顶点坐标
-        qreal semi = PLANE_LENGTH / 2.0;
-        const QVector3D vertices[] =
-        {
-            QVector3D( semi, 0.0f, -semi ),
-            QVector3D( semi, 0.0f, semi ),
-            QVector3D( -semi, 0.0f, -semi ),
-            QVector3D( -semi, 0.0f, semi )
-        };
-
-        const QVector2D texCoords[] =
-        {
-            QVector2D( 0.0, 0.0 ),
-            QVector2D( 0.0, 1.0 ),
-            QVector2D( 1.0, 0.0 ),
-            QVector2D( 1.0, 1.0 )
-        };
-
-        m_vertices = new Vertex[VERTEX_COUNT];
-        Vertex* v = m_vertices;
-
-        v[0].set( vertices[2], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[1] );
-        v[1].set( vertices[1], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[2] );
-        v[2].set( vertices[0], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[0] );
-        v[3].set( vertices[2], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[1] );
-        v[4].set( vertices[3], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[3] );
-        v[5].set( vertices[1], QVector3D( 0.0f, 1.0f, 0.0f ), texCoords[2] );
-
-        m_vertexBuffer.setUsagePattern( QOpenGLBuffer::DynamicDraw );
-        m_vertexBuffer.create( );
-        m_vertexBuffer.bind( );
-        m_vertexBuffer.allocate( v, VERTEX_COUNT * sizeof( Vertex ) );
-        m_vertexBuffer.release( );
+        // 设置顶点坐标，保留单位边长的位置用于resize
+        Geometry::MeshData data;
+        Geometry::plane( 1.0f, data );
+        m_unitPositions = data.positions;
+        Geometry::plane( PLANE_LENGTH, data );
+        m_mesh.create( data, QOpenGLBuffer::DynamicDraw );
 
         // 设置纹理滤波
         m_texture.setMinificationFilter( QOpenGLTexture::LinearMipMapLinear );
@@ -126,9 +75,8 @@ public:
     }
     ~PlaneRenderer( void )
     {
-        m_vertexBuffer.destroy( );
+        m_mesh.destroy( );
         m_texture.destroy( );
-        delete []m_vertices;
         if ( --s_count == 0 )
         {
             delete s_program;
@@ -136,16 +84,21 @@ public:
     }
     void render( void )
     {
+        // 是否启用实时阴影，由View的shadowMode决定
+        ShadowType shadowType = m_shadowType == NoShadow ?
+                    NoShadow : ShadowType( m_plane->m_view->renderShadowMode( ) );
+        if ( shadowType == NoShadow )
+        {
+            renderUnshadowed( );
+            return;
+        }
+
         s_program->bind( );
-        m_vertexBuffer.bind( );
+        int changes = 1;
 
         // 绘制box
-        int offset = 0;
-        setVertexAttribute( s_positionLoc, GL_FLOAT, 3, offset );
-        offset += 3 * sizeof( GLfloat );
-        setVertexAttribute( s_normalLoc, GL_FLOAT, 3, offset );
-        offset += 3 * sizeof( GLfloat );
-        setVertexAttribute( s_texCoordLoc, GL_FLOAT, 2, offset );
+        changes += m_mesh.bind( s_program, s_positionLoc, s_normalLoc, s_texCoordLoc,
+                                s_texCoordTransformLoc );
 
         // 摄像机的MVP矩阵
         QMatrix4x4& viewMatrix = m_plane->m_view->viewMatrix( );
@@ -153,71 +106,72 @@ public:
         s_program->setUniformValue( s_viewMatrixLoc, viewMatrix );
         s_program->setUniformValue( s_projectionMatrixLoc, m_plane->m_view->projectionMatrix( ) );
         s_program->setUniformValue( s_modelViewNormalMatrixLoc,
-                                    ( viewMatrix * m_modelMatrix ).normalMatrix( ) );
-        // 是否启用实时阴影
-        //s_program->setUniformValue( s_shadowTypeLoc, m_shadowType );
+                                    m_modelViewNormalMatrix );
+        s_program->setUniformValue( s_shadowTypeLoc, int( shadowType ) );
+        // 上面的四个矩阵和阴影类型，再加上光源数组
+        changes += 5 + s_lightUniforms.apply( s_program, m_plane->m_view );
 
         m_texture.bind( );
-        if ( m_shadowType != NoShadow )
-        {
-            s_program->setUniformValue( s_lightPositionLoc, m_plane->m_view->lightPosition( ) );
-            s_program->setUniformValue( s_lightViewProjectionMatrixLoc,
-                                        m_plane->m_view->lightViewProjectionMatrix( ) );
-
-            glActiveTexture( SHADOW_TEXTURE_UNIT );
-            glBindTexture( GL_TEXTURE_2D, m_plane->m_view->shadowTexture( ) );
-            glDrawArrays( GL_TRIANGLES, 0, VERTEX_COUNT );
-            glActiveTexture( TEXTURE_UNIT );
-        }
-        else
+        glActiveTexture( SHADOW_TEXTURE_UNIT );
+        glBindTexture( GL_TEXTURE_2D, m_plane->m_view->shadowTexture( ) );
+        if ( shadowType == PointShadow )
         {
-            glDrawArrays( GL_TRIANGLES, 0, VERTEX_COUNT );
+            glActiveTexture( SHADOW_CUBE_TEXTURE_UNIT );
+            glBindTexture( GL_TEXTURE_CUBE_MAP, m_plane->m_view->shadowCubeTexture( ) );
         }
+        m_mesh.draw( );
+        glActiveTexture( TEXTURE_UNIT );
+        changes += shadowType == PointShadow ? 3 : 2;
+        m_plane->m_view->countStateChanges( changes );
+        m_plane->m_view->countDrawCall( m_mesh.triangleCount( ) );
         m_texture.release( );
-        m_vertexBuffer.release( );
+        m_mesh.release( );
 
         s_program->release( );
     }
+    void renderUnshadowed( void )
+    {
+        // View中没有阴影计算的程序，不上传阴影的uniform，也不绑定阴影图
+        View* view = m_plane->m_view;
+        const View::UnshadowedProgram& unshadowed = view->unshadowedProgram( );
+        int changes = view->bindUnshadowedProgram( m_modelMatrix, m_modelViewNormalMatrix );
+        changes += m_mesh.bind( unshadowed.program, unshadowed.positionLoc,
+                                unshadowed.normalLoc, unshadowed.texCoordLoc,
+                                unshadowed.texCoordTransformLoc );
+        m_texture.bind( );
+        m_mesh.draw( );
+        view->countStateChanges( changes + 1 );
+        view->countDrawCall( m_mesh.triangleCount( ) );
+        m_texture.release( );
+        m_mesh.release( );
+
+        unshadowed.program->release( );
+    }
+    void prepare( void )
+    {
+        // 可以在工作线程中执行，不涉及OpenGL调用
+        m_modelViewNormalMatrix =
+                ( m_plane->m_view->viewMatrix( ) * m_modelMatrix ).normalMatrix( );
+    }
     void renderShadow( void )
     {
-        m_vertexBuffer.bind( );
+        // 阴影只需要位置
         QOpenGLShaderProgram* depthProgram = m_plane->m_view->depthProgram( );
-        depthProgram->enableAttributeArray( "position" );
-        depthProgram->setAttributeBuffer(
-                    "position",             // 位置
-                    GL_FLOAT,               // 类型
-                    0,                      // 偏移
-                    3,                      // 元大小
-                    sizeof( Vertex ) );     // 迈
+        int changes = m_mesh.bindPositions( depthProgram,
+                                            depthProgram->attributeLocation( "position" ) );
 
         depthProgram->setUniformValue( "modelMatrix", m_modelMatrix );
-        glDrawArrays( GL_TRIANGLES, 0, VERTEX_COUNT );
-        m_vertexBuffer.release( );
+        m_mesh.draw( );
+        m_plane->m_view->countStateChanges( changes + 1 );
+        m_plane->m_view->countDrawCall( m_mesh.triangleCount( ) );
+        m_mesh.release( );
     }
     void resize( qreal length )
     {
-        qreal semi = length / 2.0;
-        m_vertexBuffer.bind( );
-        Vertex* v = (Vertex*)m_vertexBuffer.map( QOpenGLBuffer::WriteOnly );
-        for ( int i = 0; i < VERTEX_COUNT; ++i )
-        {
-            canonicalPosition( v[i].position );
-            v[i].position *= semi;
-        }
-        m_vertexBuffer.unmap( );
-        m_vertexBuffer.release( );
-    }
-    void setVertexAttribute( int attributeLocation,
-                             GLenum elementType,
-                             quint32 elementSize,
-                             quint32 offset )
-    {
-        s_program->enableAttributeArray( attributeLocation );
-        s_program->setAttributeBuffer( attributeLocation,      // 位置
-                                       elementType,            // 类型
-                                       offset,                 // 偏移
-                                       elementSize,            // 元大小
-                                       sizeof( Vertex ) );     // 迈
+        QVector<QVector3D> positions( m_unitPositions.size( ) );
+        for ( int i = 0; i < positions.size( ); ++i )
+            positions[i] = m_unitPositions[i] * length;
+        m_mesh.writePositions( positions, m_plane->m_view->streamBuffer( ) );
     }
     void loadTextureFromSource( const QUrl& source )
     {
@@ -233,21 +187,23 @@ public:
         m_modelMatrix.setToIdentity( );
         m_modelMatrix.translate( translate );
     }
+    void setShadowType( ShadowType shadowType ) { m_shadowType = shadowType; }
 protected:
     Plane*                  m_plane;
 
     QMatrix4x4              m_modelMatrix;
+    QMatrix3x3              m_modelViewNormalMatrix;
     ShadowType              m_shadowType;
-    QOpenGLBuffer           m_vertexBuffer;
+    MeshBuffer              m_mesh;
+    QVector<QVector3D>      m_unitPositions;
     QOpenGLTexture          m_texture;
-    Vertex*                 m_vertices;
 
     static QOpenGLShaderProgram* s_program;
     static int s_positionLoc, s_normalLoc,
-    s_texCoordLoc, s_modelMatrixLoc,
+    s_texCoordLoc, s_texCoordTransformLoc, s_modelMatrixLoc,
     s_viewMatrixLoc, s_projectionMatrixLoc,
-    s_lightViewProjectionMatrixLoc,
-    s_lightPositionLoc, s_modelViewNormalMatrixLoc, s_shadowTypeLoc;
+    s_modelViewNormalMatrixLoc, s_shadowTypeLoc;
+    static LightUniforms    s_lightUniforms;
     static int              s_count;        // 计数
 };
 
@@ -255,20 +211,26 @@ QOpenGLShaderProgram* PlaneRenderer::s_program = Q_NULLPTR;
 int PlaneRenderer::s_positionLoc,
 PlaneRenderer::s_normalLoc,
 PlaneRenderer::s_texCoordLoc,
+PlaneRenderer::s_texCoordTransformLoc,
 PlaneRenderer::s_modelMatrixLoc,
 PlaneRenderer::s_viewMatrixLoc,
 PlaneRenderer::s_projectionMatrixLoc,
-PlaneRenderer::s_lightViewProjectionMatrixLoc,
-PlaneRenderer::s_lightPositionLoc,
 PlaneRenderer::s_modelViewNormalMatrixLoc,
 PlaneRenderer::s_shadowTypeLoc,
 PlaneRenderer::s_count = 0;
+LightUniforms PlaneRenderer::s_lightUniforms;
 
 Plane::Plane( QObject* parent ): QObject( parent )
 {
     m_length = PLANE_LENGTH;
     m_lengthIsDirty = false;
     m_sourceIsDirty = false;
+    m_translateIsDirty = false;
+    m_staticGeometry = false;
+    m_castShadows = true;
+    m_receiveShadows = true;
+    m_view = Q_NULLPTR;
+    m_renderer = Q_NULLPTR;
 }
 
 void Plane::initialize( void )
@@ -281,6 +243,11 @@ void Plane::render( void )
     m_renderer->render( );
 }
 
+void Plane::prepare( void )
+{
+    m_renderer->prepare( );
+}
+
 void Plane::renderShadow( void )
 {
     m_renderer->renderShadow( );
@@ -288,6 +255,8 @@ void Plane::renderShadow( void )
 
 void Plane::sync( void )
 {
+    TRACE_SCOPE( "Plane::sync" );
+
     if ( m_lengthIsDirty )
     {
         m_renderer->resize( m_length );
@@ -295,6 +264,7 @@ void Plane::sync( void )
     }
     if ( m_sourceIsDirty )
     {
+        TRACE_SCOPE( "Plane::loadTexture" );
         m_renderer->loadTextureFromSource( m_source );
         m_sourceIsDirty = false;
     }
@@ -303,6 +273,8 @@ void Plane::sync( void )
         m_renderer->translate( m_translate );
         m_translateIsDirty = false;
     }
+    m_renderer->setShadowType( m_receiveShadows ?
+                                   PlaneRenderer::SimpleShadow : PlaneRenderer::NoShadow );
 }
 
 void Plane::release( void )
@@ -310,12 +282,20 @@ void Plane::release( void )
     delete m_renderer;
 }
 
+AABB Plane::boundingBox( void )
+{
+    float semi = m_length / 2.0;
+    QVector3D extent( semi, 0.0f, semi );
+    return AABB( m_translate - extent, m_translate + extent );
+}
+
 void Plane::setLength( qreal length )
 {
     if ( m_length == length ) return;
     m_length = length;
     emit lengthChanged( );
     m_lengthIsDirty = true;
+    updateWindow( );
 }
 
 void Plane::setSource( const QUrl& source )
@@ -324,6 +304,7 @@ void Plane::setSource( const QUrl& source )
     m_source = source;
     emit sourceChanged( );
     m_sourceIsDirty = true;
+    updateWindow( );
 }
 
 void Plane::setTranslate( const QVector3D& translate )
@@ -332,5 +313,34 @@ void Plane::setTranslate( const QVector3D& translate )
     m_translate = translate;
     emit translateChanged( );
     m_translateIsDirty = true;
+    updateWindow( );
 }
 
+void Plane::setStaticGeometry( bool staticGeometry )
+{
+    if ( m_staticGeometry == staticGeometry ) return;
+    m_staticGeometry = staticGeometry;
+    emit staticGeometryChanged( );
+    updateWindow( );
+}
+
+void Plane::setCastShadows( bool castShadows )
+{
+    if ( m_castShadows == castShadows ) return;
+    m_castShadows = castShadows;
+    emit castShadowsChanged( );
+    updateWindow( );
+}
+
+void Plane::setReceiveShadows( bool receiveShadows )
+{
+    if ( m_receiveShadows == receiveShadows ) return;
+    m_receiveShadows = receiveShadows;
+    emit receiveShadowsChanged( );
+    updateWindow( );
+}
+
+void Plane::updateWindow( void )
+{
+    if ( m_view != Q_NULLPTR ) m_view->updateWindow( );
+}
@@ -4,6 +4,7 @@
 #include <QUrl>
 #include <QVector3D>
 #include <QObject>
+#include "BVH.h"
 
 class View;
 class PlaneRenderer;
@@ -13,15 +14,22 @@ class Plane: public QObject
     Q_PROPERTY( qreal length READ length WRITE setLength NOTIFY lengthChanged )
     Q_PROPERTY( QUrl source READ source WRITE setSource NOTIFY sourceChanged )
     Q_PROPERTY( QVector3D translate READ translate WRITE setTranslate NOTIFY translateChanged )
+    // 不再移动的实体合并到View的静态批次中绘制
+    Q_PROPERTY( bool staticGeometry READ staticGeometry WRITE setStaticGeometry NOTIFY staticGeometryChanged )
+    // 是否绘制到阴影图中，以及是否采样阴影图，例如地面通常不需要投射阴影
+    Q_PROPERTY( bool castShadows READ castShadows WRITE setCastShadows NOTIFY castShadowsChanged )
+    Q_PROPERTY( bool receiveShadows READ receiveShadows WRITE setReceiveShadows NOTIFY receiveShadowsChanged )
 public:
     explicit Plane( QObject* parent = Q_NULLPTR );
 
     void initialize( void );
     void render( void );
+    void prepare( void );
     void renderShadow( void );
     void sync( void );
     void release( void );
     void setView( View* view ) { m_view = view; }
+    AABB boundingBox( void );
 
     qreal length( void ) { return m_length; }
     void setLength( qreal length );
@@ -32,15 +40,32 @@ public:
     QVector3D translate( void ) { return m_translate; }
     void setTranslate( const QVector3D& translate );
 
+    bool staticGeometry( void ) { return m_staticGeometry; }
+    void setStaticGeometry( bool staticGeometry );
+
+    bool castShadows( void ) { return m_castShadows; }
+    void setCastShadows( bool castShadows );
+
+    bool receiveShadows( void ) { return m_receiveShadows; }
+    void setReceiveShadows( bool receiveShadows );
+
     friend class PlaneRenderer;
 signals:
     void lengthChanged( void );
     void sourceChanged( void );
     void translateChanged( void );
+    void staticGeometryChanged( void );
+    void castShadowsChanged( void );
+    void receiveShadowsChanged( void );
 protected:
+    void updateWindow( void );
+
     qreal           m_length;
     QUrl            m_source;
     QVector3D       m_translate;
+    bool            m_staticGeometry;
+    bool            m_castShadows;
+    bool            m_receiveShadows;
 
     bool            m_lengthIsDirty: 1;
     bool            m_sourceIsDirty: 1;
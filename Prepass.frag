@@ -0,0 +1,10 @@
+// Prepass.frag
+// 深度预渲染只需要深度，颜色写入已经关闭
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+void main( void )
+{
+    gl_FragColor = vec4( 1.0 );
+}
@@ -0,0 +1,110 @@
+import QtQuick 2.4
+import QtProblem 1.0
+
+// 参考场景，应用程序和benchmark的回归测试共用
+TexturedCubeView
+{
+    id: view
+    objectName: "view"
+
+    Cube
+    {
+        objectName: "biscuit cube"
+        staticGeometry: true
+        source: "image/biscuit.jpg"
+        length: 2
+        translate: Qt.vector3d( -4, -3.9, 4 )
+    }
+
+    Cube
+    {
+        objectName: "wood cube"
+        staticGeometry: true
+        source: "image/wood.jpg"
+        length: 2
+        translate: Qt.vector3d( 4, -3.9, 4 )
+    }
+
+    Cube
+    {
+        objectName: "spiral cube"
+        staticGeometry: true
+        source: "image/spiral.jpg"
+        length: 2
+        translate: Qt.vector3d( 4, -3.9, -4 )
+    }
+
+    Cube
+    {
+        objectName: "shining cube"
+        staticGeometry: true
+        source: "image/shining.jpg"
+        length: 2
+        translate: Qt.vector3d( -4, -3.9, -4 )
+    }
+
+    Cube
+    {
+        objectName: "BIG cube"
+        source: "image/color_line.jpg"
+        length: 3
+        translate: Qt.vector3d( 0, 0, 0 )
+    }
+
+    Plane
+    {
+        objectName: "plane"
+        staticGeometry: true
+        castShadows: false
+        source: "image/color_line.jpg"
+        length: 20
+        translate: Qt.vector3d( 0, -5, 0 )
+    }
+
+//    TexturedCube
+//    {
+//        objectName: "textureCube_1"
+//        source: "image/stone.jpg"
+//        length: 10
+//    }
+
+//    TexturedCube
+//    {
+//        objectName: "textureCube_2"
+//        source: "image/fruit.jpg"
+//        length: 3
+
+//        translate: Qt.vector3d( 0, 15, 0 )
+//    }
+
+    position: Qt.vector3d( 0, 4, -12 )
+    lookAt: Qt.vector3d( 0, 0, 0 )
+    up: Qt.vector3d( 0, 1, 0 )
+    fieldOfView: 90
+    aspectRatio: 0.6667
+    nearPlane: 1
+    farPlane: 100
+
+    // 按照Y轴对光源的位置进行旋转，在渲染线程中计算
+    lightPosition: Qt.vector3d( 0.0, 9.0, 5.0 )
+
+    ViewAnimator
+    {
+        target: ViewAnimator.Light
+        mode: ViewAnimator.Orbit
+        center: Qt.vector3d( 0.0, 9.0, 0.0 )
+        radius: 5.0
+        duration: 4000
+        loops: ViewAnimator.Infinite
+        running: true
+    }
+
+//    NumberAnimation on angle
+//    {
+//        from: 0
+//        to: 2 * Math.PI
+//        duration: 20000
+//        loops: Animation.Infinite
+//        running: true
+//    }
+}
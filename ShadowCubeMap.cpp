@@ -0,0 +1,163 @@
+#include <QOpenGLContext>
+#include <QOpenGLShader>
+#include "ShadowCubeMap.h"
+
+// glFramebufferTexture不在QOpenGLFunctions中，需要自己解析
+typedef void ( QOPENGLF_APIENTRYP FramebufferTextureFunction )( GLenum target, GLenum attachment,
+                                                                GLuint texture, GLint level );
+
+///////////////////////////////////////////////////////////////////////////////
+ShadowCubeMap::ShadowCubeMap( void ):
+    m_texture( 0 ),
+    m_framebuffer( 0 ),
+    m_depthBuffer( 0 ),
+    m_layeredFramebuffer( 0 ),
+    m_depthTexture( 0 ),
+    m_size( 0 )
+{
+}
+
+ShadowCubeMap::~ShadowCubeMap( void )
+{
+    destroy( );
+}
+
+bool ShadowCubeMap::create( int size )
+{
+    initializeOpenGLFunctions( );
+    destroy( );
+    m_size = size;
+
+    glGenTextures( 1, &m_texture );
+    glBindTexture( GL_TEXTURE_CUBE_MAP, m_texture );
+    for ( int face = 0; face < FaceCount; ++face )
+    {
+        glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA,
+                      size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, Q_NULLPTR );
+    }
+    // 打包的距离不能插值
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
+
+    // 几何着色器以及gl_Layer需要桌面OpenGL 3.2
+    QOpenGLContext* context = QOpenGLContext::currentContext( );
+    FramebufferTextureFunction framebufferTexture = Q_NULLPTR;
+    if ( !context->isOpenGLES( ) &&
+         context->format( ).version( ) >= qMakePair( 3, 2 ) &&
+         QOpenGLShader::hasOpenGLShaders( QOpenGLShader::Geometry, context ) )
+    {
+        framebufferTexture = reinterpret_cast<FramebufferTextureFunction>(
+                    context->getProcAddress( "glFramebufferTexture" ) );
+    }
+
+    if ( framebufferTexture != Q_NULLPTR )
+    {
+        // 分层的帧缓存要求所有附件都是分层的，深度也用立方体贴图
+        glGenTextures( 1, &m_depthTexture );
+        glBindTexture( GL_TEXTURE_CUBE_MAP, m_depthTexture );
+        for ( int face = 0; face < FaceCount; ++face )
+        {
+            glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT16,
+                          size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, Q_NULLPTR );
+        }
+        glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+        glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+        glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
+
+        glGenFramebuffers( 1, &m_layeredFramebuffer );
+        glBindFramebuffer( GL_FRAMEBUFFER, m_layeredFramebuffer );
+        framebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_texture, 0 );
+        framebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0 );
+        if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+        {
+            // 退回到逐面渲染
+            glDeleteFramebuffers( 1, &m_layeredFramebuffer );
+            glDeleteTextures( 1, &m_depthTexture );
+            m_layeredFramebuffer = 0;
+            m_depthTexture = 0;
+        }
+    }
+
+    if ( m_depthTexture == 0 )
+    {
+        glGenRenderbuffers( 1, &m_depthBuffer );
+        glBindRenderbuffer( GL_RENDERBUFFER, m_depthBuffer );
+        glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, size, size );
+        glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+    }
+
+    glGenFramebuffers( 1, &m_framebuffer );
+    bindFace( 0 );
+    if ( m_depthTexture == 0 )
+    {
+        glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_RENDERBUFFER, m_depthBuffer );
+    }
+    bool complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+    if ( !complete )
+    {
+        qWarning( "ShadowCubeMap: the framebuffer is incomplete." );
+        destroy( );
+    }
+    return complete;
+}
+
+void ShadowCubeMap::destroy( void )
+{
+    if ( m_framebuffer == 0 ) return;
+    glDeleteFramebuffers( 1, &m_framebuffer );
+    if ( m_depthBuffer != 0 ) glDeleteRenderbuffers( 1, &m_depthBuffer );
+    if ( m_layeredFramebuffer != 0 ) glDeleteFramebuffers( 1, &m_layeredFramebuffer );
+    if ( m_depthTexture != 0 ) glDeleteTextures( 1, &m_depthTexture );
+    glDeleteTextures( 1, &m_texture );
+    m_framebuffer = 0;
+    m_depthBuffer = 0;
+    m_layeredFramebuffer = 0;
+    m_depthTexture = 0;
+    m_texture = 0;
+    m_size = 0;
+}
+
+void ShadowCubeMap::bindFace( int face )
+{
+    glBindFramebuffer( GL_FRAMEBUFFER, m_framebuffer );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_texture, 0 );
+    if ( m_depthTexture != 0 )
+    {
+        glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_depthTexture, 0 );
+    }
+}
+
+void ShadowCubeMap::bindLayered( void )
+{
+    glBindFramebuffer( GL_FRAMEBUFFER, m_layeredFramebuffer );
+}
+
+QMatrix4x4 ShadowCubeMap::faceViewProjectionMatrix( const QVector3D& position,
+                                                    float nearPlane, float range,
+                                                    int face )
+{
+    // 立方体贴图各面的纹理坐标原点在左上角，所以侧面的上方向朝下
+    static const QVector3D directions[FaceCount] =
+    {
+        QVector3D( 1.0f, 0.0f, 0.0f ), QVector3D( -1.0f, 0.0f, 0.0f ),
+        QVector3D( 0.0f, 1.0f, 0.0f ), QVector3D( 0.0f, -1.0f, 0.0f ),
+        QVector3D( 0.0f, 0.0f, 1.0f ), QVector3D( 0.0f, 0.0f, -1.0f )
+    };
+    static const QVector3D ups[FaceCount] =
+    {
+        QVector3D( 0.0f, -1.0f, 0.0f ), QVector3D( 0.0f, -1.0f, 0.0f ),
+        QVector3D( 0.0f, 0.0f, 1.0f ), QVector3D( 0.0f, 0.0f, -1.0f ),
+        QVector3D( 0.0f, -1.0f, 0.0f ), QVector3D( 0.0f, -1.0f, 0.0f )
+    };
+
+    QMatrix4x4 matrix;
+    matrix.perspective( 90.0f, 1.0f, nearPlane, range );
+    matrix.lookAt( position, position + directions[face], ups[face] );
+    return matrix;
+}
@@ -0,0 +1,49 @@
+#ifndef SHADOWCUBEMAP_H
+#define SHADOWCUBEMAP_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QOpenGLFunctions>
+
+// 点光源的阴影立方体贴图。每个面保存到光源的距离（除以范围以后打包成RGBA）。
+// 桌面OpenGL 3.2以上有分层渲染，整个立方体贴图以及深度立方体贴图绑定到一个帧缓存，
+// 由几何着色器一次绘制六个面；否则（ES 2）深度缓存各面共用，六个面依次绑定到同一个帧缓存
+class ShadowCubeMap: protected QOpenGLFunctions
+{
+public:
+    enum
+    {
+        FaceCount = 6
+    };
+
+    ShadowCubeMap( void );
+    ~ShadowCubeMap( void );
+
+    // 渲染线程，需要当前的OpenGL上下文
+    bool create( int size );
+    void destroy( void );
+
+    // 绑定帧缓存并以face（GL_TEXTURE_CUBE_MAP_POSITIVE_X开始的顺序）为颜色附件，
+    // 分层时深度附件也换成同一个面
+    void bindFace( int face );
+    // 分层渲染时绑定包含所有面的帧缓存，gl_Layer选择面
+    bool isLayered( void ) { return m_layeredFramebuffer != 0; }
+    void bindLayered( void );
+
+    // 与textureCube的朝向约定一致的90度视锥体
+    static QMatrix4x4 faceViewProjectionMatrix( const QVector3D& position,
+                                                float nearPlane, float range,
+                                                int face );
+
+    GLuint texture( void ) { return m_texture; }
+    int size( void ) { return m_size; }
+protected:
+    GLuint                  m_texture;
+    GLuint                  m_framebuffer;
+    GLuint                  m_depthBuffer;
+    GLuint                  m_layeredFramebuffer;
+    GLuint                  m_depthTexture;         // 分层时代替m_depthBuffer
+    int                     m_size;
+};
+
+#endif // SHADOWCUBEMAP_H
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <QSet>
+#include <QImage>
+#include <QQmlFile>
+#include <QOpenGLTexture>
+#include <QOpenGLShaderProgram>
+#include "Cube.h"
+#include "Plane.h"
+#include "MeshBuffer.h"
+#include "View.h"
+#include "StaticBatcher.h"
+
+#define TEXTURE_UNIT        GL_TEXTURE0
+#define SHADOW_TEXTURE_UNIT GL_TEXTURE1
+#define SHADOW_CUBE_TEXTURE_UNIT GL_TEXTURE2
+#define MAX_CHUNK_VERTICES  65536       // 16位索引
+
+///////////////////////////////////////////////////////////////////////////////
+StaticBatcher::StaticBatcher( void )
+{
+    m_initialized = false;
+    m_program = Q_NULLPTR;
+    m_generation = 0;
+}
+
+StaticBatcher::~StaticBatcher( void )
+{
+    release( );
+}
+
+void StaticBatcher::initialize( void )
+{
+    initializeOpenGLFunctions( );
+
+    m_program = new QOpenGLShaderProgram;
+    View::addCommonVertexShader( m_program );
+    m_program->addShaderFromSourceFile( QOpenGLShader::Fragment, ":/Common.frag" );
+    m_program->link( );
+    m_program->bind( );
+    m_positionLoc = m_program->attributeLocation( "position" );
+    m_normalLoc = m_program->attributeLocation( "normal" );
+    m_texCoordLoc = m_program->attributeLocation( "texCoord" );
+    m_texCoordTransformLoc = m_program->uniformLocation( "texCoordTransform" );
+    m_modelMatrixLoc = m_program->uniformLocation( "modelMatrix" );
+    m_viewMatrixLoc = m_program->uniformLocation( "viewMatrix" );
+    m_projectionMatrixLoc = m_program->uniformLocation( "projectionMatrix" );
+    m_modelViewNormalMatrixLoc = m_program->uniformLocation( "modelViewNormalMatrix" );
+    m_lightUniforms.resolve( m_program );
+    m_shadowTypeLoc = m_program->uniformLocation( "shadowType" );
+    m_program->setUniformValue( m_program->uniformLocation( "texture" ),
+                                TEXTURE_UNIT - GL_TEXTURE0 );
+    m_program->setUniformValue( m_program->uniformLocation( "shadowTexture" ),
+                                SHADOW_TEXTURE_UNIT - GL_TEXTURE0 );
+    m_program->setUniformValue( m_program->uniformLocation( "shadowCubeTexture" ),
+                                SHADOW_CUBE_TEXTURE_UNIT - GL_TEXTURE0 );
+    m_program->release( );
+
+    m_initialized = true;
+}
+
+void StaticBatcher::release( void )
+{
+    if ( !m_initialized ) return;
+    for ( QHash<QUrl, Batch>::iterator it = m_batches.begin( );
+          it != m_batches.end( ); ++it ) destroy( it.value( ) );
+    m_batches.clear( );
+    m_entities.clear( );
+    delete m_program;
+    m_program = Q_NULLPTR;
+    m_initialized = false;
+}
+
+void StaticBatcher::update( const QObjectList& data )
+{
+    if ( !m_initialized ) return;
+
+    // 与上一次的状态比较，找出受影响的批次
+    QSet<QObject*> seen;
+    foreach ( QObject* object, data )
+    {
+        Cube* cube = qobject_cast<Cube*>( object );
+        Plane* plane = qobject_cast<Plane*>( object );
+
+        EntityState state;
+        if ( cube != Q_NULLPTR && cube->staticGeometry( ) )
+        {
+            state.plane = false;
+            state.length = cube->length( );
+            state.source = cube->source( );
+            state.translate = cube->translate( );
+            state.castShadows = cube->castShadows( );
+            state.receiveShadows = cube->receiveShadows( );
+        }
+        else if ( plane != Q_NULLPTR && plane->staticGeometry( ) )
+        {
+            state.plane = true;
+            state.length = plane->length( );
+            state.source = plane->source( );
+            state.translate = plane->translate( );
+            state.castShadows = plane->castShadows( );
+            state.receiveShadows = plane->receiveShadows( );
+        }
+        else continue;
+        seen.insert( object );
+
+        QHash<QObject*, EntityState>::iterator it = m_entities.find( object );
+        if ( it == m_entities.end( ) )
+        {
+            m_entities.insert( object, state );
+            Batch& batch = m_batches[state.source];
+            batch.entities.append( object );
+            batch.dirty = true;
+        }
+        else if ( it.value( ) != state )
+        {
+            if ( it.value( ).source != state.source )
+            {
+                Batch& oldBatch = m_batches[it.value( ).source];
+                oldBatch.entities.removeOne( object );
+                oldBatch.dirty = true;
+                m_batches[state.source].entities.append( object );
+            }
+            m_batches[state.source].dirty = true;
+            it.value( ) = state;
+        }
+    }
+
+    // 不再是静态的实体
+    for ( QHash<QObject*, EntityState>::iterator it = m_entities.begin( );
+          it != m_entities.end( ); )
+    {
+        if ( seen.contains( it.key( ) ) )
+        {
+            ++it;
+            continue;
+        }
+        Batch& batch = m_batches[it.value( ).source];
+        batch.entities.removeOne( it.key( ) );
+        batch.dirty = true;
+        it = m_entities.erase( it );
+    }
+
+    for ( QHash<QUrl, Batch>::iterator it = m_batches.begin( );
+          it != m_batches.end( ); )
+    {
+        if ( !it.value( ).dirty )
+        {
+            ++it;
+            continue;
+        }
+        ++m_generation;
+        if ( it.value( ).entities.isEmpty( ) )
+        {
+            destroy( it.value( ) );
+            it = m_batches.erase( it );
+            continue;
+        }
+        rebuild( it.key( ), it.value( ) );
+        ++it;
+    }
+}
+
+void StaticBatcher::rebuild( const QUrl& source, Batch& batch )
+{
+    // 顶点预先变换到世界坐标系，模型矩阵为单位矩阵
+    destroyChunks( batch );
+
+    // 按阴影标志排序，标志相同的实体放在同一个块中
+    QList<QObject*> entities = batch.entities;
+    std::stable_sort( entities.begin( ), entities.end( ),
+                      [this]( QObject* a, QObject* b )
+    {
+        const EntityState& first = m_entities[a];
+        const EntityState& second = m_entities[b];
+        if ( first.castShadows != second.castShadows ) return first.castShadows;
+        return first.receiveShadows && !second.receiveShadows;
+    } );
+
+    Geometry::MeshData merged, entity;
+    AABB bounds;
+    EntityState flags;
+    foreach ( QObject* object, entities )
+    {
+        const EntityState& state = m_entities[object];
+        if ( state.plane ) Geometry::plane( state.length, entity );
+        else Geometry::cube( state.length, entity );
+
+        if ( !merged.indices.isEmpty( ) &&
+             ( merged.positions.size( ) + entity.positions.size( ) > MAX_CHUNK_VERTICES ||
+               state.castShadows != flags.castShadows ||
+               state.receiveShadows != flags.receiveShadows ) )
+        {
+            appendChunk( batch, merged, bounds, flags );
+            merged = Geometry::MeshData( );
+            bounds = AABB( );
+        }
+        flags = state;
+
+        int base = merged.positions.size( );
+        foreach ( const QVector3D& position, entity.positions )
+        {
+            merged.positions.append( position + state.translate );
+            bounds.unite( merged.positions.last( ) );
+        }
+        merged.normals += entity.normals;
+        merged.texCoords += entity.texCoords;
+        foreach ( quint16 index, entity.indices )
+            merged.indices.append( quint16( base + index ) );
+    }
+    if ( !merged.indices.isEmpty( ) ) appendChunk( batch, merged, bounds, flags );
+
+    // 同一纹理的实体共用一张纹理
+    if ( batch.texture == Q_NULLPTR )
+    {
+        QString imagePath = QQmlFile::urlToLocalFileOrQrc( source );
+        batch.texture = new QOpenGLTexture( QImage( imagePath ).mirrored( ) );
+        batch.texture->setMinificationFilter( QOpenGLTexture::LinearMipMapLinear );
+        batch.texture->setMagnificationFilter( QOpenGLTexture::Linear );
+    }
+    batch.dirty = false;
+}
+
+void StaticBatcher::appendChunk( Batch& batch, const Geometry::MeshData& data,
+                                 const AABB& bounds, const EntityState& flags )
+{
+    Chunk chunk;
+    chunk.mesh = new MeshBuffer;
+    chunk.mesh->create( data, QOpenGLBuffer::StaticDraw );
+    chunk.bounds = bounds;
+    chunk.castShadows = flags.castShadows;
+    chunk.receiveShadows = flags.receiveShadows;
+    batch.chunks.append( chunk );
+}
+
+void StaticBatcher::destroyChunks( Batch& batch )
+{
+    foreach ( const Chunk& chunk, batch.chunks ) delete chunk.mesh;
+    batch.chunks.clear( );
+}
+
+void StaticBatcher::destroy( Batch& batch )
+{
+    destroyChunks( batch );
+    delete batch.texture;
+    batch.texture = Q_NULLPTR;
+}
+
+void StaticBatcher::render( View* view )
+{
+    if ( m_batches.isEmpty( ) ) return;
+
+    QVector4D planes[6];
+    BVH::extractPlanes( view->projectionMatrix( ) * view->viewMatrix( ), planes );
+
+    // 接收阴影的块使用自己的程序，其余的以及NoShadow模式使用View中没有阴影计算的程序。
+    // 两个程序的uniform都在第一次用到时设置，之后切换只需要重新绑定
+    View::ShadowMode shadowMode = View::ShadowMode( view->renderShadowMode( ) );
+    const View::UnshadowedProgram& unshadowed = view->unshadowedProgram( );
+    QOpenGLShaderProgram* current = Q_NULLPTR;
+    bool shadowedReady = false, unshadowedReady = false;
+    for ( QHash<QUrl, Batch>::iterator it = m_batches.begin( );
+          it != m_batches.end( ); ++it )
+    {
+        Batch& batch = it.value( );
+        bool textureBound = false;
+        foreach ( const Chunk& chunk, batch.chunks )
+        {
+            if ( BVH::outsideFrustum( chunk.bounds, planes ) ) continue;
+            bool shadowed = chunk.receiveShadows && shadowMode != View::NoShadow;
+            QOpenGLShaderProgram* program = shadowed ? m_program : unshadowed.program;
+            if ( program != current )
+            {
+                if ( shadowed && !shadowedReady )
+                {
+                    view->countStateChanges( bindShadowedProgram( view, shadowMode ) );
+                    shadowedReady = true;
+                }
+                else if ( !shadowed && !unshadowedReady )
+                {
+                    view->countStateChanges( view->bindUnshadowedProgram(
+                                                 QMatrix4x4( ), view->viewMatrix( ).normalMatrix( ) ) );
+                    unshadowedReady = true;
+                }
+                else
+                {
+                    program->bind( );
+                    view->countStateChanges( 1 );
+                }
+                current = program;
+            }
+            if ( !textureBound )
+            {
+                batch.texture->bind( );
+                view->countStateChanges( 1 );
+                textureBound = true;
+            }
+
+            int changes = shadowed ?
+                        chunk.mesh->bind( m_program, m_positionLoc, m_normalLoc, m_texCoordLoc,
+                                          m_texCoordTransformLoc ) :
+                        chunk.mesh->bind( unshadowed.program, unshadowed.positionLoc,
+                                          unshadowed.normalLoc, unshadowed.texCoordLoc,
+                                          unshadowed.texCoordTransformLoc );
+            chunk.mesh->draw( );
+            view->countStateChanges( changes );
+            view->countDrawCall( chunk.mesh->triangleCount( ) );
+        }
+        if ( textureBound ) batch.texture->release( );
+    }
+    MeshBuffer::release( );
+    if ( current != Q_NULLPTR ) current->release( );
+}
+
+int StaticBatcher::bindShadowedProgram( View* view, int shadowMode )
+{
+    m_program->bind( );
+    m_program->setUniformValue( m_modelMatrixLoc, QMatrix4x4( ) );
+    m_program->setUniformValue( m_viewMatrixLoc, view->viewMatrix( ) );
+    m_program->setUniformValue( m_projectionMatrixLoc, view->projectionMatrix( ) );
+    m_program->setUniformValue( m_modelViewNormalMatrixLoc,
+                                view->viewMatrix( ).normalMatrix( ) );
+    m_program->setUniformValue( m_shadowTypeLoc, shadowMode );
+    glActiveTexture( SHADOW_TEXTURE_UNIT );
+    glBindTexture( GL_TEXTURE_2D, view->shadowTexture( ) );
+    if ( shadowMode == View::PointShadow )
+    {
+        glActiveTexture( SHADOW_CUBE_TEXTURE_UNIT );
+        glBindTexture( GL_TEXTURE_CUBE_MAP, view->shadowCubeTexture( ) );
+    }
+    glActiveTexture( TEXTURE_UNIT );
+    // 着色器、五个uniform、阴影图以及光源数组
+    return ( shadowMode == View::PointShadow ? 8 : 7 ) +
+            m_lightUniforms.apply( m_program, view );
+}
+
+void StaticBatcher::renderShadow( View* view, const QMatrix4x4& lightViewProjectionMatrix )
+{
+    drawPositions( view, lightViewProjectionMatrix, true );
+}
+
+void StaticBatcher::renderDepth( View* view )
+{
+    drawPositions( view, view->projectionMatrix( ) * view->viewMatrix( ), false );
+}
+
+void StaticBatcher::drawPositions( View* view, const QMatrix4x4& viewProjectionMatrix,
+                                   bool castersOnly )
+{
+    if ( m_batches.isEmpty( ) ) return;
+
+    QVector4D planes[6];
+    BVH::extractPlanes( viewProjectionMatrix, planes );
+
+    QOpenGLShaderProgram* depthProgram = view->depthProgram( );
+    depthProgram->setUniformValue( "modelMatrix", QMatrix4x4( ) );
+    view->countStateChanges( 1 );
+    int positionLoc = depthProgram->attributeLocation( "position" );
+    for ( QHash<QUrl, Batch>::iterator it = m_batches.begin( );
+          it != m_batches.end( ); ++it )
+    {
+        foreach ( const Chunk& chunk, it.value( ).chunks )
+        {
+            if ( castersOnly && !chunk.castShadows ) continue;
+            if ( BVH::outsideFrustum( chunk.bounds, planes ) ) continue;
+
+            int changes = chunk.mesh->bindPositions( depthProgram, positionLoc );
+            chunk.mesh->draw( );
+            view->countStateChanges( changes );
+            view->countDrawCall( chunk.mesh->triangleCount( ) );
+        }
+    }
+    MeshBuffer::release( );
+}
@@ -0,0 +1,113 @@
+#ifndef STATICBATCHER_H
+#define STATICBATCHER_H
+
+#include <QHash>
+#include <QUrl>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QOpenGLFunctions>
+#include "BVH.h"
+#include "Geometry.h"
+#include "Light.h"
+
+QT_BEGIN_NAMESPACE
+class QOpenGLTexture;
+class QOpenGLShaderProgram;
+QT_END_NAMESPACE
+
+class View;
+class MeshBuffer;
+
+// 把staticGeometry为true的立方体和平面按纹理合并成预先变换好的大顶点缓存，
+// 每种纹理只需要一次绘制（顶点超过16位索引的范围时分成多块）。只有静态实体变化时才重建受影响的批次
+class StaticBatcher: protected QOpenGLFunctions
+{
+public:
+    StaticBatcher( void );
+    ~StaticBatcher( void );
+
+    // 渲染线程，需要当前的OpenGL上下文
+    void initialize( void );
+    void release( void );
+
+    // sync中调用，此时GUI线程被阻塞
+    void update( const QObjectList& data );
+    bool isBatched( QObject* object ) { return m_entities.contains( object ); }
+
+    void render( View* view );
+    // 每个投射阴影的光源调用一次，深度着色器已经绑定
+    void renderShadow( View* view, const QMatrix4x4& lightViewProjectionMatrix );
+    // 深度预渲染，包括不投射阴影的块，View已经绑定了预渲染的着色器
+    void renderDepth( View* view );
+
+    int batchCount( void ) { return m_batches.size( ); }
+
+    // 合并的几何体每次变化都会加一，用来判断缓存的静态阴影是否有效
+    int generation( void ) { return m_generation; }
+protected:
+    struct EntityState
+    {
+        bool            plane;
+        float           length;
+        QUrl            source;
+        QVector3D       translate;
+        bool            castShadows;
+        bool            receiveShadows;
+
+        bool operator ==( const EntityState& other ) const
+        {
+            return plane == other.plane && length == other.length &&
+                    source == other.source && translate == other.translate &&
+                    castShadows == other.castShadows &&
+                    receiveShadows == other.receiveShadows;
+        }
+        bool operator !=( const EntityState& other ) const
+        {
+            return !( *this == other );
+        }
+    };
+
+    // 同一个块中的实体阴影标志相同，阴影只绘制castShadows的块
+    struct Chunk
+    {
+        MeshBuffer*         mesh;
+        AABB                bounds;
+        bool                castShadows;
+        bool                receiveShadows;
+    };
+
+    struct Batch
+    {
+        Batch( void ): texture( Q_NULLPTR ), dirty( true ) { }
+
+        QList<Chunk>        chunks;
+        QOpenGLTexture*     texture;
+        QList<QObject*>     entities;
+        bool                dirty;
+    };
+
+    void rebuild( const QUrl& source, Batch& batch );
+    void appendChunk( Batch& batch, const Geometry::MeshData& data,
+                      const AABB& bounds, const EntityState& flags );
+    void destroyChunks( Batch& batch );
+    void destroy( Batch& batch );
+    void drawPositions( View* view, const QMatrix4x4& viewProjectionMatrix,
+                        bool castersOnly );
+    // 绑定接收阴影的块使用的程序，返回计入的状态切换
+    int bindShadowedProgram( View* view, int shadowMode );
+
+    bool                            m_initialized;
+    QHash<QObject*, EntityState>    m_entities;
+    QHash<QUrl, Batch>              m_batches;
+    int                             m_generation;
+
+    QOpenGLShaderProgram*           m_program;
+    int                             m_positionLoc, m_normalLoc, m_texCoordLoc;
+    int                             m_texCoordTransformLoc;
+    int                             m_modelMatrixLoc, m_viewMatrixLoc;
+    int                             m_projectionMatrixLoc, m_modelViewNormalMatrixLoc;
+    int                             m_shadowTypeLoc;
+    LightUniforms                   m_lightUniforms;
+};
+
+#endif // STATICBATCHER_H
@@ -0,0 +1,226 @@
+#include <string.h>
+#include <QOpenGLContext>
+#include "StreamBuffer.h"
+
+#define STREAM_FRAME_SIZE   ( 4 * 1024 * 1024 ) // 每帧的区域大小（字节），够一万个物体的uniform块
+#define STREAM_ALIGNMENT    16
+#define STREAM_WAIT_TIMEOUT 1000000             // 每次等待栅栏的时间（纳秒）
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT   0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT     0x0080
+#endif
+
+// glBufferStorage不在QOpenGLExtraFunctions中，需要自己解析
+typedef void ( QOPENGLF_APIENTRYP BufferStorageFunction )( GLenum target, GLsizeiptr size,
+                                                           const void* data, GLbitfield flags );
+
+///////////////////////////////////////////////////////////////////////////////
+StreamBuffer::StreamBuffer( void )
+{
+    m_mode = Unavailable;
+    m_buffer = 0;
+    m_frameSize = 0;
+    m_mapped = Q_NULLPTR;
+    for ( int i = 0; i < FrameCount; ++i ) m_fences[i] = Q_NULLPTR;
+    m_frame = 0;
+    m_offset = 0;
+    m_frameOpen = false;
+    m_orphanPending = false;
+    m_uploadedBytes = 0;
+    m_uniformBlocks = false;
+    m_uniformAlignment = 0;
+    m_uniformBuffer = 0;
+    m_uniformBufferSize = 0;
+}
+
+StreamBuffer::~StreamBuffer( void )
+{
+    release( );
+}
+
+void StreamBuffer::initialize( QOpenGLContext* context )
+{
+    release( );
+    initializeOpenGLFunctions( );
+
+    // 拷贝需要OpenGL 3.1或者ES 3.0，栅栏需要3.2
+    QPair<int, int> version = context->format( ).version( );
+    if ( context->isOpenGLES( ) ? version < qMakePair( 3, 0 ) :
+                                  version < qMakePair( 3, 2 ) ) return;
+
+    m_frameSize = STREAM_FRAME_SIZE;
+
+    // uniform块在3.1以后是核心功能，但是着色器是GLSL 1.20，需要这个扩展才能声明。
+    // ES 3.0的着色器要求GLSL ES 3.00，这里的着色器都是1.00，所以不使用
+    if ( !context->isOpenGLES( ) && context->hasExtension( "GL_ARB_uniform_buffer_object" ) )
+    {
+        glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_uniformAlignment );
+        m_uniformAlignment = qMax( m_uniformAlignment, STREAM_ALIGNMENT );
+        m_uniformBlocks = true;
+    }
+
+    BufferStorageFunction bufferStorage = Q_NULLPTR;
+    if ( !context->isOpenGLES( ) &&
+         ( version >= qMakePair( 4, 4 ) || context->hasExtension( "GL_ARB_buffer_storage" ) ) )
+    {
+        bufferStorage = reinterpret_cast<BufferStorageFunction>(
+                    context->getProcAddress( "glBufferStorage" ) );
+    }
+    if ( bufferStorage != Q_NULLPTR )
+    {
+        // 一致的映射不需要显式刷新，拷贝命令总能看到memcpy写入的数据
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers( 1, &m_buffer );
+        glBindBuffer( GL_COPY_READ_BUFFER, m_buffer );
+        bufferStorage( GL_COPY_READ_BUFFER, FrameCount * m_frameSize, Q_NULLPTR, flags );
+        m_mapped = static_cast<char*>( glMapBufferRange( GL_COPY_READ_BUFFER, 0,
+                                                         FrameCount * m_frameSize, flags ) );
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+        if ( m_mapped != Q_NULLPTR )
+        {
+            m_mode = Persistent;
+            return;
+        }
+
+        // 存储已经不可变，换一个缓存用孤立的方式
+        glDeleteBuffers( 1, &m_buffer );
+    }
+
+    glGenBuffers( 1, &m_buffer );
+    glBindBuffer( GL_COPY_READ_BUFFER, m_buffer );
+    glBufferData( GL_COPY_READ_BUFFER, m_frameSize, Q_NULLPTR, GL_STREAM_DRAW );
+    glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    m_mode = Orphaning;
+}
+
+void StreamBuffer::release( void )
+{
+    if ( m_mode == Unavailable ) return;
+    for ( int i = 0; i < FrameCount; ++i )
+    {
+        if ( m_fences[i] != Q_NULLPTR ) glDeleteSync( m_fences[i] );
+        m_fences[i] = Q_NULLPTR;
+    }
+    if ( m_mapped != Q_NULLPTR )
+    {
+        glBindBuffer( GL_COPY_READ_BUFFER, m_buffer );
+        glUnmapBuffer( GL_COPY_READ_BUFFER );
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+        m_mapped = Q_NULLPTR;
+    }
+    glDeleteBuffers( 1, &m_buffer );
+    m_buffer = 0;
+    if ( m_uniformBuffer != 0 ) glDeleteBuffers( 1, &m_uniformBuffer );
+    m_uniformBuffer = 0;
+    m_uniformBufferSize = 0;
+    m_uniformBlocks = false;
+    m_mode = Unavailable;
+    m_frameOpen = false;
+}
+
+void StreamBuffer::beginFrame( void )
+{
+    if ( m_frameOpen ) return;
+    m_frameOpen = true;
+    m_offset = 0;
+    m_uploadedBytes = 0;
+
+    // 大多数帧什么也不上传，孤立推迟到第一次写入时
+    if ( m_mode == Orphaning ) m_orphanPending = true;
+    else if ( m_mode == Persistent )
+    {
+        // 三帧以前的拷贝通常早已完成，栅栏只在GPU落后太多时才会等待
+        m_frame = ( m_frame + 1 ) % FrameCount;
+        GLsync& fence = m_fences[m_frame];
+        if ( fence == Q_NULLPTR ) return;
+        while ( glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                  STREAM_WAIT_TIMEOUT ) == GL_TIMEOUT_EXPIRED ) { }
+        glDeleteSync( fence );
+        fence = Q_NULLPTR;
+    }
+}
+
+void StreamBuffer::endFrame( void )
+{
+    if ( !m_frameOpen ) return;
+    m_frameOpen = false;
+    if ( m_mode == Persistent )
+        m_fences[m_frame] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+int StreamBuffer::write( const void* data, int size, int alignment )
+{
+    int offset = ( m_offset + alignment - 1 ) / alignment * alignment;
+    if ( offset + size > m_frameSize ) return -1;
+    m_offset = offset + size;
+
+    if ( m_orphanPending )
+    {
+        // 孤立以后驱动分配新的存储，还没有执行的拷贝和绘制继续读旧的存储
+        glBufferData( GL_COPY_READ_BUFFER, m_frameSize, Q_NULLPTR, GL_STREAM_DRAW );
+        m_orphanPending = false;
+    }
+
+    if ( m_mode == Persistent )
+    {
+        offset += m_frame * m_frameSize;
+        memcpy( m_mapped + offset, data, size_t( size ) );
+    }
+    else glBufferSubData( GL_COPY_READ_BUFFER, offset, size, data );
+    return offset;
+}
+
+void StreamBuffer::upload( GLuint target, int targetOffset, const void* data, int size )
+{
+    m_uploadedBytes += size;
+    if ( m_mode != Unavailable && m_frameOpen )
+    {
+        glBindBuffer( GL_COPY_READ_BUFFER, m_buffer );
+        int offset = write( data, size, STREAM_ALIGNMENT );
+        if ( offset >= 0 )
+        {
+            glBindBuffer( GL_COPY_WRITE_BUFFER, target );
+            glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                 offset, targetOffset, size );
+            glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+            glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+            return;
+        }
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    }
+
+    // 不能拷贝或者这一帧的区域已满，直接更新目标缓存
+    glBindBuffer( GL_ARRAY_BUFFER, target );
+    glBufferSubData( GL_ARRAY_BUFFER, targetOffset, size, data );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void StreamBuffer::bindUniformBlock( GLuint binding, const void* data, int size )
+{
+    m_uploadedBytes += size;
+    if ( m_mode != Unavailable && m_frameOpen )
+    {
+        glBindBuffer( GL_COPY_READ_BUFFER, m_buffer );
+        int offset = write( data, size, m_uniformAlignment );
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+        if ( offset >= 0 )
+        {
+            glBindBufferRange( GL_UNIFORM_BUFFER, binding, m_buffer, offset, size );
+            return;
+        }
+    }
+
+    // 区域已满，每次都更新同一个缓存，驱动可能需要等待上一次绘制
+    if ( m_uniformBuffer == 0 ) glGenBuffers( 1, &m_uniformBuffer );
+    glBindBuffer( GL_UNIFORM_BUFFER, m_uniformBuffer );
+    if ( size > m_uniformBufferSize )
+    {
+        glBufferData( GL_UNIFORM_BUFFER, size, data, GL_STREAM_DRAW );
+        m_uniformBufferSize = size;
+    }
+    else glBufferSubData( GL_UNIFORM_BUFFER, 0, size, data );
+    glBindBufferRange( GL_UNIFORM_BUFFER, binding, m_uniformBuffer, 0, size );
+}
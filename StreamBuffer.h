@@ -0,0 +1,72 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <QOpenGLExtraFunctions>
+
+QT_BEGIN_NAMESPACE
+class QOpenGLContext;
+QT_END_NAMESPACE
+
+// 每个上下文一个的流式上传缓存：每帧的动态数据先写到这里，再在GPU上拷贝到目标缓存，
+// CPU不需要等待GPU读完目标缓存。有GL_ARB_buffer_storage时缓存分成三段并持久映射，
+// 每帧写一段，用栅栏保证GPU已经读完再重用；否则每帧第一次写入时用glBufferData孤立整个缓存。
+// 没有glCopyBufferSubData（ES 2.0）或者这一帧的空间用完时直接更新目标缓存。
+// 桌面OpenGL有GL_ARB_uniform_buffer_object时，每个物体的uniform块也写在这里，直接绑定使用
+class StreamBuffer: protected QOpenGLExtraFunctions
+{
+public:
+    enum Mode
+    {
+        Unavailable = 0,
+        Orphaning,
+        Persistent
+    };
+    enum { FrameCount = 3 };
+
+    StreamBuffer( void );
+    ~StreamBuffer( void );
+
+    // 渲染线程，需要当前的OpenGL上下文
+    void initialize( QOpenGLContext* context );
+    void release( void );
+    Mode mode( void ) { return m_mode; }
+
+    // beginFrame可以重复调用，直到endFrame以后才换到下一段。
+    // sync以及render开始时都调用，endFrame在一帧的绘制命令之后调用
+    void beginFrame( void );
+    void endFrame( void );
+
+    // 把数据写到这一帧的区域中，再拷贝到target的targetOffset处
+    void upload( GLuint target, int targetOffset, const void* data, int size );
+
+    // 着色器可以使用uniform块（见View::addCommonVertexShader）时为true
+    bool hasUniformBlocks( void ) { return m_uniformBlocks; }
+    // 把一个uniform块的数据写到这一帧的区域中，并绑定到binding。
+    // 空间用完时改用一个单独的缓存
+    void bindUniformBlock( GLuint binding, const void* data, int size );
+
+    // 这一帧上传的字节数，包括直接更新目标缓存的
+    int uploadedBytes( void ) { return m_uploadedBytes; }
+protected:
+    // 在这一帧的区域中按alignment分配并写入，返回缓存中的偏移，空间不够时返回-1。
+    // 调用前m_buffer需要绑定到GL_COPY_READ_BUFFER
+    int write( const void* data, int size, int alignment );
+
+    Mode                m_mode;
+    GLuint              m_buffer;
+    int                 m_frameSize;
+    char*               m_mapped;               // 持久映射的起始地址
+    GLsync              m_fences[FrameCount];
+    int                 m_frame;                // 当前使用的区域
+    int                 m_offset;               // 区域中已经使用的字节数
+    bool                m_frameOpen;
+    bool                m_orphanPending;        // 这一帧还没有孤立缓存
+    int                 m_uploadedBytes;
+
+    bool                m_uniformBlocks;
+    int                 m_uniformAlignment;     // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GLuint              m_uniformBuffer;        // 区域用完时使用
+    int                 m_uniformBufferSize;
+};
+
+#endif // STREAMBUFFER_H
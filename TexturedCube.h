@@ -6,6 +6,7 @@
 #include <QVector3D>
 #include <QUrl>
 #include <QObject>
+#include "BVH.h"
 
 class View;
 class TexturedCubeRenderer;
@@ -19,9 +20,11 @@ public:
     TexturedCube( QObject* parent = Q_NULLPTR );
     void initialize( void );
     void render( void );
+    void prepare( void );
     void sync( void );
     void release( void );
     void setView( View* view ) { m_view = view; }
+    AABB boundingBox( void );
 
     qreal length( void ) { return m_length; }
     void setLength( qreal length );
@@ -48,6 +51,7 @@ protected:
 
     // 模型矩阵
     QVector3D           m_translate;
+    bool                m_translateDirty;
 
     TexturedCubeRenderer* m_renderer;
     View*   m_view;
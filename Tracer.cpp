@@ -0,0 +1,170 @@
+#include <QThread>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCoreApplication>
+#include "Tracer.h"
+
+#ifndef GL_DEBUG_SOURCE_APPLICATION
+#define GL_DEBUG_SOURCE_APPLICATION     0x824A
+#endif
+
+QAtomicInt Tracer::s_enabled;
+
+Tracer::Tracer( void )
+{
+    m_capacity = DefaultCapacity;
+    m_next = 0;
+    m_debugContext = Q_NULLPTR;
+    m_pushDebugGroup = Q_NULLPTR;
+    m_popDebugGroup = Q_NULLPTR;
+    m_clock.start( );
+}
+
+Tracer* Tracer::instance( void )
+{
+    static Tracer tracer;
+    return &tracer;
+}
+
+void Tracer::setEnabled( bool enabled )
+{
+    s_enabled.store( enabled ? 1 : 0 );
+}
+
+void Tracer::setCapacity( int capacity )
+{
+    QMutexLocker locker( &m_mutex );
+    m_capacity = qMax( 1, capacity );
+    m_events.clear( );
+    m_next = 0;
+}
+
+void Tracer::record( const char* name, qint64 begin, qint64 end )
+{
+    Event event;
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.thread = quintptr( QThread::currentThreadId( ) );
+
+    QMutexLocker locker( &m_mutex );
+    if ( !m_threadNames.contains( event.thread ) )
+    {
+        QThread* thread = QThread::currentThread( );
+        QString threadName = thread->objectName( );
+        if ( QCoreApplication::instance( ) != Q_NULLPTR &&
+             thread == QCoreApplication::instance( )->thread( ) )
+            threadName = "GUI";
+        else if ( threadName.isEmpty( ) )
+            threadName = thread->metaObject( )->className( );
+        m_threadNames.insert( event.thread, threadName );
+    }
+
+    // 缓冲满了以后覆盖最早的事件
+    if ( m_events.size( ) < m_capacity ) m_events.append( event );
+    else m_events[m_next] = event;
+    m_next = ( m_next + 1 ) % m_capacity;
+}
+
+void Tracer::clear( void )
+{
+    QMutexLocker locker( &m_mutex );
+    m_events.clear( );
+    m_next = 0;
+}
+
+bool Tracer::save( const QString& fileName )
+{
+    QJsonArray traceEvents;
+    qint64 pid = QCoreApplication::applicationPid( );
+    {
+        QMutexLocker locker( &m_mutex );
+        for ( QHash<quintptr, QString>::const_iterator it = m_threadNames.constBegin( );
+              it != m_threadNames.constEnd( ); ++it )
+        {
+            QJsonObject args;
+            args["name"] = it.value( );
+            QJsonObject metadata;
+            metadata["name"] = QStringLiteral( "thread_name" );
+            metadata["ph"] = QStringLiteral( "M" );
+            metadata["pid"] = pid;
+            metadata["tid"] = qint64( it.key( ) );
+            metadata["args"] = args;
+            traceEvents.append( metadata );
+        }
+
+        // 从最早的事件开始输出
+        int count = m_events.size( );
+        int first = count < m_capacity ? 0 : m_next;
+        for ( int i = 0; i < count; ++i )
+        {
+            const Event& event = m_events[( first + i ) % count];
+            QJsonObject object;
+            object["name"] = QString::fromLatin1( event.name );
+            object["ph"] = QStringLiteral( "X" );
+            object["ts"] = event.begin / 1000.0;
+            object["dur"] = ( event.end - event.begin ) / 1000.0;
+            object["pid"] = pid;
+            object["tid"] = qint64( event.thread );
+            traceEvents.append( object );
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = traceEvents;
+    root["displayTimeUnit"] = QStringLiteral( "ms" );
+
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+    {
+        qWarning( "Tracer: cannot write %s.", qPrintable( fileName ) );
+        return false;
+    }
+    file.write( QJsonDocument( root ).toJson( QJsonDocument::Compact ) );
+    return true;
+}
+
+void Tracer::resolveDebugFunctions( QOpenGLContext* context )
+{
+    m_debugContext = context;
+    m_pushDebugGroup = Q_NULLPTR;
+    m_popDebugGroup = Q_NULLPTR;
+    if ( context == Q_NULLPTR ) return;
+
+    // OpenGL 4.3核心或者KHR_debug扩展
+    if ( context->hasExtension( "GL_KHR_debug" ) && context->isOpenGLES( ) )
+    {
+        m_pushDebugGroup = reinterpret_cast<PushDebugGroupFunction>(
+                    context->getProcAddress( "glPushDebugGroupKHR" ) );
+        m_popDebugGroup = reinterpret_cast<PopDebugGroupFunction>(
+                    context->getProcAddress( "glPopDebugGroupKHR" ) );
+    }
+    else if ( context->hasExtension( "GL_KHR_debug" ) ||
+              context->format( ).version( ) >= qMakePair( 4, 3 ) )
+    {
+        m_pushDebugGroup = reinterpret_cast<PushDebugGroupFunction>(
+                    context->getProcAddress( "glPushDebugGroup" ) );
+        m_popDebugGroup = reinterpret_cast<PopDebugGroupFunction>(
+                    context->getProcAddress( "glPopDebugGroup" ) );
+    }
+    if ( m_pushDebugGroup == Q_NULLPTR || m_popDebugGroup == Q_NULLPTR )
+    {
+        m_pushDebugGroup = Q_NULLPTR;
+        m_popDebugGroup = Q_NULLPTR;
+    }
+}
+
+void Tracer::pushDebugGroup( const char* name )
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext( );
+    if ( context != m_debugContext ) resolveDebugFunctions( context );
+    if ( m_pushDebugGroup != Q_NULLPTR )
+        m_pushDebugGroup( GL_DEBUG_SOURCE_APPLICATION, 0, -1, name );
+}
+
+void Tracer::popDebugGroup( void )
+{
+    if ( m_popDebugGroup != Q_NULLPTR ) m_popDebugGroup( );
+}
@@ -0,0 +1,100 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+
+// 记录各个阶段的开始和结束时间，导出为Chrome trace-event格式的JSON，
+// 可以在chrome://tracing或者Perfetto里查看。默认关闭，关闭时每个作用域
+// 只有一次原子读取的开销
+class Tracer
+{
+public:
+    struct Event
+    {
+        const char*     name;       // 必须是静态字符串
+        qint64          begin;      // 纳秒
+        qint64          end;
+        quintptr        thread;
+    };
+
+    enum { DefaultCapacity = 65536 };
+
+    static Tracer* instance( void );
+    static bool isEnabled( void ) { return s_enabled.load( ) != 0; }
+
+    void setEnabled( bool enabled );
+
+    // 只保留最近capacity个事件
+    void setCapacity( int capacity );
+    int capacity( void ) { return m_capacity; }
+
+    qint64 now( void ) { return m_clock.nsecsElapsed( ); }
+    void record( const char* name, qint64 begin, qint64 end );
+    void clear( void );
+    bool save( const QString& fileName );
+
+    // 调试组标记，只在有当前OpenGL上下文的线程调用
+    void pushDebugGroup( const char* name );
+    void popDebugGroup( void );
+protected:
+    Tracer( void );
+    void resolveDebugFunctions( QOpenGLContext* context );
+
+    typedef void ( QOPENGLF_APIENTRYP PushDebugGroupFunction )(
+            GLenum source, GLuint id, GLsizei length, const GLchar* message );
+    typedef void ( QOPENGLF_APIENTRYP PopDebugGroupFunction )( void );
+
+    static QAtomicInt           s_enabled;
+
+    QMutex                      m_mutex;
+    QElapsedTimer               m_clock;
+    QVector<Event>              m_events;
+    int                         m_capacity;
+    int                         m_next;
+    QHash<quintptr, QString>    m_threadNames;
+
+    QOpenGLContext*             m_debugContext;
+    PushDebugGroupFunction      m_pushDebugGroup;
+    PopDebugGroupFunction       m_popDebugGroup;
+};
+
+// 作用域内的一个事件，gpu为true时同时插入glPushDebugGroup标记
+class TraceScope
+{
+public:
+    explicit TraceScope( const char* name, bool gpu = false )
+    {
+        m_name = Q_NULLPTR;
+        m_gpu = false;
+        if ( !Tracer::isEnabled( ) ) return;
+        m_name = name;
+        m_gpu = gpu;
+        m_begin = Tracer::instance( )->now( );
+        if ( m_gpu ) Tracer::instance( )->pushDebugGroup( name );
+    }
+    ~TraceScope( void )
+    {
+        if ( m_name == Q_NULLPTR ) return;
+        Tracer* tracer = Tracer::instance( );
+        if ( m_gpu ) tracer->popDebugGroup( );
+        tracer->record( m_name, m_begin, tracer->now( ) );
+    }
+protected:
+    const char*     m_name;
+    bool            m_gpu;
+    qint64          m_begin;
+};
+
+#define TRACE_CONCAT_( a, b )   a##b
+#define TRACE_CONCAT( a, b )    TRACE_CONCAT_( a, b )
+#define TRACE_SCOPE( name ) \
+    TraceScope TRACE_CONCAT( traceScope, __LINE__ )( name )
+#define TRACE_GPU_SCOPE( name ) \
+    TraceScope TRACE_CONCAT( traceScope, __LINE__ )( name, true )
+
+#endif // TRACER_H
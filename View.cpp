@@ -1,17 +1,44 @@
+#include <algorithm>
+#include <math.h>
+#include <QFile>
 #include <QOpenGLFunctions>
 #include <QQmlFile>
+#include <QtQml>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFramebufferObject>
 #include <QQuickWindow>
+#include <QVector2D>
+#include <QThread>
 #include "Cube.h"
 #include "Plane.h"
 #include "TexturedCube.h"
+#include "Mesh.h"
+#include "Light.h"
+#include "ViewAnimator.h"
 #include "View.h"
 
-#define FBO_WIDTH       1024
-#define FBO_HEIGHT      1024
+#define SHADOW_ATLAS_SIZE   2048
+#define MAX_SHADOW_TILE     1024    // 最重要的光源，也是只有一个光源时的大小
+#define MIN_SHADOW_TILE     256
+#define LIGHT_NEAR_PLANE    0.5
+#define POINT_SHADOW_SIZE   512     // 立方体贴图每个面的边长
+#define MAX_BLUR_RADIUS     8       // 与Blur.frag中的MAX_BLUR_RADIUS一致
+#define ENTITY_CHUNK    256
 
 ///////////////////////////////////////////////////////////////////////////////
+void View::registerTypes( const char* uri )
+{
+    qmlRegisterType<View>( uri, 1, 0, "TexturedCubeView" );
+    qmlRegisterType<TexturedCube>( uri, 1, 0, "TexturedCube" );
+    qmlRegisterType<Cube>( uri, 1, 0, "Cube" );
+    qmlRegisterType<Plane>( uri, 1, 0, "Plane" );
+    qmlRegisterType<Mesh>( uri, 1, 0, "Mesh" );
+    qmlRegisterType<Light>( uri, 1, 0, "Light" );
+    qmlRegisterType<ViewAnimator>( uri, 1, 0, "ViewAnimator" );
+    qmlRegisterUncreatableType<FrameStats>( uri, 1, 0, "FrameStats",
+                                            "FrameStats is provided by View.stats" );
+}
+
 View::View( QQuickItem* parent ): QQuickItem( parent )
 {
     m_position = QVector3D( 0.0f, 0.0f, 50.0f );
@@ -23,13 +50,60 @@ View::View( QQuickItem* parent ): QQuickItem( parent )
     m_nearPlane = 0.5;
     m_farPlane = 500.0;
 
+    m_shadowMode = SimpleShadow;
+    m_renderShadowMode = SimpleShadow;
+    m_shadowSoftness = m_renderShadowSoftness = 2.0;
+    m_shadowUpdateBudget = m_renderShadowUpdateBudget = 0;
+    m_shadowsPending = false;
+    m_shadowCasterGeneration = 0;
+    m_shadowBatchGeneration = -1;
+    m_shadowInstanceGeneration = -1;
+    m_depthPrepass = m_renderDepthPrepass = false;
+    m_occlusionCulling = m_renderOcclusionCulling = false;
+    m_gpuCulling = m_renderGpuCulling = false;
+
+    m_lodThreshold = m_renderLodThreshold = 1.0;
+    m_shadowLodBias = m_renderShadowLodBias = 4.0;
+
     m_initialized = false;
+    m_initializedEntities = 0;
     m_viewMatrixDirty = false;
     m_projectionMatrixDirty = false;
-    m_projectionMatrixDirty = false;
+    m_viewMatrixOverridden = false;
+    m_projectionMatrixOverridden = false;
+    m_pickMatrixValid = false;
+    m_lightPositionDirty = true;
 
-    m_FBO = Q_NULLPTR;
+    m_shadowAtlas = Q_NULLPTR;
     m_depthProgram = Q_NULLPTR;
+    m_unshadowedProgram.program = Q_NULLPTR;
+    m_pointShadowRange = 0.0f;
+    m_blurProgram = Q_NULLPTR;
+    m_shadowBlurFBO = Q_NULLPTR;
+    m_prepassProgram = Q_NULLPTR;
+    m_prepassActive = false;
+    m_layeredDepthProgram = Q_NULLPTR;
+    m_layeredShadowActive = false;
+    m_staticShadowAtlas = Q_NULLPTR;
+    m_staticShadowVariance = false;
+    m_staticShadowGeneration = -1;
+
+    m_sceneFBO = Q_NULLPTR;
+    m_updatePending = false;
+    m_renderDirty = true;
+    m_previousFrameDirty = false;
+    m_sceneCached = false;
+    m_reportedFramesSkipped = 0;
+
+    m_workerThreads = qMax( 0, QThread::idealThreadCount( ) - 1 );
+
+    m_stats = new FrameStats( this );
+    m_syncTime = 0;
+    m_frameIndex = 0;
+
+    m_pendingRecorder = Q_NULLPTR;
+    m_recorder = Q_NULLPTR;
+    m_recorderDirty = false;
 
     connect( this, SIGNAL( windowChanged( QQuickWindow* ) ),
              this, SLOT( onWindowChanged( QQuickWindow* ) ) );
@@ -37,7 +111,7 @@ View::View( QQuickItem* parent ): QQuickItem( parent )
 
 View::~View( void )
 {
-
+    delete m_pendingRecorder;
 }
 
 
@@ -55,67 +129,585 @@ void View::onWindowChanged( QQuickWindow* win )
 
 void View::render( void )
 {
-    window( )->resetOpenGLState( );
+    QElapsedTimer frameTimer;
+    frameTimer.start( );
+    m_currentSample = FrameSample( );
+    m_currentSample.sync = m_syncTime;
+
+    // 没有经过sync的帧也要有自己的上传区域
+    m_streamBuffer.beginFrame( );
+
+    TRACE_GPU_SCOPE( "View::render" );
+    resetOpenGLState( );
+
+    bool animating = animate( );
+
+    QRectF sceneRect = boundingRect( );
+    QRect targetRect = sceneRect.toRect( );
+
+    // 场景没有变化并且没有过期的阴影图块时跳过阴影以及主渲染，只拷贝上一帧的结果
+    if ( !m_renderDirty && !m_shadowsPending && m_sceneCached &&
+         m_sceneFBO->size( ) == targetRect.size( ) )
+    {
+        blitScene( targetRect );
+        m_framesSkipped.ref( );
+        m_streamBuffer.endFrame( );
+        resetOpenGLState( );
+        return;
+    }
+
+    if ( m_recorder != Q_NULLPTR )
+    {
+        m_recorder->recordFrame( m_viewMatrix, m_projectionMatrix,
+                                 m_renderLightPosition, m_renderShadowMode );
+    }
+
+    updateLights( );
+    updateLodParameters( targetRect.height( ) );
+    m_gpuDriven.beginFrame( );
 
     QOpenGLFunctions* f = window( )->openglContext( )->functions( );
     f->glEnable( GL_DEPTH_TEST );
     f->glEnable( GL_CULL_FACE );
 
-    renderShadow( );
+    m_currentSample.index = m_frameIndex++;
+    m_gpuTimer.beginFrame( m_currentSample.index );
+    if ( m_renderShadowMode != NoShadow )
+    {
+        ScopedTimer timer( m_currentSample.shadow );
+        m_gpuTimer.begin( GpuTimer::ShadowPass );
+        renderShadow( );
+        m_gpuTimer.end( GpuTimer::ShadowPass );
+    }
 
-    QRectF sceneRect = boundingRect( );
-    f->glViewport( sceneRect.x( ),
-                   sceneRect.y( ),
-                   sceneRect.width( ),
-                   sceneRect.height( ) );
-    f->glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
-    f->glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    {
+        TRACE_GPU_SCOPE( "View::renderMain" );
+        ScopedTimer timer( m_currentSample.main );
+        m_gpuTimer.begin( GpuTimer::MainPass );
 
-    foreach ( QObject* object, m_data )
+        // 动画器运行或者连续两帧都有变化时，下一帧多半还要重画，缓存的结果用不上，
+        // 直接画到窗口，省掉多重采样缓存的绘制以及拷贝
+        bool continuous = animating || ( m_renderDirty && m_previousFrameDirty );
+        bool cached = !continuous && prepareSceneFramebuffer( targetRect.size( ) );
+        m_sceneCached = cached;
+        if ( cached )
+        {
+            m_sceneFBO->bind( );
+            f->glViewport( 0, 0, targetRect.width( ), targetRect.height( ) );
+        }
+        else
+        {
+            f->glViewport( sceneRect.x( ),
+                           sceneRect.y( ),
+                           sceneRect.width( ),
+                           sceneRect.height( ) );
+        }
+        f->glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
+        f->glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+        // 视锥体裁剪，从近到远绘制让early-z剔除被遮挡的片段
+        m_bvh.queryFrustum( m_projectionMatrix * m_viewMatrix, m_visibleEntities );
+
+        // 合批的静态实体也可以作为遮挡体，所以在去掉它们之前光栅化
+        if ( m_renderOcclusionCulling ) rasterizeOccluders( m_visibleEntities );
+        removeBatchedEntities( m_visibleEntities );
+        if ( m_renderOcclusionCulling ) removeOccludedEntities( m_visibleEntities );
+        prepareEntities( m_visibleEntities );
+        sortFrontToBack( m_visibleEntities );
+
+        // 预渲染以后深度缓存中已经是最终的深度，只有可见的片段通过GL_EQUAL
+        if ( m_renderDepthPrepass )
+        {
+            ScopedTimer prepassTimer( m_currentSample.depthPrepass );
+            renderDepthPrepass( );
+            f->glDepthFunc( GL_EQUAL );
+        }
+        foreach ( int index, m_visibleEntities )
+        {
+            QObject* object = m_bvhObjects[index];
+            Cube* cube = qobject_cast<Cube*>( object );
+            Plane* plane = qobject_cast<Plane*>( object );
+            TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+            Mesh* mesh = qobject_cast<Mesh*>( object );
+
+            if ( cube != Q_NULLPTR ) cube->render( );
+            else if ( plane != Q_NULLPTR ) plane->render( );
+            else if ( mesh != Q_NULLPTR ) mesh->render( );
+            else if ( texturedCube != Q_NULLPTR )
+            {
+                // TexturedCube没有只写深度的路径，不参与预渲染
+                if ( m_renderDepthPrepass ) f->glDepthFunc( GL_LEQUAL );
+                texturedCube->render( );
+                if ( m_renderDepthPrepass ) f->glDepthFunc( GL_EQUAL );
+            }
+        }
+        m_staticBatcher.render( this );
+        f->glDepthFunc( GL_LESS );
+        m_gpuDriven.render( this );
+
+        if ( cached )
+        {
+            bindWindowFramebuffer( );
+            blitScene( targetRect );
+        }
+        m_gpuTimer.end( GpuTimer::MainPass );
+    }
+    // 还有过期的阴影图块时由m_shadowsPending继续渲染下一帧
+    m_previousFrameDirty = m_renderDirty;
+    m_renderDirty = false;
+
+    // 拾取使用屏幕上的这一帧的相机，动画器移动的相机只存在于渲染线程
     {
-        Cube* cube = qobject_cast<Cube*>( object );
-        Plane* plane = qobject_cast<Plane*>( object );
-        TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+        QMutexLocker locker( &m_pickMutex );
+        m_pickViewProjectionMatrix = m_projectionMatrix * m_viewMatrix;
+        m_pickMatrixValid = true;
+    }
+
+    // 栅栏在这一帧所有的命令之后，三帧以后重用这一段时GPU早已读完
+    m_streamBuffer.endFrame( );
+    m_currentSample.uploadBytes = m_streamBuffer.uploadedBytes( );
+
+    resetOpenGLState( );
+
+    // 提交这一帧的统计
+    m_currentSample.frame = m_currentSample.sync + frameTimer.nsecsElapsed( );
+    if ( m_gpuTimer.isAvailable( ) && m_gpuTimer.resultFrame( ) >= 0 )
+    {
+        m_currentSample.gpuIndex = m_gpuTimer.resultFrame( );
+        m_currentSample.gpuShadow = m_gpuTimer.result( GpuTimer::ShadowPass );
+        m_currentSample.gpuMain = m_gpuTimer.result( GpuTimer::MainPass );
+    }
+    m_stats->submit( m_currentSample );
+
+    // 在渲染线程请求下一帧，GUI线程繁忙时也不会停下来
+    if ( animating || m_shadowsPending ) window( )->update( );
+}
+
+bool View::animate( void )
+{
+    bool animating = false;
+    qint64 time = m_animationClock.elapsed( );
+    foreach ( ViewAnimator* animator, m_animators )
+    {
+        QVector3D position;
+        if ( !animator->evaluate( time, position ) ) continue;
+        animating = true;
 
-        if ( cube != Q_NULLPTR ) cube->render( );
-        else if ( plane != Q_NULLPTR ) plane->render( );
-        else if ( texturedCube != Q_NULLPTR ) texturedCube->render( );
+        if ( animator->renderTarget( ) == ViewAnimator::Light )
+        {
+            m_renderLightPosition = position;
+            calculateLightMatrix( );
+        }
+        else
+        {
+            m_viewMatrix.setToIdentity( );
+            m_viewMatrix.lookAt( position, m_renderLookAt, m_renderUp );
+        }
     }
 
+    if ( animating ) m_renderDirty = true;
+    return animating;
+}
+
+void View::calculateLightMatrix( void )
+{
+    QMatrix4x4 lightViewMatrix;
+    lightViewMatrix.lookAt( m_renderLightPosition,
+                            QVector3D( 0, 0, 0 ),
+                            QVector3D( 0, 1, 0 ) );
+    m_lightViewProjectionMatrix = m_projectionMatrix * lightViewMatrix;
+}
+
+void View::updateLights( void )
+{
+    // 没有Light实体时只有lightPosition一个白色光源，与相机共用投影矩阵
+    m_lights = m_syncedLights;
+    if ( m_lights.isEmpty( ) )
+    {
+        RenderLight light;
+        light.position = m_renderLightPosition;
+        light.color = QVector3D( 1.0f, 1.0f, 1.0f );
+        light.importance = 1.0f;
+        light.castShadows = true;
+        light.viewProjectionMatrix = m_lightViewProjectionMatrix;
+        light.focal = m_projectionMatrix( 1, 1 );
+
+        // 透视投影的P[2][3] / (P[2][2] + 1)即远平面，回放时也适用
+        light.range = m_projectionMatrix( 2, 3 ) / ( m_projectionMatrix( 2, 2 ) + 1.0f );
+        m_lights.append( light );
+    }
+    else
+    {
+        for ( int i = 0; i < m_lights.size( ); ++i )
+        {
+            RenderLight& light = m_lights[i];
+            QMatrix4x4 projectionMatrix;
+            projectionMatrix.perspective( light.fieldOfView, 1.0f,
+                                          LIGHT_NEAR_PLANE, light.range );
+
+            // 朝向与Y轴平行时换一个上方向
+            QVector3D direction = light.lookAt - light.position;
+            QVector3D up( 0.0f, 1.0f, 0.0f );
+            if ( QVector3D::crossProduct( direction, up ).lengthSquared( ) <=
+                 1e-6f * direction.lengthSquared( ) )
+                up = QVector3D( 0.0f, 0.0f, 1.0f );
+            QMatrix4x4 lightViewMatrix;
+            lightViewMatrix.lookAt( light.position, light.lookAt, up );
+
+            light.viewProjectionMatrix = projectionMatrix * lightViewMatrix;
+            light.focal = projectionMatrix( 1, 1 );
+        }
+    }
+
+    // 点光源阴影模式下第一个光源改用立方体贴图，不再占用图集
+    m_pointShadowRange = 0.0f;
+    if ( m_renderShadowMode == PointShadow && m_lights[0].castShadows &&
+         m_shadowCubeMap.texture( ) != 0 )
+    {
+        m_pointShadowRange = m_lights[0].range;
+        m_lights[0].castShadows = false;
+    }
+    allocateShadowTiles( m_lights );
+    scheduleShadowUpdates( );
+
+    int count = m_lights.size( );
+    m_lightPositions.resize( count );
+    m_lightColors.resize( count );
+    m_lightMatrices.resize( count );
+    m_shadowTiles.resize( count );
+    m_lightRanges.resize( count );
+    for ( int i = 0; i < count; ++i )
+    {
+        const RenderLight& light = m_lights[i];
+        const QRect& tile = light.tile;
+        m_lightPositions[i] = light.position;
+        m_lightColors[i] = light.color;
+        m_lightMatrices[i] = light.viewProjectionMatrix;
+        m_lightRanges[i] = light.range;
+        m_shadowTiles[i] = QVector4D( tile.x( ), tile.y( ),
+                                      tile.width( ), tile.height( ) ) / SHADOW_ATLAS_SIZE;
+    }
+}
+
+void View::scheduleShadowUpdates( void )
+{
+    // 图块变化或者新出现的光源必须绘制。光源矩阵或者投射者变化以后图块过期，
+    // 过期的图块按照等待帧数乘以重要程度排序，在预算以内轮流更新。
+    // 没有过期的图块不绘制，也不请求下一帧。没有轮到的光源用上次绘制时的矩阵采样，
+    // 阴影与图块的内容一致，只是滞后几帧
+    bool shadows = m_renderShadowMode != NoShadow;
+    int budget = m_renderShadowUpdateBudget > 0 ?
+                m_renderShadowUpdateBudget : m_lights.size( );
+    m_shadowTileStates.resize( m_lights.size( ) );
+    QVector<int> candidates;
+    for ( int i = 0; i < m_lights.size( ); ++i )
+    {
+        RenderLight& light = m_lights[i];
+        ShadowTileState& state = m_shadowTileStates[i];
+        light.refresh = true;
+        if ( !shadows || light.tile.isEmpty( ) )
+        {
+            state.valid = false;
+            continue;
+        }
+        if ( !state.valid || state.tile != light.tile )
+        {
+            --budget;
+            continue;
+        }
+        light.refresh = false;
+        if ( state.viewProjectionMatrix != light.viewProjectionMatrix ||
+             state.casterGeneration != m_shadowCasterGeneration )
+            candidates.append( i );
+        else state.age = 0;
+    }
+
+    const QVector<ShadowTileState>& states = m_shadowTileStates;
+    const QVector<RenderLight>& lights = m_lights;
+    std::stable_sort( candidates.begin( ), candidates.end( ), [&]( int a, int b )
+    {
+        return ( states[a].age + 1 ) * lights[a].importance >
+                ( states[b].age + 1 ) * lights[b].importance;
+    } );
+    for ( int i = 0; i < candidates.size( ) && i < budget; ++i )
+        m_lights[candidates[i]].refresh = true;
+
+    m_shadowsPending = false;
+    for ( int i = 0; i < m_lights.size( ); ++i )
+    {
+        RenderLight& light = m_lights[i];
+        ShadowTileState& state = m_shadowTileStates[i];
+        if ( !shadows || light.tile.isEmpty( ) ) continue;
+        if ( light.refresh )
+        {
+            state.viewProjectionMatrix = light.viewProjectionMatrix;
+            state.tile = light.tile;
+            state.casterGeneration = m_shadowCasterGeneration;
+            state.age = 0;
+            state.valid = true;
+        }
+        else
+        {
+            // 没有过期的图块矩阵相同，age在上面已经清零
+            if ( state.viewProjectionMatrix != light.viewProjectionMatrix ||
+                 state.casterGeneration != m_shadowCasterGeneration )
+            {
+                ++state.age;
+                m_shadowsPending = true;
+            }
+            light.viewProjectionMatrix = state.viewProjectionMatrix;
+        }
+    }
+}
+
+void View::allocateShadowTiles( QVector<RenderLight>& lights )
+{
+    // 最重要的光源使用MAX_SHADOW_TILE，重要程度每减半边长也减半
+    float maxImportance = 0.0f;
+    foreach ( const RenderLight& light, lights )
+    {
+        if ( light.castShadows ) maxImportance = qMax( maxImportance, light.importance );
+    }
+
+    QVector<int> sizes( lights.size( ), 0 );
+    qint64 area = 0;
+    for ( int i = 0; i < lights.size( ); ++i )
+    {
+        lights[i].tile = QRect( );
+        if ( !lights[i].castShadows || lights[i].importance <= 0.0f ) continue;
+        int size = MAX_SHADOW_TILE;
+        float ratio = maxImportance / lights[i].importance;
+        while ( size > MIN_SHADOW_TILE && ratio >= 2.0f )
+        {
+            size /= 2;
+            ratio /= 2.0f;
+        }
+        sizes[i] = size;
+        area += qint64( size ) * size;
+    }
+
+    // 图集放不下时所有图块一起缩小
+    while ( area > qint64( SHADOW_ATLAS_SIZE ) * SHADOW_ATLAS_SIZE )
+    {
+        area = 0;
+        for ( int i = 0; i < sizes.size( ); ++i )
+        {
+            sizes[i] /= 2;
+            area += qint64( sizes[i] ) * sizes[i];
+        }
+    }
+
+    // 边长都是2的幂，从大到小依次取最小的空闲正方形并四分，总面积不超过图集就一定放得下
+    QVector<int> order;
+    for ( int i = 0; i < sizes.size( ); ++i )
+    {
+        if ( sizes[i] > 0 ) order.append( i );
+    }
+    std::stable_sort( order.begin( ), order.end( ), [&sizes]( int a, int b )
+    {
+        return sizes[a] > sizes[b];
+    } );
+
+    QVector<QRect> freeTiles;
+    freeTiles.append( QRect( 0, 0, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE ) );
+    foreach ( int index, order )
+    {
+        int size = sizes[index];
+        int best = -1;
+        for ( int i = 0; i < freeTiles.size( ); ++i )
+        {
+            if ( freeTiles[i].width( ) >= size &&
+                 ( best < 0 || freeTiles[i].width( ) < freeTiles[best].width( ) ) )
+                best = i;
+        }
+        if ( best < 0 ) break;
+
+        QRect tile = freeTiles.takeAt( best );
+        while ( tile.width( ) > size )
+        {
+            int half = tile.width( ) / 2;
+            freeTiles.append( QRect( tile.x( ) + half, tile.y( ), half, half ) );
+            freeTiles.append( QRect( tile.x( ), tile.y( ) + half, half, half ) );
+            freeTiles.append( QRect( tile.x( ) + half, tile.y( ) + half, half, half ) );
+            tile.setSize( QSize( half, half ) );
+        }
+        lights[index].tile = tile;
+    }
+}
+
+void View::updateLodParameters( int viewportHeight )
+{
+    // 透视投影下，距离d处长度为l的线段大约占l * P[1][1] * h / 2 / d个像素
+    float focal = m_projectionMatrix( 1, 1 ) * 0.5f;
+    m_mainLod.origin = m_viewMatrix.inverted( ).column( 3 ).toVector3D( );
+    m_mainLod.pixelsPerUnit = focal * viewportHeight;
+    m_mainLod.threshold = m_renderLodThreshold;
+
+    // 阴影的origin以及pixelsPerUnit随光源变化，在renderShadow中设置
+    m_shadowLod.threshold = m_renderLodThreshold * m_renderShadowLodBias;
+}
+
+bool View::prepareSceneFramebuffer( const QSize& size )
+{
+    // 不支持拷贝帧缓存时只能每帧都完整地绘制
+    if ( !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit( ) ||
+         size.isEmpty( ) ) return false;
+
+    if ( m_sceneFBO != Q_NULLPTR && m_sceneFBO->size( ) == size ) return true;
+
+    delete m_sceneFBO;
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment( QOpenGLFramebufferObject::CombinedDepthStencil );
+    format.setSamples( window( )->openglContext( )->format( ).samples( ) );
+    m_sceneFBO = new QOpenGLFramebufferObject( size, format );
+    return true;
+}
+
+void View::bindWindowFramebuffer( void )
+{
+    if ( window( )->renderTarget( ) != Q_NULLPTR )
+        window( )->renderTarget( )->bind( );
+    else QOpenGLFramebufferObject::bindDefault( );
+}
+
+void View::blitScene( const QRect& targetRect )
+{
+    QOpenGLFramebufferObject::blitFramebuffer(
+                window( )->renderTarget( ),
+                targetRect,
+                m_sceneFBO,
+                QRect( QPoint( 0, 0 ), m_sceneFBO->size( ) ) );
+    bindWindowFramebuffer( );
+}
+
+void View::resetOpenGLState( void )
+{
+    TRACE_SCOPE( "resetOpenGLState" );
     window( )->resetOpenGLState( );
 }
 
 void View::sync( void )
 {
+    TRACE_SCOPE( "View::sync" );
+    m_syncTime = 0;
+    ScopedTimer syncTimer( m_syncTime );
+
     if ( !m_initialized ) initialize( );
+    initializeEntities( );
+    m_streamBuffer.beginFrame( );
+
+    // 此时GUI线程被阻塞，可以安全地交换标记
+    if ( m_updatePending )
+    {
+        m_renderDirty = true;
+        m_updatePending = false;
+    }
+    int framesSkipped = m_framesSkipped.load( );
+    if ( framesSkipped != m_reportedFramesSkipped )
+    {
+        m_reportedFramesSkipped = framesSkipped;
+        // sync在渲染线程中执行，统计面板的绑定要在GUI线程中求值
+        QMetaObject::invokeMethod( this, "framesSkippedChanged", Qt::QueuedConnection );
+    }
 
     if ( m_viewMatrixDirty )
     {
         m_viewMatrix = m_pendingViewMatrix;
+        m_renderLookAt = m_lookAt;
+        m_renderUp = m_up;
         m_viewMatrixDirty = false;
     }
 
     if ( m_projectionMatrixDirty )
     {
         m_projectionMatrix = m_pendingProjectionMatrix;
-        QMatrix4x4 lightViewMatrix;
-        lightViewMatrix.lookAt( m_lightPosition,
-                                QVector3D( 0, 0, 0 ),
-                                QVector3D( 0, 1, 0 ) );
-        m_lightViewProjectionMatrix = m_projectionMatrix * lightViewMatrix;
+        calculateLightMatrix( );
         m_projectionMatrixDirty = false;
     }
 
     if ( m_lightPositionDirty )
     {
-        QMatrix4x4 lightViewMatrix;
-        lightViewMatrix.lookAt( m_lightPosition,
-                                QVector3D( 0, 0, 0 ),
-                                QVector3D( 0, 1, 0 ) );
-        m_lightViewProjectionMatrix = m_projectionMatrix * lightViewMatrix;
+        m_renderLightPosition = m_lightPosition;
+        calculateLightMatrix( );
         m_lightPositionDirty = false;
     }
 
+    if ( m_jobSystem.workerCount( ) != m_workerThreads )
+        m_jobSystem.setWorkerCount( m_workerThreads );
+    if ( m_renderShadowMode != m_shadowMode ||
+         m_renderShadowSoftness != m_shadowSoftness ||
+         m_renderLodThreshold != m_lodThreshold ||
+         m_renderShadowLodBias != m_shadowLodBias )
+        ++m_shadowCasterGeneration;
+    m_renderShadowMode = m_shadowMode;
+    m_renderShadowSoftness = m_shadowSoftness;
+    m_renderShadowUpdateBudget = m_shadowUpdateBudget;
+    m_renderDepthPrepass = m_depthPrepass;
+    m_renderOcclusionCulling = m_occlusionCulling;
+    m_renderGpuCulling = m_gpuCulling;
+    m_renderLodThreshold = m_lodThreshold;
+    m_renderShadowLodBias = m_shadowLodBias;
+
+    if ( m_recorderDirty )
+    {
+        delete m_recorder;
+        m_recorder = m_pendingRecorder;
+        m_pendingRecorder = Q_NULLPTR;
+        m_recorderDirty = false;
+    }
+
+    // 动画器的状态拷贝到渲染线程
+    m_animators.clear( );
+    foreach ( QObject* object, m_data )
+    {
+        ViewAnimator* animator = qobject_cast<ViewAnimator*>( object );
+        if ( animator == Q_NULLPTR ) continue;
+        animator->sync( m_animationClock.elapsed( ) );
+        m_animators.append( animator );
+    }
+
+    // Light实体拷贝到渲染线程，超过MAX_LIGHTS的部分忽略
+    m_syncedLights.clear( );
+    foreach ( QObject* object, m_data )
+    {
+        Light* light = qobject_cast<Light*>( object );
+        if ( light == Q_NULLPTR ) continue;
+        if ( m_syncedLights.size( ) == MAX_LIGHTS )
+        {
+            static bool warned = false;
+            if ( !warned ) qWarning( "View: only %d lights are supported.", MAX_LIGHTS );
+            warned = true;
+            break;
+        }
+
+        QColor color = light->color( );
+        RenderLight state;
+        state.position = light->position( );
+        state.lookAt = light->lookAt( );
+        state.color = QVector3D( color.redF( ), color.greenF( ), color.blueF( ) );
+        state.fieldOfView = light->fieldOfView( );
+        state.range = light->range( );
+        state.importance = light->importance( );
+        state.castShadows = light->castShadows( );
+        m_syncedLights.append( state );
+    }
+
+    // 有Light实体时lightPosition不再使用，以光源为目标的动画器不起作用
+    if ( !m_syncedLights.isEmpty( ) )
+    {
+        foreach ( ViewAnimator* animator, m_animators )
+        {
+            if ( animator->renderTarget( ) != ViewAnimator::Light || !animator->running( ) )
+                continue;
+            static bool warned = false;
+            if ( !warned ) qWarning( "View: a ViewAnimator with target Light only drives "
+                                     "lightPosition, which is unused while the view "
+                                     "contains Light entities." );
+            warned = true;
+            break;
+        }
+    }
+
     // 临时测试的
     static bool runOnce = grubData( );
     Q_UNUSED( runOnce );
@@ -125,10 +717,26 @@ void View::sync( void )
         Cube* cube = qobject_cast<Cube*>( object );
         Plane* plane = qobject_cast<Plane*>( object );
         TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+        Mesh* mesh = qobject_cast<Mesh*>( object );
 
         if ( cube != Q_NULLPTR ) cube->sync( );
         else if ( plane != Q_NULLPTR ) plane->sync( );
         else if ( texturedCube != Q_NULLPTR ) texturedCube->sync( );
+        else if ( mesh != Q_NULLPTR ) mesh->sync( );
+    }
+
+    if ( m_recorder != Q_NULLPTR ) m_recorder->recordEntities( m_data );
+
+    m_staticBatcher.update( m_data );
+    m_gpuDriven.update( m_data, m_changedCubes, m_renderGpuCulling, &m_streamBuffer );
+    m_changedCubes.clear( );
+    updateBoundingVolumes( );
+    if ( m_shadowBatchGeneration != m_staticBatcher.generation( ) ||
+         m_shadowInstanceGeneration != m_gpuDriven.generation( ) )
+    {
+        m_shadowBatchGeneration = m_staticBatcher.generation( );
+        m_shadowInstanceGeneration = m_gpuDriven.generation( );
+        ++m_shadowCasterGeneration;
     }
 }
 
@@ -139,50 +747,445 @@ void View::cleanup( void )
         Cube* cube = qobject_cast<Cube*>( object );
         Plane* plane = qobject_cast<Plane*>( object );
         TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+        Mesh* mesh = qobject_cast<Mesh*>( object );
 
         if ( cube != Q_NULLPTR ) cube->release( );
         else if ( plane != Q_NULLPTR ) plane->release( );
         else if ( texturedCube != Q_NULLPTR ) texturedCube->release( );
+        else if ( mesh != Q_NULLPTR ) mesh->release( );
     }
 
-    delete m_FBO;
+    m_gpuTimer.release( );
+    m_streamBuffer.release( );
+    m_staticBatcher.release( );
+    m_gpuDriven.release( );
+    delete m_shadowAtlas;
+    delete m_staticShadowAtlas;
+    m_staticShadowAtlas = Q_NULLPTR;
+    m_staticShadowGeneration = -1;
+    m_shadowTileStates.clear( );
+    m_shadowCubeMap.destroy( );
+    delete m_shadowBlurFBO;
+    delete m_blurProgram;
+    m_quadBuffer.destroy( );
+    delete m_prepassProgram;
+    m_prepassProgram = Q_NULLPTR;
+    delete m_layeredDepthProgram;
+    m_layeredDepthProgram = Q_NULLPTR;
     delete m_depthProgram;
+    delete m_unshadowedProgram.program;
+    m_unshadowedProgram.program = Q_NULLPTR;
+    delete m_sceneFBO;
+    delete m_recorder;
+    m_recorder = Q_NULLPTR;
+    m_sceneFBO = Q_NULLPTR;
+    m_sceneCached = false;
 }
 
 void View::renderShadow( void )
 {
-    // 根据各自的方法进行渲染阴影
-    m_FBO->bind( );
+    TRACE_GPU_SCOPE( "View::renderShadow" );
+
     QOpenGLFunctions* f = window( )->openglContext( )->functions( );
-    f->glViewport( 0.0,
-                   0.0,
-                   FBO_WIDTH,
-                   FBO_HEIGHT );
     f->glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
+    f->glCullFace( GL_FRONT );
+    m_depthProgram->bind( );
+    m_depthPointLight = QVector4D( );
+    m_depthProgram->setUniformValue( "pointLight", m_depthPointLight );
+    bool variance = m_renderShadowMode == VarianceShadow;
+    m_depthProgram->setUniformValue( "moments", int( variance ) );
+    countStateChanges( 3 );
+
+    // 静态层的颜色以及深度拷贝到各个图块，这一帧只需要绘制动态的投射者
+    bool cached = updateStaticShadowLayer( variance );
+    if ( cached )
+    {
+        foreach ( const RenderLight& light, m_lights )
+        {
+            if ( light.tile.isEmpty( ) || !light.refresh ) continue;
+            QOpenGLFramebufferObject::blitFramebuffer(
+                        m_shadowAtlas, light.tile, m_staticShadowAtlas, light.tile,
+                        GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+        }
+    }
+
+    // 所有光源的阴影图都在同一个图集中，只绑定一次FBO，
+    // 每个光源只绘制自己的图块，没有轮到的图块保留上次的内容
+    m_shadowAtlas->bind( );
+    countStateChanges( 1 );
+    f->glEnable( GL_SCISSOR_TEST );
+    foreach ( const RenderLight& light, m_lights )
+    {
+        if ( light.tile.isEmpty( ) || !light.refresh ) continue;
+        beginShadowTile( light, variance, !cached );
+        renderShadowCasters( light.viewProjectionMatrix, !cached );
+    }
+    f->glDisable( GL_SCISSOR_TEST );
+
+    if ( m_pointShadowRange > 0.0f ) renderPointShadow( m_lights[0].position );
+
+    m_depthProgram->release( );
+    f->glCullFace( GL_BACK );
+    if ( variance ) blurShadowTiles( );
+
+    // 方差阴影在主渲染中使用硬件双线性过滤，其它模式打包的深度不能插值
+    GLint filter = variance ? GL_LINEAR : GL_NEAREST;
+    f->glBindTexture( GL_TEXTURE_2D, m_shadowAtlas->texture( ) );
+    f->glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter );
+    f->glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter );
+    f->glBindTexture( GL_TEXTURE_2D, 0 );
+
+    bindWindowFramebuffer( );
+    countStateChanges( 2 );
+}
+
+void View::renderPointShadow( const QVector3D& position )
+{
+    TRACE_GPU_SCOPE( "View::renderPointShadow" );
+
+    QOpenGLFunctions* f = window( )->openglContext( )->functions( );
+    int size = m_shadowCubeMap.size( );
+    f->glViewport( 0, 0, size, size );
+    m_depthPointLight = QVector4D( position, m_pointShadowRange );
+    m_depthProgram->setUniformValue( "pointLight", m_depthPointLight );
+    countStateChanges( 1 );
+
+    // 90度视锥体的P[1][1]为1
+    m_shadowLod.origin = position;
+    m_shadowLod.pixelsPerUnit = 0.5f * size;
+
+    if ( m_layeredDepthProgram != Q_NULLPTR )
+    {
+        renderLayeredPointShadow( position );
+        return;
+    }
+
+    // 没有分层渲染，六个面依次绘制。每个面单独裁剪，
+    // 大部分实体只落在一两个面里，总的绘制次数接近一张阴影图
+    for ( int face = 0; face < ShadowCubeMap::FaceCount; ++face )
+    {
+        QMatrix4x4 viewProjectionMatrix = ShadowCubeMap::faceViewProjectionMatrix(
+                    position, LIGHT_NEAR_PLANE, m_pointShadowRange, face );
+        m_shadowCubeMap.bindFace( face );
+        f->glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+        m_depthProgram->setUniformValue( "viewProjectionMatrix", viewProjectionMatrix );
+        countStateChanges( 2 );
+        renderShadowCasters( viewProjectionMatrix, true );
+    }
+}
+
+void View::renderLayeredPointShadow( const QVector3D& position )
+{
+    // 每个投射者只绘制一次，几何着色器把三角形分发到各个面。
+    // 裁剪使用包住光源范围的盒子，它是六个面的视锥体的并集的外接盒
+    QMatrix4x4 faceMatrices[ShadowCubeMap::FaceCount];
+    for ( int face = 0; face < ShadowCubeMap::FaceCount; ++face )
+    {
+        faceMatrices[face] = ShadowCubeMap::faceViewProjectionMatrix(
+                    position, LIGHT_NEAR_PLANE, m_pointShadowRange, face );
+    }
+    QMatrix4x4 rangeMatrix;
+    rangeMatrix.ortho( -m_pointShadowRange, m_pointShadowRange,
+                       -m_pointShadowRange, m_pointShadowRange,
+                       -m_pointShadowRange, m_pointShadowRange );
+    rangeMatrix.translate( -position );
+
+    QOpenGLFunctions* f = window( )->openglContext( )->functions( );
+    m_shadowCubeMap.bindLayered( );
     f->glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    m_layeredDepthProgram->bind( );
+    m_layeredDepthProgram->setUniformValueArray( "faceMatrices", faceMatrices,
+                                                 ShadowCubeMap::FaceCount );
+    m_layeredDepthProgram->setUniformValue( "pointLight", m_depthPointLight );
+    m_layeredDepthProgram->setUniformValue( "moments", 0 );
+    countStateChanges( 5 );
 
-    f->glCullFace( GL_FRONT );
+    m_layeredShadowActive = true;
+    renderShadowCasters( rangeMatrix, true, false );
+    m_layeredShadowActive = false;
     m_depthProgram->bind( );
-    m_depthProgram->setUniformValue( "viewProjectionMatrix", m_lightViewProjectionMatrix );
-    foreach ( QObject* object, m_data )
+    countStateChanges( 1 );
+
+    // GPU剔除的立方体有自己的分层程序，同样只绘制一次。
+    // 它链接失败时才逐面绘制，深度与分层的部分共用
+    if ( m_gpuDriven.instanceCount( ) == 0 ||
+         m_gpuDriven.renderLayeredShadow( this, rangeMatrix, faceMatrices,
+                                          m_depthPointLight ) ) return;
+    for ( int face = 0; face < ShadowCubeMap::FaceCount; ++face )
+    {
+        m_shadowCubeMap.bindFace( face );
+        countStateChanges( 1 );
+        m_gpuDriven.renderShadow( this, faceMatrices[face], m_depthPointLight );
+    }
+}
+
+void View::beginShadowTile( const RenderLight& light, bool variance, bool clear )
+{
+    const QRect& tile = light.tile;
+    QOpenGLFunctions* f = window( )->openglContext( )->functions( );
+    f->glViewport( tile.x( ), tile.y( ), tile.width( ), tile.height( ) );
+    f->glScissor( tile.x( ), tile.y( ), tile.width( ), tile.height( ) );
+    if ( clear ) f->glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    m_depthProgram->setUniformValue( "viewProjectionMatrix",
+                                     light.viewProjectionMatrix );
+    countStateChanges( 1 );
+    if ( variance )
+    {
+        m_depthPointLight = QVector4D( light.position, light.range );
+        m_depthProgram->setUniformValue( "pointLight", m_depthPointLight );
+        countStateChanges( 1 );
+    }
+
+    // 细节层次按照光源的位置以及图块的分辨率选择
+    m_shadowLod.origin = light.position;
+    m_shadowLod.pixelsPerUnit = light.focal * 0.5f * tile.height( );
+}
+
+bool View::updateStaticShadowLayer( bool variance )
+{
+    // 没有静态几何体或者不能拷贝帧缓存时每帧完整地绘制
+    if ( m_staticBatcher.batchCount( ) == 0 ||
+         !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit( ) ) return false;
+
+    // 光源、图块以及静态几何体都没有变化时沿用上次的结果
+    if ( m_staticShadowAtlas != Q_NULLPTR &&
+         m_staticShadowGeneration == m_staticBatcher.generation( ) &&
+         m_staticShadowVariance == variance &&
+         m_staticShadowMatrices == m_lightMatrices &&
+         m_staticShadowTiles == m_shadowTiles &&
+         m_staticShadowRanges == m_lightRanges ) return true;
+
+    TRACE_GPU_SCOPE( "View::renderStaticShadowLayer" );
+    if ( m_staticShadowAtlas == Q_NULLPTR )
+    {
+        m_staticShadowAtlas = new QOpenGLFramebufferObject(
+                    QSize( SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE ),
+                    QOpenGLFramebufferObject::Depth );
+    }
+
+    m_staticShadowAtlas->bind( );
+    countStateChanges( 1 );
+    QOpenGLFunctions* f = window( )->openglContext( )->functions( );
+    f->glEnable( GL_SCISSOR_TEST );
+    foreach ( const RenderLight& light, m_lights )
     {
+        if ( light.tile.isEmpty( ) ) continue;
+        beginShadowTile( light, variance, true );
+        m_staticBatcher.renderShadow( this, light.viewProjectionMatrix );
+    }
+    f->glDisable( GL_SCISSOR_TEST );
+
+    m_staticShadowGeneration = m_staticBatcher.generation( );
+    m_staticShadowVariance = variance;
+    m_staticShadowMatrices = m_lightMatrices;
+    m_staticShadowTiles = m_shadowTiles;
+    m_staticShadowRanges = m_lightRanges;
+    return true;
+}
+
+void View::blurShadowTiles( void )
+{
+    // 高斯核的半径取2σ
+    int radius = qMin( MAX_BLUR_RADIUS, int( ceil( m_renderShadowSoftness * 2.0 ) ) );
+    if ( radius <= 0 ) return;
+
+    TRACE_GPU_SCOPE( "View::blurShadowTiles" );
+    GLfloat weights[MAX_BLUR_RADIUS + 1];
+    float sum = 0.0f;
+    for ( int i = 0; i <= radius; ++i )
+    {
+        weights[i] = exp( -0.5 * i * i / ( m_renderShadowSoftness * m_renderShadowSoftness ) );
+        sum += i == 0 ? weights[i] : 2.0f * weights[i];
+    }
+    for ( int i = 0; i <= radius; ++i ) weights[i] /= sum;
+
+    if ( m_shadowBlurFBO == Q_NULLPTR )
+    {
+        m_shadowBlurFBO = new QOpenGLFramebufferObject( QSize( SHADOW_ATLAS_SIZE,
+                                                               SHADOW_ATLAS_SIZE ) );
+    }
+
+    QOpenGLFunctions* f = window( )->openglContext( )->functions( );
+    f->glDisable( GL_DEPTH_TEST );
+    f->glDisable( GL_CULL_FACE );
+    f->glActiveTexture( GL_TEXTURE0 );
+    m_blurProgram->bind( );
+    m_blurProgram->setUniformValue( "texture", 0 );
+    m_blurProgram->setUniformValue( "radius", radius );
+    m_blurProgram->setUniformValueArray( "weights", weights, radius + 1, 1 );
+    m_quadBuffer.bind( );
+    int positionLoc = m_blurProgram->attributeLocation( "position" );
+    m_blurProgram->enableAttributeArray( positionLoc );
+    m_blurProgram->setAttributeBuffer( positionLoc, GL_FLOAT, 0, 2 );
+    // 着色器、三个uniform以及顶点缓存
+    countStateChanges( 5 );
+
+    // 每个图块先横向模糊到临时帧缓存，再纵向模糊回图集
+    float texel = 1.0f / SHADOW_ATLAS_SIZE;
+    foreach ( const RenderLight& light, m_lights )
+    {
+        const QRect& tile = light.tile;
+        if ( tile.isEmpty( ) || !light.refresh ) continue;
+
+        f->glViewport( tile.x( ), tile.y( ), tile.width( ), tile.height( ) );
+        m_blurProgram->setUniformValue( "tile", QVector4D( tile.x( ), tile.y( ),
+                                                           tile.width( ), tile.height( ) ) * texel );
+        m_blurProgram->setUniformValue( "tileBounds",
+                                        QVector4D( tile.left( ) + 0.5f, tile.top( ) + 0.5f,
+                                                   tile.right( ) + 0.5f, tile.bottom( ) + 0.5f ) * texel );
+
+        m_shadowBlurFBO->bind( );
+        f->glBindTexture( GL_TEXTURE_2D, m_shadowAtlas->texture( ) );
+        m_blurProgram->setUniformValue( "direction", QVector2D( texel, 0.0f ) );
+        f->glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+
+        m_shadowAtlas->bind( );
+        f->glBindTexture( GL_TEXTURE_2D, m_shadowBlurFBO->texture( ) );
+        m_blurProgram->setUniformValue( "direction", QVector2D( 0.0f, texel ) );
+        f->glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+
+        // 四个uniform，两次帧缓存以及纹理的绑定
+        countStateChanges( 8 );
+        countDrawCall( 2 );
+        countDrawCall( 2 );
+    }
+
+    m_blurProgram->disableAttributeArray( positionLoc );
+    m_quadBuffer.release( );
+    m_blurProgram->release( );
+    f->glBindTexture( GL_TEXTURE_2D, 0 );
+    f->glEnable( GL_DEPTH_TEST );
+    f->glEnable( GL_CULL_FACE );
+}
+
+void View::renderDepthPrepass( void )
+{
+    TRACE_GPU_SCOPE( "View::renderDepthPrepass" );
+
+    // 复用各个实体只绑定位置的阴影路径，depthProgram以及细节层次切换到主渲染的
+    QOpenGLFunctions* f = window( )->openglContext( )->functions( );
+    f->glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+    m_prepassActive = true;
+    m_prepassProgram->bind( );
+    m_prepassProgram->setUniformValue( "viewMatrix", m_viewMatrix );
+    m_prepassProgram->setUniformValue( "projectionMatrix", m_projectionMatrix );
+    countStateChanges( 3 );
+
+    foreach ( int index, m_visibleEntities )
+    {
+        QObject* object = m_bvhObjects[index];
         Cube* cube = qobject_cast<Cube*>( object );
         Plane* plane = qobject_cast<Plane*>( object );
+        Mesh* mesh = qobject_cast<Mesh*>( object );
 
         if ( cube != Q_NULLPTR ) cube->renderShadow( );
         else if ( plane != Q_NULLPTR ) plane->renderShadow( );
+        else if ( mesh != Q_NULLPTR ) mesh->renderShadow( );
     }
-    m_depthProgram->release( );
-    f->glCullFace( GL_BACK );
+    m_staticBatcher.renderDepth( this );
+
+    m_prepassProgram->release( );
+    m_prepassActive = false;
+    f->glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+}
 
-    m_FBO->bindDefault( );
+void View::sortFrontToBack( QVector<int>& entities )
+{
+    // 包围盒中心的视空间深度，相机朝向-z
+    m_entityDepths.resize( m_entityBounds.size( ) );
+    QVector4D row = m_viewMatrix.row( 2 );
+    foreach ( int index, entities )
+    {
+        const AABB& bounds = m_entityBounds[index];
+        QVector3D center = ( bounds.minimum + bounds.maximum ) * 0.5f;
+        m_entityDepths[index] = -QVector4D::dotProduct( row, QVector4D( center, 1.0f ) );
+    }
+    const float* depths = m_entityDepths.constData( );
+    std::sort( entities.begin( ), entities.end( ), [depths]( int a, int b )
+    {
+        return depths[a] < depths[b];
+    } );
+}
+
+void View::rasterizeOccluders( const QVector<int>& entities )
+{
+    TRACE_SCOPE( "View::rasterizeOccluders" );
+
+    m_occlusionCuller.begin( m_projectionMatrix * m_viewMatrix );
+    foreach ( int index, entities )
+    {
+        OcclusionCuller::OccluderShape shape = m_entityOccluderShapes[index];
+        if ( shape != OcclusionCuller::NoOccluder )
+            m_occlusionCuller.addOccluder( m_entityBounds[index], shape );
+    }
+    m_occlusionCuller.rasterize( m_jobSystem );
+}
+
+void View::removeOccludedEntities( QVector<int>& entities )
+{
+    if ( m_occlusionCuller.occluderCount( ) == 0 ) return;
+    TRACE_SCOPE( "View::removeOccludedEntities" );
+
+    // 各个实体的测试互不相关，分块并行，结果按原来的顺序合并
+    m_occlusionVisible.resize( entities.size( ) );
+    char* visible = m_occlusionVisible.data( );
+    const int* indices = entities.constData( );
+    const QVector<AABB>& bounds = m_entityBounds;
+    const OcclusionCuller& culler = m_occlusionCuller;
+    m_jobSystem.parallelFor( entities.size( ), ENTITY_CHUNK, [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; ++i )
+            visible[i] = culler.isVisible( bounds.at( indices[i] ) );
+    } );
+
+    int count = 0;
+    for ( int i = 0; i < entities.size( ); ++i )
+    {
+        if ( visible[i] ) entities[count++] = entities[i];
+    }
+    m_currentSample.occluded += entities.size( ) - count;
+    entities.resize( count );
+}
+
+void View::renderShadowCasters( const QMatrix4x4& lightViewProjectionMatrix,
+                                bool staticCasters, bool gpuCasters )
+{
+    // 只有在光源视锥体内的物体才会投射到阴影图上
+    m_bvh.queryFrustum( lightViewProjectionMatrix, m_shadowCasters );
+    removeBatchedEntities( m_shadowCasters );
+    foreach ( int index, m_shadowCasters )
+    {
+        if ( !m_entityCastsShadows[index] ) continue;
+        QObject* object = m_bvhObjects[index];
+        Cube* cube = qobject_cast<Cube*>( object );
+        Plane* plane = qobject_cast<Plane*>( object );
+        Mesh* mesh = qobject_cast<Mesh*>( object );
+
+        if ( cube != Q_NULLPTR ) cube->renderShadow( );
+        else if ( plane != Q_NULLPTR ) plane->renderShadow( );
+        else if ( mesh != Q_NULLPTR ) mesh->renderShadow( );
+    }
+    if ( staticCasters ) m_staticBatcher.renderShadow( this, lightViewProjectionMatrix );
+    if ( gpuCasters )
+        m_gpuDriven.renderShadow( this, lightViewProjectionMatrix, m_depthPointLight );
 }
 
 void View::updateWindow( void )
 {
+    // 多次修改合并成一次更新，QQuickWindow会在下一个垂直同步时渲染
+    if ( m_updatePending ) return;
+    m_updatePending = true;
+    emit sceneChanged( );
     if ( window( ) != Q_NULLPTR ) window( )->update( );
 }
 
+void View::geometryChanged( const QRectF& newGeometry,
+                            const QRectF& oldGeometry )
+{
+    QQuickItem::geometryChanged( newGeometry, oldGeometry );
+    if ( newGeometry.size( ) != oldGeometry.size( ) ) updateWindow( );
+}
+
 void View::setPosition( const QVector3D& position )
 {
     if ( m_position == position ) return;
@@ -239,6 +1242,80 @@ void View::setFarPlane( qreal farPlane )
     calculateProjectionMatrix( );
 }
 
+void View::setWorkerThreads( int workerThreads )
+{
+    workerThreads = qMax( 0, workerThreads );
+    if ( m_workerThreads == workerThreads ) return;
+    m_workerThreads = workerThreads;
+    emit workerThreadsChanged( );
+    updateWindow( );
+}
+
+void View::setLodThreshold( qreal lodThreshold )
+{
+    lodThreshold = qMax( qreal( 0.0 ), lodThreshold );
+    if ( m_lodThreshold == lodThreshold ) return;
+    m_lodThreshold = lodThreshold;
+    emit lodThresholdChanged( );
+    updateWindow( );
+}
+
+void View::setShadowLodBias( qreal shadowLodBias )
+{
+    shadowLodBias = qMax( qreal( 1.0 ), shadowLodBias );
+    if ( m_shadowLodBias == shadowLodBias ) return;
+    m_shadowLodBias = shadowLodBias;
+    emit shadowLodBiasChanged( );
+    updateWindow( );
+}
+
+void View::setTracing( bool tracing )
+{
+    if ( Tracer::isEnabled( ) == tracing ) return;
+    Tracer::instance( )->setEnabled( tracing );
+    emit tracingChanged( );
+}
+
+bool View::saveTrace( const QString& fileName )
+{
+    return Tracer::instance( )->save( fileName );
+}
+
+bool View::startRecording( const QString& fileName )
+{
+    FrameRecorder* recorder = new FrameRecorder;
+    if ( !recorder->open( fileName ) )
+    {
+        delete recorder;
+        return false;
+    }
+    delete m_pendingRecorder;
+    m_pendingRecorder = recorder;
+    m_recorderDirty = true;
+    updateWindow( );
+    return true;
+}
+
+void View::stopRecording( void )
+{
+    delete m_pendingRecorder;
+    m_pendingRecorder = Q_NULLPTR;
+    m_recorderDirty = true;
+    updateWindow( );
+}
+
+void View::setMatrices( const QMatrix4x4& viewMatrix,
+                        const QMatrix4x4& projectionMatrix )
+{
+    m_pendingViewMatrix = viewMatrix;
+    m_pendingProjectionMatrix = projectionMatrix;
+    m_viewMatrixDirty = true;
+    m_projectionMatrixDirty = true;
+    m_viewMatrixOverridden = true;
+    m_projectionMatrixOverridden = true;
+    updateWindow( );
+}
+
 void View::setLightPosition( const QVector3D& lightPosition )
 {
     if ( m_lightPosition == lightPosition ) return;
@@ -248,9 +1325,73 @@ void View::setLightPosition( const QVector3D& lightPosition )
     updateWindow( );
 }
 
+void View::setShadowSoftness( qreal shadowSoftness )
+{
+    shadowSoftness = qBound( qreal( 0.0 ), shadowSoftness, qreal( MAX_BLUR_RADIUS / 2 ) );
+    if ( m_shadowSoftness == shadowSoftness ) return;
+    m_shadowSoftness = shadowSoftness;
+    emit shadowSoftnessChanged( );
+    updateWindow( );
+}
+
+void View::setShadowUpdateBudget( int shadowUpdateBudget )
+{
+    shadowUpdateBudget = qMax( 0, shadowUpdateBudget );
+    if ( m_shadowUpdateBudget == shadowUpdateBudget ) return;
+    m_shadowUpdateBudget = shadowUpdateBudget;
+    emit shadowUpdateBudgetChanged( );
+    updateWindow( );
+}
+
+void View::setDepthPrepass( bool depthPrepass )
+{
+    if ( m_depthPrepass == depthPrepass ) return;
+    m_depthPrepass = depthPrepass;
+    emit depthPrepassChanged( );
+    updateWindow( );
+}
+
+void View::setOcclusionCulling( bool occlusionCulling )
+{
+    if ( m_occlusionCulling == occlusionCulling ) return;
+    m_occlusionCulling = occlusionCulling;
+    emit occlusionCullingChanged( );
+    updateWindow( );
+}
+
+void View::setGpuCulling( bool gpuCulling )
+{
+    if ( m_gpuCulling == gpuCulling ) return;
+    m_gpuCulling = gpuCulling;
+    emit gpuCullingChanged( );
+    updateWindow( );
+}
+
+void View::setShadowMode( ShadowMode shadowMode )
+{
+    if ( m_shadowMode == shadowMode ) return;
+    m_shadowMode = shadowMode;
+    emit shadowModeChanged( );
+    updateWindow( );
+}
+
 int View::shadowTexture( void )
 {
-    return m_FBO->texture( );
+    return m_shadowAtlas->texture( );
+}
+
+int View::bindUnshadowedProgram( const QMatrix4x4& modelMatrix,
+                                 const QMatrix3x3& modelViewNormalMatrix )
+{
+    UnshadowedProgram& unshadowed = m_unshadowedProgram;
+    unshadowed.program->bind( );
+    unshadowed.program->setUniformValue( unshadowed.modelMatrixLoc, modelMatrix );
+    unshadowed.program->setUniformValue( unshadowed.viewMatrixLoc, m_viewMatrix );
+    unshadowed.program->setUniformValue( unshadowed.projectionMatrixLoc, m_projectionMatrix );
+    unshadowed.program->setUniformValue( unshadowed.modelViewNormalMatrixLoc,
+                                         modelViewNormalMatrix );
+    // 着色器、四个矩阵，再加上光源数组中没有阴影的部分
+    return 5 + unshadowed.lightUniforms.apply( unshadowed.program, this );
 }
 
 QQmlListProperty<QObject> View::data( void )
@@ -273,65 +1414,364 @@ void View::initialize( void )
                                              ":/Depth.frag" );
     m_depthProgram->link( );
 
-    // 首先创建FBO
-    m_FBO = new QOpenGLFramebufferObject( QSize( FBO_WIDTH, FBO_HEIGHT ) );
+    // 深度预渲染必须与主渲染使用同一个顶点着色器，并且gl_Position是invariant，GL_EQUAL才能成立
+    m_prepassProgram = new QOpenGLShaderProgram;
+    addCommonVertexShader( m_prepassProgram );
+    m_prepassProgram->addShaderFromSourceFile( QOpenGLShader::Fragment,
+                                               ":/Prepass.frag" );
+    m_prepassProgram->link( );
 
-    foreach ( QObject* object, m_data )
+    // 不接收阴影的实体共用的主渲染程序
+    QFile commonFragment( ":/Common.frag" );
+    commonFragment.open( QIODevice::ReadOnly );
+    QByteArray unshadowedFragment = commonFragment.readAll( );
+    unshadowedFragment.prepend( "#define NO_SHADOW\n" );
+    UnshadowedProgram& unshadowed = m_unshadowedProgram;
+    unshadowed.program = new QOpenGLShaderProgram;
+    addCommonVertexShader( unshadowed.program );
+    unshadowed.program->addShaderFromSourceCode( QOpenGLShader::Fragment, unshadowedFragment );
+    unshadowed.program->link( );
+    unshadowed.program->bind( );
+    unshadowed.positionLoc = unshadowed.program->attributeLocation( "position" );
+    unshadowed.normalLoc = unshadowed.program->attributeLocation( "normal" );
+    unshadowed.texCoordLoc = unshadowed.program->attributeLocation( "texCoord" );
+    unshadowed.texCoordTransformLoc = unshadowed.program->uniformLocation( "texCoordTransform" );
+    unshadowed.modelMatrixLoc = unshadowed.program->uniformLocation( "modelMatrix" );
+    unshadowed.viewMatrixLoc = unshadowed.program->uniformLocation( "viewMatrix" );
+    unshadowed.projectionMatrixLoc = unshadowed.program->uniformLocation( "projectionMatrix" );
+    unshadowed.modelViewNormalMatrixLoc =
+            unshadowed.program->uniformLocation( "modelViewNormalMatrix" );
+    unshadowed.lightUniforms.resolve( unshadowed.program );
+    // 与各个实体的TEXTURE_UNIT相同
+    unshadowed.program->setUniformValue( unshadowed.program->uniformLocation( "texture" ), 0 );
+    unshadowed.program->release( );
+
+    // 首先创建阴影图集
+    // 需要深度缓存，否则后画的投射者会覆盖更近的，静态层也无法与动态的合并
+    m_shadowAtlas = new QOpenGLFramebufferObject( QSize( SHADOW_ATLAS_SIZE,
+                                                         SHADOW_ATLAS_SIZE ),
+                                                  QOpenGLFramebufferObject::Depth );
+    m_shadowCubeMap.create( POINT_SHADOW_SIZE );
+    if ( m_shadowCubeMap.isLayered( ) )
     {
+        // 片段着色器与逐面渲染相同，按GLSL 1.50编译
+        QFile file( ":/Depth.frag" );
+        file.open( QIODevice::ReadOnly );
+        QByteArray fragment = file.readAll( );
+        fragment.prepend( "#version 150\n#define DEPTH_LAYERED\n" );
+        m_layeredDepthProgram = new QOpenGLShaderProgram;
+        bool linked = m_layeredDepthProgram->addShaderFromSourceFile(
+                    QOpenGLShader::Vertex, ":/DepthLayered.vert" ) &&
+                m_layeredDepthProgram->addShaderFromSourceFile(
+                    QOpenGLShader::Geometry, ":/DepthLayered.geom" ) &&
+                m_layeredDepthProgram->addShaderFromSourceCode(
+                    QOpenGLShader::Fragment, fragment ) &&
+                m_layeredDepthProgram->link( );
+        if ( !linked )
+        {
+            qWarning( "View: the layered point shadow program failed to link, "
+                      "drawing the six faces separately." );
+            delete m_layeredDepthProgram;
+            m_layeredDepthProgram = Q_NULLPTR;
+        }
+    }
+
+    // 方差阴影模糊用的着色器以及覆盖整个视口的四边形
+    m_blurProgram = new QOpenGLShaderProgram;
+    m_blurProgram->addShaderFromSourceFile( QOpenGLShader::Vertex, ":/Blur.vert" );
+    m_blurProgram->addShaderFromSourceFile( QOpenGLShader::Fragment, ":/Blur.frag" );
+    m_blurProgram->link( );
+    static const GLfloat quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    m_quadBuffer.create( );
+    m_quadBuffer.bind( );
+    m_quadBuffer.allocate( quad, sizeof( quad ) );
+    m_quadBuffer.release( );
+
+    // 没有GL_TIME_ELAPSED时只统计CPU时间
+    m_gpuTimer.initialize( window( )->openglContext( ) );
+    m_streamBuffer.initialize( window( )->openglContext( ) );
+    m_staticBatcher.initialize( );
+    m_gpuDriven.initialize( window( )->openglContext( ) );
+    initializeEntities( );
+
+    // 回放在第一帧之前用setMatrices指定的矩阵不能被相机属性覆盖
+    m_aspectRatio = float( window( )->width( ) ) /
+            float( window( )->height( ) );
+    m_animationClock.start( );
+    if ( !m_viewMatrixOverridden ) calculateViewMatrix( );
+    if ( !m_projectionMatrixOverridden ) calculateProjectionMatrix( );
+    connect( window( ), SIGNAL( beforeRendering( ) ),
+             this, SLOT( render( ) ),
+             Qt::DirectConnection );
+
+    m_initialized = true;
+}
+
+bool View::addCommonVertexShader( QOpenGLShaderProgram* program, bool objectBlock )
+{
+    // 同一个着色器链接到不同的程序中时，编译器可以为gl_Position生成不同的指令，
+    // 只有invariant保证结果完全相同。桌面上没有#version时是GLSL 1.10，还没有invariant，
+    // 所以声明为1.20；ES的GLSL 1.00本来就支持
+    QFile file( ":/Common.vert" );
+    if ( !file.open( QIODevice::ReadOnly ) ) return false;
+    QByteArray source = file.readAll( );
+    QOpenGLContext* context = QOpenGLContext::currentContext( );
+    if ( objectBlock )
+        source.prepend( "#extension GL_ARB_uniform_buffer_object : require\n"
+                        "#define OBJECT_BLOCK\n" );
+    if ( context != Q_NULLPTR && !context->isOpenGLES( ) ) source.prepend( "#version 120\n" );
+    return program->addShaderFromSourceCode( QOpenGLShader::Vertex, source );
+}
+
+void View::initializeEntities( void )
+{
+    // 实体只会追加，回放或者QML在initialize以后追加的实体在下一次sync中初始化
+    for ( ; m_initializedEntities < m_data.size( ); ++m_initializedEntities )
+    {
+        QObject* object = m_data.at( m_initializedEntities );
         Cube* cube = qobject_cast<Cube*>( object );
         Plane* plane = qobject_cast<Plane*>( object );
         TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+        Mesh* mesh = qobject_cast<Mesh*>( object );
 
         if ( cube != Q_NULLPTR ) cube->initialize( );
         else if ( plane != Q_NULLPTR ) plane->initialize( );
         else if ( texturedCube != Q_NULLPTR ) texturedCube->initialize( );
+        else if ( mesh != Q_NULLPTR ) mesh->initialize( );
     }
+}
 
-    m_aspectRatio = float( window( )->width( ) ) /
-            float( window( )->height( ) );
-    calculateViewMatrix( );
-    calculateProjectionMatrix( );
-    connect( window( ), SIGNAL( beforeRendering( ) ),
-             this, SLOT( render( ) ),
-             Qt::DirectConnection );
+QMatrix4x4 View::cameraViewMatrix( void ) const
+{
+    QMatrix4x4 matrix;
+    matrix.lookAt( m_position, m_lookAt, m_up );
+    return matrix;
+}
 
-    m_initialized = true;
+QMatrix4x4 View::cameraProjectionMatrix( void ) const
+{
+    QMatrix4x4 matrix;
+    matrix.perspective( m_fieldOfView, m_aspectRatio, m_nearPlane, m_farPlane );
+    return matrix;
 }
 
 void View::calculateViewMatrix( void )
 {
-    m_pendingViewMatrix.setToIdentity( );
-    m_pendingViewMatrix.lookAt( m_position, m_lookAt, m_up );
+    m_pendingViewMatrix = cameraViewMatrix( );
     m_viewMatrixDirty = true;
+    m_viewMatrixOverridden = false;
     updateWindow( );
 }
 
 void View::calculateProjectionMatrix( void )
 {
-    m_pendingProjectionMatrix.setToIdentity( );
-    m_pendingProjectionMatrix.perspective(
-                m_fieldOfView, m_aspectRatio,
-                m_nearPlane, m_farPlane );
+    m_pendingProjectionMatrix = cameraProjectionMatrix( );
     m_projectionMatrixDirty = true;
+    m_projectionMatrixOverridden = false;
     updateWindow( );
 }
 
+QVariantMap View::pick( qreal x, qreal y )
+{
+    QVariantMap result;
+    if ( width( ) <= 0.0 || height( ) <= 0.0 ) return result;
+
+    // 使用最近一帧渲染的矩阵，把屏幕坐标反投影成世界坐标系里的射线。
+    // 还没有渲染过时使用GUI线程这边的矩阵
+    QMatrix4x4 viewProjectionMatrix;
+    {
+        QMutexLocker locker( &m_pickMutex );
+        viewProjectionMatrix = m_pickMatrixValid ? m_pickViewProjectionMatrix :
+                                                   m_pendingProjectionMatrix * m_pendingViewMatrix;
+    }
+    bool invertible;
+    QMatrix4x4 inverse = viewProjectionMatrix.inverted( &invertible );
+    if ( !invertible ) return result;
+
+    float ndcX = 2.0 * x / width( ) - 1.0;
+    float ndcY = 1.0 - 2.0 * y / height( );
+    QVector4D nearPoint = inverse * QVector4D( ndcX, ndcY, -1.0f, 1.0f );
+    QVector4D farPoint = inverse * QVector4D( ndcX, ndcY, 1.0f, 1.0f );
+    QVector3D origin = nearPoint.toVector3DAffine( );
+    QVector3D direction = ( farPoint.toVector3DAffine( ) - origin ).normalized( );
+
+    // 层次包围体以及GPU实例只在sync里修改，此时GUI线程不会与之并发
+    float distance = 1e30f;
+    int index = m_bvh.intersectRay( origin, direction, &distance );
+    QObject* entity = index < 0 ? Q_NULLPTR : m_bvhObjects[index];
+    QObject* instance = m_gpuDriven.intersectRay( origin, direction, &distance );
+    if ( instance != Q_NULLPTR ) entity = instance;
+    if ( entity == Q_NULLPTR ) return result;
+
+    result.insert( "entity", QVariant::fromValue( entity ) );
+    result.insert( "point", origin + direction * distance );
+    result.insert( "distance", distance );
+    return result;
+}
+
+void View::updateBoundingVolumes( void )
+{
+    TRACE_SCOPE( "View::updateBoundingVolumes" );
+
+    // 并行地收集包围盒，每个块只写自己的那一段
+    int count = m_data.size( );
+    m_dataBounds.resize( count );
+    AABB* dataBounds = m_dataBounds.data( );
+    const QObjectList& data = m_data;
+    m_jobSystem.parallelFor( count, ENTITY_CHUNK, [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; ++i )
+            dataBounds[i] = entityBounds( data.at( i ) );
+    } );
+
+    // 实体增减时重新构建，否则只对变化的包围盒做refit。
+    // GpuDrivenRenderer接管的立方体在GPU上裁剪，不进入层次包围体
+    QObjectList objects;
+    QVector<AABB> bounds;
+    objects.reserve( count );
+    bounds.reserve( count );
+    QVector<bool> castsShadows = m_entityCastsShadows;
+    m_entityCastsShadows.clear( );
+    m_entityOccluderShapes.clear( );
+    for ( int i = 0; i < count; ++i )
+    {
+        if ( !dataBounds[i].isValid( ) || m_gpuDriven.isManaged( data.at( i ) ) ) continue;
+        objects.append( data.at( i ) );
+        bounds.append( dataBounds[i] );
+        m_entityCastsShadows.append( entityCastsShadows( data.at( i ) ) );
+        m_entityOccluderShapes.append( entityOccluderShape( data.at( i ) ) );
+    }
+
+    if ( objects != m_bvhObjects )
+    {
+        m_bvhObjects = objects;
+        m_entityBounds = bounds;
+        m_bvh.build( m_entityBounds );
+        ++m_shadowCasterGeneration;
+        notifyBvhStats( );
+        return;
+    }
+    if ( castsShadows != m_entityCastsShadows ) ++m_shadowCasterGeneration;
+
+    // 移动的投射者使所有阴影图块过期
+    QVector<int> changed;
+    bool castersMoved = false;
+    for ( int i = 0; i < bounds.size( ); ++i )
+    {
+        if ( bounds[i] == m_entityBounds[i] ) continue;
+        changed.append( i );
+        castersMoved = castersMoved || m_entityCastsShadows[i];
+    }
+    if ( castersMoved ) ++m_shadowCasterGeneration;
+    if ( changed.isEmpty( ) ) return;
+
+    m_entityBounds = bounds;
+    // 大部分实体都移动时refit后的树质量较差，不如重建
+    if ( changed.size( ) > bounds.size( ) / 2 ) m_bvh.build( m_entityBounds );
+    else m_bvh.refit( changed, m_entityBounds );
+    notifyBvhStats( );
+}
+
+void View::notifyBvhStats( void )
+{
+    // 在渲染线程的sync中调用，QML绑定必须在GUI线程中求值，所以投递过去。
+    // 树只在sync中修改，GUI线程读取耗时的时候不会与之冲突
+    QMetaObject::invokeMethod( this, "bvhStatsChanged", Qt::QueuedConnection );
+}
+
+void View::removeBatchedEntities( QVector<int>& entities )
+{
+    // 静态批次中的实体由StaticBatcher一起绘制
+    if ( m_staticBatcher.batchCount( ) == 0 ) return;
+    int count = 0;
+    for ( int i = 0; i < entities.size( ); ++i )
+    {
+        QObject* object = m_bvhObjects[entities[i]];
+        if ( !m_staticBatcher.isBatched( object ) )
+            entities[count++] = entities[i];
+    }
+    entities.resize( count );
+}
+
+void View::prepareEntities( const QVector<int>& entities )
+{
+    TRACE_SCOPE( "View::prepareEntities" );
+
+    // 计算各个实体的矩阵，与OpenGL无关，可以分块并行
+    const int* indices = entities.constData( );
+    const QObjectList& objects = m_bvhObjects;
+    m_jobSystem.parallelFor( entities.size( ), ENTITY_CHUNK,
+                             [&]( int begin, int end )
+    {
+        for ( int i = begin; i < end; ++i )
+        {
+            QObject* object = objects.at( indices[i] );
+            Cube* cube = qobject_cast<Cube*>( object );
+            Plane* plane = qobject_cast<Plane*>( object );
+            TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+            Mesh* mesh = qobject_cast<Mesh*>( object );
+
+            if ( cube != Q_NULLPTR ) cube->prepare( );
+            else if ( plane != Q_NULLPTR ) plane->prepare( );
+            else if ( texturedCube != Q_NULLPTR ) texturedCube->prepare( );
+            else if ( mesh != Q_NULLPTR ) mesh->prepare( );
+        }
+    } );
+}
+
+AABB View::entityBounds( QObject* object )
+{
+    Cube* cube = qobject_cast<Cube*>( object );
+    Plane* plane = qobject_cast<Plane*>( object );
+    TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+    Mesh* mesh = qobject_cast<Mesh*>( object );
+
+    if ( cube != Q_NULLPTR ) return cube->boundingBox( );
+    else if ( plane != Q_NULLPTR ) return plane->boundingBox( );
+    else if ( texturedCube != Q_NULLPTR ) return texturedCube->boundingBox( );
+    else if ( mesh != Q_NULLPTR ) return mesh->boundingBox( );
+    return AABB( );
+}
+
+OcclusionCuller::OccluderShape View::entityOccluderShape( QObject* object )
+{
+    // 包围盒就是几何体本身的实体才能作为遮挡体，网格的包围盒里可能是空的。
+    // 平面的包围盒是扁平的盒子，只有朝上的一面是真正绘制的
+    if ( qobject_cast<Cube*>( object ) != Q_NULLPTR ) return OcclusionCuller::BoxOccluder;
+    if ( qobject_cast<Plane*>( object ) != Q_NULLPTR ) return OcclusionCuller::TopFaceOccluder;
+    return OcclusionCuller::NoOccluder;
+}
+
+bool View::entityCastsShadows( QObject* object )
+{
+    // TexturedCube从来不绘制到阴影图中
+    Cube* cube = qobject_cast<Cube*>( object );
+    Plane* plane = qobject_cast<Plane*>( object );
+    Mesh* mesh = qobject_cast<Mesh*>( object );
+
+    if ( cube != Q_NULLPTR ) return cube->castShadows( );
+    else if ( plane != Q_NULLPTR ) return plane->castShadows( );
+    else if ( mesh != Q_NULLPTR ) return mesh->castShadows( );
+    return false;
+}
+
 void View::qobjectListAppend(
         QQmlListProperty<QObject>* prop, QObject* object )
 {
     View* _this = qobject_cast<View*>( prop->object );
-    qDebug( "the entity \"%s\" has been appended to \"%s\".",
-            qPrintable( object->objectName( ) ),
-            qPrintable( _this->objectName( ) ) );
 
     Cube* cube = qobject_cast<Cube*>( object );
     Plane* plane = qobject_cast<Plane*>( object );
     TexturedCube* texturedCube = qobject_cast<TexturedCube*>( object );
+    Mesh* mesh = qobject_cast<Mesh*>( object );
+    Light* light = qobject_cast<Light*>( object );
+    ViewAnimator* animator = qobject_cast<ViewAnimator*>( object );
 
     if ( cube != Q_NULLPTR )
     {
         cube->setParent( _this );
         cube->setView( _this );
+        _this->cubeChanged( cube );
     }
     else if ( plane != Q_NULLPTR )
     {
@@ -343,8 +1783,24 @@ void View::qobjectListAppend(
         texturedCube->setParent( _this );
         texturedCube->setView( _this );
     }
+    else if ( mesh != Q_NULLPTR )
+    {
+        mesh->setParent( _this );
+        mesh->setView( _this );
+    }
+    else if ( light != Q_NULLPTR )
+    {
+        light->setParent( _this );
+        light->setView( _this );
+    }
+    else if ( animator != Q_NULLPTR )
+    {
+        animator->setParent( _this );
+        animator->setView( _this );
+    }
 
     reinterpret_cast<QObjectList*>( prop->data )->append( object );
+    _this->updateWindow( );
 }
 
 #include <QDebug>
@@ -1,18 +1,40 @@
 #ifndef VIEW_H
 #define VIEW_H
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSet>
 #include <QVector3D>
+#include <QVector4D>
 #include <QMatrix4x4>
+#include <QElapsedTimer>
+#include <QOpenGLBuffer>
+#include <QVariantMap>
 #include <QQuickItem>
+#include "BVH.h"
+#include "JobSystem.h"
+#include "FrameStats.h"
+#include "Tracer.h"
+#include "FrameRecorder.h"
+#include "StaticBatcher.h"
+#include "ShadowCubeMap.h"
+#include "OcclusionCuller.h"
+#include "GpuDrivenRenderer.h"
+#include "StreamBuffer.h"
+#include "Light.h"
 
 QT_BEGIN_NAMESPACE
 class QOpenGLShaderProgram;
 class QOpenGLFramebufferObject;
 QT_END_NAMESPACE
 
+class ViewAnimator;
+class Cube;
+
 class View: public QQuickItem
 {
     Q_OBJECT
+    Q_ENUMS( ShadowMode )
 
     // 相机属性
     Q_PROPERTY( QVector3D position READ position WRITE setPosition NOTIFY positionChanged )
@@ -26,13 +48,69 @@ class View: public QQuickItem
     // 光源属性
     Q_PROPERTY( QVector3D lightPosition READ lightPosition
                 WRITE setLightPosition NOTIFY lightPositionChanged )
+    Q_PROPERTY( ShadowMode shadowMode READ shadowMode WRITE setShadowMode NOTIFY shadowModeChanged )
+    // 方差阴影的模糊程度（阴影图纹素），0表示不模糊
+    Q_PROPERTY( qreal shadowSoftness READ shadowSoftness WRITE setShadowSoftness NOTIFY shadowSoftnessChanged )
+    // 每帧最多重新绘制的阴影图块数，其余的光源轮流更新，0表示不限制。
+    // 只作用于图集中的图块：PointShadow的立方体贴图（逐面或者分层）每次都完整地重画，
+    // 既不受这个预算限制，也不使用只有静态投射者的缓存层
+    Q_PROPERTY( int shadowUpdateBudget READ shadowUpdateBudget
+                WRITE setShadowUpdateBudget NOTIFY shadowUpdateBudgetChanged )
+
+    // 主渲染之前先只写深度，着色时用GL_EQUAL，每个像素只计算一次光照
+    Q_PROPERTY( bool depthPrepass READ depthPrepass WRITE setDepthPrepass NOTIFY depthPrepassChanged )
+
+    // 在CPU上用大的立方体和平面做遮挡剔除，被完全挡住的实体不提交绘制
+    Q_PROPERTY( bool occlusionCulling READ occlusionCulling
+                WRITE setOcclusionCulling NOTIFY occlusionCullingChanged )
+
+    // OpenGL 4.3以上由计算着色器裁剪动态立方体，并用间接绘制一次提交
+    Q_PROPERTY( bool gpuCulling READ gpuCulling WRITE setGpuCulling NOTIFY gpuCullingChanged )
 //    Q_PROPERTY( QVector3D lightLookAt READ lightLookAt WRITE setLightLookAt NOTIFY lightLookAtChanged )
 //    Q_PROPERTY( QVector3D lightUp READ lightUp WRITE setLightUp NOTIFY lightUpChanged )
 
+    // 层次包围体的统计（毫秒）
+    Q_PROPERTY( qreal bvhBuildTime READ bvhBuildTime NOTIFY bvhStatsChanged )
+    Q_PROPERTY( qreal bvhRefitTime READ bvhRefitTime NOTIFY bvhStatsChanged )
+
+    // 场景没有变化而跳过的帧数
+    Q_PROPERTY( int framesSkipped READ framesSkipped NOTIFY framesSkippedChanged )
+
+    // 准备帧数据使用的工作线程数，0表示只在渲染线程上执行
+    Q_PROPERTY( int workerThreads READ workerThreads WRITE setWorkerThreads NOTIFY workerThreadsChanged )
+
+    // 各个阶段的耗时以及绘制统计
+    Q_PROPERTY( FrameStats* stats READ stats CONSTANT )
+
+    // 细节层次：选择屏幕空间误差不超过lodThreshold像素的最粗的一层，
+    // 阴影的阈值再乘以shadowLodBias
+    Q_PROPERTY( qreal lodThreshold READ lodThreshold WRITE setLodThreshold NOTIFY lodThresholdChanged )
+    Q_PROPERTY( qreal shadowLodBias READ shadowLodBias WRITE setShadowLodBias NOTIFY shadowLodBiasChanged )
+
+    // 记录各个阶段的事件，用saveTrace导出为Chrome trace-event格式
+    Q_PROPERTY( bool tracing READ tracing WRITE setTracing NOTIFY tracingChanged )
+
     // 支持默认孩子
     Q_PROPERTY( QQmlListProperty<QObject> data READ data )
     Q_CLASSINFO( "DefaultProperty", "data" )
 public:
+    enum ShadowMode
+    {
+        NoShadow = 0,
+        SimpleShadow,
+        PointShadow,        // 第一个光源使用全方向的立方体阴影贴图，支持几何着色器时
+                            // 单遍分层绘制（包括GPU剔除的立方体），否则六个面依次绘制
+        VarianceShadow      // 模糊以后的方差阴影图，一次过滤采样得到软阴影
+    };
+
+    // 渲染线程选择细节层次用的参数，render开头分别为主渲染和阴影计算
+    struct LodParameters
+    {
+        QVector3D       origin;             // 相机或者光源的位置
+        float           pixelsPerUnit;      // 距离为1处单位长度投影以后的像素数
+        float           threshold;          // 允许的屏幕空间误差（像素）
+    };
+
     View( QQuickItem* parent = Q_NULLPTR );
     ~View( void );
 
@@ -60,14 +138,139 @@ public:
     QVector3D lightPosition( void ) { return m_lightPosition; }
     void setLightPosition( const QVector3D& lightPosition );
 
+    ShadowMode shadowMode( void ) { return m_shadowMode; }
+    void setShadowMode( ShadowMode shadowMode );
+    ShadowMode renderShadowMode( void ) { return m_renderShadowMode; }
+
+    qreal shadowSoftness( void ) { return m_shadowSoftness; }
+    void setShadowSoftness( qreal shadowSoftness );
+
+    int shadowUpdateBudget( void ) { return m_shadowUpdateBudget; }
+    void setShadowUpdateBudget( int shadowUpdateBudget );
+
+    bool depthPrepass( void ) { return m_depthPrepass; }
+    void setDepthPrepass( bool depthPrepass );
+
+    bool occlusionCulling( void ) { return m_occlusionCulling; }
+    void setOcclusionCulling( bool occlusionCulling );
+
+    bool gpuCulling( void ) { return m_gpuCulling; }
+    void setGpuCulling( bool gpuCulling );
+
+    FrameStats* stats( void ) { return m_stats; }
+
+    // 渲染线程中由各个渲染器调用
+    void countDrawCall( int triangles )
+    {
+        ++m_currentSample.drawCalls;
+        m_currentSample.triangles += triangles;
+    }
+    // 一次状态切换是一次着色器、缓存、纹理或帧缓存的绑定，或者一次uniform上传
+    void countStateChanges( int count ) { m_currentSample.stateChanges += count; }
+
+    // GUI线程：立方体的属性变化，下次sync时只更新这些立方体的GPU实例
+    void cubeChanged( Cube* cube ) { m_changedCubes.insert( cube ); }
+
+    int workerThreads( void ) { return m_workerThreads; }
+    void setWorkerThreads( int workerThreads );
+
+    int framesSkipped( void ) { return m_framesSkipped.load( ); }
+
+    qreal lodThreshold( void ) { return m_lodThreshold; }
+    void setLodThreshold( qreal lodThreshold );
+
+    qreal shadowLodBias( void ) { return m_shadowLodBias; }
+    void setShadowLodBias( qreal shadowLodBias );
+
+    // 深度预渲染借用阴影的绘制路径，但必须与主渲染选择同一层
+    const LodParameters& lodParameters( bool shadowPass )
+    {
+        return shadowPass && !m_prepassActive ? m_shadowLod : m_mainLod;
+    }
+
+    bool tracing( void ) { return Tracer::isEnabled( ); }
+    void setTracing( bool tracing );
+
+    // 实体、相机以及光源变化时调用，每个同步周期最多请求一次更新
+    void updateWindow( void );
+
+    qreal bvhBuildTime( void ) { return m_bvh.buildTime( ) / 1000000.0; }
+    qreal bvhRefitTime( void ) { return m_bvh.refitTime( ) / 1000000.0; }
+
     QMatrix4x4& viewMatrix( void ) { return m_viewMatrix; }
     QMatrix4x4& projectionMatrix( void ) { return m_projectionMatrix; }
-    QMatrix4x4& lightViewProjectionMatrix( void ) { return m_lightViewProjectionMatrix; }
+
+    // 渲染线程实际使用的光源位置（可能由动画器驱动）
+    QVector3D& renderLightPosition( void ) { return m_renderLightPosition; }
+
+    // 渲染线程的光源数组，着色器中按下标一一对应，最多MAX_LIGHTS个。
+    // 阴影图块为图集中的(x, y, 宽, 高)，宽为0表示不投射阴影
+    int lightCount( void ) { return m_lightPositions.size( ); }
+    const QVector3D* lightPositions( void ) { return m_lightPositions.constData( ); }
+    const QVector3D* lightColors( void ) { return m_lightColors.constData( ); }
+    const QMatrix4x4* lightMatrices( void ) { return m_lightMatrices.constData( ); }
+    const QVector4D* shadowTiles( void ) { return m_shadowTiles.constData( ); }
+    const GLfloat* lightRanges( void ) { return m_lightRanges.constData( ); }
+
+    // 所有光源共用的阴影图集
     int shadowTexture( void );
-    QOpenGLShaderProgram* depthProgram( void ) { return m_depthProgram; }
+
+    // 点光源阴影的立方体贴图以及范围，范围为0表示这一帧没有点光源阴影
+    int shadowCubeTexture( void ) { return m_shadowCubeMap.texture( ); }
+    float pointShadowRange( void ) { return m_pointShadowRange; }
+
+    // 每帧的动态顶点以及实例数据经过这个缓存上传
+    StreamBuffer* streamBuffer( void ) { return &m_streamBuffer; }
+
+    // 只需要位置的绘制使用的着色器：阴影或者深度预渲染
+    QOpenGLShaderProgram* depthProgram( void )
+    {
+        return m_prepassActive ? m_prepassProgram :
+               m_layeredShadowActive ? m_layeredDepthProgram : m_depthProgram;
+    }
+
+    // 不接收阴影的绘制使用的主渲染程序：Common.frag定义NO_SHADOW编译，
+    // 没有阴影图、光源矩阵以及逐个光源的阴影计算。各个实体共用，位置只查找一次
+    struct UnshadowedProgram
+    {
+        QOpenGLShaderProgram*   program;
+        int                     positionLoc, normalLoc, texCoordLoc, texCoordTransformLoc;
+        int                     modelMatrixLoc, viewMatrixLoc, projectionMatrixLoc;
+        int                     modelViewNormalMatrixLoc;
+        LightUniforms           lightUniforms;
+    };
+    const UnshadowedProgram& unshadowedProgram( void ) { return m_unshadowedProgram; }
+    // 绑定上面的程序并设置矩阵以及光源，返回计入的状态切换
+    int bindUnshadowedProgram( const QMatrix4x4& modelMatrix,
+                               const QMatrix3x3& modelViewNormalMatrix );
 
     QQmlListProperty<QObject> data( void );
     void initialize( void );
+    // 初始化initialize以后追加的实体，sync中调用
+    void initializeEntities( void );
+
+    // 注册View以及所有实体的QML类型，应用程序和benchmark共用
+    static void registerTypes( const char* uri );
+
+    // 加载Common.vert，主渲染以及深度预渲染的程序都必须用它，需要当前的OpenGL上下文。
+    // objectBlock为true时每个物体的矩阵在uniform块ObjectBlock中，
+    // 只能在StreamBuffer::hasUniformBlocks时使用
+    static bool addCommonVertexShader( QOpenGLShaderProgram* program,
+                                       bool objectBlock = false );
+
+    // 拾取屏幕上(x, y)处最近的实体，返回entity、point以及distance
+    Q_INVOKABLE QVariantMap pick( qreal x, qreal y );
+
+    // 把最近记录的事件写入文件，可以在chrome://tracing或者Perfetto里打开
+    Q_INVOKABLE bool saveTrace( const QString& fileName );
+
+    // 把每一帧使用的相机、光源以及实体状态记录到日志，供FrameReplayer重放
+    Q_INVOKABLE bool startRecording( const QString& fileName );
+    Q_INVOKABLE void stopRecording( void );
+
+    // 直接指定视图和投影矩阵，下次设置相机属性时重新计算
+    void setMatrices( const QMatrix4x4& viewMatrix,
+                      const QMatrix4x4& projectionMatrix );
 signals:
     void positionChanged( void );
     void lookAtChanged( void );
@@ -78,16 +281,85 @@ signals:
     void farPlaneChanged( void );
     void propertyChanged( void );
     void lightPositionChanged( void );
+    void shadowModeChanged( void );
+    void shadowSoftnessChanged( void );
+    void shadowUpdateBudgetChanged( void );
+    void depthPrepassChanged( void );
+    void occlusionCullingChanged( void );
+    void gpuCullingChanged( void );
+    void bvhStatsChanged( void );
+    void sceneChanged( void );
+    void framesSkippedChanged( void );
+    void workerThreadsChanged( void );
+    void tracingChanged( void );
+    void lodThresholdChanged( void );
+    void shadowLodBiasChanged( void );
 protected slots:
     void onWindowChanged( QQuickWindow* win );
     void render( void );
     void sync( void );
     void cleanup( void );
 protected:
+    void geometryChanged( const QRectF& newGeometry,
+                          const QRectF& oldGeometry ) Q_DECL_OVERRIDE;
     void renderShadow( void );
-    void updateWindow( void );
+    void renderPointShadow( const QVector3D& position );
+    void renderLayeredPointShadow( const QVector3D& position );
+    void renderShadowCasters( const QMatrix4x4& lightViewProjectionMatrix,
+                              bool staticCasters, bool gpuCasters = true );
+    void blurShadowTiles( void );
+    void renderDepthPrepass( void );
+    void sortFrontToBack( QVector<int>& entities );
+    void rasterizeOccluders( const QVector<int>& entities );
+    void removeOccludedEntities( QVector<int>& entities );
+    bool prepareSceneFramebuffer( const QSize& size );
+    void bindWindowFramebuffer( void );
+    void blitScene( const QRect& targetRect );
+    void resetOpenGLState( void );
+    // 只根据相机的属性计算矩阵，calculate*Matrix再把结果交给下一次sync
+    QMatrix4x4 cameraViewMatrix( void ) const;
+    QMatrix4x4 cameraProjectionMatrix( void ) const;
     void calculateViewMatrix( void );
     void calculateProjectionMatrix( void );
+    void calculateLightMatrix( void );
+    void updateLights( void );
+    void updateLodParameters( int viewportHeight );
+    bool animate( void );
+    void updateBoundingVolumes( void );
+    void notifyBvhStats( void );
+    void removeBatchedEntities( QVector<int>& entities );
+    void prepareEntities( const QVector<int>& entities );
+    static AABB entityBounds( QObject* object );
+    static bool entityCastsShadows( QObject* object );
+    static OcclusionCuller::OccluderShape entityOccluderShape( QObject* object );
+
+    // 渲染线程的光源
+    struct RenderLight
+    {
+        QVector3D       position, lookAt, color;
+        float           fieldOfView, range, importance;
+        bool            castShadows;
+        QMatrix4x4      viewProjectionMatrix;   // 以下在updateLights中计算
+        float           focal;                  // 投影矩阵的P[1][1]
+        QRect           tile;                   // 在阴影图集中的位置
+        bool            refresh;                // 这一帧是否重新绘制图块
+    };
+
+    // 图块上次绘制时的状态，没有轮到更新的光源继续用当时的矩阵采样
+    struct ShadowTileState
+    {
+        ShadowTileState( void ): casterGeneration( -1 ), age( 0 ), valid( false ) { }
+
+        QMatrix4x4      viewProjectionMatrix;
+        QRect           tile;
+        int             casterGeneration;       // 绘制时的m_shadowCasterGeneration
+        int             age;                    // 过期以后等待的帧数
+        bool            valid;
+    };
+    static void allocateShadowTiles( QVector<RenderLight>& lights );
+    void beginShadowTile( const RenderLight& light, bool variance, bool clear );
+    bool updateStaticShadowLayer( bool variance );
+    void scheduleShadowUpdates( void );
     static void qobjectListAppend( QQmlListProperty<QObject>* prop, QObject* object );
 
     // 临时
@@ -99,6 +371,16 @@ protected:
     qreal                       m_aspectRatio, m_fieldOfView;
     qreal                       m_nearPlane, m_farPlane;
     QVector3D                   m_lightPosition;
+    ShadowMode                  m_shadowMode;
+    ShadowMode                  m_renderShadowMode;
+    qreal                       m_shadowSoftness, m_renderShadowSoftness;
+    int                         m_shadowUpdateBudget, m_renderShadowUpdateBudget;
+    bool                        m_depthPrepass, m_renderDepthPrepass;
+    bool                        m_occlusionCulling, m_renderOcclusionCulling;
+    bool                        m_gpuCulling, m_renderGpuCulling;
+    qreal                       m_lodThreshold, m_shadowLodBias;
+    qreal                       m_renderLodThreshold, m_renderShadowLodBias;
+    LodParameters               m_mainLod, m_shadowLod;
 
     // 视角矩阵以及投影矩阵
     QMatrix4x4                  m_viewMatrix;
@@ -109,14 +391,123 @@ protected:
     QMatrix4x4                  m_pendingProjectionMatrix;
     bool                        m_viewMatrixDirty: 1;
     bool                        m_projectionMatrixDirty: 1;
+    // setMatrices指定的矩阵，initialize时不用相机属性覆盖
+    bool                        m_viewMatrixOverridden: 1;
+    bool                        m_projectionMatrixOverridden: 1;
+
+    // 最近一帧实际使用的相机（包括动画），渲染线程写入，pick在GUI线程读取
+    QMutex                      m_pickMutex;
+    QMatrix4x4                  m_pickViewProjectionMatrix;
+    bool                        m_pickMatrixValid;
+
+    // 渲染线程的相机以及光源状态
+    QVector3D                   m_renderLookAt, m_renderUp;
+    QVector3D                   m_renderLightPosition;
 
-    // 渲染阴影用的
+    // 渲染线程上的动画
+    QList<ViewAnimator*>        m_animators;
+    QElapsedTimer               m_animationClock;
+
+    // 渲染阴影用的，没有Light实体时使用lightPosition以及m_lightViewProjectionMatrix
     bool                        m_lightPositionDirty: 1;
     QMatrix4x4                  m_lightViewProjectionMatrix;
     QOpenGLShaderProgram*       m_depthProgram;
-    QOpenGLFramebufferObject*   m_FBO;
+    UnshadowedProgram           m_unshadowedProgram;
+    QOpenGLFramebufferObject*   m_shadowAtlas;
+    QVector4D                   m_depthPointLight;      // 深度着色器当前的pointLight
+
+    // sync中拷贝的Light实体，以及每帧上传给着色器的数组
+    QVector<RenderLight>        m_syncedLights;
+    QVector<RenderLight>        m_lights;
+    QVector<QVector3D>          m_lightPositions, m_lightColors;
+    QVector<QMatrix4x4>         m_lightMatrices;
+    QVector<QVector4D>          m_shadowTiles;
+    QVector<GLfloat>            m_lightRanges;
+
+    // 分帧更新阴影，m_shadowsPending表示还有过期的图块在等待。
+    // 投射者或者影响阴影图内容的设置变化时m_shadowCasterGeneration加一，所有图块过期
+    QVector<ShadowTileState>    m_shadowTileStates;
+    bool                        m_shadowsPending;
+    int                         m_shadowCasterGeneration;
+    int                         m_shadowBatchGeneration;
+    int                         m_shadowInstanceGeneration;
+
+    // 只有静态投射者的图集，光源以及静态几何体不变时每帧拷贝过来
+    QOpenGLFramebufferObject*   m_staticShadowAtlas;
+    QVector<QMatrix4x4>         m_staticShadowMatrices;
+    QVector<QVector4D>          m_staticShadowTiles;
+    QVector<GLfloat>            m_staticShadowRanges;
+    bool                        m_staticShadowVariance;
+    int                         m_staticShadowGeneration;
+
+    // 点光源阴影
+    ShadowCubeMap               m_shadowCubeMap;
+    float                       m_pointShadowRange;
+
+    // 方差阴影的模糊，m_shadowBlurFBO第一次使用时才创建
+    QOpenGLShaderProgram*       m_blurProgram;
+    QOpenGLFramebufferObject*   m_shadowBlurFBO;
+    QOpenGLBuffer               m_quadBuffer;
+
+    // 深度预渲染，与主渲染共用Common.vert，invariant的gl_Position保证深度完全相同
+    QOpenGLShaderProgram*       m_prepassProgram;
+    QOpenGLShaderProgram*       m_layeredDepthProgram;  // 点光源阴影的单遍渲染，不支持时为空
+    bool                        m_layeredShadowActive;
+    bool                        m_prepassActive;
+
+    // 按需渲染：GUI线程标记场景变化，渲染线程没有变化时只拷贝缓存的结果。
+    // 两个标记由不同的线程写入，不能是同一个字节中的位域
+    QOpenGLFramebufferObject*   m_sceneFBO;
+    bool                        m_updatePending;        // GUI线程，sync中清除
+    bool                        m_renderDirty;          // 渲染线程，sync中设置
+    bool                        m_previousFrameDirty;   // 渲染线程，上一次绘制的帧是否有变化
+    bool                        m_sceneCached;          // 渲染线程，m_sceneFBO中是最后绘制的一帧
+    QAtomicInt                  m_framesSkipped;
+    int                         m_reportedFramesSkipped;
+
+    // 场景实体的层次包围体，图元编号对应m_bvhObjects的下标
+    BVH                         m_bvh;
+    QObjectList                 m_bvhObjects;
+    QVector<AABB>               m_entityBounds;
+    QVector<int>                m_visibleEntities;
+    QVector<int>                m_shadowCasters;
+    QVector<bool>               m_entityCastsShadows;   // 与m_bvhObjects一一对应
+    QVector<float>              m_entityDepths;         // 排序用的视空间深度
+    QVector<OcclusionCuller::OccluderShape> m_entityOccluderShapes;
+
+    // 遮挡剔除，m_occlusionVisible为每个候选实体的测试结果
+    OcclusionCuller             m_occlusionCuller;
+    QVector<char>               m_occlusionVisible;
+    QVector<AABB>               m_dataBounds;
+
+    // 帧统计
+    FrameStats*                 m_stats;
+    FrameSample                 m_currentSample;
+    qint64                      m_syncTime;
+    int                         m_frameIndex;           // 渲染线程，完整绘制的帧数
+    GpuTimer                    m_gpuTimer;
+
+    // 静态几何体的合批
+    StaticBatcher               m_staticBatcher;
+
+    // GPU剔除以及间接绘制的动态立方体，m_changedCubes由GUI线程写入，sync中清空
+    GpuDrivenRenderer           m_gpuDriven;
+    QSet<Cube*>                 m_changedCubes;
+
+    // 这个上下文的流式上传缓存
+    StreamBuffer                m_streamBuffer;
+
+    // 帧记录，m_pendingRecorder在sync中交给渲染线程
+    FrameRecorder*              m_pendingRecorder;
+    FrameRecorder*              m_recorder;
+    bool                        m_recorderDirty;
+
+    // 并行准备帧数据
+    int                         m_workerThreads;
+    JobSystem                   m_jobSystem;
 
     bool                        m_initialized;
+    int                         m_initializedEntities;  // m_data中已经初始化的数量
 };
 
 #endif // VIEW_H
@@ -0,0 +1,247 @@
+#include <math.h>
+#include <algorithm>
+#include <QVariantMap>
+#include "View.h"
+#include "ViewAnimator.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+ViewAnimator::ViewAnimator( QObject* parent ): QObject( parent )
+{
+    m_target = Light;
+    m_mode = Orbit;
+    m_running = false;
+    m_duration = 1000;
+    m_loops = 1;
+    m_radius = 1.0;
+    m_closed = false;
+    m_dirty = true;
+    m_view = Q_NULLPTR;
+
+    m_state.running = false;
+    m_state.finished = false;
+    m_state.startTime = 0;
+}
+
+void ViewAnimator::sync( qint64 time )
+{
+    if ( !m_dirty ) return;
+    m_dirty = false;
+
+    // 从停止到运行时重新计时
+    if ( m_running && !m_state.running )
+    {
+        m_state.startTime = time;
+        m_state.finished = false;
+    }
+
+    m_state.target = m_target;
+    m_state.mode = m_mode;
+    m_state.running = m_running;
+    m_state.duration = m_duration;
+    m_state.loops = m_loops;
+    m_state.center = m_center;
+    m_state.radius = m_radius;
+    m_state.closed = m_closed;
+
+    m_state.path.clear( );
+    foreach ( const QVariant& point, m_path )
+        m_state.path.append( point.value<QVector3D>( ) );
+
+    // 关键帧按照时间排序
+    QVector<QPair<float, QVector3D> > keys;
+    foreach ( const QVariant& keyframe, m_keyframes )
+    {
+        QVariantMap map = keyframe.toMap( );
+        keys.append( qMakePair( map.value( "time" ).toFloat( ),
+                                map.value( "position" ).value<QVector3D>( ) ) );
+    }
+    std::stable_sort( keys.begin( ), keys.end( ),
+                      []( const QPair<float, QVector3D>& a,
+                      const QPair<float, QVector3D>& b )
+    {
+        return a.first < b.first;
+    } );
+    m_state.keyTimes.clear( );
+    m_state.keyPositions.clear( );
+    for ( int i = 0; i < keys.size( ); ++i )
+    {
+        m_state.keyTimes.append( keys[i].first );
+        m_state.keyPositions.append( keys[i].second );
+    }
+}
+
+bool ViewAnimator::evaluate( qint64 time, QVector3D& position )
+{
+    if ( !m_state.running || m_state.finished ) return false;
+
+    // 关键帧模式下duration无效时使用最后一帧的时间作为周期
+    float period = m_state.duration;
+    if ( m_state.mode == Keyframe && period <= 0.0f &&
+         !m_state.keyTimes.isEmpty( ) ) period = m_state.keyTimes.last( );
+    if ( period <= 0.0f ) return false;
+
+    float cycles = ( time - m_state.startTime ) / period;
+    float progress;
+    if ( m_state.loops != Infinite && cycles >= m_state.loops )
+    {
+        // 最后一帧停在终点
+        progress = 1.0f;
+        m_state.finished = true;
+    }
+    else progress = cycles - floorf( cycles );
+
+    switch ( m_state.mode )
+    {
+    case Orbit: position = evaluateOrbit( progress ); break;
+    case Path: position = evaluatePath( progress ); break;
+    case Keyframe: position = evaluateKeyframe( progress * period ); break;
+    }
+    return true;
+}
+
+QVector3D ViewAnimator::evaluateOrbit( float progress )
+{
+    float theta = 2.0f * float( M_PI ) * progress;
+    return m_state.center + QVector3D( m_state.radius * sinf( theta ),
+                                       0.0f,
+                                       m_state.radius * cosf( theta ) );
+}
+
+QVector3D ViewAnimator::evaluatePath( float progress )
+{
+    const QVector<QVector3D>& p = m_state.path;
+    int count = p.size( );
+    if ( count == 0 ) return QVector3D( );
+    if ( count == 1 ) return p[0];
+
+    int segments = m_state.closed ? count : count - 1;
+    float t = progress * segments;
+    int segment = qMin( int( t ), segments - 1 );
+    t -= segment;
+
+    // 越界的控制点在闭合时回绕，否则取端点
+    int i1 = segment, i2 = segment + 1, i0 = segment - 1, i3 = segment + 2;
+    if ( m_state.closed )
+    {
+        i0 = ( i0 + count ) % count;
+        i2 %= count;
+        i3 %= count;
+    }
+    else
+    {
+        i0 = qMax( i0, 0 );
+        i3 = qMin( i3, count - 1 );
+    }
+
+    float t2 = t * t, t3 = t2 * t;
+    return ( p[i1] * 2.0f +
+             ( p[i2] - p[i0] ) * t +
+             ( p[i0] * 2.0f - p[i1] * 5.0f + p[i2] * 4.0f - p[i3] ) * t2 +
+             ( p[i1] * 3.0f - p[i0] - p[i2] * 3.0f + p[i3] ) * t3 ) * 0.5f;
+}
+
+QVector3D ViewAnimator::evaluateKeyframe( float time )
+{
+    const QVector<float>& times = m_state.keyTimes;
+    const QVector<QVector3D>& positions = m_state.keyPositions;
+    if ( times.isEmpty( ) ) return QVector3D( );
+    if ( time <= times.first( ) ) return positions.first( );
+    if ( time >= times.last( ) ) return positions.last( );
+
+    int next = int( std::upper_bound( times.begin( ), times.end( ), time ) -
+                    times.begin( ) );
+    int previous = next - 1;
+    float span = times[next] - times[previous];
+    float t = span > 0.0f ? ( time - times[previous] ) / span : 1.0f;
+    return positions[previous] + ( positions[next] - positions[previous] ) * t;
+}
+
+void ViewAnimator::markDirty( void )
+{
+    m_dirty = true;
+    if ( m_view != Q_NULLPTR ) m_view->updateWindow( );
+}
+
+void ViewAnimator::setTarget( Target target )
+{
+    if ( m_target == target ) return;
+    m_target = target;
+    emit targetChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setMode( Mode mode )
+{
+    if ( m_mode == mode ) return;
+    m_mode = mode;
+    emit modeChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setRunning( bool running )
+{
+    if ( m_running == running ) return;
+    m_running = running;
+    emit runningChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setDuration( int duration )
+{
+    if ( m_duration == duration ) return;
+    m_duration = duration;
+    emit durationChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setLoops( int loops )
+{
+    if ( m_loops == loops ) return;
+    m_loops = loops;
+    emit loopsChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setCenter( const QVector3D& center )
+{
+    if ( m_center == center ) return;
+    m_center = center;
+    emit centerChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setRadius( qreal radius )
+{
+    if ( m_radius == radius ) return;
+    m_radius = radius;
+    emit radiusChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setPath( const QVariantList& path )
+{
+    if ( m_path == path ) return;
+    m_path = path;
+    emit pathChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setClosed( bool closed )
+{
+    if ( m_closed == closed ) return;
+    m_closed = closed;
+    emit closedChanged( );
+    markDirty( );
+}
+
+void ViewAnimator::setKeyframes( const QVariantList& keyframes )
+{
+    if ( m_keyframes == keyframes ) return;
+    m_keyframes = keyframes;
+    emit keyframesChanged( );
+    markDirty( );
+}
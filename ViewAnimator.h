@@ -0,0 +1,139 @@
+#ifndef VIEWANIMATOR_H
+#define VIEWANIMATOR_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QVariantList>
+#include <QObject>
+
+// 在渲染线程上驱动光源或者相机位置的动画，类似于Qt Quick的Animator
+// GUI线程卡顿时阴影依然可以流畅地更新。注意View的lightPosition以及position
+// 属性并不会随之改变。
+class View;
+class ViewAnimator: public QObject
+{
+    Q_OBJECT
+    Q_ENUMS( Target Mode Loops )
+    Q_PROPERTY( Target target READ target WRITE setTarget NOTIFY targetChanged )
+    Q_PROPERTY( Mode mode READ mode WRITE setMode NOTIFY modeChanged )
+    Q_PROPERTY( bool running READ running WRITE setRunning NOTIFY runningChanged )
+    Q_PROPERTY( int duration READ duration WRITE setDuration NOTIFY durationChanged )
+    Q_PROPERTY( int loops READ loops WRITE setLoops NOTIFY loopsChanged )
+
+    // 环绕模式：绕着经过center的Y轴旋转
+    Q_PROPERTY( QVector3D center READ center WRITE setCenter NOTIFY centerChanged )
+    Q_PROPERTY( qreal radius READ radius WRITE setRadius NOTIFY radiusChanged )
+
+    // 路径模式：经过path中各点的Catmull-Rom曲线
+    Q_PROPERTY( QVariantList path READ path WRITE setPath NOTIFY pathChanged )
+    Q_PROPERTY( bool closed READ closed WRITE setClosed NOTIFY closedChanged )
+
+    // 关键帧模式：形如{ time: 毫秒, position: Qt.vector3d( ) }的列表
+    Q_PROPERTY( QVariantList keyframes READ keyframes WRITE setKeyframes NOTIFY keyframesChanged )
+public:
+    enum Target
+    {
+        Light = 0,
+        Camera
+    };
+    enum Mode
+    {
+        Orbit = 0,
+        Path,
+        Keyframe
+    };
+    enum Loops
+    {
+        Infinite = -1
+    };
+
+    explicit ViewAnimator( QObject* parent = Q_NULLPTR );
+
+    void setView( View* view ) { m_view = view; }
+
+    // 以下两个函数都在渲染线程中调用，sync时GUI线程被阻塞
+    void sync( qint64 time );
+    bool evaluate( qint64 time, QVector3D& position );
+    Target renderTarget( void ) { return m_state.target; }
+
+    Target target( void ) { return m_target; }
+    void setTarget( Target target );
+
+    Mode mode( void ) { return m_mode; }
+    void setMode( Mode mode );
+
+    bool running( void ) { return m_running; }
+    void setRunning( bool running );
+
+    int duration( void ) { return m_duration; }
+    void setDuration( int duration );
+
+    int loops( void ) { return m_loops; }
+    void setLoops( int loops );
+
+    QVector3D center( void ) { return m_center; }
+    void setCenter( const QVector3D& center );
+
+    qreal radius( void ) { return m_radius; }
+    void setRadius( qreal radius );
+
+    QVariantList path( void ) { return m_path; }
+    void setPath( const QVariantList& path );
+
+    bool closed( void ) { return m_closed; }
+    void setClosed( bool closed );
+
+    QVariantList keyframes( void ) { return m_keyframes; }
+    void setKeyframes( const QVariantList& keyframes );
+signals:
+    void targetChanged( void );
+    void modeChanged( void );
+    void runningChanged( void );
+    void durationChanged( void );
+    void loopsChanged( void );
+    void centerChanged( void );
+    void radiusChanged( void );
+    void pathChanged( void );
+    void closedChanged( void );
+    void keyframesChanged( void );
+protected:
+    void markDirty( void );
+    QVector3D evaluateOrbit( float progress );
+    QVector3D evaluatePath( float progress );
+    QVector3D evaluateKeyframe( float progress );
+
+    // GUI线程的属性
+    Target              m_target;
+    Mode                m_mode;
+    bool                m_running;
+    int                 m_duration;
+    int                 m_loops;
+    QVector3D           m_center;
+    qreal               m_radius;
+    QVariantList        m_path;
+    bool                m_closed;
+    QVariantList        m_keyframes;
+    bool                m_dirty;
+
+    // 渲染线程使用的副本
+    struct State
+    {
+        Target              target;
+        Mode                mode;
+        bool                running;
+        bool                finished;
+        int                 duration;
+        int                 loops;
+        QVector3D           center;
+        float               radius;
+        QVector<QVector3D>  path;
+        bool                closed;
+        QVector<float>      keyTimes;
+        QVector<QVector3D>  keyPositions;
+        qint64              startTime;
+    }                   m_state;
+
+    View*               m_view;
+};
+
+#endif // VIEWANIMATOR_H
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QQuickItem>
+#include "Cube.h"
+#include "OffscreenRenderer.h"
+#include "SceneGenerator.h"
+#include "MicroBenchmark.h"
+
+///////////////////////////////////////////////////////////////////////////////
+MicroBenchmark::MicroBenchmark( OffscreenRenderer* renderer,
+                                const QString& textureDirectory,
+                                int entities, int repetitions ):
+    m_renderer( renderer ),
+    m_textureDirectory( textureDirectory ),
+    m_entities( qMax( 1, entities ) ),
+    m_repetitions( qMax( 1, repetitions ) ),
+    m_view( Q_NULLPTR ),
+    m_sink( 0.0f )
+{
+}
+
+QStringList MicroBenchmark::caseNames( void )
+{
+    return QStringList( ) << "appendEntities" << "viewMatrix"
+                          << "projectionMatrix" << "sync"
+                          << "normalMatrix" << "resize";
+}
+
+QJsonObject MicroBenchmark::run( const QStringList& filter )
+{
+    QJsonObject result;
+    foreach ( const QString& name, caseNames( ) )
+    {
+        if ( !filter.isEmpty( ) && !filter.contains( name ) ) continue;
+        if ( name == "appendEntities" ) result[name] = appendEntities( );
+        else if ( name == "viewMatrix" ) result[name] = viewMatrix( );
+        else if ( name == "projectionMatrix" ) result[name] = projectionMatrix( );
+        else if ( name == "sync" ) result[name] = sync( );
+        else if ( name == "normalMatrix" ) result[name] = normalMatrix( );
+        else if ( name == "resize" ) result[name] = resize( );
+    }
+    return result;
+}
+
+QJsonObject MicroBenchmark::measure( int operations, const Body& body )
+{
+    // 第一次作为预热，不计入结果
+    body( );
+
+    QVector<double> samples;
+    for ( int i = 0; i < m_repetitions; ++i )
+        samples.append( double( body( ) ) / operations );
+    std::sort( samples.begin( ), samples.end( ) );
+
+    double sum = 0.0;
+    foreach ( double sample, samples ) sum += sample;
+
+    QJsonObject result;
+    result["operations"] = operations;
+    result["min"] = samples.first( );
+    result["median"] = samples[samples.size( ) / 2];
+    result["mean"] = sum / samples.size( );
+    return result;
+}
+
+View* MicroBenchmark::sceneView( void )
+{
+    // 需要OpenGL资源的用例共用一个渲染过的场景
+    if ( m_view == Q_NULLPTR )
+    {
+        SceneOptions options;
+        options.cubes = m_entities;
+        m_view = SceneGenerator::generate( m_renderer->rootItem( ), options,
+                                           m_textureDirectory );
+        m_renderer->renderFrame( );
+        m_view->stats( )->setRecording( true );
+    }
+    return m_view;
+}
+
+QJsonObject MicroBenchmark::appendEntities( void )
+{
+    // View::qobjectListAppend，不包括创建实体的时间
+    return measure( m_entities, [this]( ) -> qint64
+    {
+        View view;
+        QList<Cube*> cubes;
+        for ( int i = 0; i < m_entities; ++i ) cubes.append( new Cube );
+
+        QQmlListProperty<QObject> data = view.data( );
+        QElapsedTimer timer;
+        timer.start( );
+        foreach ( Cube* cube, cubes ) data.append( &data, cube );
+        return timer.nsecsElapsed( );
+    } );
+}
+
+QJsonObject MicroBenchmark::viewMatrix( void )
+{
+    // View::calculateViewMatrix中的矩阵计算，结果累加起来以免被优化掉
+    MatrixView view;
+    view.setPosition( QVector3D( 1.0f, 4.0f, -12.0f ) );
+    return measure( m_entities, [this, &view]( ) -> qint64
+    {
+        float sum = 0.0f;
+        QElapsedTimer timer;
+        timer.start( );
+        for ( int i = 0; i < m_entities; ++i )
+            sum += view.cameraViewMatrix( )( 0, 0 );
+        qint64 elapsed = timer.nsecsElapsed( );
+        m_sink = sum;
+        return elapsed;
+    } );
+}
+
+QJsonObject MicroBenchmark::projectionMatrix( void )
+{
+    MatrixView view;
+    return measure( m_entities, [this, &view]( ) -> qint64
+    {
+        float sum = 0.0f;
+        QElapsedTimer timer;
+        timer.start( );
+        for ( int i = 0; i < m_entities; ++i )
+            sum += view.cameraProjectionMatrix( )( 0, 0 );
+        qint64 elapsed = timer.nsecsElapsed( );
+        m_sink = sum;
+        return elapsed;
+    } );
+}
+
+QJsonObject MicroBenchmark::sync( void )
+{
+    // 所有实体的位置都发生变化时View::sync的耗时
+    View* view = sceneView( );
+    QList<Cube*> cubes = view->findChildren<Cube*>( );
+    int round = 0;
+    return measure( cubes.size( ), [this, view, &cubes, &round]( ) -> qint64
+    {
+        QVector3D offset( 0.0f, ( ++round & 1 ) ? 0.01f : -0.01f, 0.0f );
+        foreach ( Cube* cube, cubes )
+            cube->setTranslate( cube->translate( ) + offset );
+        m_renderer->renderFrame( );
+
+        view->stats( )->collect( );
+        return view->stats( )->recorded( ).last( ).sync;
+    } );
+}
+
+QJsonObject MicroBenchmark::normalMatrix( void )
+{
+    // CubeRenderer::prepare中每个实体的法线矩阵
+    View* view = sceneView( );
+    QList<Cube*> cubes = view->findChildren<Cube*>( );
+    return measure( cubes.size( ), [&cubes]( ) -> qint64
+    {
+        QElapsedTimer timer;
+        timer.start( );
+        foreach ( Cube* cube, cubes ) cube->prepare( );
+        return timer.nsecsElapsed( );
+    } );
+}
+
+QJsonObject MicroBenchmark::resize( void )
+{
+    // 修改边长以后的Cube::sync，即位置缓存的更新
+    View* view = sceneView( );
+    QList<Cube*> cubes = view->findChildren<Cube*>( );
+    int round = 0;
+    return measure( cubes.size( ), [this, &cubes, &round]( ) -> qint64
+    {
+        qreal length = ( ++round & 1 ) ? 2.5 : 2.0;
+        foreach ( Cube* cube, cubes ) cube->setLength( length );
+
+        m_renderer->makeCurrent( );
+        QElapsedTimer timer;
+        timer.start( );
+        foreach ( Cube* cube, cubes ) cube->sync( );
+        return timer.nsecsElapsed( );
+    } );
+}
@@ -0,0 +1,53 @@
+#ifndef MICROBENCHMARK_H
+#define MICROBENCHMARK_H
+
+#include <functional>
+#include <QJsonObject>
+#include <QStringList>
+#include "View.h"
+
+class OffscreenRenderer;
+
+// 直接调用View的矩阵计算，不经过setter的信号和updateWindow
+class MatrixView: public View
+{
+public:
+    using View::cameraViewMatrix;
+    using View::cameraProjectionMatrix;
+};
+
+// 单独测量sync以及render中CPU部分的热点，结果是每个操作的纳秒数
+class MicroBenchmark
+{
+public:
+    MicroBenchmark( OffscreenRenderer* renderer,
+                    const QString& textureDirectory,
+                    int entities, int repetitions );
+
+    static QStringList caseNames( void );
+
+    // filter为空时运行所有的用例
+    QJsonObject run( const QStringList& filter );
+protected:
+    // body返回本次测量的纳秒数，operations是一次测量包含的操作数
+    typedef std::function<qint64( void )> Body;
+    QJsonObject measure( int operations, const Body& body );
+
+    View* sceneView( void );
+
+    QJsonObject appendEntities( void );
+    QJsonObject viewMatrix( void );
+    QJsonObject projectionMatrix( void );
+    QJsonObject sync( void );
+    QJsonObject normalMatrix( void );
+    QJsonObject resize( void );
+
+    OffscreenRenderer*  m_renderer;
+    QString             m_textureDirectory;
+    int                 m_entities;
+    int                 m_repetitions;
+    View*               m_view;
+    volatile float      m_sink;
+};
+
+#endif // MICROBENCHMARK_H
@@ -0,0 +1,117 @@
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QQuickRenderControl>
+#include <QQuickWindow>
+#include <QQuickItem>
+#include "OffscreenRenderer.h"
+
+///////////////////////////////////////////////////////////////////////////////
+OffscreenRenderer::OffscreenRenderer( const QSize& size ):
+    m_size( size )
+{
+    m_majorVersion = m_minorVersion = 0;
+    m_context = Q_NULLPTR;
+    m_surface = Q_NULLPTR;
+    m_renderControl = Q_NULLPTR;
+    m_window = Q_NULLPTR;
+    m_FBO = Q_NULLPTR;
+}
+
+OffscreenRenderer::~OffscreenRenderer( void )
+{
+    if ( m_context != Q_NULLPTR ) m_context->makeCurrent( m_surface );
+
+    // 删除QQuickRenderControl时场景图失效，触发View的cleanup
+    delete m_renderControl;
+    delete m_window;
+    delete m_FBO;
+
+    if ( m_context != Q_NULLPTR ) m_context->doneCurrent( );
+    delete m_context;
+    delete m_surface;
+}
+
+void OffscreenRenderer::requestVersion( int major, int minor )
+{
+    m_majorVersion = major;
+    m_minorVersion = minor;
+}
+
+bool OffscreenRenderer::initialize( void )
+{
+    QSurfaceFormat format;
+    format.setDepthBufferSize( 24 );
+    format.setStencilBufferSize( 8 );
+    if ( m_majorVersion > 0 )
+    {
+        format.setVersion( m_majorVersion, m_minorVersion );
+        format.setProfile( QSurfaceFormat::CompatibilityProfile );
+    }
+
+    m_context = new QOpenGLContext;
+    m_context->setFormat( format );
+    if ( !m_context->create( ) ) return false;
+
+    m_surface = new QOffscreenSurface;
+    m_surface->setFormat( m_context->format( ) );
+    m_surface->create( );
+    if ( !m_context->makeCurrent( m_surface ) ) return false;
+
+    m_rendererName = QString::fromLatin1( reinterpret_cast<const char*>(
+                    m_context->functions( )->glGetString( GL_RENDERER ) ) );
+
+    m_renderControl = new QQuickRenderControl;
+    m_window = new QQuickWindow( m_renderControl );
+    m_window->setGeometry( 0, 0, m_size.width( ), m_size.height( ) );
+    m_window->contentItem( )->setSize( m_size );
+
+    m_FBO = new QOpenGLFramebufferObject(
+                m_size, QOpenGLFramebufferObject::CombinedDepthStencil );
+    m_window->setRenderTarget( m_FBO );
+
+    m_renderControl->initialize( m_context );
+    return true;
+}
+
+QQuickItem* OffscreenRenderer::rootItem( void )
+{
+    return m_window->contentItem( );
+}
+
+OffscreenRenderer::FrameTiming OffscreenRenderer::renderFrame( void )
+{
+    FrameTiming timing;
+    QElapsedTimer timer;
+    m_context->makeCurrent( m_surface );
+
+    timer.start( );
+    m_renderControl->polishItems( );
+    timing.polish = timer.nsecsElapsed( );
+
+    timer.start( );
+    m_renderControl->sync( );
+    timing.sync = timer.nsecsElapsed( );
+
+    timer.start( );
+    m_renderControl->render( );
+    timing.render = timer.nsecsElapsed( );
+
+    // 等待GPU（或llvmpipe）完成，使得每帧的耗时互不重叠
+    m_context->functions( )->glFinish( );
+    timing.total = timing.polish + timing.sync + timer.nsecsElapsed( );
+    return timing;
+}
+
+QImage OffscreenRenderer::grabImage( void )
+{
+    makeCurrent( );
+    return m_FBO->toImage( );
+}
+
+void OffscreenRenderer::makeCurrent( void )
+{
+    m_context->makeCurrent( m_surface );
+}
@@ -0,0 +1,55 @@
+#ifndef OFFSCREENRENDERER_H
+#define OFFSCREENRENDERER_H
+
+#include <QSize>
+#include <QImage>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QOpenGLContext;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+class QQuickRenderControl;
+class QQuickWindow;
+class QQuickItem;
+QT_END_NAMESPACE
+
+// 通过QQuickRenderControl把场景渲染到FBO，不需要窗口和GPU
+class OffscreenRenderer
+{
+public:
+    // 各个阶段的CPU耗时（纳秒）
+    struct FrameTiming
+    {
+        qint64          polish;
+        qint64          sync;
+        qint64          render;
+        qint64          total;      // 包括glFinish
+    };
+
+    explicit OffscreenRenderer( const QSize& size );
+    ~OffscreenRenderer( void );
+
+    // 在initialize之前调用。GPU剔除需要OpenGL 4.3，使用兼容模式，
+    // 其余的着色器仍然是不带版本号的GLSL
+    void requestVersion( int major, int minor );
+    bool initialize( void );
+    FrameTiming renderFrame( void );
+    QImage grabImage( void );
+    void makeCurrent( void );
+
+    QQuickWindow* window( void ) { return m_window; }
+    QQuickItem* rootItem( void );
+    QString rendererName( void ) { return m_rendererName; }
+protected:
+    QSize                       m_size;
+    int                         m_majorVersion, m_minorVersion;     // 0表示默认的上下文
+    QOpenGLContext*             m_context;
+    QOffscreenSurface*          m_surface;
+    QQuickRenderControl*        m_renderControl;
+    QQuickWindow*               m_window;
+    QOpenGLFramebufferObject*   m_FBO;
+    QString                     m_rendererName;
+};
+
+#endif // OFFSCREENRENDERER_H
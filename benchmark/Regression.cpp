@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <QFile>
+#include <QJsonDocument>
+#include <QStringList>
+#include "Regression.h"
+
+///////////////////////////////////////////////////////////////////////////////
+Regression::ImageDifference Regression::compareImages( const QImage& actual,
+                                                       const QImage& expected,
+                                                       int tolerance )
+{
+    ImageDifference result;
+    result.sizeMatches = actual.size( ) == expected.size( );
+    result.differentPixels = 0;
+    result.maxDifference = 0;
+    result.fraction = 1.0;
+    if ( !result.sizeMatches || actual.isNull( ) ) return result;
+
+    // FBO读回来的可能带有预乘的alpha，统一成RGB32再比较
+    QImage a = actual.convertToFormat( QImage::Format_RGB32 );
+    QImage b = expected.convertToFormat( QImage::Format_RGB32 );
+    result.diff = QImage( a.size( ), QImage::Format_RGB32 );
+
+    for ( int y = 0; y < a.height( ); ++y )
+    {
+        const QRgb* lineA = reinterpret_cast<const QRgb*>( a.constScanLine( y ) );
+        const QRgb* lineB = reinterpret_cast<const QRgb*>( b.constScanLine( y ) );
+        QRgb* lineDiff = reinterpret_cast<QRgb*>( result.diff.scanLine( y ) );
+        for ( int x = 0; x < a.width( ); ++x )
+        {
+            int difference = qMax( qAbs( qRed( lineA[x] ) - qRed( lineB[x] ) ),
+                                   qMax( qAbs( qGreen( lineA[x] ) - qGreen( lineB[x] ) ),
+                                         qAbs( qBlue( lineA[x] ) - qBlue( lineB[x] ) ) ) );
+            result.maxDifference = qMax( result.maxDifference, difference );
+            if ( difference > tolerance )
+            {
+                ++result.differentPixels;
+                lineDiff[x] = qRgb( 255, 0, 0 );
+            }
+            else
+            {
+                // 相同的部分画成淡灰色，方便对照
+                int gray = 192 + qGray( lineA[x] ) / 4;
+                lineDiff[x] = qRgb( gray, gray, gray );
+            }
+        }
+    }
+    result.fraction = double( result.differentPixels ) / ( a.width( ) * a.height( ) );
+    return result;
+}
+
+bool Regression::checkBudget( const QJsonObject& baseline,
+                              const QString& scene,
+                              const QJsonObject& frameTime,
+                              double slack,
+                              QString* message )
+{
+    QJsonObject budget = baseline.value( scene ).toObject( );
+    if ( budget.isEmpty( ) )
+    {
+        if ( message != Q_NULLPTR )
+            *message = QString( "no baseline for scene \"%1\"" ).arg( scene );
+        return false;
+    }
+
+    bool passed = true;
+    QStringList report;
+    foreach ( const QString& key, QStringList( ) << "p50" << "p99" )
+    {
+        if ( !budget.contains( key ) ) continue;
+        double limit = budget.value( key ).toDouble( ) * ( 1.0 + slack );
+        double measured = frameTime.value( key ).toDouble( );
+        bool within = measured <= limit;
+        passed = passed && within;
+        report.append( QString( "%1 %2 ms (limit %3 ms)%4" )
+                       .arg( key )
+                       .arg( measured, 0, 'f', 3 )
+                       .arg( limit, 0, 'f', 3 )
+                       .arg( within ? "" : " EXCEEDED" ) );
+    }
+    if ( message != Q_NULLPTR ) *message = report.join( ", " );
+    return passed;
+}
+
+QJsonObject Regression::summarize( QVector<qint64> samples )
+{
+    QJsonObject result;
+    if ( samples.isEmpty( ) ) return result;
+
+    std::sort( samples.begin( ), samples.end( ) );
+    double sum = 0.0;
+    foreach ( qint64 sample, samples ) sum += sample;
+
+    int last = samples.size( ) - 1;
+    result["mean"] = sum / samples.size( ) / 1000000.0;
+    result["p50"] = samples[last * 50 / 100] / 1000000.0;
+    result["p99"] = samples[last * 99 / 100] / 1000000.0;
+    result["max"] = samples[last] / 1000000.0;
+    return result;
+}
+
+QJsonObject Regression::loadJson( const QString& fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) ) return QJsonObject( );
+    return QJsonDocument::fromJson( file.readAll( ) ).object( );
+}
+
+bool Regression::saveJson( const QString& fileName, const QJsonObject& object )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) ) return false;
+    file.write( QJsonDocument( object ).toJson( ) );
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+
+// 与参考图片比较，以及检查帧时间是否超出基线
+class Regression
+{
+public:
+    struct ImageDifference
+    {
+        bool            sizeMatches;
+        int             differentPixels;
+        int             maxDifference;      // 单个通道的最大差值
+        double          fraction;           // 超出容差的像素比例
+        QImage          diff;               // 超出容差的像素标为红色
+    };
+
+    static ImageDifference compareImages( const QImage& actual,
+                                          const QImage& expected,
+                                          int tolerance );
+
+    // baseline形如{ "scene": { "p50": 毫秒, "p99": 毫秒 } }，
+    // 测量值超过基线的(1 + slack)倍时失败
+    static bool checkBudget( const QJsonObject& baseline,
+                             const QString& scene,
+                             const QJsonObject& frameTime,
+                             double slack,
+                             QString* message );
+
+    // 纳秒样本的平均值以及百分位数（毫秒），checkBudget使用其中的p50和p99
+    static QJsonObject summarize( QVector<qint64> samples );
+
+    static QJsonObject loadJson( const QString& fileName );
+    static bool saveJson( const QString& fileName, const QJsonObject& object );
+};
+
+#endif // REGRESSION_H
@@ -0,0 +1,93 @@
+#include <math.h>
+#include <QDir>
+#include <QFile>
+#include <QUrl>
+#include <QColor>
+#include <QImage>
+#include <QQuickItem>
+#include "Cube.h"
+#include "Plane.h"
+#include "SceneGenerator.h"
+
+#define CUBE_LENGTH     2.0
+#define CUBE_SPACING    3.0
+
+///////////////////////////////////////////////////////////////////////////////
+static QUrl generateTexture( const QString& directory, int index, int size )
+{
+    // 每张纹理是不同颜色的棋盘格
+    QString path = QDir( directory ).filePath(
+                QString( "texture_%1.png" ).arg( index ) );
+    if ( !QFile::exists( path ) )
+    {
+        QColor color = QColor::fromHsv( ( index * 47 ) % 360, 160, 230 );
+        QImage image( size, size, QImage::Format_RGB32 );
+        for ( int y = 0; y < size; ++y )
+        {
+            for ( int x = 0; x < size; ++x )
+            {
+                bool dark = ( ( x * 4 / size ) + ( y * 4 / size ) ) % 2;
+                image.setPixel( x, y, dark ? color.darker( 150 ).rgb( ) :
+                                             color.rgb( ) );
+            }
+        }
+        image.save( path );
+    }
+    return QUrl::fromLocalFile( path );
+}
+
+View* SceneGenerator::generate( QQuickItem* parent,
+                                const SceneOptions& options,
+                                const QString& textureDirectory )
+{
+    View* view = new View;
+    view->setObjectName( "view" );
+    view->setParentItem( parent );
+    view->setSize( QSizeF( parent->width( ), parent->height( ) ) );
+    view->setShadowMode( options.shadowMode );
+    view->setDepthPrepass( options.depthPrepass );
+    view->setOcclusionCulling( options.occlusionCulling );
+    view->setGpuCulling( options.gpuCulling );
+
+    int textureCount = qMax( 1, options.textures );
+    QList<QUrl> textures;
+    for ( int i = 0; i < textureCount; ++i )
+        textures.append( generateTexture( textureDirectory, i, options.textureSize ) );
+
+    // 立方体排列在XZ平面上的正方形网格里
+    int side = qMax( 1, int( ceil( sqrt( double( options.cubes ) ) ) ) );
+    float extent = side * CUBE_SPACING;
+    QQmlListProperty<QObject> data = view->data( );
+    for ( int i = 0; i < options.cubes; ++i )
+    {
+        Cube* cube = new Cube;
+        cube->setObjectName( QString( "cube %1" ).arg( i ) );
+        cube->setLength( CUBE_LENGTH );
+        cube->setSource( textures[i % textureCount] );
+        cube->setStaticGeometry( options.staticGeometry );
+        cube->setTranslate( QVector3D( ( i % side + 0.5f ) * CUBE_SPACING - extent / 2.0f,
+                                       0.0f,
+                                       ( i / side + 0.5f ) * CUBE_SPACING - extent / 2.0f ) );
+        data.append( &data, cube );
+    }
+
+    Plane* plane = new Plane;
+    plane->setObjectName( "ground" );
+    plane->setLength( extent + 2.0 * CUBE_SPACING );
+    plane->setSource( textures.first( ) );
+    plane->setStaticGeometry( options.staticGeometry );
+    plane->setCastShadows( false );      // 地面下方没有东西可以遮挡
+    plane->setTranslate( QVector3D( 0.0f, -CUBE_LENGTH / 2.0f, 0.0f ) );
+    data.append( &data, plane );
+
+    // 相机从斜上方看向整个网格
+    float distance = qMax( extent, 10.0f );
+    view->setPosition( QVector3D( 0.0f, distance * 0.6f, distance * 0.9f ) );
+    view->setLookAt( QVector3D( 0.0f, 0.0f, 0.0f ) );
+    view->setUp( QVector3D( 0.0f, 1.0f, 0.0f ) );
+    view->setFieldOfView( 60.0 );
+    view->setNearPlane( 1.0 );
+    view->setFarPlane( distance * 4.0 );
+    view->setLightPosition( QVector3D( distance * 0.3f, distance * 0.8f, distance * 0.3f ) );
+    return view;
+}
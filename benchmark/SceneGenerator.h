@@ -0,0 +1,43 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <QString>
+#include "View.h"
+
+QT_BEGIN_NAMESPACE
+class QQuickItem;
+QT_END_NAMESPACE
+
+// 生成由N个立方体组成的网格场景，纹理是程序生成的
+struct SceneOptions
+{
+    SceneOptions( void ):
+        cubes( 100 ),
+        textures( 4 ),
+        textureSize( 16 ),
+        shadowMode( View::SimpleShadow ),
+        staticGeometry( false ),
+        depthPrepass( false ),
+        occlusionCulling( false ),
+        gpuCulling( false ) { }
+
+    int                 cubes;
+    int                 textures;
+    int                 textureSize;
+    View::ShadowMode    shadowMode;
+    bool                staticGeometry;     // 立方体和地面都合批
+    bool                depthPrepass;
+    bool                occlusionCulling;
+    bool                gpuCulling;
+};
+
+class SceneGenerator
+{
+public:
+    // 纹理图片写在textureDirectory里
+    static View* generate( QQuickItem* parent,
+                           const SceneOptions& options,
+                           const QString& textureDirectory );
+};
+
+#endif // SCENEGENERATOR_H
@@ -0,0 +1,25 @@
+TEMPLATE = app
+TARGET = benchmark
+
+QT += qml quick
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    OffscreenRenderer.cpp \
+    SceneGenerator.cpp \
+    Regression.cpp \
+    MicroBenchmark.cpp
+
+HEADERS += \
+    OffscreenRenderer.h \
+    SceneGenerator.h \
+    Regression.h \
+    MicroBenchmark.h
+
+# 参考场景以及它用到的图片
+RESOURCES += ../qml.qrc \
+    ../image.qrc
+
+include(../renderer.pri)
@@ -0,0 +1,437 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QTextStream>
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QQuickItem>
+#include "OffscreenRenderer.h"
+#include "SceneGenerator.h"
+#include "Regression.h"
+#include "MicroBenchmark.h"
+#include "ViewAnimator.h"
+#include "View.h"
+
+static bool s_verbose = false;
+
+// 默认屏蔽调试信息，--verbose时输出
+static void messageHandler( QtMsgType type, const QMessageLogContext&,
+                            const QString& message )
+{
+    if ( type == QtDebugMsg && !s_verbose ) return;
+    QTextStream( stderr ) << message << "\n";
+}
+
+// fileName为空时输出到stdout
+static int writeResult( const QJsonObject& result, const QString& fileName )
+{
+    QByteArray json = QJsonDocument( result ).toJson( );
+    if ( fileName.isEmpty( ) )
+    {
+        QTextStream( stdout ) << json;
+        return 0;
+    }
+
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+    {
+        qCritical( "cannot write %s.", qPrintable( fileName ) );
+        return 1;
+    }
+    file.write( json );
+    return 0;
+}
+
+int main( int argc, char* argv[] )
+{
+    // 默认使用offscreen平台以及Mesa的llvmpipe，CI上不需要GPU
+    if ( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    // 微基准测试使用Mesa的空驱动：OpenGL调用照常经过状态跟踪，但不做任何绘制，
+    // 测得的只有CPU上的开销
+    bool hardware = false, micro = false;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( qstrcmp( argv[i], "--hardware" ) == 0 ) hardware = true;
+        if ( qstrcmp( argv[i], "--micro" ) == 0 ) micro = true;
+    }
+    if ( !hardware ) qputenv( "LIBGL_ALWAYS_SOFTWARE", "1" );
+    if ( !hardware && micro && qEnvironmentVariableIsEmpty( "GALLIUM_NOOP" ) )
+        qputenv( "GALLIUM_NOOP", "1" );
+
+    QGuiApplication app( argc, argv );
+    app.setApplicationName( "benchmark" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Renders generated scenes offscreen "
+                                      "and reports frame times as JSON." );
+    parser.addHelpOption( );
+    QCommandLineOption cubesOption( "cubes", "Number of cubes.", "n", "100" );
+    QCommandLineOption texturesOption( "textures", "Number of distinct textures.", "n", "4" );
+    QCommandLineOption textureSizeOption( "texture-size", "Texture edge in pixels.", "n", "16" );
+    QCommandLineOption shadowOption( "shadow", "Shadow mode: none, simple, point or variance.", "mode", "simple" );
+    QCommandLineOption staticOption( "static", "Mark the generated entities as static geometry." );
+    QCommandLineOption prepassOption( "depth-prepass", "Render a depth-only pass before the main pass." );
+    QCommandLineOption occlusionOption( "occlusion-culling", "Cull entities hidden behind large cubes and planes on the CPU." );
+    QCommandLineOption gpuCullingOption( "gpu-culling", "Cull dynamic cubes in a compute shader and draw them "
+                                         "with multi-draw indirect (requests an OpenGL 4.3 context)." );
+    QCommandLineOption framesOption( "frames", "Number of measured frames.", "n", "200" );
+    QCommandLineOption warmupOption( "warmup", "Number of frames before measuring.", "n", "10" );
+    QCommandLineOption sizeOption( "size", "Framebuffer size.", "WxH", "1280x720" );
+    QCommandLineOption outputOption( "output", "Write JSON to a file instead of stdout.", "file" );
+    QCommandLineOption replayOption( "replay", "Replay a frame log recorded with SHADOWMAP_RECORD "
+                                     "instead of generating a scene.", "file" );
+    QCommandLineOption qmlOption( "qml", "Load the scene from a QML file, e.g. qrc:/Scene.qml.", "url" );
+    QCommandLineOption goldenOption( "golden", "Compare the last frame with a reference image.", "png" );
+    QCommandLineOption updateGoldenOption( "update-golden", "Write the last frame as the reference image." );
+    QCommandLineOption toleranceOption( "tolerance", "Per-channel difference ignored by --golden.", "n", "8" );
+    QCommandLineOption maxDiffOption( "max-diff", "Fraction of pixels allowed to differ.", "f", "0.002" );
+    QCommandLineOption baselineOption( "baseline", "Check frame times against a baseline JSON file.", "file" );
+    QCommandLineOption updateBaselineOption( "update-baseline", "Store the measured frame times in the baseline." );
+    QCommandLineOption nameOption( "name", "Scene name used as the baseline key.", "name", "default" );
+    QCommandLineOption slackOption( "slack", "Allowed slowdown relative to the baseline.", "f", "0.25" );
+    QCommandLineOption microOption( "micro", "Run the CPU micro-benchmarks with --cubes entities." );
+    QCommandLineOption casesOption( "cases", "Comma separated micro-benchmark cases: " +
+                                    MicroBenchmark::caseNames( ).join( ", " ) + ".", "names" );
+    QCommandLineOption repetitionsOption( "repetitions", "Repetitions of each micro-benchmark.", "n", "20" );
+    QCommandLineOption traceOption( "trace", "Write a Chrome trace of the measured frames.", "file" );
+    QCommandLineOption hardwareOption( "hardware", "Do not force Mesa's software rasterizer." );
+    QCommandLineOption verboseOption( "verbose", "Print debug messages." );
+    parser.addOption( cubesOption );
+    parser.addOption( texturesOption );
+    parser.addOption( textureSizeOption );
+    parser.addOption( shadowOption );
+    parser.addOption( staticOption );
+    parser.addOption( prepassOption );
+    parser.addOption( occlusionOption );
+    parser.addOption( gpuCullingOption );
+    parser.addOption( framesOption );
+    parser.addOption( warmupOption );
+    parser.addOption( sizeOption );
+    parser.addOption( outputOption );
+    parser.addOption( replayOption );
+    parser.addOption( qmlOption );
+    parser.addOption( goldenOption );
+    parser.addOption( updateGoldenOption );
+    parser.addOption( toleranceOption );
+    parser.addOption( maxDiffOption );
+    parser.addOption( baselineOption );
+    parser.addOption( updateBaselineOption );
+    parser.addOption( nameOption );
+    parser.addOption( slackOption );
+    parser.addOption( microOption );
+    parser.addOption( casesOption );
+    parser.addOption( repetitionsOption );
+    parser.addOption( traceOption );
+    parser.addOption( hardwareOption );
+    parser.addOption( verboseOption );
+    parser.process( app );
+
+    s_verbose = parser.isSet( verboseOption );
+    qInstallMessageHandler( messageHandler );
+
+    SceneOptions options;
+    options.cubes = parser.value( cubesOption ).toInt( );
+    options.textures = parser.value( texturesOption ).toInt( );
+    options.textureSize = parser.value( textureSizeOption ).toInt( );
+    QString shadowMode = parser.value( shadowOption );
+    options.shadowMode = shadowMode == "none" ? View::NoShadow :
+                         shadowMode == "point" ? View::PointShadow :
+                         shadowMode == "variance" ? View::VarianceShadow : View::SimpleShadow;
+    options.staticGeometry = parser.isSet( staticOption );
+    options.depthPrepass = parser.isSet( prepassOption );
+    options.occlusionCulling = parser.isSet( occlusionOption );
+    options.gpuCulling = parser.isSet( gpuCullingOption );
+    int frames = parser.value( framesOption ).toInt( );
+    int warmup = parser.value( warmupOption ).toInt( );
+    QStringList size = parser.value( sizeOption ).split( 'x' );
+    QSize frameSize( size.value( 0 ).toInt( ), size.value( 1 ).toInt( ) );
+    if ( frameSize.isEmpty( ) ) frameSize = QSize( 1280, 720 );
+
+    // QML创建的场景要在引擎之前销毁
+    View::registerTypes( "QtProblem" );
+    QQmlEngine engine;
+
+    OffscreenRenderer renderer( frameSize );
+    if ( options.gpuCulling ) renderer.requestVersion( 4, 3 );
+    if ( !renderer.initialize( ) )
+    {
+        qCritical( "failed to create an offscreen OpenGL context." );
+        return 1;
+    }
+
+    // 微基准测试只输出各个用例每次操作的耗时
+    if ( parser.isSet( microOption ) )
+    {
+        QTemporaryDir textureDirectory;
+        MicroBenchmark micro( &renderer, textureDirectory.path( ), options.cubes,
+                              parser.value( repetitionsOption ).toInt( ) );
+        QStringList cases = parser.value( casesOption ).split( ',', Qt::SkipEmptyParts );
+
+        QJsonObject result;
+        result["renderer"] = renderer.rendererName( );
+        result["entities"] = options.cubes;
+        result["unit"] = QStringLiteral( "ns/op" );
+        result["micro"] = micro.run( cases );
+        return writeResult( result, parser.value( outputOption ) );
+    }
+
+    // 重放时场景完全由日志决定，日志播放完以后从头开始
+    FrameReplayer replayer;
+    QTemporaryDir textureDirectory;
+    View* view;
+    if ( parser.isSet( replayOption ) )
+    {
+        if ( !replayer.open( parser.value( replayOption ) ) ) return 1;
+        view = new View;
+        view->setParentItem( renderer.rootItem( ) );
+        view->setSize( QSizeF( frameSize ) );
+    }
+    else if ( parser.isSet( qmlOption ) )
+    {
+        QQmlComponent component( &engine, QUrl( parser.value( qmlOption ) ) );
+        QObject* object = component.create( );
+        view = qobject_cast<View*>( object );
+        if ( view == Q_NULLPTR && object != Q_NULLPTR ) view = object->findChild<View*>( );
+        if ( view == Q_NULLPTR )
+        {
+            qCritical( "%s does not contain a view.", qPrintable( component.errorString( ) ) );
+            return 1;
+        }
+        QQuickItem* item = qobject_cast<QQuickItem*>( object );
+        if ( item == Q_NULLPTR ) item = view;
+        item->setParent( renderer.rootItem( ) );
+        item->setParentItem( renderer.rootItem( ) );
+        item->setSize( QSizeF( frameSize ) );
+    }
+    else
+    {
+        view = SceneGenerator::generate( renderer.rootItem( ), options,
+                                         textureDirectory.path( ) );
+    }
+
+    // 重放以及QML场景也可以打开深度预渲染
+    if ( options.depthPrepass ) view->setDepthPrepass( true );
+    if ( options.occlusionCulling ) view->setOcclusionCulling( true );
+    if ( options.gpuCulling ) view->setGpuCulling( true );
+
+    // 与参考图片比较时需要确定的画面，停止所有的动画器
+    bool golden = parser.isSet( goldenOption );
+    if ( golden )
+    {
+        foreach ( ViewAnimator* animator, view->findChildren<ViewAnimator*>( ) )
+            animator->setRunning( false );
+    }
+
+    // 每一帧都标记场景变化，否则按需渲染会跳过绘制
+    QVector<qint64> frameTimes, polishTimes, syncTimes, renderTimes;
+    for ( int i = 0; i < warmup + frames; ++i )
+    {
+        if ( i == warmup && parser.isSet( traceOption ) )
+            Tracer::instance( )->setEnabled( true );
+        if ( parser.isSet( replayOption ) && !replayer.next( view ) )
+        {
+            replayer.rewind( );
+            replayer.next( view );
+        }
+        view->updateWindow( );
+        OffscreenRenderer::FrameTiming timing = renderer.renderFrame( );
+
+        // View的统计在事件循环中收集
+        view->stats( )->setRecording( i >= warmup );
+        app.processEvents( );
+        if ( i < warmup ) continue;
+        frameTimes.append( timing.total );
+        polishTimes.append( timing.polish );
+        syncTimes.append( timing.sync );
+        renderTimes.append( timing.render );
+    }
+
+    if ( parser.isSet( traceOption ) )
+    {
+        Tracer::instance( )->setEnabled( false );
+        if ( !Tracer::instance( )->save( parser.value( traceOption ) ) ) return 1;
+    }
+
+    QJsonObject scene;
+    if ( parser.isSet( replayOption ) )
+    {
+        scene["replay"] = parser.value( replayOption );
+        scene["replayFrames"] = replayer.frameCount( );
+    }
+    else if ( parser.isSet( qmlOption ) )
+    {
+        scene["qml"] = parser.value( qmlOption );
+    }
+    else
+    {
+        scene["cubes"] = options.cubes;
+        scene["textures"] = options.textures;
+        scene["textureSize"] = options.textureSize;
+        scene["shadow"] = parser.value( shadowOption );
+        scene["static"] = options.staticGeometry;
+    }
+    scene["depthPrepass"] = options.depthPrepass;
+    scene["occlusionCulling"] = options.occlusionCulling;
+    scene["gpuCulling"] = options.gpuCulling;
+    scene["width"] = frameSize.width( );
+    scene["height"] = frameSize.height( );
+
+    QJsonObject passes;
+    passes["polish"] = Regression::summarize( polishTimes );
+    passes["sync"] = Regression::summarize( syncTimes );
+    passes["render"] = Regression::summarize( renderTimes );
+
+    // View内部各个阶段的耗时。GPU时间属于几帧以前，只统计属于测量范围内的帧的，
+    // 最后几帧的GPU时间在测量结束以前还读不到
+    QVector<qint64> shadowTimes, mainTimes, prepassTimes, gpuShadowTimes, gpuMainTimes;
+    int drawCalls = 0, triangles = 0, occluded = 0;
+    qint64 uploadBytes = 0;
+    view->stats( )->collect( );
+    const QVector<FrameSample>& recorded = view->stats( )->recorded( );
+    int firstIndex = recorded.isEmpty( ) ? 0 : recorded.first( ).index;
+    int firstGpuIndex = -1, lastGpuIndex = -1;
+    foreach ( const FrameSample& sample, recorded )
+    {
+        shadowTimes.append( sample.shadow );
+        mainTimes.append( sample.main );
+        prepassTimes.append( sample.depthPrepass );
+        if ( sample.gpuIndex >= firstIndex && sample.gpuMain >= 0 )
+        {
+            gpuShadowTimes.append( qMax( sample.gpuShadow, qint64( 0 ) ) );
+            gpuMainTimes.append( sample.gpuMain );
+            if ( firstGpuIndex < 0 ) firstGpuIndex = sample.gpuIndex;
+            lastGpuIndex = sample.gpuIndex;
+        }
+        drawCalls = sample.drawCalls;
+        triangles = sample.triangles;
+        occluded = sample.occluded;
+        uploadBytes += sample.uploadBytes;
+    }
+    passes["shadow"] = Regression::summarize( shadowTimes );
+    passes["main"] = Regression::summarize( mainTimes );
+    if ( options.depthPrepass ) passes["depthPrepass"] = Regression::summarize( prepassTimes );
+    if ( !gpuMainTimes.isEmpty( ) )
+    {
+        passes["gpuShadow"] = Regression::summarize( gpuShadowTimes );
+        passes["gpuMain"] = Regression::summarize( gpuMainTimes );
+    }
+
+    QJsonObject result;
+    result["renderer"] = renderer.rendererName( );
+    result["scene"] = scene;
+    result["frames"] = frames;
+    result["frameTime"] = Regression::summarize( frameTimes );
+    result["passes"] = passes;
+    result["drawCalls"] = drawCalls;
+    result["triangles"] = triangles;
+    if ( options.occlusionCulling ) result["occluded"] = occluded;
+    int samples = recorded.size( );
+    result["uploadBytesPerFrame"] = samples > 0 ? double( uploadBytes ) / samples : 0.0;
+    if ( !gpuMainTimes.isEmpty( ) )
+    {
+        // GPU时间所属的帧，与passes中其它阶段的帧不完全相同
+        QJsonObject gpuFrames;
+        gpuFrames["first"] = firstGpuIndex;
+        gpuFrames["last"] = lastGpuIndex;
+        gpuFrames["measuredFirst"] = firstIndex;
+        gpuFrames["measuredLast"] = recorded.last( ).index;
+        result["gpuFrames"] = gpuFrames;
+    }
+
+    // 回归检查，失败时返回2
+    int exitCode = 0;
+    QTextStream err( stderr );
+    if ( golden )
+    {
+        QString goldenFile = parser.value( goldenOption );
+        QImage image = renderer.grabImage( );
+        if ( parser.isSet( updateGoldenOption ) )
+        {
+            if ( !image.save( goldenFile ) )
+            {
+                qCritical( "cannot write %s.", qPrintable( goldenFile ) );
+                return 1;
+            }
+            err << "golden: wrote " << goldenFile << "\n";
+        }
+        else if ( !QFile::exists( goldenFile ) )
+        {
+            // 缺少参考图片算作失败，只有--update-golden才会生成
+            QJsonObject report;
+            report["passed"] = false;
+            report["missing"] = true;
+            result["golden"] = report;
+            err << "golden: " << goldenFile << " is missing, "
+                << "record it with --update-golden\n";
+            exitCode = 2;
+        }
+        else
+        {
+            Regression::ImageDifference difference = Regression::compareImages(
+                        image, QImage( goldenFile ),
+                        parser.value( toleranceOption ).toInt( ) );
+            double maxDiff = parser.value( maxDiffOption ).toDouble( );
+            bool passed = difference.sizeMatches && difference.fraction <= maxDiff;
+            QJsonObject report;
+            report["passed"] = passed;
+            report["differentPixels"] = difference.differentPixels;
+            report["maxDifference"] = difference.maxDifference;
+            report["fraction"] = difference.fraction;
+            result["golden"] = report;
+            if ( !passed )
+            {
+                QString prefix = goldenFile;
+                prefix.chop( 4 );
+                image.save( prefix + ".actual.png" );
+                if ( !difference.diff.isNull( ) ) difference.diff.save( prefix + ".diff.png" );
+                err << "golden: " << goldenFile << " differs in "
+                    << difference.differentPixels << " pixels, see "
+                    << prefix << ".diff.png\n";
+                exitCode = 2;
+            }
+        }
+    }
+
+    if ( parser.isSet( baselineOption ) )
+    {
+        QString baselineFile = parser.value( baselineOption );
+        QString name = parser.value( nameOption );
+        QJsonObject baseline = Regression::loadJson( baselineFile );
+        QJsonObject measured = result["frameTime"].toObject( );
+        // 缺少这个场景的基线时checkBudget失败，只有--update-baseline才会记录
+        if ( parser.isSet( updateBaselineOption ) )
+        {
+            QJsonObject budget;
+            budget["p50"] = measured["p50"];
+            budget["p99"] = measured["p99"];
+            baseline[name] = budget;
+            if ( !Regression::saveJson( baselineFile, baseline ) )
+            {
+                qCritical( "cannot write %s.", qPrintable( baselineFile ) );
+                return 1;
+            }
+            err << "baseline: recorded " << name << " in " << baselineFile << "\n";
+        }
+        else
+        {
+            QString message;
+            bool passed = Regression::checkBudget(
+                        baseline, name, measured,
+                        parser.value( slackOption ).toDouble( ), &message );
+            QJsonObject report;
+            report["passed"] = passed;
+            report["message"] = message;
+            result["budget"] = report;
+            err << "budget: " << name << ": " << message << "\n";
+            if ( !passed ) exitCode = 2;
+        }
+    }
+
+    err.flush( );
+    if ( writeResult( result, parser.value( outputOption ) ) != 0 ) return 1;
+    return exitCode;
+}
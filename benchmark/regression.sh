@@ -0,0 +1,32 @@
+#!/bin/sh
+# 渲染参考场景和压力场景，与golden目录中的图片以及baseline.json中的帧时间比较。
+# 缺少参考数据的场景算作失败，传入--update-golden --update-baseline时重新生成。
+# 用法: regression.sh [path/to/benchmark [额外参数]]
+
+BENCHMARK=${1:-./benchmark}
+[ $# -gt 0 ] && shift
+DIR=$(cd "$(dirname "$0")" && pwd)
+GOLDEN="$DIR/golden"
+BASELINE="$DIR/baseline.json"
+mkdir -p "$GOLDEN"
+
+status=0
+run( )
+{
+    name=$1
+    shift
+    echo "== $name"
+    "$BENCHMARK" --name "$name" --golden "$GOLDEN/$name.png" \
+        --baseline "$BASELINE" --output /dev/null "$@" || status=1
+}
+
+run main --qml qrc:/Scene.qml --size 320x480 --frames 100 "$@"
+run grid --cubes 400 --textures 8 --size 640x480 --frames 100 "$@"
+run stress --cubes 10000 --textures 16 --size 1280x720 --frames 50 "$@"
+run stress-static --cubes 10000 --textures 16 --static --size 1280x720 --frames 50 "$@"
+run stress-prepass --cubes 10000 --textures 16 --depth-prepass --size 1280x720 --frames 50 "$@"
+run stress-gpu --cubes 10000 --textures 16 --gpu-culling --size 1280x720 --frames 50 "$@"
+run stress-occlusion --cubes 10000 --textures 16 --occlusion-culling --size 1280x720 --frames 50 "$@"
+run stress-noshadow --cubes 10000 --textures 16 --shadow none --size 1280x720 --frames 50 "$@"
+
+exit $status
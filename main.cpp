@@ -1,27 +1,35 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QSurfaceFormat>
-#include "Cube.h"
-#include "Plane.h"
-#include "TexturedCube.h"
 #include "View.h"
 
 int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
 
-    qmlRegisterType<View>( "QtProblem", 1, 0, "TexturedCubeView" );
-    qmlRegisterType<TexturedCube>( "QtProblem", 1, 0, "TexturedCube" );
-    qmlRegisterType<Cube>( "QtProblem", 1, 0, "Cube" );
-    qmlRegisterType<Plane>( "QtProblem", 1, 0, "Plane" );
+    View::registerTypes( "QtProblem" );
 
     // 注册一些类
     QSurfaceFormat defaultFormat;
     defaultFormat.setSamples( 4 );
     QSurfaceFormat::setDefaultFormat( defaultFormat );
 
+    // 设置了SHADOWMAP_TRACE时从启动开始记录，退出时写入该文件
+    QString traceFile = QString::fromLocal8Bit( qgetenv( "SHADOWMAP_TRACE" ) );
+    if ( !traceFile.isEmpty( ) ) Tracer::instance( )->setEnabled( true );
+
     QQmlApplicationEngine engine;
     engine.load(QUrl(QStringLiteral("qrc:/main.qml")));
 
-    return app.exec( );
+    // 设置了SHADOWMAP_RECORD时记录这次运行，之后可以用benchmark --replay重放
+    QString recordFile = QString::fromLocal8Bit( qgetenv( "SHADOWMAP_RECORD" ) );
+    if ( !recordFile.isEmpty( ) && !engine.rootObjects( ).isEmpty( ) )
+    {
+        View* view = engine.rootObjects( ).first( )->findChild<View*>( );
+        if ( view != Q_NULLPTR ) view->startRecording( recordFile );
+    }
+
+    int result = app.exec( );
+    if ( !traceFile.isEmpty( ) ) Tracer::instance( )->save( traceFile );
+    return result;
 }
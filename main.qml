@@ -9,105 +9,49 @@ Window
     width: 320
     height: 480
 
-    TexturedCubeView
+    // 最近一次点击拾取到的实体，显示在帧统计下面
+    property string pickedName: ""
+
+    Scene
     {
-        objectName: "view"
+        id: view
         anchors.fill: parent
+    }
 
-        Cube
-        {
-            objectName: "biscuit cube"
-            source: "image/biscuit.jpg"
-            length: 2
-            translate: Qt.vector3d( -4, -3.9, 4 )
-        }
-
-        Cube
-        {
-            objectName: "wood cube"
-            source: "image/wood.jpg"
-            length: 2
-            translate: Qt.vector3d( 4, -3.9, 4 )
-        }
-
-        Cube
-        {
-            objectName: "spiral cube"
-            source: "image/spiral.jpg"
-            length: 2
-            translate: Qt.vector3d( 4, -3.9, -4 )
-        }
-
-        Cube
-        {
-            objectName: "shining cube"
-            source: "image/shining.jpg"
-            length: 2
-            translate: Qt.vector3d( -4, -3.9, -4 )
-        }
-
-        Cube
-        {
-            objectName: "BIG cube"
-            source: "image/color_line.jpg"
-            length: 3
-            translate: Qt.vector3d( 0, 0, 0 )
-        }
-
-        Plane
-        {
-            objectName: "plane"
-            source: "image/color_line.jpg"
-            length: 20
-            translate: Qt.vector3d( 0, -5, 0 )
-        }
-
-//        TexturedCube
-//        {
-//            objectName: "textureCube_1"
-//            source: "image/stone.jpg"
-//            length: 10
-//        }
-
-//        TexturedCube
-//        {
-//            objectName: "textureCube_2"
-//            source: "image/fruit.jpg"
-//            length: 3
-
-//            translate: Qt.vector3d( 0, 15, 0 )
-//        }
-
-        position: Qt.vector3d( 0, 4, -12 )
-        lookAt: Qt.vector3d( 0, 0, 0 )
-        up: Qt.vector3d( 0, 1, 0 )
-        fieldOfView: 90
-        aspectRatio: 0.6667
-        nearPlane: 1
-        farPlane: 100
-
-        // 按照Y轴对光源的位置进行旋转
-        property real theta: 0.0
-        lightPosition: Qt.vector3d( 5.0 * Math.sin( theta ),
-                                    9.0,
-                                    5.0 * Math.cos( theta ) )
-
-        NumberAnimation on theta
+    // 点击拾取实体
+    MouseArea
+    {
+        anchors.fill: parent
+        onClicked:
         {
-            from: 0
-            to: 2.0 * Math.PI
-            duration: 4000
-            loops: Animation.Infinite
+            var hit = view.pick( mouse.x, mouse.y );
+            pickedName = hit.entity ? hit.entity.objectName : "";
         }
+    }
 
-//        NumberAnimation on angle
-//        {
-//            from: 0
-//            to: 2 * Math.PI
-//            duration: 20000
-//            loops: Animation.Infinite
-//            running: true
-//        }
+    // 帧统计
+    Text
+    {
+        anchors.left: parent.left
+        anchors.top: parent.top
+        anchors.margins: 8
+        color: "black"
+        font.pixelSize: 12
+        text: "frame " + view.stats.frameTime.toFixed( 2 ) + " ms" +
+              " (p99 " + view.stats.frameTimeP99.toFixed( 2 ) + ")\n" +
+              "shadow " + view.stats.shadowTime.toFixed( 2 ) + " ms" +
+              ( view.stats.gpuTimingAvailable ?
+                    " / gpu " + view.stats.gpuShadowTime.toFixed( 2 ) : "" ) + "\n" +
+              "main " + view.stats.mainTime.toFixed( 2 ) + " ms" +
+              ( view.stats.gpuTimingAvailable ?
+                    " / gpu " + view.stats.gpuMainTime.toFixed( 2 ) : "" ) + "\n" +
+              ( view.stats.gpuTimingAvailable ?
+                    "gpu times of frame " + view.stats.gpuFrameIndex +
+                    " (frame " + view.stats.frameIndex + ")\n" : "" ) +
+              "draw calls " + view.stats.drawCalls +
+              ", triangles " + view.stats.triangles + "\n" +
+              "upload " + ( view.stats.uploadBytes / 1024 ).toFixed( 1 ) + " KB" +
+              ( pickedName !== "" ? "\npicked " + pickedName : "" )
     }
 
 //    Label
@@ -0,0 +1,48 @@
+# 渲染器本身的源文件，应用程序和benchmark共用
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/Cube.cpp \
+    $$PWD/Plane.cpp \
+    $$PWD/TexturedCube.cpp \
+    $$PWD/View.cpp \
+    $$PWD/BVH.cpp \
+    $$PWD/ViewAnimator.cpp \
+    $$PWD/JobSystem.cpp \
+    $$PWD/FrameStats.cpp \
+    $$PWD/Tracer.cpp \
+    $$PWD/FrameRecorder.cpp \
+    $$PWD/Geometry.cpp \
+    $$PWD/MeshBuffer.cpp \
+    $$PWD/Mesh.cpp \
+    $$PWD/Light.cpp \
+    $$PWD/ShadowCubeMap.cpp \
+    $$PWD/StaticBatcher.cpp \
+    $$PWD/OcclusionCuller.cpp \
+    $$PWD/GpuDrivenRenderer.cpp \
+    $$PWD/StreamBuffer.cpp
+
+HEADERS += \
+    $$PWD/Cube.h \
+    $$PWD/Plane.h \
+    $$PWD/TexturedCube.h \
+    $$PWD/View.h \
+    $$PWD/BVH.h \
+    $$PWD/ViewAnimator.h \
+    $$PWD/JobSystem.h \
+    $$PWD/FrameStats.h \
+    $$PWD/Tracer.h \
+    $$PWD/FrameRecorder.h \
+    $$PWD/Geometry.h \
+    $$PWD/MeshBuffer.h \
+    $$PWD/MeshFormat.h \
+    $$PWD/Mesh.h \
+    $$PWD/Light.h \
+    $$PWD/ShadowCubeMap.h \
+    $$PWD/StaticBatcher.h \
+    $$PWD/OcclusionCuller.h \
+    $$PWD/GpuDrivenRenderer.h \
+    $$PWD/StreamBuffer.h
+
+RESOURCES += $$PWD/shader.qrc
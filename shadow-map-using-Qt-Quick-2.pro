@@ -2,24 +2,17 @@ TEMPLATE = app
 
 QT += qml quick
 
-SOURCES += main.cpp \
-    Cube.cpp \
-    Plane.cpp \
-    TexturedCube.cpp \
-    View.cpp
+CONFIG += c++11
+
+SOURCES += main.cpp
+
+include(renderer.pri)
 
 RESOURCES += qml.qrc \
-    image.qrc \
-    shader.qrc
+    image.qrc
 
 # Additional import path used to resolve QML modules in Qt Creator's code model
 QML_IMPORT_PATH =
 
 # Default rules for deployment.
 include(deployment.pri)
-
-HEADERS += \
-    Cube.h \
-    Plane.h \
-    TexturedCube.h \
-    View.h
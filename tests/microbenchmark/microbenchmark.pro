@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = tst_microbenchmark
+
+QT += qml quick testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../benchmark
+
+SOURCES += tst_microbenchmark.cpp \
+    ../../benchmark/OffscreenRenderer.cpp \
+    ../../benchmark/SceneGenerator.cpp
+
+HEADERS += \
+    ../../benchmark/OffscreenRenderer.h \
+    ../../benchmark/SceneGenerator.h \
+    ../../benchmark/MicroBenchmark.h
+
+include(../../renderer.pri)
@@ -0,0 +1,186 @@
+#include <QtTest>
+#include <QGuiApplication>
+#include <QTemporaryDir>
+#include <QQuickItem>
+#include "OffscreenRenderer.h"
+#include "SceneGenerator.h"
+#include "MicroBenchmark.h"
+#include "Cube.h"
+
+// 与benchmark --micro相同的CPU热点，每个用例一个QBENCHMARK。
+// 需要OpenGL资源的用例运行在Mesa的空驱动上（见main），不需要GPU，也不计入绘制的开销
+class TestMicroBenchmark: public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase( void );
+    void cleanupTestCase( void );
+    void appendEntities_data( void );
+    void appendEntities( void );
+    void viewMatrix( void );
+    void projectionMatrix( void );
+    void sync( void );
+    void normalMatrix( void );
+    void resize( void );
+protected:
+    View* sceneView( void );
+
+    OffscreenRenderer*  m_renderer;
+    QTemporaryDir       m_textureDirectory;
+    View*               m_view;
+};
+
+#define SCENE_ENTITIES  10000
+#define SYNC_ROUNDS     20
+
+void TestMicroBenchmark::initTestCase( void )
+{
+    m_renderer = new OffscreenRenderer( QSize( 640, 480 ) );
+    if ( !m_renderer->initialize( ) )
+    {
+        delete m_renderer;
+        m_renderer = Q_NULLPTR;
+    }
+    m_view = Q_NULLPTR;
+}
+
+void TestMicroBenchmark::cleanupTestCase( void )
+{
+    delete m_renderer;
+}
+
+View* TestMicroBenchmark::sceneView( void )
+{
+    // 需要OpenGL资源的用例共用一个渲染过的场景
+    if ( m_view == Q_NULLPTR && m_renderer != Q_NULLPTR )
+    {
+        SceneOptions options;
+        options.cubes = SCENE_ENTITIES;
+        m_view = SceneGenerator::generate( m_renderer->rootItem( ), options,
+                                           m_textureDirectory.path( ) );
+        m_renderer->renderFrame( );
+        m_view->stats( )->setRecording( true );
+    }
+    return m_view;
+}
+
+void TestMicroBenchmark::appendEntities_data( void )
+{
+    QTest::addColumn<int>( "entities" );
+    QTest::newRow( "1000" ) << 1000;
+    QTest::newRow( "10000" ) << 10000;
+    QTest::newRow( "100000" ) << 100000;
+}
+
+void TestMicroBenchmark::appendEntities( void )
+{
+    // View::qobjectListAppend，不包括创建实体的时间。追加只能做一次，所以只测量一轮
+    QFETCH( int, entities );
+    View view;
+    QList<Cube*> cubes;
+    for ( int i = 0; i < entities; ++i ) cubes.append( new Cube );
+
+    QQmlListProperty<QObject> data = view.data( );
+    QBENCHMARK_ONCE
+    {
+        foreach ( Cube* cube, cubes ) data.append( &data, cube );
+    }
+    QCOMPARE( view.findChildren<Cube*>( ).size( ), entities );
+}
+
+void TestMicroBenchmark::viewMatrix( void )
+{
+    // 只有View::calculateViewMatrix中的矩阵计算，不包括信号和updateWindow
+    MatrixView view;
+    view.setPosition( QVector3D( 1.0f, 4.0f, -12.0f ) );
+    volatile float sink = 0.0f;
+    QBENCHMARK
+    {
+        sink = sink + view.cameraViewMatrix( )( 0, 0 );
+    }
+}
+
+void TestMicroBenchmark::projectionMatrix( void )
+{
+    MatrixView view;
+    volatile float sink = 0.0f;
+    QBENCHMARK
+    {
+        sink = sink + view.cameraProjectionMatrix( )( 0, 0 );
+    }
+}
+
+void TestMicroBenchmark::sync( void )
+{
+    // 所有实体的位置都发生变化时View::sync的耗时，取自View自己的统计，
+    // 不包括渲染的部分
+    View* view = sceneView( );
+    if ( view == Q_NULLPTR ) QSKIP( "no OpenGL context." );
+    QList<Cube*> cubes = view->findChildren<Cube*>( );
+
+    qint64 total = 0;
+    for ( int round = 0; round < SYNC_ROUNDS; ++round )
+    {
+        QVector3D offset( 0.0f, ( round & 1 ) ? 0.01f : -0.01f, 0.0f );
+        foreach ( Cube* cube, cubes )
+            cube->setTranslate( cube->translate( ) + offset );
+        m_renderer->renderFrame( );
+        view->stats( )->collect( );
+        total += view->stats( )->recorded( ).last( ).sync;
+    }
+    QTest::setBenchmarkResult( total / 1000000.0 / SYNC_ROUNDS,
+                               QTest::WalltimeMilliseconds );
+}
+
+void TestMicroBenchmark::normalMatrix( void )
+{
+    // CubeRenderer::prepare中每个实体的法线矩阵
+    View* view = sceneView( );
+    if ( view == Q_NULLPTR ) QSKIP( "no OpenGL context." );
+    QList<Cube*> cubes = view->findChildren<Cube*>( );
+    QBENCHMARK
+    {
+        foreach ( Cube* cube, cubes ) cube->prepare( );
+    }
+}
+
+void TestMicroBenchmark::resize( void )
+{
+    // 修改边长以后的Cube::sync，即根据单位边长的位置重写位置缓存。
+    // 修改属性必须在测量以外，所以自己计时
+    View* view = sceneView( );
+    if ( view == Q_NULLPTR ) QSKIP( "no OpenGL context." );
+    QList<Cube*> cubes = view->findChildren<Cube*>( );
+
+    qint64 total = 0;
+    for ( int round = 0; round < SYNC_ROUNDS; ++round )
+    {
+        foreach ( Cube* cube, cubes ) cube->setLength( ( round & 1 ) ? 2.5 : 2.0 );
+        m_renderer->makeCurrent( );
+        QElapsedTimer timer;
+        timer.start( );
+        foreach ( Cube* cube, cubes ) cube->sync( );
+        total += timer.nsecsElapsed( );
+    }
+    QTest::setBenchmarkResult( total / 1000000.0 / SYNC_ROUNDS,
+                               QTest::WalltimeMilliseconds );
+}
+
+// OpenGL使用offscreen平台上Mesa的空驱动（GALLIUM_NOOP）：调用照常经过Mesa的状态跟踪，
+// 但是不做任何绘制，相当于一个空的OpenGL实现。需要在创建QGuiApplication之前设置
+int main( int argc, char* argv[] )
+{
+    if ( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    if ( qEnvironmentVariableIsEmpty( "LIBGL_ALWAYS_SOFTWARE" ) )
+        qputenv( "LIBGL_ALWAYS_SOFTWARE", "1" );
+    if ( qEnvironmentVariableIsEmpty( "GALLIUM_NOOP" ) )
+        qputenv( "GALLIUM_NOOP", "1" );
+
+    QGuiApplication app( argc, argv );
+    View::registerTypes( "QtProblem" );
+    TestMicroBenchmark test;
+    return QTest::qExec( &test, argc, argv );
+}
+
+#include "tst_microbenchmark.moc"
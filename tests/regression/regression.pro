@@ -0,0 +1,27 @@
+TEMPLATE = app
+TARGET = tst_regression
+
+QT += qml quick testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+# 参考图片和基线与benchmark/regression.sh共用
+DEFINES += BENCHMARK_DIR=\\\"$$PWD/../../benchmark\\\"
+
+INCLUDEPATH += ../../benchmark
+
+SOURCES += tst_regression.cpp \
+    ../../benchmark/OffscreenRenderer.cpp \
+    ../../benchmark/SceneGenerator.cpp \
+    ../../benchmark/Regression.cpp
+
+HEADERS += \
+    ../../benchmark/OffscreenRenderer.h \
+    ../../benchmark/SceneGenerator.h \
+    ../../benchmark/Regression.h
+
+RESOURCES += ../../qml.qrc \
+    ../../image.qrc
+
+include(../../renderer.pri)
@@ -0,0 +1,170 @@
+#include <QtTest>
+#include <QGuiApplication>
+#include <QTemporaryDir>
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QQuickItem>
+#include "OffscreenRenderer.h"
+#include "SceneGenerator.h"
+#include "Regression.h"
+#include "ViewAnimator.h"
+#include "View.h"
+
+// 与benchmark/regression.sh相同的场景：离屏渲染以后与golden目录中的图片比较，
+// 再用baseline.json检查帧时间。参考数据与机器有关，
+// 用regression.sh --update-golden --update-baseline记录，还没有记录的场景跳过
+class TestRegression: public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase( void );
+    void render_data( void );
+    void render( void );
+protected:
+    View* createScene( OffscreenRenderer& renderer, const QString& qml,
+                       const SceneOptions& options, const QString& textureDirectory );
+
+    QQmlEngine*         m_engine;
+    QJsonObject         m_baseline;
+};
+
+Q_DECLARE_METATYPE( SceneOptions )
+
+void TestRegression::initTestCase( void )
+{
+    View::registerTypes( "QtProblem" );
+    m_engine = new QQmlEngine( this );
+    m_baseline = Regression::loadJson( BENCHMARK_DIR "/baseline.json" );
+}
+
+void TestRegression::render_data( void )
+{
+    QTest::addColumn<QString>( "qml" );
+    QTest::addColumn<SceneOptions>( "options" );
+    QTest::addColumn<QSize>( "size" );
+    QTest::addColumn<int>( "frames" );
+
+    SceneOptions grid;
+    grid.cubes = 400;
+    grid.textures = 8;
+    SceneOptions stress;
+    stress.cubes = 10000;
+    stress.textures = 16;
+    SceneOptions stressStatic = stress;
+    stressStatic.staticGeometry = true;
+    SceneOptions stressPrepass = stress;
+    stressPrepass.depthPrepass = true;
+    SceneOptions stressGpu = stress;
+    stressGpu.gpuCulling = true;
+    SceneOptions stressOcclusion = stress;
+    stressOcclusion.occlusionCulling = true;
+    SceneOptions stressNoShadow = stress;
+    stressNoShadow.shadowMode = View::NoShadow;
+
+    QTest::newRow( "main" ) << "qrc:/Scene.qml" << SceneOptions( ) << QSize( 320, 480 ) << 100;
+    QTest::newRow( "grid" ) << QString( ) << grid << QSize( 640, 480 ) << 100;
+    QTest::newRow( "stress" ) << QString( ) << stress << QSize( 1280, 720 ) << 50;
+    QTest::newRow( "stress-static" ) << QString( ) << stressStatic << QSize( 1280, 720 ) << 50;
+    QTest::newRow( "stress-prepass" ) << QString( ) << stressPrepass << QSize( 1280, 720 ) << 50;
+    QTest::newRow( "stress-gpu" ) << QString( ) << stressGpu << QSize( 1280, 720 ) << 50;
+    QTest::newRow( "stress-occlusion" ) << QString( ) << stressOcclusion << QSize( 1280, 720 ) << 50;
+    QTest::newRow( "stress-noshadow" ) << QString( ) << stressNoShadow << QSize( 1280, 720 ) << 50;
+}
+
+View* TestRegression::createScene( OffscreenRenderer& renderer, const QString& qml,
+                                   const SceneOptions& options,
+                                   const QString& textureDirectory )
+{
+    if ( qml.isEmpty( ) )
+        return SceneGenerator::generate( renderer.rootItem( ), options, textureDirectory );
+
+    QQmlComponent component( m_engine, QUrl( qml ) );
+    QObject* object = component.create( );
+    View* view = qobject_cast<View*>( object );
+    if ( view == Q_NULLPTR && object != Q_NULLPTR ) view = object->findChild<View*>( );
+    if ( view == Q_NULLPTR ) return Q_NULLPTR;
+    QQuickItem* item = qobject_cast<QQuickItem*>( object );
+    if ( item == Q_NULLPTR ) item = view;
+    item->setParent( renderer.rootItem( ) );
+    item->setParentItem( renderer.rootItem( ) );
+    item->setSize( QSizeF( renderer.window( )->size( ) ) );
+    return view;
+}
+
+void TestRegression::render( void )
+{
+    QFETCH( QString, qml );
+    QFETCH( SceneOptions, options );
+    QFETCH( QSize, size );
+    QFETCH( int, frames );
+    QString name = QTest::currentDataTag( );
+    QString goldenFile = QString( BENCHMARK_DIR "/golden/%1.png" ).arg( name );
+    if ( !QFile::exists( goldenFile ) )
+        QSKIP( qPrintable( goldenFile + " is not recorded, run regression.sh --update-golden" ) );
+
+    OffscreenRenderer renderer( size );
+    if ( options.gpuCulling ) renderer.requestVersion( 4, 3 );
+    if ( !renderer.initialize( ) )
+    {
+        if ( options.gpuCulling ) QSKIP( "no OpenGL 4.3 context." );
+        QFAIL( "failed to create an offscreen OpenGL context." );
+    }
+
+    QTemporaryDir textureDirectory;
+    View* view = createScene( renderer, qml, options, textureDirectory.path( ) );
+    QVERIFY2( view != Q_NULLPTR, "the scene does not contain a view." );
+    if ( options.depthPrepass ) view->setDepthPrepass( true );
+    if ( options.occlusionCulling ) view->setOcclusionCulling( true );
+    if ( options.gpuCulling ) view->setGpuCulling( true );
+    foreach ( ViewAnimator* animator, view->findChildren<ViewAnimator*>( ) )
+        animator->setRunning( false );
+
+    // 每一帧都标记场景变化，否则按需渲染会跳过绘制
+    const int warmup = 10;
+    QVector<qint64> frameTimes;
+    for ( int i = 0; i < warmup + frames; ++i )
+    {
+        view->updateWindow( );
+        OffscreenRenderer::FrameTiming timing = renderer.renderFrame( );
+        QCoreApplication::processEvents( );
+        if ( i >= warmup ) frameTimes.append( timing.total );
+    }
+
+    QImage image = renderer.grabImage( );
+    Regression::ImageDifference difference =
+            Regression::compareImages( image, QImage( goldenFile ), 8 );
+    QVERIFY2( difference.sizeMatches, "the frame and the reference differ in size." );
+    if ( difference.fraction > 0.002 )
+    {
+        QString prefix = goldenFile;
+        prefix.chop( 4 );
+        image.save( prefix + ".actual.png" );
+        difference.diff.save( prefix + ".diff.png" );
+        QFAIL( qPrintable( QString( "%1 pixels differ, see %2.diff.png" )
+                           .arg( difference.differentPixels ).arg( prefix ) ) );
+    }
+
+    if ( !m_baseline.contains( name ) )
+        QSKIP( qPrintable( "no frame-time budget for " + name +
+                           ", run regression.sh --update-baseline" ) );
+    QString message;
+    bool passed = Regression::checkBudget( m_baseline, name,
+                                           Regression::summarize( frameTimes ),
+                                           0.25, &message );
+    QVERIFY2( passed, qPrintable( message ) );
+}
+
+// 默认使用offscreen平台以及Mesa的llvmpipe，需要在创建QGuiApplication之前设置
+int main( int argc, char* argv[] )
+{
+    if ( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    if ( qEnvironmentVariableIsEmpty( "LIBGL_ALWAYS_SOFTWARE" ) )
+        qputenv( "LIBGL_ALWAYS_SOFTWARE", "1" );
+
+    QGuiApplication app( argc, argv );
+    TestRegression test;
+    return QTest::qExec( &test, argc, argv );
+}
+
+#include "tst_regression.moc"
@@ -0,0 +1,497 @@
+#include <math.h>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QTextStream>
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+#include "MeshFormat.h"
+
+using namespace MeshFormat;
+
+// OBJ面中的一个角，三个序号都从0开始，没有纹理坐标时为-1
+struct Corner
+{
+    int position, texCoord, normal;
+
+    bool operator ==( const Corner& other ) const
+    {
+        return position == other.position && texCoord == other.texCoord &&
+                normal == other.normal;
+    }
+};
+
+static uint qHash( const Corner& corner, uint seed = 0 )
+{
+    return ::qHash( corner.position, seed ) ^
+            ::qHash( corner.texCoord * 31 + corner.normal * 131071, seed );
+}
+
+struct Vertex
+{
+    QVector3D                   position;
+    QVector3D                   normal;
+    QVector2D                   texCoord;
+};
+
+// 一个细节层次的三角形列表，索引为32位
+struct Level
+{
+    QVector<Vertex>             vertices;
+    QVector<quint32>            indices;
+    float                       error;
+};
+
+// 一块最多MaxChunkVertices个顶点，数据已经是GPU的布局
+struct Chunk
+{
+    Chunk( void ): minimum( 1e30f, 1e30f, 1e30f ),
+        maximum( -1e30f, -1e30f, -1e30f ) { }
+
+    QVector<QVector3D>          positions;
+    QVector<PackedAttributes>   attributes;
+    QVector<quint16>            indices;
+    QVector3D                   minimum, maximum;
+    TexCoordTransform           texCoordTransform;
+};
+
+class MeshConverter
+{
+public:
+    bool loadObj( const QString& fileName );
+    // 生成最多levelCount层（包括原始网格），每一层的三角形至少比上一层少四分之一
+    void buildLevels( int levelCount );
+    bool save( const QString& fileName );
+
+    int levelCount( void ) { return m_levels.size( ); }
+    int triangleCount( int level ) { return m_levels[level].indices.size( ) / 3; }
+    int chunkCount( void );
+protected:
+    bool parseCorner( const QByteArray& token, Corner& corner );
+    static Level simplify( const Level& level, float cellSize );
+    static QList<Chunk> split( const Level& level );
+
+    QVector<QVector3D>          m_positions;
+    QVector<QVector3D>          m_normals;
+    QVector<QVector2D>          m_texCoords;
+    QList<Level>                m_levels;
+    QList<QList<Chunk> >        m_chunks;
+};
+
+static int resolveIndex( int index, int count )
+{
+    // OBJ的序号从1开始，负数表示相对于当前末尾
+    return index > 0 ? index - 1 : count + index;
+}
+
+bool MeshConverter::parseCorner( const QByteArray& token, Corner& corner )
+{
+    QList<QByteArray> parts = token.split( '/' );
+    bool ok = false;
+    corner.position = resolveIndex( parts[0].toInt( &ok ), m_positions.size( ) );
+    if ( !ok || corner.position < 0 || corner.position >= m_positions.size( ) )
+        return false;
+
+    corner.texCoord = -1;
+    if ( parts.size( ) > 1 && !parts[1].isEmpty( ) )
+    {
+        corner.texCoord = resolveIndex( parts[1].toInt( &ok ), m_texCoords.size( ) );
+        if ( !ok || corner.texCoord < 0 || corner.texCoord >= m_texCoords.size( ) )
+            return false;
+    }
+
+    corner.normal = -1;
+    if ( parts.size( ) > 2 && !parts[2].isEmpty( ) )
+    {
+        corner.normal = resolveIndex( parts[2].toInt( &ok ), m_normals.size( ) );
+        if ( !ok || corner.normal < 0 || corner.normal >= m_normals.size( ) )
+            return false;
+    }
+    return true;
+}
+
+bool MeshConverter::loadObj( const QString& fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+    {
+        qCritical( "cannot read %s.", qPrintable( fileName ) );
+        return false;
+    }
+
+    Level level;
+    level.error = 0.0f;
+    QHash<Corner, quint32> corners;
+    int lineNumber = 0;
+    while ( !file.atEnd( ) )
+    {
+        QByteArray line = file.readLine( ).simplified( );
+        ++lineNumber;
+        if ( line.isEmpty( ) || line.startsWith( '#' ) ) continue;
+
+        QList<QByteArray> tokens = line.split( ' ' );
+        const QByteArray& keyword = tokens[0];
+        if ( keyword == "v" && tokens.size( ) >= 4 )
+        {
+            m_positions.append( QVector3D( tokens[1].toFloat( ),
+                                           tokens[2].toFloat( ),
+                                           tokens[3].toFloat( ) ) );
+        }
+        else if ( keyword == "vn" && tokens.size( ) >= 4 )
+        {
+            m_normals.append( QVector3D( tokens[1].toFloat( ),
+                                         tokens[2].toFloat( ),
+                                         tokens[3].toFloat( ) ).normalized( ) );
+        }
+        else if ( keyword == "vt" && tokens.size( ) >= 3 )
+        {
+            m_texCoords.append( QVector2D( tokens[1].toFloat( ),
+                                           tokens[2].toFloat( ) ) );
+        }
+        else if ( keyword == "f" && tokens.size( ) >= 4 )
+        {
+            QVector<Corner> polygon( tokens.size( ) - 1 );
+            for ( int i = 0; i < polygon.size( ); ++i )
+            {
+                if ( !parseCorner( tokens[i + 1], polygon[i] ) )
+                {
+                    qCritical( "%s:%d: invalid face.", qPrintable( fileName ), lineNumber );
+                    return false;
+                }
+            }
+
+            // 没有法线时使用面法线，每个面单独一个
+            if ( polygon[0].normal < 0 )
+            {
+                QVector3D normal = QVector3D::normal( m_positions[polygon[0].position],
+                                                      m_positions[polygon[1].position],
+                                                      m_positions[polygon[2].position] );
+                m_normals.append( normal );
+                for ( int i = 0; i < polygon.size( ); ++i )
+                    polygon[i].normal = m_normals.size( ) - 1;
+            }
+
+            // 合并相同的角，多边形按扇形拆成三角形
+            QVector<quint32> indices( polygon.size( ) );
+            for ( int i = 0; i < polygon.size( ); ++i )
+            {
+                QHash<Corner, quint32>::const_iterator it = corners.constFind( polygon[i] );
+                if ( it == corners.constEnd( ) )
+                {
+                    Vertex vertex;
+                    vertex.position = m_positions[polygon[i].position];
+                    vertex.normal = m_normals[polygon[i].normal];
+                    if ( polygon[i].texCoord >= 0 )
+                        vertex.texCoord = m_texCoords[polygon[i].texCoord];
+                    it = corners.insert( polygon[i], level.vertices.size( ) );
+                    level.vertices.append( vertex );
+                }
+                indices[i] = it.value( );
+            }
+            for ( int i = 1; i + 1 < indices.size( ); ++i )
+                level.indices << indices[0] << indices[i] << indices[i + 1];
+        }
+        // 其他的关键字（材质、分组等）忽略
+    }
+
+    m_levels.clear( );
+    m_levels.append( level );
+    return true;
+}
+
+Level MeshConverter::simplify( const Level& level, float cellSize )
+{
+    // 顶点聚类：落在同一个格子里的顶点合并成一个，退化的三角形被去掉
+    Level result;
+    result.error = 0.0f;
+
+    QVector<quint32> remap( level.vertices.size( ) );
+    QHash<quint64, quint32> cells;
+    QVector<int> members;
+    for ( int i = 0; i < level.vertices.size( ); ++i )
+    {
+        const Vertex& vertex = level.vertices[i];
+        quint64 x = quint64( qint64( floorf( vertex.position.x( ) / cellSize ) ) & 0x1FFFFF );
+        quint64 y = quint64( qint64( floorf( vertex.position.y( ) / cellSize ) ) & 0x1FFFFF );
+        quint64 z = quint64( qint64( floorf( vertex.position.z( ) / cellSize ) ) & 0x1FFFFF );
+        quint64 key = ( x << 42 ) | ( y << 21 ) | z;
+
+        QHash<quint64, quint32>::const_iterator it = cells.constFind( key );
+        if ( it == cells.constEnd( ) )
+        {
+            it = cells.insert( key, result.vertices.size( ) );
+            Vertex cluster = vertex;
+            cluster.position = QVector3D( );
+            cluster.normal = QVector3D( );
+            result.vertices.append( cluster );
+            members.append( 0 );
+        }
+        Vertex& cluster = result.vertices[it.value( )];
+        cluster.position += vertex.position;
+        cluster.normal += vertex.normal;
+        ++members[it.value( )];
+        remap[i] = it.value( );
+    }
+
+    // 纹理坐标沿用第一个顶点的
+    for ( int i = 0; i < result.vertices.size( ); ++i )
+    {
+        Vertex& cluster = result.vertices[i];
+        cluster.position /= float( members[i] );
+        if ( cluster.normal.lengthSquared( ) > 0.0f ) cluster.normal.normalize( );
+        else cluster.normal = QVector3D( 0.0f, 1.0f, 0.0f );
+    }
+
+    // 误差是原始顶点到合并后位置的最大距离，不超过格子的对角线长度
+    for ( int i = 0; i < level.vertices.size( ); ++i )
+    {
+        float distance = ( level.vertices[i].position -
+                           result.vertices[remap[i]].position ).length( );
+        result.error = qMax( result.error, distance );
+    }
+
+    for ( int i = 0; i + 2 < level.indices.size( ); i += 3 )
+    {
+        quint32 a = remap[level.indices[i]];
+        quint32 b = remap[level.indices[i + 1]];
+        quint32 c = remap[level.indices[i + 2]];
+        if ( a == b || b == c || a == c ) continue;
+        result.indices << a << b << c;
+    }
+    return result;
+}
+
+void MeshConverter::buildLevels( int levelCount )
+{
+    if ( m_levels.isEmpty( ) ) return;
+    while ( m_levels.size( ) > 1 ) m_levels.removeLast( );
+
+    QVector3D minimum( 1e30f, 1e30f, 1e30f ), maximum( -1e30f, -1e30f, -1e30f );
+    foreach ( const Vertex& vertex, m_levels[0].vertices )
+    {
+        for ( int i = 0; i < 3; ++i )
+        {
+            minimum[i] = qMin( minimum[i], vertex.position[i] );
+            maximum[i] = qMax( maximum[i], vertex.position[i] );
+        }
+    }
+    QVector3D extent = maximum - minimum;
+    float size = qMax( extent.x( ), qMax( extent.y( ), extent.z( ) ) );
+    if ( size <= 0.0f ) return;
+
+    // 从细的网格开始，每次格子的边长加倍
+    for ( int resolution = 256;
+          resolution >= 2 && m_levels.size( ) < levelCount; resolution /= 2 )
+    {
+        Level level = simplify( m_levels[0], size / resolution );
+        if ( level.indices.size( ) > m_levels.last( ).indices.size( ) * 3 / 4 ) continue;
+        if ( level.indices.isEmpty( ) ) break;
+        m_levels.append( level );
+    }
+}
+
+QList<Chunk> MeshConverter::split( const Level& level )
+{
+    // 当前块放不下三个新顶点时开始新的一块，块之间不共享顶点。
+    // 纹理坐标的变换取决于整块的范围，所以先记下每一块的原始顶点，最后再压缩
+    QList<Chunk> chunks;
+    QList<QVector<quint32> > sources;
+    QHash<quint32, quint16> local;
+    for ( int i = 0; i + 2 < level.indices.size( ); i += 3 )
+    {
+        if ( chunks.isEmpty( ) ||
+             chunks.last( ).positions.size( ) + 3 > MaxChunkVertices )
+        {
+            chunks.append( Chunk( ) );
+            sources.append( QVector<quint32>( ) );
+            local.clear( );
+        }
+
+        Chunk& chunk = chunks.last( );
+        for ( int j = 0; j < 3; ++j )
+        {
+            quint32 index = level.indices[i + j];
+            QHash<quint32, quint16>::const_iterator it = local.constFind( index );
+            if ( it == local.constEnd( ) )
+            {
+                const Vertex& vertex = level.vertices[index];
+                const QVector3D& position = vertex.position;
+                it = local.insert( index, quint16( chunk.positions.size( ) ) );
+                chunk.positions.append( position );
+                sources.last( ).append( index );
+                for ( int k = 0; k < 3; ++k )
+                {
+                    chunk.minimum[k] = qMin( chunk.minimum[k], position[k] );
+                    chunk.maximum[k] = qMax( chunk.maximum[k], position[k] );
+                }
+            }
+            chunk.indices.append( it.value( ) );
+        }
+    }
+
+    for ( int i = 0; i < chunks.size( ); ++i )
+    {
+        Chunk& chunk = chunks[i];
+        float minimum[2] = { 0.0f, 0.0f }, maximum[2] = { 1.0f, 1.0f };
+        foreach ( quint32 index, sources[i] )
+        {
+            const QVector2D& texCoord = level.vertices[index].texCoord;
+            minimum[0] = qMin( minimum[0], texCoord.x( ) );
+            minimum[1] = qMin( minimum[1], texCoord.y( ) );
+            maximum[0] = qMax( maximum[0], texCoord.x( ) );
+            maximum[1] = qMax( maximum[1], texCoord.y( ) );
+        }
+        chunk.texCoordTransform = texCoordTransform( minimum, maximum );
+        foreach ( quint32 index, sources[i] )
+        {
+            const Vertex& vertex = level.vertices[index];
+            chunk.attributes.append( packAttributes(
+                                         vertex.normal.x( ), vertex.normal.y( ),
+                                         vertex.normal.z( ), vertex.texCoord.x( ),
+                                         vertex.texCoord.y( ), chunk.texCoordTransform ) );
+        }
+    }
+    return chunks;
+}
+
+int MeshConverter::chunkCount( void )
+{
+    int count = 0;
+    foreach ( const QList<Chunk>& chunks, m_chunks ) count += chunks.size( );
+    return count;
+}
+
+bool MeshConverter::save( const QString& fileName )
+{
+    m_chunks.clear( );
+    foreach ( const Level& level, m_levels ) m_chunks.append( split( level ) );
+    QList<Chunk> chunks;
+    foreach ( const QList<Chunk>& levelChunks, m_chunks ) chunks += levelChunks;
+
+    FileHeader header;
+    header.magic = Magic;
+    header.version = Version;
+    header.chunkCount = chunks.size( );
+    header.lodCount = m_levels.size( );
+    for ( int i = 0; i < 3; ++i )
+    {
+        header.minimum[i] = chunks.isEmpty( ) ? 0.0f : 1e30f;
+        header.maximum[i] = chunks.isEmpty( ) ? 0.0f : -1e30f;
+    }
+
+    QVector<LodHeader> lodHeaders( m_levels.size( ) );
+    quint32 firstChunk = 0;
+    for ( int i = 0; i < m_levels.size( ); ++i )
+    {
+        lodHeaders[i].firstChunk = firstChunk;
+        lodHeaders[i].chunkCount = m_chunks[i].size( );
+        lodHeaders[i].error = m_levels[i].error;
+        lodHeaders[i].reserved = 0;
+        firstChunk += m_chunks[i].size( );
+    }
+
+    // 先排好各段的偏移，再依次写入
+    QVector<ChunkHeader> chunkHeaders( chunks.size( ) );
+    quint32 offset = sizeof( FileHeader ) + lodHeaders.size( ) * sizeof( LodHeader ) +
+            chunks.size( ) * sizeof( ChunkHeader );
+    for ( int i = 0; i < chunks.size( ); ++i )
+    {
+        const Chunk& chunk = chunks[i];
+        ChunkHeader& chunkHeader = chunkHeaders[i];
+        chunkHeader.vertexCount = chunk.positions.size( );
+        chunkHeader.indexCount = chunk.indices.size( );
+        chunkHeader.reserved = 0;
+        chunkHeader.texCoordTransform = chunk.texCoordTransform;
+
+        offset = align( offset );
+        chunkHeader.positionOffset = offset;
+        offset += chunk.positions.size( ) * 3 * sizeof( float );
+        offset = align( offset );
+        chunkHeader.attributeOffset = offset;
+        offset += chunk.attributes.size( ) * sizeof( PackedAttributes );
+        offset = align( offset );
+        chunkHeader.indexOffset = offset;
+        offset += chunk.indices.size( ) * sizeof( quint16 );
+
+        for ( int j = 0; j < 3; ++j )
+        {
+            chunkHeader.minimum[j] = chunk.minimum[j];
+            chunkHeader.maximum[j] = chunk.maximum[j];
+            header.minimum[j] = qMin( header.minimum[j], chunk.minimum[j] );
+            header.maximum[j] = qMax( header.maximum[j], chunk.maximum[j] );
+        }
+    }
+
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+    {
+        qCritical( "cannot write %s.", qPrintable( fileName ) );
+        return false;
+    }
+
+    // 与加载端相同的字节序，网格文件不跨平台
+    file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+    file.write( reinterpret_cast<const char*>( lodHeaders.constData( ) ),
+                lodHeaders.size( ) * sizeof( LodHeader ) );
+    file.write( reinterpret_cast<const char*>( chunkHeaders.constData( ) ),
+                chunkHeaders.size( ) * sizeof( ChunkHeader ) );
+    for ( int i = 0; i < chunks.size( ); ++i )
+    {
+        const Chunk& chunk = chunks[i];
+        const ChunkHeader& chunkHeader = chunkHeaders[i];
+        const char padding[Alignment] = { 0 };
+
+        file.write( padding, chunkHeader.positionOffset - file.pos( ) );
+        file.write( reinterpret_cast<const char*>( chunk.positions.constData( ) ),
+                    chunk.positions.size( ) * 3 * sizeof( float ) );
+        file.write( padding, chunkHeader.attributeOffset - file.pos( ) );
+        file.write( reinterpret_cast<const char*>( chunk.attributes.constData( ) ),
+                    chunk.attributes.size( ) * sizeof( PackedAttributes ) );
+        file.write( padding, chunkHeader.indexOffset - file.pos( ) );
+        file.write( reinterpret_cast<const char*>( chunk.indices.constData( ) ),
+                    chunk.indices.size( ) * sizeof( quint16 ) );
+    }
+    return true;
+}
+
+int main( int argc, char* argv[] )
+{
+    QCoreApplication app( argc, argv );
+    app.setApplicationName( "meshconv" );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Converts a Wavefront OBJ file into the "
+                                      "binary mesh format loaded by Mesh." );
+    parser.addHelpOption( );
+    parser.addPositionalArgument( "input", "OBJ file to convert." );
+    parser.addPositionalArgument( "output", "Mesh file to write." );
+    QCommandLineOption lodsOption( "lods", "Maximum number of detail levels, "
+                                   "including the original mesh.", "n", "4" );
+    parser.addOption( lodsOption );
+    parser.process( app );
+
+    QStringList arguments = parser.positionalArguments( );
+    if ( arguments.size( ) != 2 ) parser.showHelp( 1 );
+
+    QElapsedTimer timer;
+    timer.start( );
+    MeshConverter converter;
+    if ( !converter.loadObj( arguments[0] ) ) return 1;
+    converter.buildLevels( qMax( 1, parser.value( lodsOption ).toInt( ) ) );
+    if ( !converter.save( arguments[1] ) ) return 1;
+
+    QStringList triangles;
+    for ( int i = 0; i < converter.levelCount( ); ++i )
+        triangles.append( QString::number( converter.triangleCount( i ) ) );
+    QTextStream( stdout ) << QString( "%1: %2 levels (%3 triangles), %4 chunks in %5 ms" )
+                             .arg( arguments[1] )
+                             .arg( converter.levelCount( ) )
+                             .arg( triangles.join( "/" ) )
+                             .arg( converter.chunkCount( ) )
+                             .arg( timer.elapsed( ) ) << "\n";
+    return 0;
+}
@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = meshconv
+
+QT = core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+
+HEADERS += ../../MeshFormat.h